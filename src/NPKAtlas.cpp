@@ -0,0 +1,342 @@
+//
+// Created by liu86 on 24-8-12.
+//
+
+#include "NPKAtlas.h"
+#include <algorithm>
+#include <cstring>
+#include "logger.h"
+#include "NPKHandler.h"
+#include "NPKMatrix.h"
+
+namespace neapu {
+namespace {
+constexpr uint32_t MAX_ENTRY_SIZE = 0xFFFF;
+
+bool intersects(const NPKAtlasRect& a, const NPKAtlasRect& b)
+{
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+bool contains(const NPKAtlasRect& outer, const NPKAtlasRect& inner)
+{
+    return inner.x >= outer.x && inner.y >= outer.y && inner.x + inner.width <= outer.x + outer.width &&
+           inner.y + inner.height <= outer.y + outer.height;
+}
+
+bool transparentRow(const NPKColor* row, const uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        if (row[i].a != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+NPKMaxRectsPacker::NPKMaxRectsPacker(const uint32_t width, const uint32_t height)
+    : m_width(width), m_height(height)
+{
+    m_freeRects.push_back(NPKAtlasRect{0, 0, width, height});
+}
+
+bool NPKMaxRectsPacker::insert(const uint32_t width, const uint32_t height, NPKAtlasRect& result)
+{
+    if (width == 0 || height == 0) {
+        return false;
+    }
+
+    // 最短边剩余最小的空闲矩形，相同时比较最长边
+    uint32_t bestShort = UINT32_MAX;
+    uint32_t bestLong = UINT32_MAX;
+    const NPKAtlasRect* best = nullptr;
+    for (const auto& rect : m_freeRects) {
+        if (rect.width < width || rect.height < height) {
+            continue;
+        }
+        const uint32_t leftoverX = rect.width - width;
+        const uint32_t leftoverY = rect.height - height;
+        const uint32_t shortSide = leftoverX < leftoverY ? leftoverX : leftoverY;
+        const uint32_t longSide = leftoverX < leftoverY ? leftoverY : leftoverX;
+        if (shortSide < bestShort || (shortSide == bestShort && longSide < bestLong)) {
+            bestShort = shortSide;
+            bestLong = longSide;
+            best = &rect;
+        }
+    }
+    if (!best) {
+        return false;
+    }
+
+    result = NPKAtlasRect{best->x, best->y, width, height};
+    splitFreeRects(result);
+    m_usedArea += static_cast<uint64_t>(width) * height;
+    return true;
+}
+
+double NPKMaxRectsPacker::occupancy() const
+{
+    const uint64_t area = static_cast<uint64_t>(m_width) * m_height;
+    return area ? static_cast<double>(m_usedArea) / area : 0.0;
+}
+
+void NPKMaxRectsPacker::splitFreeRects(const NPKAtlasRect& used)
+{
+    // 与已用区域相交的空闲矩形拆成最多4个不含已用区域的极大矩形
+    std::vector<NPKAtlasRect> added;
+    for (size_t i = 0; i < m_freeRects.size();) {
+        const NPKAtlasRect rect = m_freeRects[i];
+        if (!intersects(rect, used)) {
+            ++i;
+            continue;
+        }
+        if (used.x > rect.x) {
+            added.push_back(NPKAtlasRect{rect.x, rect.y, used.x - rect.x, rect.height});
+        }
+        if (used.x + used.width < rect.x + rect.width) {
+            added.push_back(NPKAtlasRect{used.x + used.width, rect.y, rect.x + rect.width - used.x - used.width, rect.height});
+        }
+        if (used.y > rect.y) {
+            added.push_back(NPKAtlasRect{rect.x, rect.y, rect.width, used.y - rect.y});
+        }
+        if (used.y + used.height < rect.y + rect.height) {
+            added.push_back(NPKAtlasRect{rect.x, used.y + used.height, rect.width, rect.y + rect.height - used.y - used.height});
+        }
+        m_freeRects[i] = m_freeRects.back();
+        m_freeRects.pop_back();
+    }
+
+    // 去掉被其他空闲矩形包含的新矩形。新矩形都在原来的空闲矩形内，
+    // 而原来的空闲矩形之间互不包含，所以不会包含未拆分的空闲矩形
+    const size_t kept = m_freeRects.size();
+    for (size_t i = 0; i < added.size(); ++i) {
+        bool redundant = false;
+        for (size_t j = 0; j < added.size() && !redundant; ++j) {
+            if (i != j && contains(added[j], added[i])) {
+                // 完全相同的矩形只保留第一个
+                const bool same = contains(added[i], added[j]);
+                redundant = !same || j < i;
+            }
+        }
+        for (size_t j = 0; j < kept && !redundant; ++j) {
+            redundant = contains(m_freeRects[j], added[i]);
+        }
+        if (!redundant) {
+            m_freeRects.push_back(added[i]);
+        }
+    }
+}
+
+NPKAtlasBuilder::NPKAtlasBuilder(const NPKAtlasOptions& options)
+    : m_options(options)
+{
+    m_options.pageWidth = m_options.pageWidth < MAX_ENTRY_SIZE ? m_options.pageWidth : MAX_ENTRY_SIZE;
+    m_options.pageHeight = m_options.pageHeight < MAX_ENTRY_SIZE ? m_options.pageHeight : MAX_ENTRY_SIZE;
+}
+
+bool NPKAtlasBuilder::addFrame(const NPKFrameKey& key, const NPKMatrix& matrix)
+{
+    if (m_entries.count(key)) {
+        return true;
+    }
+    NPKAtlasRect content;
+    if (!contentRect(matrix, content)) {
+        return false;
+    }
+    return place(key, matrix, content);
+}
+
+uint32_t NPKAtlasBuilder::addFrames(const NPKHandler& npk, const std::vector<NPKFrameKey>& keys, std::shared_ptr<NPKThreadPool> pool)
+{
+    std::vector<NPKFrameKey> pending;
+    std::unordered_map<NPKFrameKey, uint32_t, NPKFrameKeyHash> requested;
+    for (const auto& key : keys) {
+        if (!m_entries.count(key) && requested.emplace(key, static_cast<uint32_t>(pending.size())).second) {
+            pending.push_back(key);
+        }
+    }
+
+    typedef struct Item {
+        uint32_t index;
+        std::shared_ptr<NPKMatrix> matrix;
+        NPKAtlasRect content;
+    } Item;
+    std::vector<Item> items;
+    items.reserve(pending.size());
+    // 回调是串行的，可以直接写入
+    npk.decodeFrames(pending, [&](const NPKFrameKey& key, const std::shared_ptr<NPKMatrix>& matrix) {
+        NPKAtlasRect content;
+        if (matrix && contentRect(*matrix, content)) {
+            items.push_back(Item{requested[key], matrix, content});
+        }
+    }, std::move(pool));
+
+    // 先放大的，完成顺序不固定，最后按请求顺序保证结果稳定
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+        const uint32_t sideA = a.content.width > a.content.height ? a.content.width : a.content.height;
+        const uint32_t sideB = b.content.width > b.content.height ? b.content.width : b.content.height;
+        if (sideA != sideB) {
+            return sideA > sideB;
+        }
+        if (a.content.height != b.content.height) {
+            return a.content.height > b.content.height;
+        }
+        return a.index < b.index;
+    });
+    for (const auto& item : items) {
+        place(pending[item.index], *item.matrix, item.content);
+    }
+
+    uint32_t count = 0;
+    for (const auto& key : keys) {
+        count += m_entries.count(key) ? 1 : 0;
+    }
+    return count;
+}
+
+const NPKAtlasEntry* NPKAtlasBuilder::find(const NPKFrameKey& key) const
+{
+    const auto it = m_entries.find(key);
+    return it == m_entries.end() ? nullptr : &it->second;
+}
+
+NPKAtlasUV NPKAtlasBuilder::uv(const NPKAtlasEntry& entry) const
+{
+    const float width = static_cast<float>(m_options.pageWidth);
+    const float height = static_cast<float>(m_options.pageHeight);
+    return NPKAtlasUV{entry.x / width, entry.y / height, (entry.x + entry.width) / width, (entry.y + entry.height) / height};
+}
+
+std::shared_ptr<NPKMatrix> NPKAtlasBuilder::page(const uint32_t index) const
+{
+    return index < m_pages.size() ? m_pages[index] : nullptr;
+}
+
+std::vector<uint32_t> NPKAtlasBuilder::takeDirtyPages()
+{
+    std::vector<uint32_t> pages;
+    for (uint32_t i = 0; i < m_dirty.size(); ++i) {
+        if (m_dirty[i]) {
+            pages.push_back(i);
+            m_dirty[i] = false;
+        }
+    }
+    return pages;
+}
+
+void NPKAtlasBuilder::clear()
+{
+    m_pages.clear();
+    m_packers.clear();
+    m_dirty.clear();
+    m_entries.clear();
+}
+
+bool NPKAtlasBuilder::contentRect(const NPKMatrix& matrix, NPKAtlasRect& rect) const
+{
+    if (matrix.canvasWidth() > MAX_ENTRY_SIZE || matrix.canvasHeight() > MAX_ENTRY_SIZE) {
+        LOG_WARNING << "Frame canvas is too large for atlas.";
+        return false;
+    }
+
+    // 图像超出画布的部分不显示
+    rect = NPKAtlasRect{};
+    if (matrix.isEmpty() || matrix.offsetX() >= matrix.canvasWidth() || matrix.offsetY() >= matrix.canvasHeight()) {
+        return true;
+    }
+    uint32_t left = matrix.offsetX();
+    uint32_t top = matrix.offsetY();
+    uint32_t right = left + std::min(matrix.width(), matrix.canvasWidth() - left);
+    uint32_t bottom = top + std::min(matrix.height(), matrix.canvasHeight() - top);
+
+    if (m_options.trim) {
+        const NPKColor* data = matrix.data();
+        const uint32_t stride = matrix.canvasWidth();
+        while (top < bottom && transparentRow(data + top * stride + left, right - left)) {
+            top++;
+        }
+        while (bottom > top && transparentRow(data + (bottom - 1) * stride + left, right - left)) {
+            bottom--;
+        }
+        if (top == bottom) {
+            return true;
+        }
+        // 逐行收缩左右边界，每行只检查当前边界之外的部分
+        uint32_t minX = right;
+        uint32_t maxX = left;
+        for (uint32_t y = top; y < bottom; ++y) {
+            const NPKColor* row = data + y * stride;
+            for (uint32_t x = left; x < minX; ++x) {
+                if (row[x].a != 0) {
+                    minX = x;
+                    break;
+                }
+            }
+            for (uint32_t x = right; x > maxX && x > minX; --x) {
+                if (row[x - 1].a != 0) {
+                    maxX = x;
+                    break;
+                }
+            }
+        }
+        left = minX;
+        right = maxX;
+    }
+    rect = NPKAtlasRect{left, top, right - left, bottom - top};
+    return true;
+}
+
+bool NPKAtlasBuilder::place(const NPKFrameKey& key, const NPKMatrix& matrix, const NPKAtlasRect& content)
+{
+    NPKAtlasEntry entry{};
+    entry.offsetX = static_cast<uint16_t>(content.x);
+    entry.offsetY = static_cast<uint16_t>(content.y);
+    entry.width = static_cast<uint16_t>(content.width);
+    entry.height = static_cast<uint16_t>(content.height);
+    entry.canvasWidth = static_cast<uint16_t>(matrix.canvasWidth());
+    entry.canvasHeight = static_cast<uint16_t>(matrix.canvasHeight());
+    if (content.width == 0 || content.height == 0) {
+        m_entries[key] = entry;
+        return true;
+    }
+    if (content.width > m_options.pageWidth || content.height > m_options.pageHeight) {
+        LOG_WARNING << "Frame is larger than atlas page.";
+        return false;
+    }
+
+    // 装箱区域比页面多出一个间隔，使帧可以贴着页面的右边和下边
+    const uint32_t packWidth = content.width + m_options.padding;
+    const uint32_t packHeight = content.height + m_options.padding;
+    NPKAtlasRect rect;
+    uint32_t pageIndex = 0;
+    for (; pageIndex < m_packers.size(); ++pageIndex) {
+        if (m_packers[pageIndex].insert(packWidth, packHeight, rect)) {
+            break;
+        }
+    }
+    if (pageIndex == m_packers.size()) {
+        if ((m_options.maxPages != 0 && m_pages.size() >= m_options.maxPages) || m_pages.size() > MAX_ENTRY_SIZE) {
+            LOG_WARNING << "Atlas page limit reached.";
+            return false;
+        }
+        m_packers.emplace_back(m_options.pageWidth + m_options.padding, m_options.pageHeight + m_options.padding);
+        m_pages.push_back(NPKMatrix::createMatrix(m_options.pageWidth, m_options.pageHeight));
+        m_dirty.push_back(false);
+        m_packers.back().insert(packWidth, packHeight, rect);
+    }
+
+    const auto& page = m_pages[pageIndex];
+    for (uint32_t y = 0; y < content.height; ++y) {
+        memcpy(page->data() + (rect.y + y) * m_options.pageWidth + rect.x,
+               matrix.data() + (content.y + y) * matrix.canvasWidth() + content.x, content.width * sizeof(NPKColor));
+    }
+    m_dirty[pageIndex] = true;
+
+    entry.page = static_cast<uint16_t>(pageIndex);
+    entry.x = static_cast<uint16_t>(rect.x);
+    entry.y = static_cast<uint16_t>(rect.y);
+    m_entries[key] = entry;
+    return true;
+}
+} // neapu
@@ -0,0 +1,157 @@
+//
+// Created by liu86 on 24-8-12.
+//
+
+#ifndef NPKATLAS_H
+#define NPKATLAS_H
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "NPKFrameCache.h"
+#include "NPKThreadPool.h"
+
+namespace neapu {
+class NPKHandler;
+class NPKMatrix;
+
+typedef struct NPKAtlasRect {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+} NPKAtlasRect;
+
+/**
+ * @brief MaxRects矩形装箱，记录所有极大空闲矩形，按最短边最贴合(BSSF)选择位置，不旋转
+ *
+ * 可以随时继续插入，已放置的矩形不会移动。
+ */
+class NPKMaxRectsPacker {
+public:
+    NPKMaxRectsPacker(uint32_t width, uint32_t height);
+
+    /**
+     * @brief 放置一个矩形
+     * @param width 宽
+     * @param height 高
+     * @param result 成功时输出放置的位置
+     * @return 放不下返回false
+     */
+    bool insert(uint32_t width, uint32_t height, NPKAtlasRect& result);
+    /**
+     * @brief 已使用面积占比
+     */
+    double occupancy() const;
+
+private:
+    void splitFreeRects(const NPKAtlasRect& used);
+
+private:
+    uint32_t m_width{0};
+    uint32_t m_height{0};
+    uint64_t m_usedArea{0};
+    std::vector<NPKAtlasRect> m_freeRects;
+};
+
+typedef struct NPKAtlasOptions {
+    // 页面大小，不超过65535
+    uint32_t pageWidth = 2048;
+    uint32_t pageHeight = 2048;
+    // 帧之间留出的透明像素，避免纹理过滤时采样到相邻的帧
+    uint32_t padding = 1;
+    // 裁掉帧四周完全透明的部分
+    bool trim = true;
+    // 页面数量上限，为0时不限制
+    uint32_t maxPages = 0;
+} NPKAtlasOptions;
+
+/**
+ * @brief 帧在图集中的位置，画布坐标系下帧的内容位于(offsetX, offsetY, width, height)
+ */
+typedef struct NPKAtlasEntry {
+    uint16_t page;
+    uint16_t x; // 在页面中的位置
+    uint16_t y;
+    uint16_t width; // 完全透明的帧为0，不占用页面
+    uint16_t height;
+    uint16_t offsetX; // 裁剪后的内容在帧画布中的位置
+    uint16_t offsetY;
+    uint16_t canvasWidth;
+    uint16_t canvasHeight;
+} NPKAtlasEntry;
+
+typedef struct NPKAtlasUV {
+    float u0;
+    float v0;
+    float u1;
+    float v1;
+} NPKAtlasUV;
+
+/**
+ * @brief 把多个帧打包到固定大小的页面中
+ *
+ * 帧可以分多次加入，已加入的帧位置不变，新帧先尝试放入已有页面，放不下时新建页面。
+ * 不是线程安全的。
+ */
+class NPKAtlasBuilder {
+public:
+    explicit NPKAtlasBuilder(const NPKAtlasOptions& options = {});
+    virtual ~NPKAtlasBuilder() = default;
+
+    /**
+     * @brief 加入一帧，已在图集中时直接返回true
+     * @param key 帧的键
+     * @param matrix 帧画面
+     * @return 帧超出页面大小或页面数量达到上限时返回false
+     */
+    bool addFrame(const NPKFrameKey& key, const NPKMatrix& matrix);
+    /**
+     * @brief 在线程池中批量解码后加入，按尺寸从大到小放置，比逐帧加入更紧凑
+     * @param npk 帧所在的NPK
+     * @param keys 要加入的帧，已在图集中的会跳过
+     * @param pool 解码用的线程池，为空时使用NPKThreadPool::global()
+     * @return keys中已在图集中的数量
+     */
+    uint32_t addFrames(const NPKHandler& npk, const std::vector<NPKFrameKey>& keys, std::shared_ptr<NPKThreadPool> pool = nullptr);
+
+    /**
+     * @brief 查询帧在图集中的位置，不在图集中返回nullptr
+     */
+    const NPKAtlasEntry* find(const NPKFrameKey& key) const;
+    const std::unordered_map<NPKFrameKey, NPKAtlasEntry, NPKFrameKeyHash>& entries() const { return m_entries; }
+    /**
+     * @brief 计算帧在页面中的纹理坐标
+     */
+    NPKAtlasUV uv(const NPKAtlasEntry& entry) const;
+
+    uint32_t pageCount() const { return static_cast<uint32_t>(m_pages.size()); }
+    /**
+     * @brief 页面画面，之后加入的帧会写入同一个矩阵
+     */
+    std::shared_ptr<NPKMatrix> page(uint32_t index) const;
+    /**
+     * @brief 获取上次调用后有新帧写入的页面并清除标记，用于增量上传
+     */
+    std::vector<uint32_t> takeDirtyPages();
+    void clear();
+
+private:
+    /**
+     * @brief 计算帧内容在画布中的区域，裁剪时去掉四周完全透明的行列
+     * @return 帧超出条目能表示的范围时返回false
+     */
+    bool contentRect(const NPKMatrix& matrix, NPKAtlasRect& rect) const;
+    bool place(const NPKFrameKey& key, const NPKMatrix& matrix, const NPKAtlasRect& content);
+
+private:
+    NPKAtlasOptions m_options;
+    std::vector<std::shared_ptr<NPKMatrix>> m_pages;
+    std::vector<NPKMaxRectsPacker> m_packers;
+    std::vector<bool> m_dirty;
+    std::unordered_map<NPKFrameKey, NPKAtlasEntry, NPKFrameKeyHash> m_entries;
+};
+} // neapu
+
+#endif //NPKATLAS_H
@@ -0,0 +1,153 @@
+//
+// Created by liu86 on 24-8-4.
+//
+
+#include "NPKDDSCache.h"
+#include "NPKMatrix.h"
+
+namespace neapu {
+void NPKDDSCache::reset(const uint32_t ddsCount)
+{
+    std::lock_guard lock(m_mutex);
+    m_lru.clear();
+    m_entries.clear();
+    for (uint32_t i = 0; i < ddsCount; ++i) {
+        m_entries.push_back(std::make_unique<Entry>());
+    }
+}
+
+void NPKDDSCache::setPolicy(const DDSCachePolicy policy, const uint32_t lruCapacity)
+{
+    std::lock_guard lock(m_mutex);
+    m_policy = policy;
+    m_lruCapacity = lruCapacity == 0 ? 1 : lruCapacity;
+    for (uint32_t i = 0; i < m_entries.size(); ++i) {
+        auto& entry = *m_entries[i];
+        if (policy == DCP_NONE) {
+            entry.strong.reset();
+            entry.weak.reset();
+        } else if (policy == DCP_WEAK) {
+            if (entry.strong) {
+                entry.weak = entry.strong;
+            }
+            entry.strong.reset();
+        } else if (entry.strong == nullptr) {
+            // 从WEAK切换过来时，仍然存活的图集转为强引用
+            entry.strong = entry.weak.lock();
+        }
+        if (policy == DCP_LRU && entry.strong && !entry.inLru) {
+            m_lru.push_back(i);
+            entry.lruPos = std::prev(m_lru.end());
+            entry.inLru = true;
+        } else if (policy != DCP_LRU) {
+            removeFromLru(entry);
+        }
+    }
+    trimLru();
+}
+
+DDSCachePolicy NPKDDSCache::policy() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_policy;
+}
+
+std::shared_ptr<NPKMatrix> NPKDDSCache::get(const uint32_t ddsIndex, const Decoder& decoder)
+{
+    {
+        std::unique_lock lock(m_mutex);
+        if (m_policy == DCP_NONE || ddsIndex >= m_entries.size()) {
+            lock.unlock();
+            return decoder();
+        }
+        if (auto matrix = lookup(*m_entries[ddsIndex])) {
+            return matrix;
+        }
+    }
+
+    auto& entry = *m_entries[ddsIndex];
+    std::lock_guard decodeLock(entry.decodeMutex);
+    {
+        // 等待期间可能已经被其他线程解码
+        std::lock_guard lock(m_mutex);
+        if (auto matrix = lookup(entry)) {
+            return matrix;
+        }
+    }
+
+    auto matrix = decoder();
+    if (matrix) {
+        std::lock_guard lock(m_mutex);
+        store(entry, ddsIndex, matrix);
+    }
+    return matrix;
+}
+
+std::shared_ptr<NPKMatrix> NPKDDSCache::find(const uint32_t ddsIndex)
+{
+    std::lock_guard lock(m_mutex);
+    if (m_policy == DCP_NONE || ddsIndex >= m_entries.size()) {
+        return nullptr;
+    }
+    return lookup(*m_entries[ddsIndex]);
+}
+
+void NPKDDSCache::clear()
+{
+    std::lock_guard lock(m_mutex);
+    m_lru.clear();
+    for (const auto& entry : m_entries) {
+        entry->strong.reset();
+        entry->weak.reset();
+        entry->inLru = false;
+    }
+}
+
+std::shared_ptr<NPKMatrix> NPKDDSCache::lookup(Entry& entry)
+{
+    if (entry.strong) {
+        if (entry.inLru) {
+            m_lru.splice(m_lru.begin(), m_lru, entry.lruPos);
+        }
+        return entry.strong;
+    }
+    return entry.weak.lock();
+}
+
+void NPKDDSCache::store(Entry& entry, const uint32_t ddsIndex, const std::shared_ptr<NPKMatrix>& matrix)
+{
+    switch (m_policy) {
+    case DCP_PIN: entry.strong = matrix;
+        break;
+    case DCP_LRU: entry.strong = matrix;
+        if (!entry.inLru) {
+            m_lru.push_front(ddsIndex);
+            entry.lruPos = m_lru.begin();
+            entry.inLru = true;
+        }
+        trimLru();
+        break;
+    case DCP_WEAK: entry.weak = matrix;
+        break;
+    default: break;
+    }
+}
+
+void NPKDDSCache::removeFromLru(Entry& entry)
+{
+    if (entry.inLru) {
+        m_lru.erase(entry.lruPos);
+        entry.inLru = false;
+    }
+}
+
+void NPKDDSCache::trimLru()
+{
+    while (m_lru.size() > m_lruCapacity) {
+        auto& victim = *m_entries[m_lru.back()];
+        victim.strong.reset();
+        victim.inLru = false;
+        m_lru.pop_back();
+    }
+}
+} // neapu
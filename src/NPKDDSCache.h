@@ -0,0 +1,88 @@
+//
+// Created by liu86 on 24-8-4.
+//
+
+#ifndef NPKDDSCACHE_H
+#define NPKDDSCACHE_H
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace neapu {
+enum DDSCachePolicy: uint32_t {
+    DCP_NONE = 0x00, // 不缓存，每次都重新解码
+    DCP_PIN = 0x01,  // 解码后一直保留
+    DCP_LRU = 0x02,  // 最多保留若干个最近使用的
+    DCP_WEAK = 0x03  // 只保留弱引用，外部仍持有时可复用
+};
+
+class NPKMatrix;
+
+/**
+ * @brief 已解码DDS图集的缓存，以DDS索引为键，线程安全
+ *
+ * 同一个DDS同时被多个线程请求时只会解码一次，其他线程等待解码结果。
+ */
+class NPKDDSCache {
+public:
+    using Decoder = std::function<std::shared_ptr<NPKMatrix>()>;
+
+    NPKDDSCache() = default;
+    virtual ~NPKDDSCache() = default;
+    NPKDDSCache(const NPKDDSCache&) = delete;
+    NPKDDSCache& operator=(const NPKDDSCache&) = delete;
+
+    /**
+     * @brief 重置缓存大小，会清空已缓存的数据
+     * @param ddsCount DDS数量
+     */
+    void reset(uint32_t ddsCount);
+    /**
+     * @brief 设置缓存策略
+     * @param policy 缓存策略
+     * @param lruCapacity DCP_LRU策略下最多保留的图集数量
+     */
+    void setPolicy(DDSCachePolicy policy, uint32_t lruCapacity = 1);
+    DDSCachePolicy policy() const;
+    /**
+     * @brief 获取图集，未缓存时调用decoder解码并按策略缓存
+     * @param ddsIndex DDS索引
+     * @param decoder 解码函数
+     * @return 解码失败返回nullptr
+     */
+    std::shared_ptr<NPKMatrix> get(uint32_t ddsIndex, const Decoder& decoder);
+    /**
+     * @brief 获取已缓存的图集，不会触发解码
+     * @param ddsIndex DDS索引
+     * @return 未缓存返回nullptr
+     */
+    std::shared_ptr<NPKMatrix> find(uint32_t ddsIndex);
+    void clear();
+
+private:
+    typedef struct Entry {
+        std::mutex decodeMutex; // 保证同一个DDS只有一个线程在解码
+        std::shared_ptr<NPKMatrix> strong;
+        std::weak_ptr<NPKMatrix> weak;
+        std::list<uint32_t>::iterator lruPos;
+        bool inLru{false};
+    } Entry;
+
+    std::shared_ptr<NPKMatrix> lookup(Entry& entry);
+    void store(Entry& entry, uint32_t ddsIndex, const std::shared_ptr<NPKMatrix>& matrix);
+    void removeFromLru(Entry& entry);
+    void trimLru();
+
+private:
+    mutable std::mutex m_mutex;
+    DDSCachePolicy m_policy{DCP_NONE};
+    uint32_t m_lruCapacity{1};
+    std::vector<std::unique_ptr<Entry>> m_entries;
+    std::list<uint32_t> m_lru; // 头部为最近使用
+};
+} // neapu
+
+#endif //NPKDDSCACHE_H
@@ -4,10 +4,15 @@
 
 #include "NPKDDSHandler.h"
 
-#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 #include "logger.h"
+#include "NPKDecompressor.h"
+#include "NPKInflate.h"
 #include "NPKMatrix.h"
+#include "NPKSimd.h"
 
 namespace {
 std::string DDSPixelDTXFormatToString(const neapu::DDSPixelDTXFormat format)
@@ -28,6 +33,9 @@ constexpr auto DXT1_UNIT_LENGTH = 8;
 constexpr auto DXT3_UNIT_LENGTH = 16;
 constexpr auto DXT5_UNIT_LENGTH = 16;
 constexpr auto UNIT_COLOR_COUNT = 16;
+// 解码为透明黑色的块，用于补齐图集中不存在的块
+constexpr uint8_t DXT1_TRANSPARENT_UNIT[DXT1_UNIT_LENGTH] = {0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF};
+constexpr uint8_t DXT5_TRANSPARENT_UNIT[DXT5_UNIT_LENGTH] = {};
 
 //枚举
 enum DDSHeaderFlag:uint32_t {
@@ -62,51 +70,44 @@ enum DDSCap2:uint32_t {
     DDSCAPS2_VOLUME = 0x00200000U
 };
 
-enum DDSPixelFormatFlag:uint32_t {
-    DDPF_UNKNOWN = 0x00000000U,
-    DDPF_ALPHAPIXELS = 0x00000001U,
-    DDPF_ALPHA = 0x00000002U,
-    DDPF_FOURCC = 0x00000004U,
-    DDPF_RGB = 0x00000040U,
-    DDPF_YUV = 0x00000200U,
-    DDPF_LUMINANCE = 0x00002000U
-};
+namespace {
+uint32_t unitLength(const DDSPixelDTXFormat format)
+{
+    switch (format) {
+    case DDSPixelDTXFormat::DXT1: return DXT1_UNIT_LENGTH;
+    case DDSPixelDTXFormat::DXT3: return DXT3_UNIT_LENGTH;
+    case DDSPixelDTXFormat::DXT5: return DXT5_UNIT_LENGTH;
+    default: return 0;
+    }
+}
 
+bool checkHeader(const NPKDDSHeader& header, const uint64_t uncompressSize)
+{
+    if (header.magic != 0x20534444) {
+        LOG_ERROR << "Magic is not correct.";
+        return false;
+    }
+
+    if (header.size != sizeof(NPKDDSHeader) - 4) {
+        LOG_ERROR << "Size is not correct.";
+        return false;
+    }
+
+    if (header.flags != 0x00081007) {
+        LOG_ERROR << "Flags is not correct.";
+        return false;
+    }
+    if (header.pitchOrLinearSize < uncompressSize - sizeof(NPKDDSHeader)) {
+        LOG_ERROR << "Data length is too short.";
+        return false;
+    }
+    return true;
+}
+}
 
-#pragma pack(push, 1)
-typedef struct NPKDDSPixelFormat {
-    uint32_t size;            //像素格式数据大小，固定为32(0x20)
-    DDSPixelFormatFlag flags; //标志位，DNF里一般用DDPF_FOURCC（0x04）
-    DDSPixelDTXFormat fourCC; // DXT格式，flag里有DDPF_FOURCC有效，DNF里一般为字符串DXT1-5（0x31545844 - 0x35545844）
-    uint32_t rgbBitCount;     //一个RGB(A)包含的位数，flag里有DDPF_RGB、DDPF_YUV、DDPF_LUMINANCE有效，DNF里一般无效
-    uint32_t rBitMask;        // R通道(Y通道或亮度通道)掩码，DNF用不上
-    uint32_t gBitMask;        // G通道(U通道)掩码，DNF用不上
-    uint32_t bBitMask;        // B通道(V通道)掩码，DNF用不上
-    uint32_t aBitMask;        // A通道掩码，DNF用不上
-} NPKDDSPixelFormat;
-
-//像素头
-typedef struct NPKDDSHeader {
-    uint32_t magic;                //标识"DDS "，固定为542327876（0x20534444）
-    uint32_t size;                 //首部大小，固定为124（0x7C）
-    uint32_t flags;                //标志位（见DDSHeaderFlags），DNF里经常采用的是“压缩纹理”，一般为0x81007
-    uint32_t height;               //高度
-    uint32_t width;                //宽度
-    uint32_t pitchOrLinearSize;    //间距，对于压缩纹理，为整个图像数据的字节数，对于非压缩纹理，为一行像素数据的字节数，DNF为前者
-    uint32_t depth;                // DNF里没用，标志位DDSD_DEPTH有效时有用
-    uint32_t mipMapCount;          // DNF里没用，标志位DDSD_MIPMAPCOUNT有效时有用
-    uint32_t reserved1[11];        //保留位，DNF里第十双字一般为"NVTT"（0x5454564E），第十一双字一般为0x20008，其他为零
-    NPKDDSPixelFormat pixelFormat; //像素格式数据，见上文
-    uint32_t caps1;                //曲面的复杂性（见DDSCaps），DNF里一般为0x1000
-    uint32_t caps2;                //曲面的其他信息（主要是三维性），DNF里不用，为零
-    uint32_t caps3;                //默认零
-    uint32_t caps4;                //默认零
-    uint32_t reserved2;            //默认零
-} NPKDDSHeader;
-#pragma pack(pop)
 NPKDDSHandler::~NPKDDSHandler()
 {
-    if (m_data) {
+    if (m_ownData) {
         delete[] m_data;
     }
 }
@@ -126,75 +127,327 @@ int64_t NPKDDSHandler::loadIndex(const uint8_t* data, const uint64_t dataLen)
     return sizeof(m_index);
 }
 
-int64_t NPKDDSHandler::loadData(const uint8_t* data, const uint64_t dataLen)
+int64_t NPKDDSHandler::loadData(const uint8_t* data, const uint64_t dataLen, const bool copyData)
 {
     if (dataLen < m_index.compressSize) {
         LOG_WARNING << "Data length is too short.";
         return dataLen;
     }
 
-    m_data = new uint8_t[m_index.compressSize];
-    int ret = memcpy_s(m_data, m_index.compressSize, data, m_index.compressSize);
+    if (m_ownData) {
+        delete[] m_data;
+    }
+    m_data = nullptr;
+    m_ownData = false;
+    if (!copyData) {
+        m_data = data;
+        return m_index.compressSize;
+    }
+
+    auto* buffer = new uint8_t[m_index.compressSize];
+    int ret = memcpy_s(buffer, m_index.compressSize, data, m_index.compressSize);
     if (ret != 0) {
         LOG_ERROR << "Failed to copy data.";
+        delete[] buffer;
         return -1;
     }
+    m_data = buffer;
+    m_ownData = true;
 
     return m_index.compressSize;
 }
 
-std::shared_ptr<NPKMatrix> NPKDDSHandler::toMatrix() const
+bool NPKDDSHandler::uncompressedData(std::vector<uint8_t>& data) const
 {
-    unsigned long imgDataSize = m_index.uncompressSize;
-    auto* uncompressedData = new uint8_t[imgDataSize];
-    int ret = uncompress(uncompressedData, &imgDataSize, m_data, m_index.compressSize);
-    if (ret != Z_OK) {
+    data.clear();
+    if (m_data == nullptr) {
+        return true;
+    }
+    data.resize(m_index.uncompressSize);
+    const DecompressResult result = getDecompressor()->decompress(m_data, m_index.compressSize, data.data(), data.size());
+    if (result != DR_OK && result != DR_TRUNCATED) {
         LOG_ERROR << "Failed to uncompress data.";
-        delete[] uncompressedData;
-        return nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool NPKDDSHandler::readHeader(NPKDDSHeader& header) const
+{
+    if (m_data == nullptr || m_index.uncompressSize < sizeof(NPKDDSHeader)) {
+        LOG_ERROR << "DDS data is not loaded.";
+        return false;
+    }
+    // 只解压需要的前缀，目标写满后还有数据是正常的
+    if (getDecompressor()->decompress(m_data, m_index.compressSize, reinterpret_cast<uint8_t*>(&header), sizeof(header)) == DR_ERROR) {
+        LOG_ERROR << "Failed to uncompress data.";
+        return false;
     }
+    return checkHeader(header, m_index.uncompressSize);
+}
 
+bool NPKDDSHandler::extractBlocks(const uint32_t left, const uint32_t top, const uint32_t right, const uint32_t bottom,
+                                  NPKDXTBlocks& blocks) const
+{
+    blocks.data.clear();
     NPKDDSHeader header;
-    ret = memcpy_s(&header, sizeof(header), uncompressedData, sizeof(header));
-    if (ret != 0) {
-        LOG_ERROR << "Failed to copy header.";
-        delete[] uncompressedData;
-        return nullptr;
+    if (!readHeader(header)) {
+        return false;
     }
+    return extractBlocks(header, left, top, right, bottom, blocks);
+}
 
-    if (header.magic != 0x20534444) {
-        LOG_ERROR << "Magic is not correct.";
-        delete[] uncompressedData;
-        return nullptr;
+bool NPKDDSHandler::extractBlocks(const NPKDDSHeader& header, const uint32_t left, const uint32_t top, const uint32_t right,
+                                  const uint32_t bottom, NPKDXTBlocks& blocks) const
+{
+    blocks.data.clear();
+    if (left >= right || top >= bottom || right > m_index.width || bottom > m_index.height) {
+        LOG_ERROR << "Invalid clip area.";
+        return false;
+    }
+    const uint32_t unitCount = unitLength(header.pixelFormat.fourCC);
+    if (unitCount == 0 || right > header.width || bottom > header.height) {
+        LOG_ERROR << "Invalid DDS format or clip area.";
+        return false;
     }
 
-    if (header.size != sizeof(NPKDDSHeader) - 4) {
-        LOG_ERROR << "Size is not correct.";
-        delete[] uncompressedData;
+    const uint32_t blockWidth = header.width / 4;
+    const uint32_t blockHeight = header.height / 4;
+    const uint32_t blockLeft = left / 4;
+    const uint32_t blockTop = top / 4;
+    blocks.format = header.pixelFormat.fourCC;
+    blocks.blockSize = unitCount;
+    blocks.blockColumns = (right + 3) / 4 - blockLeft;
+    blocks.blockRows = (bottom + 3) / 4 - blockTop;
+    blocks.offsetX = left - blockLeft * 4;
+    blocks.offsetY = top - blockTop * 4;
+    const uint64_t blockRowSize = static_cast<uint64_t>(blocks.blockColumns) * unitCount;
+    blocks.data.resize(blockRowSize * blocks.blockRows);
+
+    // 宽高不是4的倍数时，最后不足一块的像素在图集中没有对应的块，用透明块补齐
+    const uint32_t copyColumns = blockLeft < blockWidth ? std::min(blockWidth - blockLeft, blocks.blockColumns) : 0;
+    const uint32_t copyRows = blockTop < blockHeight ? std::min(blockHeight - blockTop, blocks.blockRows) : 0;
+    if (copyColumns < blocks.blockColumns || copyRows < blocks.blockRows) {
+        const uint8_t* transparent = header.pixelFormat.fourCC == DDSPixelDTXFormat::DXT1 ? DXT1_TRANSPARENT_UNIT : DXT5_TRANSPARENT_UNIT;
+        for (uint64_t i = 0; i < blocks.data.size(); i += unitCount) {
+            memcpy(blocks.data.data() + i, transparent, unitCount);
+        }
+    }
+    if (copyColumns == 0 || copyRows == 0) {
+        return true;
+    }
+
+    const uint64_t rowLength = static_cast<uint64_t>(blockWidth) * unitCount;
+    if ((blockTop + copyRows) * rowLength > m_index.uncompressSize - sizeof(NPKDDSHeader)) {
+        LOG_ERROR << "Data length is too short.";
+        return false;
+    }
+
+    // 区域之前的块行解压后丢弃，整行都在区域内时直接解压到输出，否则先解压到线程内复用的缓冲区再拷贝区域内的块
+    NPKDecompressTarget target;
+    target.skip = sizeof(NPKDDSHeader) + blockTop * rowLength;
+    if (copyColumns == blockWidth) {
+        target.data = blocks.data.data();
+        target.rowSize = rowLength;
+        target.stride = blockRowSize;
+        target.rowCount = copyRows;
+        if (getDecompressor()->decompress(m_data, m_index.compressSize, target) == DR_ERROR) {
+            LOG_ERROR << "Failed to uncompress data.";
+            return false;
+        }
+        return true;
+    }
+    NPKScratchBuffer rows(copyRows * rowLength);
+    target.data = rows.data();
+    target.rowSize = rows.size();
+    target.stride = rows.size();
+    if (getDecompressor()->decompress(m_data, m_index.compressSize, target) == DR_ERROR) {
+        LOG_ERROR << "Failed to uncompress data.";
+        return false;
+    }
+    for (uint32_t y = 0; y < copyRows; ++y) {
+        memcpy(blocks.data.data() + y * blockRowSize, rows.data() + y * rowLength + static_cast<uint64_t>(blockLeft) * unitCount,
+               static_cast<size_t>(copyColumns) * unitCount);
+    }
+    return true;
+}
+
+bool NPKDDSHandler::extractDDS(const uint32_t left, const uint32_t top, const uint32_t right, const uint32_t bottom,
+                               std::vector<uint8_t>& dds) const
+{
+    dds.clear();
+    NPKDDSHeader header;
+    NPKDXTBlocks blocks;
+    if (!readHeader(header) || !extractBlocks(header, left, top, right, bottom, blocks)) {
+        return false;
+    }
+    header.width = blocks.blockColumns * 4;
+    header.height = blocks.blockRows * 4;
+    header.pitchOrLinearSize = static_cast<uint32_t>(blocks.data.size());
+    dds.resize(sizeof(header) + blocks.data.size());
+    memcpy(dds.data(), &header, sizeof(header));
+    memcpy(dds.data() + sizeof(header), blocks.data.data(), blocks.data.size());
+    return true;
+}
+
+std::shared_ptr<NPKMatrix> NPKDDSHandler::toMatrix(const NPKParallelOptions& parallel) const
+{
+    // 解压到线程内复用的缓冲区
+    NPKScratchBuffer uncompressedData(m_index.uncompressSize);
+    const DecompressResult result = getDecompressor()->decompress(m_data, m_index.compressSize, uncompressedData.data(),
+                                                                  m_index.uncompressSize);
+    if (result != DR_OK && result != DR_TRUNCATED) {
+        LOG_ERROR << "Failed to uncompress data.";
         return nullptr;
     }
 
-    if (header.flags != 0x00081007) {
-        LOG_ERROR << "Flags is not correct.";
-        delete[] uncompressedData;
+    NPKDDSHeader header;
+    int ret = memcpy_s(&header, sizeof(header), uncompressedData.data(), sizeof(header));
+    if (ret != 0) {
+        LOG_ERROR << "Failed to copy header.";
         return nullptr;
     }
-    if (header.pitchOrLinearSize < m_index.uncompressSize - sizeof(NPKDDSHeader)) {
-        LOG_ERROR << "Data length is too short.";
-        delete[] uncompressedData;
+
+    if (!checkHeader(header, m_index.uncompressSize)) {
         return nullptr;
     }
 
-    const auto* imgData = uncompressedData + sizeof(NPKDDSHeader);
+    const auto* imgData = uncompressedData.data() + sizeof(NPKDDSHeader);
     std::shared_ptr<NPKMatrix> retMatrix = DXTxToMatrix(imgData, m_index.uncompressSize - sizeof(NPKDDSHeader), header.width, header.height,
-                                                        header.pixelFormat.fourCC);
+                                                        header.pixelFormat.fourCC, parallel);
     LOG_DEBUG << "DTX Format: " << DDSPixelDTXFormatToString(header.pixelFormat.fourCC) << ", Width: " << header.width << ", Height: " <<
         header.height;
 
-    delete[] uncompressedData;
     return retMatrix;
 }
 
+bool NPKDDSHandler::decodeRegion(const uint32_t left, const uint32_t top, const uint32_t right, const uint32_t bottom,
+                                 NPKMatrix& matrix) const
+{
+    if (left >= right || top >= bottom) {
+        LOG_ERROR << "Invalid clip area.";
+        return false;
+    }
+    // 区域需要完整地写在矩阵的图像与画布内
+    if (!matrix.pixelRow(0, 0, right - left) || !matrix.pixelRow(0, bottom - top - 1, right - left)) {
+        LOG_ERROR << "Matrix is too small for clip area.";
+        return false;
+    }
+    NPKPixelBuffer buffer = matrix.pixelBuffer();
+    buffer.offsetX = matrix.offsetX();
+    buffer.offsetY = matrix.offsetY();
+    return decodeRegion(left, top, right, bottom, buffer);
+}
+
+bool NPKDDSHandler::decodeRegion(const uint32_t left, const uint32_t top, const uint32_t right, const uint32_t bottom,
+                                 const NPKPixelBuffer& buffer) const
+{
+    if (left >= right || top >= bottom || right > m_index.width || bottom > m_index.height) {
+        LOG_ERROR << "Invalid clip area.";
+        return false;
+    }
+    uint64_t stride = 0;
+    uint8_t* origin = pixelBufferOrigin(buffer, right - left, bottom - top, stride);
+    if (origin == nullptr) {
+        return false;
+    }
+
+    NPKDDSHeader header;
+    if (!readHeader(header)) {
+        return false;
+    }
+
+    const uint32_t unitCount = unitLength(header.pixelFormat.fourCC);
+    const uint32_t blockWidth = header.width / 4;
+    if (unitCount == 0 || right > header.width || bottom > header.height) {
+        LOG_ERROR << "Invalid DDS format or clip area.";
+        return false;
+    }
+
+    // 宽高不是4的倍数时，最后不足一块的像素保持透明，与完整解码一致
+    const uint32_t blockLeft = left / 4;
+    const uint32_t blockTop = top / 4;
+    const uint32_t blockRight = (right + 3) / 4 < blockWidth ? (right + 3) / 4 : blockWidth;
+    const uint32_t blockBottom = (bottom + 3) / 4 < header.height / 4 ? (bottom + 3) / 4 : header.height / 4;
+    const uint32_t copyRight = right < blockRight * 4 ? right : blockRight * 4;
+    if (copyRight < right || blockBottom * 4 < bottom) {
+        for (uint32_t y = 0; y < bottom - top; ++y) {
+            memset(origin + y * stride, 0, static_cast<size_t>(right - left) * outputPixelSize(buffer.format));
+        }
+    }
+    if (blockLeft >= blockRight || blockTop >= blockBottom) {
+        return true;
+    }
+
+    const uint64_t rowLength = static_cast<uint64_t>(blockWidth) * unitCount;
+    if (blockBottom * rowLength > m_index.uncompressSize - sizeof(NPKDDSHeader)) {
+        LOG_ERROR << "Data length is too short.";
+        return false;
+    }
+
+    // 裁剪区域之前的块行解压后丢弃，只保留区域内的块行，解压到区域的最后一个块行为止
+    NPKScratchBuffer imgData((blockBottom - blockTop) * rowLength);
+    NPKDecompressTarget target;
+    target.data = imgData.data();
+    target.rowSize = imgData.size();
+    target.stride = imgData.size();
+    target.skip = sizeof(NPKDDSHeader) + blockTop * rowLength;
+    if (getDecompressor()->decompress(m_data, m_index.compressSize, target) == DR_ERROR) {
+        LOG_ERROR << "Failed to uncompress data.";
+        return false;
+    }
+
+    const auto& kernels = simd::kernels();
+    simd::DXTBlockRowKernel kernel = nullptr;
+    switch (header.pixelFormat.fourCC) {
+    case DDSPixelDTXFormat::DXT1: kernel = kernels.dxt1BlockRow;
+        break;
+    case DDSPixelDTXFormat::DXT3: kernel = kernels.dxt3BlockRow;
+        break;
+    case DDSPixelDTXFormat::DXT5: kernel = kernels.dxt5BlockRow;
+        break;
+    default: break;
+    }
+
+    // 每个块行先解码到4行像素的条带，再把与裁剪区域相交的部分写入输出
+    const uint32_t stripBlocks = blockRight - blockLeft;
+    const uint32_t stripWidth = stripBlocks * 4;
+    NPKScratchBuffer stripBuffer(static_cast<uint64_t>(stripWidth) * 4 * sizeof(NPKColor));
+    auto* strip = reinterpret_cast<NPKColor*>(stripBuffer.data());
+    NPKColor colors[UNIT_COLOR_COUNT];
+    const uint32_t copyLeft = left - blockLeft * 4;
+    for (uint32_t by = blockTop; by < blockBottom; ++by) {
+        const uint8_t* rowData = imgData.data() + (by - blockTop) * rowLength + static_cast<uint64_t>(blockLeft) * unitCount;
+        if (kernel) {
+            kernel(rowData, stripBlocks, stripBuffer.data(), stripWidth * sizeof(NPKColor));
+        } else {
+            for (uint32_t bx = 0; bx < stripBlocks; ++bx) {
+                switch (header.pixelFormat.fourCC) {
+                case DDSPixelDTXFormat::DXT1: DXT1UnitToNPKColor(rowData + bx * unitCount, colors);
+                    break;
+                case DDSPixelDTXFormat::DXT3: DXT3UnitToNPKColor(rowData + bx * unitCount, colors);
+                    break;
+                default: DXT5UnitToNPKColor(rowData + bx * unitCount, colors);
+                    break;
+                }
+                for (uint32_t i = 0; i < UNIT_COLOR_COUNT; ++i) {
+                    strip[(i / 4) * stripWidth + bx * 4 + i % 4] = colors[i];
+                }
+            }
+        }
+
+        for (uint32_t row = 0; row < 4; ++row) {
+            const uint32_t y = by * 4 + row;
+            if (y < top || y >= bottom) {
+                continue;
+            }
+            // 条带在缓存中，写入输出时同时转换格式
+            convertPixelRow(strip + row * stripWidth + copyLeft, copyRight - left, buffer.format, origin + (y - top) * stride);
+        }
+    }
+    return true;
+}
+
 NPKColor NPKDDSHandler::RGB565ToNPKColor(const uint16_t color)
 {
     NPKColor ret;
@@ -323,9 +576,9 @@ void NPKDDSHandler::DXT5UnitToNPKColor(const uint8_t* imgData, NPKColor colors[]
 }
 
 std::shared_ptr<NPKMatrix> NPKDDSHandler::DXTxToMatrix(const uint8_t* imgData, const uint64_t dataLen, const uint32_t width,
-                                                       const uint32_t height, const DDSPixelDTXFormat format)
+                                                       const uint32_t height, const DDSPixelDTXFormat format,
+                                                       const NPKParallelOptions& parallel)
 {
-    uint64_t offset = 0;
     const uint32_t blockWidth = width / 4;
     const uint32_t blockHeight = height / 4;
     uint32_t unitCount = 0;
@@ -338,13 +591,54 @@ std::shared_ptr<NPKMatrix> NPKDDSHandler::DXTxToMatrix(const uint8_t* imgData, c
         break;
     default: return nullptr;
     }
-    if (dataLen < blockWidth * blockHeight * unitCount) {
+    if (dataLen < static_cast<uint64_t>(blockWidth) * blockHeight * unitCount) {
         return nullptr;
     }
+    auto matrex = NPKMatrix::createMatrix(width, height);
+
+    // 块数量足够多时按块行切分到线程池，每个线程写不同的像素行
+    const uint64_t blockCount = static_cast<uint64_t>(blockWidth) * blockHeight;
+    if (parallel.pool && parallel.pool->threadCount() > 0 && blockCount >= parallel.minBlocks && blockHeight > 1) {
+        const uint32_t bandCount = (parallel.pool->threadCount() + 1) * 4;
+        const uint32_t grain = blockHeight / bandCount > 0 ? blockHeight / bandCount : 1;
+        parallel.pool->parallelFor(blockHeight, [&](const uint32_t begin, const uint32_t end) {
+            DXTxBlockRowsToMatrix(imgData, blockWidth, begin, end, unitCount, format, *matrex);
+        }, grain);
+    } else {
+        DXTxBlockRowsToMatrix(imgData, blockWidth, 0, blockHeight, unitCount, format, *matrex);
+    }
+    return matrex;
+}
+
+void NPKDDSHandler::DXTxBlockRowsToMatrix(const uint8_t* imgData, const uint32_t blockWidth, const uint32_t rowBegin,
+                                          const uint32_t rowEnd, const uint32_t unitCount, const DDSPixelDTXFormat format,
+                                          NPKMatrix& matrix)
+{
+    // 有SIMD内核时按块行解码，每次输出4行像素
+    const auto& kernels = simd::kernels();
+    simd::DXTBlockRowKernel kernel = nullptr;
+    switch (format) {
+    case DDSPixelDTXFormat::DXT1: kernel = kernels.dxt1BlockRow;
+        break;
+    case DDSPixelDTXFormat::DXT3: kernel = kernels.dxt3BlockRow;
+        break;
+    case DDSPixelDTXFormat::DXT5: kernel = kernels.dxt5BlockRow;
+        break;
+    default: break;
+    }
+    if (kernel && blockWidth > 0) {
+        auto* dst = reinterpret_cast<uint8_t*>(matrix.data());
+        const size_t dstStride = static_cast<size_t>(matrix.width()) * sizeof(NPKColor);
+        for (uint32_t y = rowBegin; y < rowEnd; ++y) {
+            kernel(imgData + static_cast<uint64_t>(y) * blockWidth * unitCount, blockWidth, dst + y * 4 * dstStride, dstStride);
+        }
+        return;
+    }
+
+    uint64_t offset = static_cast<uint64_t>(rowBegin) * blockWidth * unitCount;
     uint8_t unitData[DXT5_UNIT_LENGTH]; // 按大的来
     NPKColor colors[UNIT_COLOR_COUNT];
-    auto matrex = NPKMatrix::createMatrix(width, height);
-    for (uint32_t y = 0; y < blockHeight; ++y) {
+    for (uint32_t y = rowBegin; y < rowEnd; ++y) {
         for (uint32_t x = 0; x < blockWidth; ++x) {
             memcpy(unitData, imgData + offset, unitCount);
             switch (format) {
@@ -354,16 +648,15 @@ std::shared_ptr<NPKMatrix> NPKDDSHandler::DXTxToMatrix(const uint8_t* imgData, c
                 break;
             case DDSPixelDTXFormat::DXT5: DXT5UnitToNPKColor(unitData, colors);
                 break;
-            default: return nullptr;
+            default: return;
             }
             for (uint32_t i = 0; i < UNIT_COLOR_COUNT; ++i) {
                 const uint32_t unitX = x * 4 + i % 4;
                 const uint32_t unitY = y * 4 + i / 4;
-                matrex->setPixel(unitX, unitY, colors[i]);
+                matrix.setPixel(unitX, unitY, colors[i]);
             }
             offset += unitCount;
         }
     }
-    return matrex;
 }
 } // neapu
\ No newline at end of file
@@ -7,8 +7,10 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "NPKPublic.h"
+#include "NPKThreadPool.h"
 
 namespace neapu {
 enum DDSPixelDTXFormat:uint32_t {
@@ -19,7 +21,47 @@ enum DDSPixelDTXFormat:uint32_t {
     DXT4 = 0x34545844U,
     DXT5 = 0x35545844U
 };
+enum DDSPixelFormatFlag:uint32_t {
+    DDPF_UNKNOWN = 0x00000000U,
+    DDPF_ALPHAPIXELS = 0x00000001U,
+    DDPF_ALPHA = 0x00000002U,
+    DDPF_FOURCC = 0x00000004U,
+    DDPF_RGB = 0x00000040U,
+    DDPF_YUV = 0x00000200U,
+    DDPF_LUMINANCE = 0x00002000U
+};
+
 #pragma pack(push, 1)
+typedef struct NPKDDSPixelFormat {
+    uint32_t size;            //像素格式数据大小，固定为32(0x20)
+    DDSPixelFormatFlag flags; //标志位，DNF里一般用DDPF_FOURCC（0x04）
+    DDSPixelDTXFormat fourCC; // DXT格式，flag里有DDPF_FOURCC有效，DNF里一般为字符串DXT1-5（0x31545844 - 0x35545844）
+    uint32_t rgbBitCount;     //一个RGB(A)包含的位数，flag里有DDPF_RGB、DDPF_YUV、DDPF_LUMINANCE有效，DNF里一般无效
+    uint32_t rBitMask;        // R通道(Y通道或亮度通道)掩码，DNF用不上
+    uint32_t gBitMask;        // G通道(U通道)掩码，DNF用不上
+    uint32_t bBitMask;        // B通道(V通道)掩码，DNF用不上
+    uint32_t aBitMask;        // A通道掩码，DNF用不上
+} NPKDDSPixelFormat;
+
+//像素头
+typedef struct NPKDDSHeader {
+    uint32_t magic;                //标识"DDS "，固定为542327876（0x20534444）
+    uint32_t size;                 //首部大小，固定为124（0x7C）
+    uint32_t flags;                //标志位（见DDSHeaderFlags），DNF里经常采用的是“压缩纹理”，一般为0x81007
+    uint32_t height;               //高度
+    uint32_t width;                //宽度
+    uint32_t pitchOrLinearSize;    //间距，对于压缩纹理，为整个图像数据的字节数，对于非压缩纹理，为一行像素数据的字节数，DNF为前者
+    uint32_t depth;                // DNF里没用，标志位DDSD_DEPTH有效时有用
+    uint32_t mipMapCount;          // DNF里没用，标志位DDSD_MIPMAPCOUNT有效时有用
+    uint32_t reserved1[11];        //保留位，DNF里第十双字一般为"NVTT"（0x5454564E），第十一双字一般为0x20008，其他为零
+    NPKDDSPixelFormat pixelFormat; //像素格式数据，见上文
+    uint32_t caps1;                //曲面的复杂性（见DDSCaps），DNF里一般为0x1000
+    uint32_t caps2;                //曲面的其他信息（主要是三维性），DNF里不用，为零
+    uint32_t caps3;                //默认零
+    uint32_t caps4;                //默认零
+    uint32_t reserved2;            //默认零
+} NPKDDSHeader;
+
 typedef struct NPKDDSIndex {
     uint32_t unknown1 = 0; // 默认为1
     DDSFormat format = DDSFormat::DDS_UNKNOWN;
@@ -31,7 +73,21 @@ typedef struct NPKDDSIndex {
 } NPKDDSIndex;
 #pragma pack(pop)
 
+/**
+ * @brief 未解码的DXT块，按块行连续保存，可直接作为压缩纹理上传
+ */
+typedef struct NPKDXTBlocks {
+    DDSPixelDTXFormat format = DXT_UNKNOWN;
+    uint32_t blockSize = 0;    // 每个4x4块的字节数，DXT1为8，DXT3/DXT5为16
+    uint32_t blockColumns = 0; // 每行块数
+    uint32_t blockRows = 0;    // 块行数
+    uint32_t offsetX = 0;      // 请求区域左上角在第一个块中的像素偏移
+    uint32_t offsetY = 0;
+    std::vector<uint8_t> data; // blockRows行，每行blockColumns * blockSize字节
+} NPKDXTBlocks;
+
 class NPKMatrix;
+struct NPKPixelBuffer;
 
 class NPKDDSHandler {
 public:
@@ -39,10 +95,72 @@ public:
     virtual ~NPKDDSHandler();
 
     int64_t loadIndex(const uint8_t* data, const uint64_t dataLen);
-    int64_t loadData(const uint8_t* data, const uint64_t dataLen);
+    /**
+     * @brief 加载DDS压缩数据
+     * @param data DDS数据
+     * @param dataLen 数据最大长度
+     * @param copyData 为true时拷贝数据，为false时只保存指针，调用者需保证data在DDS释放前有效
+     * @return 成功返回读取的长度，失败返回-1
+     */
+    int64_t loadData(const uint8_t* data, const uint64_t dataLen, bool copyData = true);
 
-    std::shared_ptr<NPKMatrix> toMatrix() const;
+    /**
+     * @brief 解码整张DDS
+     * @param parallel 多线程解码选项，默认在调用线程解码
+     * @return 失败返回nullptr
+     */
+    std::shared_ptr<NPKMatrix> toMatrix(const NPKParallelOptions& parallel = {}) const;
+    /**
+     * @brief 只解码与裁剪区域相交的块，直接写入输出矩阵，数据只解压到区域的最后一个块行
+     * @param left 裁剪左边界
+     * @param top 裁剪上边界
+     * @param right 裁剪右边界，不包含
+     * @param bottom 裁剪下边界，不包含
+     * @param matrix 输出矩阵，区域左上角写到矩阵的(0, 0)
+     * @return 成功返回true
+     */
+    bool decodeRegion(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, NPKMatrix& matrix) const;
+    /**
+     * @brief 按缓冲区的输出格式把裁剪区域解码到调用者的缓冲区，区域左上角写到缓冲区的写入位置，除线程内复用的缓冲区外不分配内存
+     * @return 区域或缓冲区无效、解码失败返回false
+     */
+    bool decodeRegion(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, const NPKPixelBuffer& buffer) const;
+    const NPKDDSIndex& index() const { return m_index; }
+    /**
+     * @brief 获取解压后的完整DDS数据，包括DDS头
+     * @param data 输出数据，没有数据时为空
+     * @return 解压失败返回false
+     */
+    bool uncompressedData(std::vector<uint8_t>& data) const;
+    /**
+     * @brief 只解压并检查DDS头
+     * @param header 输出DDS头
+     * @return 没有数据、解压失败或DDS头无效返回false
+     */
+    bool readHeader(NPKDDSHeader& header) const;
+    /**
+     * @brief 不解码，取出覆盖裁剪区域的DXT块，数据只解压到区域的最后一个块行
+     *
+     * 块按4像素对齐，请求区域在第一个块中的偏移写入offsetX/offsetY。
+     * 宽高不是4的倍数时，图集中不存在的块用透明块补齐，解码结果与decodeRegion一致。
+     * blocks.data的容量足够时复用其内存。
+     * @param left 裁剪左边界
+     * @param top 裁剪上边界
+     * @param right 裁剪右边界，不包含
+     * @param bottom 裁剪下边界，不包含
+     * @param blocks 输出块
+     * @return 区域无效、格式不支持或解压失败返回false
+     */
+    bool extractBlocks(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, NPKDXTBlocks& blocks) const;
+    /**
+     * @brief 把覆盖裁剪区域的DXT块保存为独立的.dds文件，宽高为块对齐后的大小，其余头部字段与原DDS相同
+     * @param dds 输出文件数据，失败时为空
+     * @return 与extractBlocks相同
+     */
+    bool extractDDS(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, std::vector<uint8_t>& dds) const;
 private:
+    // 使用已读取的DDS头提取块，见extractBlocks
+    bool extractBlocks(const NPKDDSHeader& header, uint32_t left, uint32_t top, uint32_t right, uint32_t bottom, NPKDXTBlocks& blocks) const;
     static NPKColor RGB565ToNPKColor(const uint16_t color);
     // static std::shared_ptr<NPKMatrix> DXT1ToMatrix(const uint8_t* imgData, const uint64_t dataLen, const uint32_t width, const uint32_t height);
     static void DXT1UnitToNPKColor(const uint8_t* imgData, NPKColor colors[]);
@@ -50,11 +168,16 @@ private:
     static void DXT3UnitToNPKColor(const uint8_t* imgData, NPKColor colors[]);
     // static std::shared_ptr<NPKMatrix> DXT5ToMatrix(const uint8_t* imgData, const uint64_t dataLen, const uint32_t width, const uint32_t height);
     static void DXT5UnitToNPKColor(const uint8_t* imgData, NPKColor colors[]);
-    static std::shared_ptr<NPKMatrix> DXTxToMatrix(const uint8_t* imgData, const uint64_t dataLen, const uint32_t width, const uint32_t height, const DDSPixelDTXFormat format);
+    static std::shared_ptr<NPKMatrix> DXTxToMatrix(const uint8_t* imgData, const uint64_t dataLen, const uint32_t width, const uint32_t height, const DDSPixelDTXFormat format,
+                                                   const NPKParallelOptions& parallel);
+    // 解码[rowBegin, rowEnd)块行，不同块行写入不同的像素行，可多线程同时调用
+    static void DXTxBlockRowsToMatrix(const uint8_t* imgData, uint32_t blockWidth, uint32_t rowBegin, uint32_t rowEnd, uint32_t unitCount,
+                                      DDSPixelDTXFormat format, NPKMatrix& matrix);
 
 private:
     NPKDDSIndex m_index;
-    uint8_t* m_data{nullptr};
+    const uint8_t* m_data{nullptr};
+    bool m_ownData{false};
 };
 } // neapu
 
@@ -0,0 +1,119 @@
+//
+// Created by liu86 on 24-8-9.
+//
+
+#include "NPKDecompressor.h"
+#include "NPKFastInflate.h"
+#include "NPKInflate.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <zlib.h>
+
+#ifndef NPK_DEFAULT_DECOMPRESS_BACKEND
+#define NPK_DEFAULT_DECOMPRESS_BACKEND DB_ZLIB
+#endif
+
+namespace neapu {
+namespace {
+// 每帧解码都会获取解压后端，读取只是一次原子加载，不加锁也不修改引用计数
+std::atomic<const NPKDecompressor*> g_decompressor{nullptr};
+// 调用者设置过的自定义后端都保留到进程结束，已经获取到旧后端的解码可以继续使用
+std::mutex g_decompressorMutex;
+std::vector<std::shared_ptr<const NPKDecompressor>> g_decompressors;
+
+// 内置后端每种只有一个实例，切换时只替换当前指针
+const NPKDecompressor* builtinDecompressor(const DecompressBackend backend)
+{
+    static const NPKZlibDecompressor zlib{};
+    static const NPKFastInflate fast{};
+    switch (backend) {
+    case DB_ZLIB: return &zlib;
+    case DB_FAST: return &fast;
+    default: return nullptr;
+    }
+}
+
+const NPKDecompressor* defaultDecompressor()
+{
+    return builtinDecompressor(NPK_DEFAULT_DECOMPRESS_BACKEND);
+}
+}
+
+DecompressResult NPKDecompressor::decompress(const uint8_t* src, const uint64_t srcLen, uint8_t* dst, const uint64_t dstLen) const
+{
+    NPKDecompressTarget target;
+    target.data = dst;
+    target.rowSize = dstLen;
+    target.stride = dstLen;
+    return decompress(src, srcLen, target);
+}
+
+DecompressResult NPKZlibDecompressor::decompress(const uint8_t* src, const uint64_t srcLen, const NPKDecompressTarget& target) const
+{
+    NPKInflateStream stream;
+    if (stream.reset(src, srcLen) != Z_OK) {
+        return DR_ERROR;
+    }
+
+    // 跳过的部分分段解压到栈上丢弃
+    uint8_t discard[4096];
+    for (uint64_t skipped = 0; skipped < target.skip;) {
+        const uint64_t len = target.skip - skipped < sizeof(discard) ? target.skip - skipped : sizeof(discard);
+        if (stream.read(discard, len) != Z_OK) {
+            return DR_ERROR;
+        }
+        skipped += len;
+    }
+    for (uint32_t i = 0; i < target.rowCount; ++i) {
+        if (stream.read(target.data + i * target.stride, target.rowSize) != Z_OK) {
+            return DR_ERROR;
+        }
+    }
+    if (stream.truncated()) {
+        return DR_TRUNCATED;
+    }
+
+    const int ret = stream.finish();
+    if (ret == Z_OK) {
+        return DR_OK;
+    }
+    return ret == Z_BUF_ERROR ? DR_OVERFLOW : DR_ERROR;
+}
+
+std::shared_ptr<const NPKDecompressor> createDecompressor(const DecompressBackend backend)
+{
+    switch (backend) {
+    case DB_ZLIB: return std::make_shared<NPKZlibDecompressor>();
+    case DB_FAST: return std::make_shared<NPKFastInflate>();
+    default: return nullptr;
+    }
+}
+
+std::shared_ptr<const NPKDecompressor> getDecompressor()
+{
+    const NPKDecompressor* decompressor = g_decompressor.load(std::memory_order_acquire);
+    // 不持有所有权的shared_ptr，对象是内置后端的静态实例或由g_decompressors保持有效
+    return {std::shared_ptr<const NPKDecompressor>{}, decompressor ? decompressor : defaultDecompressor()};
+}
+
+bool setDecompressor(const DecompressBackend backend)
+{
+    const NPKDecompressor* decompressor = builtinDecompressor(backend);
+    if (!decompressor) {
+        return false;
+    }
+    g_decompressor.store(decompressor, std::memory_order_release);
+    return true;
+}
+
+void setDecompressor(std::shared_ptr<const NPKDecompressor> decompressor)
+{
+    std::lock_guard lock(g_decompressorMutex);
+    if (decompressor && std::find(g_decompressors.begin(), g_decompressors.end(), decompressor) == g_decompressors.end()) {
+        g_decompressors.push_back(decompressor);
+    }
+    g_decompressor.store(decompressor.get(), std::memory_order_release);
+}
+} // neapu
@@ -0,0 +1,90 @@
+//
+// Created by liu86 on 24-8-9.
+//
+
+#ifndef NPKDECOMPRESSOR_H
+#define NPKDECOMPRESSOR_H
+#include <cstdint>
+#include <memory>
+
+namespace neapu {
+enum DecompressBackend: uint32_t {
+    DB_ZLIB = 0x00, // zlib流式解压
+    DB_FAST = 0x01  // 内置的快速inflate，针对输出大小已知的数据
+};
+
+enum DecompressResult: uint32_t {
+    DR_OK = 0x00,        // 解压完成，输出大小与目标一致
+    DR_TRUNCATED = 0x01, // 数据提前结束，剩余输出填0
+    DR_OVERFLOW = 0x02,  // 目标已写满，但数据还有剩余输出
+    DR_ERROR = 0x03      // 数据损坏或内存不足
+};
+
+/**
+ * @brief 解压的输出位置，按行写入，行与行之间可以不连续
+ *
+ * 解压结果先丢弃skip字节，之后每rowSize字节写入一行，第i行写到data + i * stride
+ */
+typedef struct NPKDecompressTarget {
+    uint8_t* data = nullptr;
+    uint64_t rowSize = 0;
+    uint64_t stride = 0;
+    uint32_t rowCount = 1;
+    uint64_t skip = 0;
+} NPKDecompressTarget;
+
+/**
+ * @brief 解压后端接口，输入为zlib格式的数据，输出大小由调用者给出
+ *
+ * 实现需要可以在多个线程中同时调用
+ */
+class NPKDecompressor {
+public:
+    virtual ~NPKDecompressor() = default;
+
+    virtual const char* name() const = 0;
+    /**
+     * @brief 解压到目标位置
+     * @param src 压缩数据
+     * @param srcLen 压缩数据长度
+     * @param target 输出位置
+     * @return 解压结果，DR_OVERFLOW时目标已写满
+     */
+    virtual DecompressResult decompress(const uint8_t* src, uint64_t srcLen, const NPKDecompressTarget& target) const = 0;
+    /**
+     * @brief 解压到连续的缓冲区
+     */
+    DecompressResult decompress(const uint8_t* src, uint64_t srcLen, uint8_t* dst, uint64_t dstLen) const;
+};
+
+/**
+ * @brief 基于zlib的解压，使用线程内复用的NPKInflateStream，不需要中间缓冲区
+ */
+class NPKZlibDecompressor : public NPKDecompressor {
+public:
+    const char* name() const override { return "zlib"; }
+    DecompressResult decompress(const uint8_t* src, uint64_t srcLen, const NPKDecompressTarget& target) const override;
+    using NPKDecompressor::decompress;
+};
+
+/**
+ * @brief 创建指定类型的解压后端
+ * @return 不支持的类型返回nullptr
+ */
+std::shared_ptr<const NPKDecompressor> createDecompressor(DecompressBackend backend);
+/**
+ * @brief 获取当前使用的解压后端，默认值由CMake的NPK_DECOMPRESS_BACKEND决定，不加锁，可多线程同时调用
+ */
+std::shared_ptr<const NPKDecompressor> getDecompressor();
+/**
+ * @brief 切换到内置的解压后端，每种后端只有一个实例，反复切换不会分配内存，正在进行的解压不受影响
+ * @return 不支持的类型返回false
+ */
+bool setDecompressor(DecompressBackend backend);
+/**
+ * @brief 使用自定义的解压后端，传入nullptr时恢复默认，设置过的自定义后端会保留到进程结束
+ */
+void setDecompressor(std::shared_ptr<const NPKDecompressor> decompressor);
+} // neapu
+
+#endif //NPKDECOMPRESSOR_H
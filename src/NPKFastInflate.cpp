@@ -0,0 +1,613 @@
+//
+// Created by liu86 on 24-8-9.
+//
+
+#include "NPKFastInflate.h"
+#include "NPKInflate.h"
+#include <cstring>
+#include <memory>
+#include <zlib.h>
+
+namespace neapu {
+namespace {
+// 哈夫曼表项：低8位为码长，8-11位为额外位数（子表项为子表位数），12-14位为类型，高16位为值
+enum EntryKind: uint32_t {
+    EK_LITERAL = 0x0000,
+    EK_LENGTH = 0x1000,
+    EK_END = 0x2000,
+    EK_SUBTABLE = 0x3000,
+    EK_INVALID = 0x4000
+};
+
+constexpr uint32_t KIND_MASK = 0x7000;
+constexpr uint32_t INVALID_ENTRY = EK_INVALID | 1;
+
+constexpr uint32_t MAX_CODE_BITS = 15;
+constexpr uint32_t LITLEN_SYMBOLS = 288;
+constexpr uint32_t DIST_SYMBOLS = 32;
+constexpr uint32_t CODELEN_SYMBOLS = 19;
+constexpr uint32_t LITLEN_TABLE_BITS = 9;
+constexpr uint32_t DIST_TABLE_BITS = 8;
+constexpr uint32_t CODELEN_TABLE_BITS = 7;
+// 每个根表项最多对应一个子表，子表大小不超过2^(15-根表位数)
+constexpr uint32_t LITLEN_TABLE_SIZE = (1 << LITLEN_TABLE_BITS) + LITLEN_SYMBOLS * (1 << (MAX_CODE_BITS - LITLEN_TABLE_BITS));
+constexpr uint32_t DIST_TABLE_SIZE = (1 << DIST_TABLE_BITS) + DIST_SYMBOLS * (1 << (MAX_CODE_BITS - DIST_TABLE_BITS));
+
+// 快速路径每次补充位缓冲后至少有56位，足够解码一个长度码、一个距离码及它们的额外位
+constexpr uint32_t FAST_OUTPUT_MARGIN = 258 + 8;
+
+constexpr uint16_t LENGTH_BASE[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195,
+                                    227, 258};
+constexpr uint8_t LENGTH_EXTRA[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t DIST_BASE[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+                                  4097, 6145, 8193, 12289, 16385, 24577};
+constexpr uint8_t DIST_EXTRA[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+constexpr uint8_t CODELEN_ORDER[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+constexpr struct ReversedByte {
+    uint8_t values[256];
+
+    constexpr ReversedByte()
+        : values()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t rev = 0;
+            for (uint32_t b = 0; b < 8; ++b) {
+                rev |= (i >> b & 1) << (7 - b);
+            }
+            values[i] = static_cast<uint8_t>(rev);
+        }
+    }
+
+    constexpr uint32_t operator[](const uint32_t i) const { return values[i]; }
+} REVERSED_BYTE;
+
+uint32_t litlenEntry(const uint32_t symbol)
+{
+    if (symbol < 256) {
+        return symbol << 16 | EK_LITERAL;
+    }
+    if (symbol == 256) {
+        return EK_END;
+    }
+    if (symbol < 257 + sizeof(LENGTH_BASE) / sizeof(LENGTH_BASE[0])) {
+        return static_cast<uint32_t>(LENGTH_BASE[symbol - 257]) << 16 | LENGTH_EXTRA[symbol - 257] << 8 | EK_LENGTH;
+    }
+    return EK_INVALID;
+}
+
+uint32_t distEntry(const uint32_t symbol)
+{
+    if (symbol < sizeof(DIST_BASE) / sizeof(DIST_BASE[0])) {
+        return static_cast<uint32_t>(DIST_BASE[symbol]) << 16 | DIST_EXTRA[symbol] << 8 | EK_LITERAL;
+    }
+    return EK_INVALID;
+}
+
+uint32_t codelenEntry(const uint32_t symbol)
+{
+    return symbol << 16 | EK_LITERAL;
+}
+
+/**
+ * @brief 按码长构建两级查表，根表用低tableBits位索引，更长的码放到子表
+ * @return 码长超额或不完整（单个1位码除外）时返回false，与zlib的判断一致
+ */
+bool buildTable(const uint8_t* lens, const uint32_t symbolCount, uint32_t (*entryOf)(uint32_t), const uint32_t tableBits,
+                uint32_t* table, const uint32_t tableSize, const bool allowIncomplete)
+{
+    uint32_t count[MAX_CODE_BITS + 1] = {};
+    uint32_t maxLen = 0;
+    for (uint32_t i = 0; i < symbolCount; ++i) {
+        count[lens[i]]++;
+        if (lens[i] > maxLen) {
+            maxLen = lens[i];
+        }
+    }
+    count[0] = 0;
+
+    int32_t left = 1;
+    for (uint32_t len = 1; len <= MAX_CODE_BITS; ++len) {
+        left = (left << 1) - static_cast<int32_t>(count[len]);
+        if (left < 0) {
+            return false;
+        }
+    }
+    if (left > 0 && maxLen > 0 && (!allowIncomplete || maxLen != 1)) {
+        return false;
+    }
+
+    uint32_t nextCode[MAX_CODE_BITS + 1] = {};
+    uint32_t code = 0;
+    for (uint32_t len = 1; len <= MAX_CODE_BITS; ++len) {
+        code = (code + count[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+
+    const uint32_t rootSize = 1U << tableBits;
+    const uint32_t rootMask = rootSize - 1;
+    if (left > 0) {
+        // 不完整的码表中没有对应码的位置解码时报错
+        for (uint32_t i = 0; i < rootSize; ++i) {
+            table[i] = INVALID_ENTRY;
+        }
+    }
+
+    // 码按位倒序存储，便于直接用位缓冲的低位索引
+    uint16_t reversed[LITLEN_SYMBOLS];
+    uint8_t subBits[1 << LITLEN_TABLE_BITS];
+    if (maxLen > tableBits) {
+        memset(subBits, 0, rootSize);
+    }
+    for (uint32_t i = 0; i < symbolCount; ++i) {
+        const uint32_t len = lens[i];
+        if (len == 0) {
+            continue;
+        }
+        const uint32_t c = nextCode[len]++;
+        const uint32_t rev = (REVERSED_BYTE[c & 0xFF] << 8 | REVERSED_BYTE[c >> 8]) >> (16 - len);
+        reversed[i] = static_cast<uint16_t>(rev);
+        if (len > tableBits && len - tableBits > subBits[rev & rootMask]) {
+            subBits[rev & rootMask] = static_cast<uint8_t>(len - tableBits);
+        }
+    }
+
+    uint32_t subOffset[1 << LITLEN_TABLE_BITS];
+    if (maxLen > tableBits) {
+        uint32_t used = rootSize;
+        for (uint32_t i = 0; i < rootSize; ++i) {
+            if (subBits[i] == 0) {
+                continue;
+            }
+            const uint32_t size = 1U << subBits[i];
+            if (used + size > tableSize) {
+                return false;
+            }
+            subOffset[i] = used;
+            table[i] = used << 16 | EK_SUBTABLE | subBits[i] << 8 | tableBits;
+            for (uint32_t j = 0; j < size; ++j) {
+                table[used + j] = INVALID_ENTRY;
+            }
+            used += size;
+        }
+    }
+
+    for (uint32_t i = 0; i < symbolCount; ++i) {
+        const uint32_t len = lens[i];
+        if (len == 0) {
+            continue;
+        }
+        const uint32_t entry = entryOf(i);
+        const uint32_t rev = reversed[i];
+        if (len <= tableBits) {
+            for (uint32_t j = rev; j < rootSize; j += 1U << len) {
+                table[j] = entry | len;
+            }
+        } else {
+            const uint32_t root = rev & rootMask;
+            const uint32_t subLen = len - tableBits;
+            for (uint32_t j = rev >> tableBits; j < 1U << subBits[root]; j += 1U << subLen) {
+                table[subOffset[root] + j] = entry | subLen;
+            }
+        }
+    }
+    return true;
+}
+
+typedef struct HuffmanTables {
+    uint32_t litlen[LITLEN_TABLE_SIZE];
+    uint32_t dist[DIST_TABLE_SIZE];
+} HuffmanTables;
+
+const HuffmanTables& fixedTables()
+{
+    static const HuffmanTables tables = [] {
+        HuffmanTables ret{};
+        uint8_t lens[LITLEN_SYMBOLS];
+        for (uint32_t i = 0; i < LITLEN_SYMBOLS; ++i) {
+            lens[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        }
+        buildTable(lens, LITLEN_SYMBOLS, litlenEntry, LITLEN_TABLE_BITS, ret.litlen, LITLEN_TABLE_SIZE, false);
+        for (uint32_t i = 0; i < DIST_SYMBOLS; ++i) {
+            lens[i] = 5;
+        }
+        buildTable(lens, DIST_SYMBOLS, distEntry, DIST_TABLE_BITS, ret.dist, DIST_TABLE_SIZE, false);
+        return ret;
+    }();
+    return tables;
+}
+
+// 动态哈夫曼表较大，每个线程第一次使用时分配一份
+thread_local std::unique_ptr<HuffmanTables> t_dynamicTables;
+
+typedef struct BitReader {
+    const uint8_t* in;
+    const uint8_t* end;
+    uint64_t buf;
+    uint32_t count;
+    uint32_t overrun; // 数据结束后补入的0字节数
+
+    void refill()
+    {
+        if (end - in >= 8) {
+            uint64_t word;
+            memcpy(&word, in, sizeof(word));
+            buf |= word << count;
+            in += (63 - count) >> 3;
+            count |= 56;
+            return;
+        }
+        while (count <= 56) {
+            if (in < end) {
+                buf |= static_cast<uint64_t>(*in++) << count;
+            } else {
+                overrun++;
+            }
+            count += 8;
+        }
+    }
+
+    uint32_t bits(const uint32_t n) const { return static_cast<uint32_t>(buf & ((1ULL << n) - 1)); }
+
+    void consume(const uint32_t n)
+    {
+        buf >>= n;
+        count -= n;
+    }
+
+    // 已经消耗了补入的0，说明数据不完整
+    bool exhausted() const { return overrun != 0 && overrun * 8 > count; }
+} BitReader;
+
+enum BlockResult: uint32_t {
+    BR_OK,
+    BR_EXHAUSTED,
+    BR_OVERFLOW,
+    BR_ERROR
+};
+
+uint32_t decodeSymbol(BitReader& br, const uint32_t* table, const uint32_t tableBits)
+{
+    uint32_t entry = table[br.bits(tableBits)];
+    if ((entry & KIND_MASK) == EK_SUBTABLE) {
+        br.consume(tableBits);
+        entry = table[(entry >> 16) + br.bits(entry >> 8 & 0xF)];
+    }
+    br.consume(entry & 0xFF);
+    return entry;
+}
+
+void copyMatch(uint8_t* out, const uint32_t length, const uint32_t distance)
+{
+    // 调用前保证输出空间足够，允许多写最多7字节，后续输出会覆盖
+    const uint8_t* from = out - distance;
+    uint8_t* stop = out + length;
+    if (distance >= 8) {
+        do {
+            memcpy(out, from, 8);
+            out += 8;
+            from += 8;
+        } while (out < stop);
+    } else if (distance == 1) {
+        memset(out, *from, length);
+    } else {
+        for (uint32_t i = 0; i < length; ++i) {
+            out[i] = from[i];
+        }
+    }
+}
+
+BlockResult inflateHuffmanBlock(BitReader& br, const HuffmanTables& tables, const uint8_t* outBegin, uint8_t*& out, uint8_t* outEnd)
+{
+    // 快速路径：输入至少还有8字节，补充位缓冲不会越界；输出空间足够，写入时不检查边界
+    while (br.end - br.in >= 8 && static_cast<uint64_t>(outEnd - out) >= FAST_OUTPUT_MARGIN) {
+        br.refill();
+        uint32_t entry = decodeSymbol(br, tables.litlen, LITLEN_TABLE_BITS);
+        uint32_t kind = entry & KIND_MASK;
+        if (kind == EK_LITERAL) {
+            *out++ = static_cast<uint8_t>(entry >> 16);
+            // 位缓冲中至少还剩41位，根表中的字面量可以再解码两个
+            entry = tables.litlen[br.bits(LITLEN_TABLE_BITS)];
+            if ((entry & KIND_MASK) == EK_LITERAL) {
+                br.consume(entry & 0xFF);
+                *out++ = static_cast<uint8_t>(entry >> 16);
+                entry = tables.litlen[br.bits(LITLEN_TABLE_BITS)];
+                if ((entry & KIND_MASK) == EK_LITERAL) {
+                    br.consume(entry & 0xFF);
+                    *out++ = static_cast<uint8_t>(entry >> 16);
+                }
+            }
+            continue;
+        }
+        if (kind != EK_LENGTH) {
+            return kind == EK_END ? BR_OK : BR_ERROR;
+        }
+
+        const uint32_t length = (entry >> 16) + br.bits(entry >> 8 & 0xF);
+        br.consume(entry >> 8 & 0xF);
+        entry = decodeSymbol(br, tables.dist, DIST_TABLE_BITS);
+        kind = entry & KIND_MASK;
+        const uint32_t distance = (entry >> 16) + br.bits(entry >> 8 & 0xF);
+        br.consume(entry >> 8 & 0xF);
+        if (kind != EK_LITERAL || distance > static_cast<uint64_t>(out - outBegin)) {
+            return BR_ERROR;
+        }
+        copyMatch(out, length, distance);
+        out += length;
+    }
+
+    // 接近输入或输出结尾时逐个符号检查
+    for (;;) {
+        br.refill();
+        const uint32_t entry = decodeSymbol(br, tables.litlen, LITLEN_TABLE_BITS);
+        const uint32_t kind = entry & KIND_MASK;
+        if (kind == EK_LITERAL) {
+            if (br.exhausted()) {
+                return BR_EXHAUSTED;
+            }
+            if (out == outEnd) {
+                return BR_OVERFLOW;
+            }
+            *out++ = static_cast<uint8_t>(entry >> 16);
+            continue;
+        }
+        if (kind != EK_LENGTH) {
+            if (br.exhausted()) {
+                return BR_EXHAUSTED;
+            }
+            return kind == EK_END ? BR_OK : BR_ERROR;
+        }
+
+        const uint32_t length = (entry >> 16) + br.bits(entry >> 8 & 0xF);
+        br.consume(entry >> 8 & 0xF);
+        const uint32_t distEntry = decodeSymbol(br, tables.dist, DIST_TABLE_BITS);
+        const uint32_t distance = (distEntry >> 16) + br.bits(distEntry >> 8 & 0xF);
+        br.consume(distEntry >> 8 & 0xF);
+        if (br.exhausted()) {
+            return BR_EXHAUSTED;
+        }
+        if ((distEntry & KIND_MASK) != EK_LITERAL || distance > static_cast<uint64_t>(out - outBegin)) {
+            return BR_ERROR;
+        }
+
+        const uint64_t room = static_cast<uint64_t>(outEnd - out);
+        if (room >= static_cast<uint64_t>(length) + 8) {
+            copyMatch(out, length, distance);
+            out += length;
+            continue;
+        }
+        const uint8_t* from = out - distance;
+        const uint32_t copy = length < room ? length : static_cast<uint32_t>(room);
+        for (uint32_t i = 0; i < copy; ++i) {
+            out[i] = from[i];
+        }
+        out += copy;
+        if (copy < length) {
+            return BR_OVERFLOW;
+        }
+    }
+}
+
+BlockResult readDynamicTables(BitReader& br, HuffmanTables& tables)
+{
+    br.refill();
+    const uint32_t litlenCount = br.bits(5) + 257;
+    const uint32_t distCount = (br.bits(10) >> 5) + 1;
+    const uint32_t codelenCount = (br.bits(14) >> 10) + 4;
+    br.consume(14);
+    if (litlenCount > 286 || distCount > 30) {
+        return br.exhausted() ? BR_EXHAUSTED : BR_ERROR;
+    }
+
+    uint8_t codelenLens[CODELEN_SYMBOLS] = {};
+    for (uint32_t i = 0; i < codelenCount; ++i) {
+        br.refill();
+        codelenLens[CODELEN_ORDER[i]] = static_cast<uint8_t>(br.bits(3));
+        br.consume(3);
+    }
+    if (br.exhausted()) {
+        return BR_EXHAUSTED;
+    }
+    uint32_t codelenTable[1 << CODELEN_TABLE_BITS];
+    if (!buildTable(codelenLens, CODELEN_SYMBOLS, codelenEntry, CODELEN_TABLE_BITS, codelenTable, 1 << CODELEN_TABLE_BITS, false)) {
+        return BR_ERROR;
+    }
+
+    uint8_t lens[LITLEN_SYMBOLS + DIST_SYMBOLS] = {};
+    const uint32_t total = litlenCount + distCount;
+    for (uint32_t i = 0; i < total;) {
+        br.refill();
+        const uint32_t entry = decodeSymbol(br, codelenTable, CODELEN_TABLE_BITS);
+        if ((entry & KIND_MASK) != EK_LITERAL) {
+            return br.exhausted() ? BR_EXHAUSTED : BR_ERROR;
+        }
+        const uint32_t symbol = entry >> 16;
+        if (symbol < 16) {
+            lens[i++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+
+        uint8_t value = 0;
+        uint32_t repeat;
+        if (symbol == 16) {
+            if (i == 0) {
+                return br.exhausted() ? BR_EXHAUSTED : BR_ERROR;
+            }
+            value = lens[i - 1];
+            repeat = 3 + br.bits(2);
+            br.consume(2);
+        } else if (symbol == 17) {
+            repeat = 3 + br.bits(3);
+            br.consume(3);
+        } else {
+            repeat = 11 + br.bits(7);
+            br.consume(7);
+        }
+        if (br.exhausted()) {
+            return BR_EXHAUSTED;
+        }
+        if (i + repeat > total) {
+            return BR_ERROR;
+        }
+        memset(lens + i, value, repeat);
+        i += repeat;
+    }
+    if (br.exhausted()) {
+        return BR_EXHAUSTED;
+    }
+    if (lens[256] == 0) {
+        return BR_ERROR;
+    }
+
+    // 距离码只在lens的后半部分，先拷贝出来，litlen表只用前litlenCount个码长
+    uint8_t distLens[DIST_SYMBOLS] = {};
+    memcpy(distLens, lens + litlenCount, distCount);
+    memset(lens + litlenCount, 0, distCount);
+    if (!buildTable(lens, LITLEN_SYMBOLS, litlenEntry, LITLEN_TABLE_BITS, tables.litlen, LITLEN_TABLE_SIZE, true) ||
+        !buildTable(distLens, DIST_SYMBOLS, distEntry, DIST_TABLE_BITS, tables.dist, DIST_TABLE_SIZE, true)) {
+        return BR_ERROR;
+    }
+    return BR_OK;
+}
+
+BlockResult inflateStoredBlock(BitReader& br, uint8_t*& out, uint8_t* outEnd)
+{
+    // 对齐到字节后，把位缓冲中还没使用的整字节退回输入
+    br.consume(br.count & 7);
+    const uint32_t buffered = br.count >> 3;
+    if (br.overrun >= buffered) {
+        br.in = br.end;
+    } else {
+        br.in -= buffered - br.overrun;
+    }
+    br.buf = 0;
+    br.count = 0;
+    br.overrun = 0;
+
+    if (br.end - br.in < 4) {
+        br.in = br.end;
+        return BR_EXHAUSTED;
+    }
+    const uint32_t len = br.in[0] | br.in[1] << 8;
+    const uint32_t nlen = br.in[2] | br.in[3] << 8;
+    br.in += 4;
+    if (len != (~nlen & 0xFFFF)) {
+        return BR_ERROR;
+    }
+
+    const uint64_t available = static_cast<uint64_t>(br.end - br.in);
+    const uint64_t room = static_cast<uint64_t>(outEnd - out);
+    uint64_t copy = len < available ? len : available;
+    const bool overflow = copy > room;
+    if (overflow) {
+        copy = room;
+    }
+    memcpy(out, br.in, copy);
+    out += copy;
+    br.in += copy;
+    if (overflow) {
+        return BR_OVERFLOW;
+    }
+    return copy < len ? BR_EXHAUSTED : BR_OK;
+}
+
+uint32_t adler32Of(const uint8_t* data, uint64_t len)
+{
+    uLong adler = adler32(0L, Z_NULL, 0);
+    while (len > 0) {
+        const uInt chunk = len > 0x40000000 ? 0x40000000 : static_cast<uInt>(len);
+        adler = adler32(adler, data, chunk);
+        data += chunk;
+        len -= chunk;
+    }
+    return static_cast<uint32_t>(adler);
+}
+}
+
+DecompressResult NPKFastInflate::decompress(const uint8_t* src, const uint64_t srcLen, const NPKDecompressTarget& target) const
+{
+    const uint64_t outputSize = target.rowSize * target.rowCount;
+    if (target.skip == 0 && (target.rowCount <= 1 || target.stride == target.rowSize)) {
+        return inflate(src, srcLen, target.data, outputSize);
+    }
+
+    // 匹配串可能引用已输出的任意位置，输出不连续时先解压到临时缓冲区再按行拷贝
+    NPKScratchBuffer buffer(target.skip + outputSize);
+    const DecompressResult ret = inflate(src, srcLen, buffer.data(), buffer.size());
+    if (ret == DR_ERROR) {
+        return ret;
+    }
+    for (uint32_t i = 0; i < target.rowCount; ++i) {
+        memcpy(target.data + i * target.stride, buffer.data() + target.skip + i * target.rowSize, target.rowSize);
+    }
+    return ret;
+}
+
+DecompressResult NPKFastInflate::inflate(const uint8_t* src, const uint64_t srcLen, uint8_t* dst, const uint64_t dstLen)
+{
+    uint8_t* out = dst;
+    uint8_t* const outEnd = dst + dstLen;
+    BlockResult ret = BR_EXHAUSTED;
+
+    // zlib头：压缩方法为deflate，窗口不超过32K，不使用预设字典
+    if (srcLen >= 2) {
+        const uint32_t header = src[0] << 8 | src[1];
+        if ((src[0] & 0x0F) != Z_DEFLATED || (src[0] >> 4) > 7 || header % 31 != 0 || (src[1] & 0x20) != 0) {
+            return DR_ERROR;
+        }
+
+        BitReader br{src + 2, src + srcLen, 0, 0, 0};
+        auto& dynamicTables = t_dynamicTables;
+        bool lastBlock = false;
+        do {
+            br.refill();
+            lastBlock = br.bits(1) != 0;
+            const uint32_t type = br.bits(3) >> 1;
+            br.consume(3);
+            if (br.exhausted()) {
+                ret = BR_EXHAUSTED;
+                break;
+            }
+            if (type == 0) {
+                ret = inflateStoredBlock(br, out, outEnd);
+            } else if (type == 1) {
+                ret = inflateHuffmanBlock(br, fixedTables(), dst, out, outEnd);
+            } else if (type == 2) {
+                if (!dynamicTables) {
+                    dynamicTables = std::make_unique<HuffmanTables>();
+                }
+                ret = readDynamicTables(br, *dynamicTables);
+                if (ret == BR_OK) {
+                    ret = inflateHuffmanBlock(br, *dynamicTables, dst, out, outEnd);
+                }
+            } else {
+                ret = BR_ERROR;
+            }
+        } while (ret == BR_OK && !lastBlock);
+
+        if (ret == BR_OK) {
+            // 数据结尾的adler32校验，数据不完整时不检查
+            br.consume(br.count & 7);
+            br.refill();
+            const uint32_t trailer = br.bits(32);
+            br.consume(32);
+            const uint32_t expected = (trailer & 0xFF) << 24 | (trailer & 0xFF00) << 8 | (trailer >> 8 & 0xFF00) | trailer >> 24;
+            if (!br.exhausted() && expected != adler32Of(dst, out - dst)) {
+                return DR_ERROR;
+            }
+        }
+    }
+
+    if (ret == BR_ERROR) {
+        return DR_ERROR;
+    }
+    if (ret == BR_OVERFLOW) {
+        return DR_OVERFLOW;
+    }
+    if (out == outEnd) {
+        return DR_OK;
+    }
+    memset(out, 0, outEnd - out);
+    return DR_TRUNCATED;
+}
+} // neapu
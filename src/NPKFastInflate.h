@@ -0,0 +1,35 @@
+//
+// Created by liu86 on 24-8-9.
+//
+
+#ifndef NPKFASTINFLATE_H
+#define NPKFASTINFLATE_H
+#include "NPKDecompressor.h"
+
+namespace neapu {
+/**
+ * @brief 内置的inflate实现，针对输出大小已知的数据
+ *
+ * 一次解码整个zlib数据到输出缓冲区，使用64位位缓冲和两级查表的哈夫曼解码，
+ * 输出空间足够时按8字节复制匹配串，不需要维护滑动窗口。
+ * 数据提前结束、输出写满、校验失败时的结果与NPKZlibDecompressor一致。
+ */
+class NPKFastInflate : public NPKDecompressor {
+public:
+    const char* name() const override { return "fast"; }
+    DecompressResult decompress(const uint8_t* src, uint64_t srcLen, const NPKDecompressTarget& target) const override;
+    using NPKDecompressor::decompress;
+
+    /**
+     * @brief 解压到连续的缓冲区
+     * @param src zlib格式的数据
+     * @param srcLen 数据长度
+     * @param dst 输出缓冲区
+     * @param dstLen 输出大小
+     * @return 解压结果
+     */
+    static DecompressResult inflate(const uint8_t* src, uint64_t srcLen, uint8_t* dst, uint64_t dstLen);
+};
+} // neapu
+
+#endif //NPKFASTINFLATE_H
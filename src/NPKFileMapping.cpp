@@ -0,0 +1,157 @@
+//
+// Created by liu86 on 24-8-3.
+//
+
+#include "NPKFileMapping.h"
+#include <algorithm>
+#include "logger.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace neapu {
+NPKFileMapping::~NPKFileMapping()
+{
+    close();
+}
+
+#ifdef _WIN32
+bool NPKFileMapping::open(const std::string& path)
+{
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        LOG_ERROR << "Failed to open file: " << path;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        LOG_ERROR << "Failed to get file size: " << path;
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        LOG_ERROR << "Failed to create file mapping: " << path;
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        LOG_ERROR << "Failed to map view of file: " << path;
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = fileSize.QuadPart;
+    return true;
+}
+
+void NPKFileMapping::close()
+{
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = nullptr;
+    m_size = 0;
+}
+
+void NPKFileMapping::advise(uint64_t offset, uint64_t length, MappingAdvice advice) const
+{
+    // Windows没有与madvise对应的接口，只有预读可以通过PrefetchVirtualMemory实现
+    if (!m_data || offset >= m_size || advice != MA_WILLNEED) {
+        return;
+    }
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<uint8_t*>(m_data + offset);
+    range.NumberOfBytes = static_cast<SIZE_T>(std::min(length, m_size - offset));
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+#else
+bool NPKFileMapping::open(const std::string& path)
+{
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR << "Failed to open file: " << path;
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        LOG_ERROR << "Failed to get file size: " << path;
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // 映射建立后文件描述符就不再需要了
+    if (view == MAP_FAILED) {
+        LOG_ERROR << "Failed to map file: " << path;
+        return false;
+    }
+
+    m_data = static_cast<const uint8_t*>(view);
+    m_size = st.st_size;
+    return true;
+}
+
+void NPKFileMapping::close()
+{
+    if (m_data) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
+
+void NPKFileMapping::advise(uint64_t offset, uint64_t length, MappingAdvice advice) const
+{
+    if (!m_data || offset >= m_size) {
+        return;
+    }
+
+    // madvise要求起始地址按页对齐
+    static const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    const uint64_t alignedOffset = offset / pageSize * pageSize;
+    const uint64_t alignedLength = std::min(length, m_size - offset) + (offset - alignedOffset);
+
+    int flag = MADV_NORMAL;
+    switch (advice) {
+    case MA_SEQUENTIAL: flag = MADV_SEQUENTIAL;
+        break;
+    case MA_RANDOM: flag = MADV_RANDOM;
+        break;
+    case MA_WILLNEED: flag = MADV_WILLNEED;
+        break;
+    default: break;
+    }
+    if (madvise(const_cast<uint8_t*>(m_data + alignedOffset), alignedLength, flag) != 0) {
+        LOG_DEBUG << "madvise failed. [offset:" << offset << "][length:" << length << "]";
+    }
+}
+#endif
+} // neapu
@@ -0,0 +1,58 @@
+//
+// Created by liu86 on 24-8-3.
+//
+
+#ifndef NPKFILEMAPPING_H
+#define NPKFILEMAPPING_H
+#include <cstdint>
+#include <string>
+
+namespace neapu {
+enum MappingAdvice: uint32_t {
+    MA_NORMAL = 0x00,
+    MA_SEQUENTIAL = 0x01, // 顺序访问，适合索引表解析
+    MA_RANDOM = 0x02,     // 随机访问，适合按需读取帧数据
+    MA_WILLNEED = 0x03    // 即将访问，提前预读
+};
+
+/**
+ * @brief 只读文件内存映射，映射的生命周期内data()指向的内存一直有效
+ */
+class NPKFileMapping {
+public:
+    NPKFileMapping() = default;
+    virtual ~NPKFileMapping();
+    NPKFileMapping(const NPKFileMapping&) = delete;
+    NPKFileMapping& operator=(const NPKFileMapping&) = delete;
+
+    /**
+     * @brief 以只读方式映射整个文件
+     * @param path 文件路径
+     * @return 成功返回true，失败返回false
+     */
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const uint8_t* data() const { return m_data; }
+    uint64_t size() const { return m_size; }
+
+    /**
+     * @brief 向系统提示接下来对某段映射内存的访问方式，失败时忽略
+     * @param offset 起始偏移
+     * @param length 长度，超出映射范围的部分会被截断
+     * @param advice 访问方式
+     */
+    void advise(uint64_t offset, uint64_t length, MappingAdvice advice) const;
+
+private:
+    const uint8_t* m_data{nullptr};
+    uint64_t m_size{0};
+#ifdef _WIN32
+    void* m_file{nullptr};
+    void* m_mapping{nullptr};
+#endif
+};
+} // neapu
+
+#endif //NPKFILEMAPPING_H
@@ -0,0 +1,129 @@
+//
+// Created by liu86 on 24-8-24.
+//
+
+#include "NPKFileReader.h"
+#include <algorithm>
+#include "logger.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace neapu {
+NPKFileReader::~NPKFileReader()
+{
+    close();
+}
+
+bool NPKFileReader::read(const uint64_t offset, const uint64_t length, uint8_t* dst) const
+{
+    if (!isOpen() || offset > m_size || length > m_size - offset) {
+        LOG_ERROR << "Read out of range. [offset:" << offset << "][length:" << length << "][size:" << m_size << "]";
+        return false;
+    }
+    uint64_t done = 0;
+    while (done < length) {
+        const int64_t len = readAt(offset + done, length - done, dst + done);
+        if (len <= 0) {
+            LOG_ERROR << "Failed to read file. [offset:" << offset + done << "][length:" << length - done << "]";
+            return false;
+        }
+        done += len;
+    }
+    return true;
+}
+
+#ifdef _WIN32
+bool NPKFileReader::open(const std::string& path)
+{
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        LOG_ERROR << "Failed to open file: " << path;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        LOG_ERROR << "Failed to get file size: " << path;
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_size = fileSize.QuadPart;
+    return true;
+}
+
+void NPKFileReader::close()
+{
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+    m_file = nullptr;
+    m_size = 0;
+}
+
+int64_t NPKFileReader::readAt(const uint64_t offset, const uint64_t length, uint8_t* dst) const
+{
+    // 同步句柄上带OVERLAPPED的ReadFile从指定偏移读取，不使用也不改变共享的文件指针
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD len = 0;
+    const DWORD request = static_cast<DWORD>(std::min<uint64_t>(length, 0x40000000));
+    if (!ReadFile(m_file, dst, request, &len, &overlapped)) {
+        return -1;
+    }
+    return len;
+}
+#else
+bool NPKFileReader::open(const std::string& path)
+{
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR << "Failed to open file: " << path;
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        LOG_ERROR << "Failed to get file size: " << path;
+        ::close(fd);
+        return false;
+    }
+
+    m_fd = fd;
+    m_size = st.st_size;
+    return true;
+}
+
+void NPKFileReader::close()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+    m_size = 0;
+}
+
+int64_t NPKFileReader::readAt(const uint64_t offset, const uint64_t length, uint8_t* dst) const
+{
+    // pread不使用也不改变共享的文件偏移，多个线程可以同时读取
+    ssize_t len = 0;
+    do {
+        len = pread(m_fd, dst, std::min<uint64_t>(length, 0x40000000), static_cast<off_t>(offset));
+    } while (len < 0 && errno == EINTR);
+    return len;
+}
+#endif
+} // neapu
@@ -0,0 +1,62 @@
+//
+// Created by liu86 on 24-8-24.
+//
+
+#ifndef NPKFILEREADER_H
+#define NPKFILEREADER_H
+#include <cstdint>
+#include <string>
+
+namespace neapu {
+/**
+ * @brief 只读打开的文件，按偏移读取其中一段，不映射也不缓存文件数据
+ *
+ * 读取使用pread（Windows为带OVERLAPPED的ReadFile），不依赖共享的文件偏移，多个线程可以同时读取而不需要加锁。
+ * 打开期间占用一个文件描述符，析构时关闭。
+ */
+class NPKFileReader {
+public:
+    NPKFileReader() = default;
+    virtual ~NPKFileReader();
+    NPKFileReader(const NPKFileReader&) = delete;
+    NPKFileReader& operator=(const NPKFileReader&) = delete;
+
+    /**
+     * @brief 以只读方式打开文件并获取大小
+     * @param path 文件路径
+     * @return 成功返回true，失败返回false
+     */
+    bool open(const std::string& path);
+    void close();
+
+#ifdef _WIN32
+    bool isOpen() const { return m_file != nullptr; }
+#else
+    bool isOpen() const { return m_fd >= 0; }
+#endif
+    uint64_t size() const { return m_size; }
+
+    /**
+     * @brief 读取[offset, offset + length)，可多线程同时调用，不能与open、close同时调用
+     * @param offset 起始偏移
+     * @param length 长度
+     * @param dst 输出，至少length字节
+     * @return 范围超出文件或读取失败返回false
+     */
+    bool read(uint64_t offset, uint64_t length, uint8_t* dst) const;
+
+private:
+    // 从offset开始读取一次，返回读取的长度，失败返回-1
+    int64_t readAt(uint64_t offset, uint64_t length, uint8_t* dst) const;
+
+private:
+    uint64_t m_size{0};
+#ifdef _WIN32
+    void* m_file{nullptr};
+#else
+    int m_fd{-1};
+#endif
+};
+} // neapu
+
+#endif //NPKFILEREADER_H
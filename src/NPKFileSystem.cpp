@@ -0,0 +1,266 @@
+//
+// Created by liu86 on 24-8-17.
+//
+
+#include "NPKFileSystem.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "logger.h"
+#include "NPKImageHandler.h"
+#ifndef _WIN32
+#define fopen_s(pFile, filename, mode) (((*(pFile)) = fopen((filename), (mode))) == NULL)
+#endif
+
+namespace neapu {
+NPKFileSystem::NPKFileSystem(const NPKLoadOptions& options)
+    : m_options(options)
+{
+}
+
+bool NPKFileSystem::mount(const std::string& path, const int32_t priority)
+{
+    std::vector<std::string> names;
+    if (!readNames(path, names)) {
+        return false;
+    }
+
+    auto pack = std::make_unique<Pack>();
+    pack->path = path;
+    pack->priority = priority;
+    pack->imageCount = static_cast<uint32_t>(names.size());
+
+    std::unique_lock lock(m_mutex);
+    const auto packIndex = static_cast<uint32_t>(m_packs.size());
+    for (uint32_t i = 0; i < names.size(); ++i) {
+        const int64_t id = m_names.find(names[i]);
+        if (id < 0) {
+            m_names.add(names[i]);
+            m_locations.push_back(NPKImageLocation{packIndex, i});
+            continue;
+        }
+        // 优先级相同时后挂载的覆盖，同一个NPK中的重复名称保留第一个
+        auto& location = m_locations[id];
+        if (location.pack != packIndex && priority >= m_packs[location.pack]->priority) {
+            location = NPKImageLocation{packIndex, i};
+        }
+    }
+    m_packs.push_back(std::move(pack));
+    return true;
+}
+
+uint32_t NPKFileSystem::mount(const std::vector<std::string>& paths, const int32_t priority)
+{
+    uint32_t count = 0;
+    for (const auto& path : paths) {
+        if (mount(path, priority)) {
+            count++;
+        } else {
+            LOG_WARNING << "Failed to mount: " << path;
+        }
+    }
+    return count;
+}
+
+uint32_t NPKFileSystem::mountDirectory(const std::string& directory, const int32_t priority, const bool recursive)
+{
+    std::vector<std::filesystem::path> paths;
+    auto collect = [&paths](const std::filesystem::directory_entry& entry) {
+        if (!entry.is_regular_file()) {
+            return;
+        }
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](const char c) { return static_cast<char>(tolower(c)); });
+        if (extension == ".npk") {
+            paths.push_back(entry.path());
+        }
+    };
+    std::error_code ec;
+    if (recursive) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, ec)) {
+            collect(entry);
+        }
+    } else {
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            collect(entry);
+        }
+    }
+    if (ec) {
+        LOG_ERROR << "Failed to read directory: " << directory << " " << ec.message();
+        return 0;
+    }
+
+    // 目录遍历的顺序与平台有关，排序后覆盖关系才是确定的
+    std::sort(paths.begin(), paths.end());
+    std::vector<std::string> files;
+    files.reserve(paths.size());
+    for (const auto& path : paths) {
+        files.push_back(path.string());
+    }
+    return mount(files, priority);
+}
+
+uint32_t NPKFileSystem::getPackCount() const
+{
+    std::shared_lock lock(m_mutex);
+    return static_cast<uint32_t>(m_packs.size());
+}
+
+std::string NPKFileSystem::getPackPath(const uint32_t pack) const
+{
+    std::shared_lock lock(m_mutex);
+    return pack < m_packs.size() ? m_packs[pack]->path : std::string{};
+}
+
+uint32_t NPKFileSystem::getImageCount() const
+{
+    std::shared_lock lock(m_mutex);
+    return m_names.size();
+}
+
+bool NPKFileSystem::find(const std::string_view name, NPKImageLocation& location) const
+{
+    std::shared_lock lock(m_mutex);
+    const int64_t id = m_names.find(name);
+    if (id < 0) {
+        return false;
+    }
+    location = m_locations[id];
+    return true;
+}
+
+std::vector<std::string> NPKFileSystem::findImages(const std::string_view prefix) const
+{
+    std::shared_lock lock(m_mutex);
+    std::vector<std::string> result;
+    for (const auto id : m_names.findPrefix(prefix)) {
+        result.push_back(m_names.name(id));
+    }
+    return result;
+}
+
+std::shared_ptr<NPKImageHandler> NPKFileSystem::getImage(const std::string_view name) const
+{
+    NPKImageLocation location;
+    if (!find(name, location)) {
+        return nullptr;
+    }
+    const auto pack = getPack(location.pack);
+    return pack ? pack->getImage(location.image) : nullptr;
+}
+
+std::shared_ptr<NPKHandler> NPKFileSystem::getPack(const uint32_t pack) const
+{
+    Pack* entry = nullptr;
+    {
+        std::shared_lock lock(m_mutex);
+        if (pack >= m_packs.size()) {
+            return nullptr;
+        }
+        entry = m_packs[pack].get();
+    }
+
+    // 挂载的NPK不会移除，加载时只锁住这一个NPK
+    entry->lastAccess = now();
+    std::lock_guard lock(entry->mutex);
+    if (!entry->handler) {
+        auto handler = std::make_shared<NPKHandler>();
+        if (!handler->loadNPK(entry->path, m_options)) {
+            LOG_ERROR << "Failed to load mounted NPK: " << entry->path;
+            return nullptr;
+        }
+        // 挂载后文件被替换时名称表已经不可信
+        if (handler->getImageCount() != entry->imageCount) {
+            LOG_ERROR << "Mounted NPK has changed: " << entry->path;
+            return nullptr;
+        }
+        entry->handler = handler;
+    }
+    return entry->handler;
+}
+
+uint32_t NPKFileSystem::closeIdlePacks(const std::chrono::milliseconds idleTime)
+{
+    std::vector<Pack*> packs;
+    {
+        std::shared_lock lock(m_mutex);
+        for (const auto& pack : m_packs) {
+            packs.push_back(pack.get());
+        }
+    }
+
+    const int64_t deadline = now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(idleTime).count();
+    uint32_t count = 0;
+    for (auto* pack : packs) {
+        std::lock_guard lock(pack->mutex);
+        if (pack->handler && pack->lastAccess <= deadline) {
+            pack->handler.reset();
+            count++;
+        }
+    }
+    return count;
+}
+
+uint32_t NPKFileSystem::getOpenPackCount() const
+{
+    std::shared_lock lock(m_mutex);
+    uint32_t count = 0;
+    for (const auto& pack : m_packs) {
+        std::lock_guard packLock(pack->mutex);
+        count += pack->handler ? 1 : 0;
+    }
+    return count;
+}
+
+bool NPKFileSystem::readNames(const std::string& path, std::vector<std::string>& names)
+{
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), "rb") != 0) {
+        LOG_ERROR << "Failed to open file: " << path;
+        return false;
+    }
+
+    NPKHeader header{};
+    static constexpr char magic[] = "NeoplePack_Bill";
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, magic, sizeof(magic)) != 0) {
+        LOG_ERROR << "Magic is not correct: " << path;
+        fclose(file);
+        return false;
+    }
+
+    // 先按文件大小检查数量，损坏的文件头不能导致超大的分配
+    _fseeki64(file, 0, SEEK_END);
+    const int64_t fileSize = _ftelli64(file);
+    _fseeki64(file, sizeof(header), SEEK_SET);
+    if (fileSize < 0 || sizeof(NPKHeader) + static_cast<uint64_t>(header.imgCount) * sizeof(NPKImageIndex) > static_cast<uint64_t>(fileSize)) {
+        LOG_ERROR << "Index table is out of range: " << path << " [imgCount:" << header.imgCount << "][fileSize:" << fileSize << "]";
+        fclose(file);
+        return false;
+    }
+
+    // 索引表一次读出
+    std::vector<NPKImageIndex> indexes(header.imgCount);
+    const size_t readCount = fread(indexes.data(), sizeof(NPKImageIndex), indexes.size(), file);
+    fclose(file);
+    if (readCount != indexes.size()) {
+        LOG_ERROR << "Index table is out of range: " << path;
+        return false;
+    }
+
+    names.clear();
+    names.reserve(indexes.size());
+    for (auto& index : indexes) {
+        char temp[sizeof(index.name) + 1]{};
+        memcpy(temp, index.name, sizeof(index.name));
+        NPKImageHandler::maskName(temp);
+        names.emplace_back(temp);
+    }
+    return true;
+}
+
+int64_t NPKFileSystem::now()
+{
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+} // neapu
@@ -0,0 +1,123 @@
+//
+// Created by liu86 on 24-8-17.
+//
+
+#ifndef NPKFILESYSTEM_H
+#define NPKFILESYSTEM_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKNameIndex.h"
+
+namespace neapu {
+class NPKImageHandler;
+
+typedef struct NPKImageLocation {
+    uint32_t pack = 0;  // 挂载编号，按挂载顺序
+    uint32_t image = 0; // Image在NPK中的索引
+} NPKImageLocation;
+
+/**
+ * @brief 把多个NPK合并为一个名称空间
+ *
+ * 挂载时只读取每个NPK的索引表，合并成一张名称到(NPK, Image)的表，按名称查找只需要一次哈希查找。
+ * 同名的Image按优先级覆盖：优先级高的NPK覆盖优先级低的，优先级相同时后挂载的覆盖先挂载的。
+ * NPK在第一次访问其中的Image时才加载，长时间未访问的NPK可以关闭，之后访问时重新加载。
+ * 所有方法都可以多线程调用。
+ */
+class NPKFileSystem {
+public:
+    explicit NPKFileSystem(const NPKLoadOptions& options = {});
+    virtual ~NPKFileSystem() = default;
+    NPKFileSystem(const NPKFileSystem&) = delete;
+    NPKFileSystem& operator=(const NPKFileSystem&) = delete;
+
+    /**
+     * @brief 挂载一个NPK
+     * @param path NPK文件路径
+     * @param priority 优先级，越大越优先
+     * @return 无法读取索引表返回false
+     */
+    bool mount(const std::string& path, int32_t priority = 0);
+    /**
+     * @brief 按顺序挂载多个NPK，失败的文件跳过
+     * @return 挂载成功的数量
+     */
+    uint32_t mount(const std::vector<std::string>& paths, int32_t priority = 0);
+    /**
+     * @brief 挂载目录中所有扩展名为.npk（不区分大小写）的文件，按文件名排序后依次挂载
+     * @param directory 目录
+     * @param priority 优先级
+     * @param recursive 是否包括子目录，子目录中的文件按相对路径排序
+     * @return 挂载成功的数量
+     */
+    uint32_t mountDirectory(const std::string& directory, int32_t priority = 0, bool recursive = false);
+
+    uint32_t getPackCount() const;
+    std::string getPackPath(uint32_t pack) const;
+    // 合并后的Image数量，同名的Image只计算一次
+    uint32_t getImageCount() const;
+
+    /**
+     * @brief 按完整名称查找，不会加载NPK
+     * @return 不存在返回false
+     */
+    bool find(std::string_view name, NPKImageLocation& location) const;
+    /**
+     * @brief 查找名称以prefix开头的Image，不会加载NPK
+     * @return 按名称排序的完整名称
+     */
+    std::vector<std::string> findImages(std::string_view prefix) const;
+    /**
+     * @brief 按完整名称获取Image，所在的NPK未加载时先加载
+     * @return 不存在或加载失败返回nullptr
+     */
+    std::shared_ptr<NPKImageHandler> getImage(std::string_view name) const;
+    /**
+     * @brief 获取已挂载的NPK，未加载时先加载
+     * @return 编号无效或加载失败返回nullptr
+     */
+    std::shared_ptr<NPKHandler> getPack(uint32_t pack) const;
+
+    /**
+     * @brief 关闭超过idleTime未访问的NPK，已获取的Image不受影响
+     * @return 关闭的数量
+     */
+    uint32_t closeIdlePacks(std::chrono::milliseconds idleTime);
+    uint32_t getOpenPackCount() const;
+
+private:
+    typedef struct Pack {
+        std::string path;
+        int32_t priority = 0;
+        uint32_t imageCount = 0;
+        std::mutex mutex; // 保护handler的加载与关闭
+        std::shared_ptr<NPKHandler> handler{nullptr};
+        std::atomic<int64_t> lastAccess{0};
+    } Pack;
+
+    /**
+     * @brief 只读取NPK文件头和索引表中的名称
+     * @return 文件无法读取或格式错误返回false
+     */
+    static bool readNames(const std::string& path, std::vector<std::string>& names);
+    static int64_t now();
+
+private:
+    NPKLoadOptions m_options;
+    mutable std::shared_mutex m_mutex; // 保护挂载表，加载NPK时不持有
+    std::vector<std::unique_ptr<Pack>> m_packs;
+    NPKNameIndex m_names;
+    std::vector<NPKImageLocation> m_locations; // 与m_names的名称编号一一对应
+};
+} // neapu
+
+#endif //NPKFILESYSTEM_H
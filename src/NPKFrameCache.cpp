@@ -0,0 +1,317 @@
+//
+// Created by liu86 on 24-8-5.
+//
+
+#include "NPKFrameCache.h"
+#include <algorithm>
+#include "NPKMatrix.h"
+
+namespace neapu {
+namespace {
+constexpr uint64_t MATRIX_OVERHEAD = sizeof(NPKMatrix) + 64; // 对象本身与控制块的大致开销
+constexpr uint32_t SKETCH_DEPTH = 4;
+constexpr uint32_t SKETCH_MAX_COUNT = 15;
+
+uint64_t mixHash(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+}
+
+NPKFrameCache::NPKFrameCache(const uint64_t capacity, std::unique_ptr<NPKCachePolicy> policy)
+    : m_capacity(capacity), m_policy(std::move(policy))
+{
+    if (!m_policy) {
+        m_policy = std::make_unique<NPKLruPolicy>(capacity);
+    }
+    m_stats.capacity = capacity;
+}
+
+std::unique_ptr<NPKCachePolicy> NPKFrameCache::createPolicy(const FrameCachePolicy policy, const uint64_t capacity)
+{
+    if (policy == FCP_TINYLFU) {
+        return std::make_unique<NPKTinyLfuPolicy>(capacity);
+    }
+    return std::make_unique<NPKLruPolicy>(capacity);
+}
+
+uint64_t NPKFrameCache::matrixSize(const NPKMatrix& matrix)
+{
+    return static_cast<uint64_t>(matrix.canvasWidth()) * matrix.canvasHeight() * sizeof(NPKColor) + MATRIX_OVERHEAD;
+}
+
+std::shared_ptr<NPKMatrix> NPKFrameCache::get(const NPKFrameKey& key)
+{
+    std::lock_guard lock(m_mutex);
+    m_policy->onAccess(key);
+    const auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        m_stats.misses++;
+        return nullptr;
+    }
+    m_stats.hits++;
+    m_policy->onHit(key);
+    return it->second.matrix;
+}
+
+void NPKFrameCache::put(const NPKFrameKey& key, const std::shared_ptr<NPKMatrix>& matrix)
+{
+    if (!matrix) {
+        return;
+    }
+
+    std::lock_guard lock(m_mutex);
+    if (m_entries.find(key) != m_entries.end()) {
+        return; // 多个线程同时解码了同一帧，保留先放入的
+    }
+
+    const uint64_t size = matrixSize(*matrix);
+    std::vector<NPKFrameKey> evicted;
+    m_policy->onInsert(key, size, evicted);
+
+    bool admitted = true;
+    for (const auto& victim : evicted) {
+        if (victim == key) {
+            admitted = false;
+            m_stats.rejections++;
+            continue;
+        }
+        const auto it = m_entries.find(victim);
+        if (it != m_entries.end()) {
+            m_stats.bytes -= it->second.size;
+            m_entries.erase(it);
+            m_stats.evictions++;
+        }
+    }
+
+    if (admitted) {
+        m_entries[key] = Entry{matrix, size};
+        m_stats.bytes += size;
+        m_stats.insertions++;
+    }
+    m_stats.entries = m_entries.size();
+}
+
+void NPKFrameCache::clear()
+{
+    std::lock_guard lock(m_mutex);
+    m_entries.clear();
+    m_policy->clear();
+    m_stats.bytes = 0;
+    m_stats.entries = 0;
+}
+
+NPKFrameCacheStats NPKFrameCache::stats() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_stats;
+}
+
+NPKLruPolicy::NPKLruPolicy(const uint64_t capacity)
+    : m_capacity(capacity)
+{
+}
+
+void NPKLruPolicy::onHit(const NPKFrameKey& key)
+{
+    const auto it = m_nodes.find(key);
+    if (it != m_nodes.end()) {
+        m_order.splice(m_order.begin(), m_order, it->second.pos);
+    }
+}
+
+void NPKLruPolicy::onInsert(const NPKFrameKey& key, const uint64_t size, std::vector<NPKFrameKey>& evicted)
+{
+    if (size > m_capacity) {
+        evicted.push_back(key);
+        return;
+    }
+
+    m_order.push_front(key);
+    m_nodes[key] = Node{m_order.begin(), size};
+    m_bytes += size;
+    while (m_bytes > m_capacity) {
+        const NPKFrameKey victim = m_order.back();
+        m_bytes -= m_nodes[victim].size;
+        m_nodes.erase(victim);
+        m_order.pop_back();
+        evicted.push_back(victim);
+    }
+}
+
+void NPKLruPolicy::onErase(const NPKFrameKey& key)
+{
+    const auto it = m_nodes.find(key);
+    if (it != m_nodes.end()) {
+        m_bytes -= it->second.size;
+        m_order.erase(it->second.pos);
+        m_nodes.erase(it);
+    }
+}
+
+void NPKLruPolicy::clear()
+{
+    m_order.clear();
+    m_nodes.clear();
+    m_bytes = 0;
+}
+
+NPKTinyLfuPolicy::NPKTinyLfuPolicy(const uint64_t capacity)
+{
+    m_windowCapacity = capacity / 100;
+    m_mainCapacity = capacity - m_windowCapacity;
+    m_protectedCapacity = m_mainCapacity / 5 * 4;
+
+    // 按平均每帧16KB估计缓存的帧数量，计数器宽度取不小于它的2的幂
+    uint64_t width = 1024;
+    while (width < capacity / 16384 && width < (1ULL << 22)) {
+        width <<= 1;
+    }
+    m_sketchMask = width - 1;
+    m_sketch.assign(width * SKETCH_DEPTH / 16, 0);
+    m_sampleSize = width * 10;
+}
+
+void NPKTinyLfuPolicy::onAccess(const NPKFrameKey& key)
+{
+    increment(key);
+}
+
+void NPKTinyLfuPolicy::onHit(const NPKFrameKey& key)
+{
+    const auto it = m_nodes.find(key);
+    if (it == m_nodes.end()) {
+        return;
+    }
+
+    auto& node = it->second;
+    if (node.segment == SEG_PROBATION) {
+        // 试用区命中，晋升到保护区，保护区超出时把最久未用的降回试用区
+        moveTo(key, node, SEG_PROTECTED);
+        while (m_bytes[SEG_PROTECTED] > m_protectedCapacity && m_lists[SEG_PROTECTED].size() > 1) {
+            const NPKFrameKey demoted = m_lists[SEG_PROTECTED].back();
+            moveTo(demoted, m_nodes[demoted], SEG_PROBATION);
+        }
+    } else {
+        moveTo(key, node, node.segment);
+    }
+}
+
+void NPKTinyLfuPolicy::onInsert(const NPKFrameKey& key, const uint64_t size, std::vector<NPKFrameKey>& evicted)
+{
+    if (size > m_windowCapacity + m_mainCapacity) {
+        evicted.push_back(key);
+        return;
+    }
+
+    m_lists[SEG_WINDOW].push_front(key);
+    m_nodes[key] = Node{m_lists[SEG_WINDOW].begin(), size, SEG_WINDOW};
+    m_bytes[SEG_WINDOW] += size;
+    evictWindow(evicted);
+}
+
+void NPKTinyLfuPolicy::onErase(const NPKFrameKey& key)
+{
+    const auto it = m_nodes.find(key);
+    if (it != m_nodes.end()) {
+        m_bytes[it->second.segment] -= it->second.size;
+        m_lists[it->second.segment].erase(it->second.pos);
+        m_nodes.erase(it);
+    }
+}
+
+void NPKTinyLfuPolicy::clear()
+{
+    for (uint32_t i = 0; i < 3; ++i) {
+        m_lists[i].clear();
+        m_bytes[i] = 0;
+    }
+    m_nodes.clear();
+    std::fill(m_sketch.begin(), m_sketch.end(), 0);
+    m_additions = 0;
+}
+
+uint32_t NPKTinyLfuPolicy::frequency(const NPKFrameKey& key) const
+{
+    const uint64_t h1 = NPKFrameKeyHash()(key);
+    const uint64_t h2 = mixHash(h1) | 1;
+    uint32_t ret = SKETCH_MAX_COUNT;
+    for (uint32_t row = 0; row < SKETCH_DEPTH; ++row) {
+        const uint64_t index = row * (m_sketchMask + 1) + ((h1 + row * h2) & m_sketchMask);
+        const uint32_t count = (m_sketch[index / 16] >> (index % 16 * 4)) & 0x0F;
+        ret = std::min(ret, count);
+    }
+    return ret;
+}
+
+void NPKTinyLfuPolicy::increment(const NPKFrameKey& key)
+{
+    const uint64_t h1 = NPKFrameKeyHash()(key);
+    const uint64_t h2 = mixHash(h1) | 1;
+    for (uint32_t row = 0; row < SKETCH_DEPTH; ++row) {
+        const uint64_t index = row * (m_sketchMask + 1) + ((h1 + row * h2) & m_sketchMask);
+        const uint32_t shift = index % 16 * 4;
+        if (((m_sketch[index / 16] >> shift) & 0x0F) < SKETCH_MAX_COUNT) {
+            m_sketch[index / 16] += 1ULL << shift;
+        }
+    }
+
+    // 定期把所有计数减半，让过去的热点逐渐冷却
+    if (++m_additions >= m_sampleSize) {
+        for (auto& word : m_sketch) {
+            word = (word >> 1) & 0x7777777777777777ULL;
+        }
+        m_additions /= 2;
+    }
+}
+
+void NPKTinyLfuPolicy::moveTo(const NPKFrameKey& key, Node& node, const Segment segment)
+{
+    m_lists[node.segment].erase(node.pos);
+    m_bytes[node.segment] -= node.size;
+    m_lists[segment].push_front(key);
+    m_bytes[segment] += node.size;
+    node.pos = m_lists[segment].begin();
+    node.segment = segment;
+}
+
+void NPKTinyLfuPolicy::evictWindow(std::vector<NPKFrameKey>& evicted)
+{
+    while (m_bytes[SEG_WINDOW] > m_windowCapacity && !m_lists[SEG_WINDOW].empty()) {
+        // 窗口中最久未用的帧作为候选进入试用区
+        const NPKFrameKey candidate = m_lists[SEG_WINDOW].back();
+        auto& candidateNode = m_nodes[candidate];
+        moveTo(candidate, candidateNode, SEG_PROBATION);
+
+        const uint32_t candidateFreq = frequency(candidate);
+        while (m_bytes[SEG_PROBATION] + m_bytes[SEG_PROTECTED] > m_mainCapacity) {
+            // 淘汰候选优先取试用区尾部，试用区只剩候选本身时取保护区尾部
+            NPKFrameKey victim = m_lists[SEG_PROBATION].back();
+            if (victim == candidate) {
+                if (m_lists[SEG_PROTECTED].empty()) {
+                    remove(candidate, evicted);
+                    break;
+                }
+                victim = m_lists[SEG_PROTECTED].back();
+            }
+            if (candidateFreq > frequency(victim)) {
+                remove(victim, evicted);
+            } else {
+                remove(candidate, evicted);
+                break;
+            }
+        }
+    }
+}
+
+void NPKTinyLfuPolicy::remove(const NPKFrameKey& key, std::vector<NPKFrameKey>& evicted)
+{
+    onErase(key);
+    evicted.push_back(key);
+}
+} // neapu
@@ -0,0 +1,202 @@
+//
+// Created by liu86 on 24-8-5.
+//
+
+#ifndef NPKFRAMECACHE_H
+#define NPKFRAMECACHE_H
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace neapu {
+enum FrameCachePolicy: uint32_t {
+    FCP_LRU = 0x01,     // 最近最少使用
+    FCP_TINYLFU = 0x02  // W-TinyLFU，抗扫描，适合反复播放的动画与批量导出混合的场景
+};
+
+typedef struct NPKFrameKey {
+    uint32_t image = 0;
+    uint32_t frame = 0;
+    int32_t palette = 0;
+
+    bool operator==(const NPKFrameKey& other) const
+    {
+        return image == other.image && frame == other.frame && palette == other.palette;
+    }
+} NPKFrameKey;
+
+struct NPKFrameKeyHash {
+    size_t operator()(const NPKFrameKey& key) const
+    {
+        uint64_t h = (static_cast<uint64_t>(key.image) << 32 | key.frame) * 0x9E3779B97F4A7C15ULL;
+        h ^= static_cast<uint32_t>(key.palette) + (h >> 29);
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+};
+
+typedef struct NPKFrameCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t insertions = 0;
+    uint64_t evictions = 0;  // 因超出预算被淘汰的数量
+    uint64_t rejections = 0; // 淘汰策略拒绝缓存的数量
+    uint64_t bytes = 0;      // 当前占用字节数
+    uint64_t capacity = 0;   // 字节预算
+    uint64_t entries = 0;    // 当前缓存的帧数量
+} NPKFrameCacheStats;
+
+/**
+ * @brief 帧缓存淘汰策略接口，只管理键与大小，不持有数据
+ *
+ * 所有方法都在NPKFrameCache的锁内调用，实现不需要考虑线程安全。
+ */
+class NPKCachePolicy {
+public:
+    virtual ~NPKCachePolicy() = default;
+    /**
+     * @brief 每次查询都会调用，不论是否命中
+     */
+    virtual void onAccess(const NPKFrameKey& key) = 0;
+    /**
+     * @brief 命中已缓存的键
+     */
+    virtual void onHit(const NPKFrameKey& key) = 0;
+    /**
+     * @brief 插入新键
+     * @param key 新键
+     * @param size 占用字节数
+     * @param evicted 输出需要淘汰的键，可能包含key本身，表示拒绝缓存
+     */
+    virtual void onInsert(const NPKFrameKey& key, uint64_t size, std::vector<NPKFrameKey>& evicted) = 0;
+    virtual void onErase(const NPKFrameKey& key) = 0;
+    virtual void clear() = 0;
+};
+
+class NPKMatrix;
+
+/**
+ * @brief 解码后帧的缓存，以(Image, 帧, 调色板)为键，总占用不超过字节预算，线程安全
+ */
+class NPKFrameCache {
+public:
+    /**
+     * @param capacity 字节预算
+     * @param policy 淘汰策略，为空时使用LRU
+     */
+    NPKFrameCache(uint64_t capacity, std::unique_ptr<NPKCachePolicy> policy);
+    virtual ~NPKFrameCache() = default;
+    NPKFrameCache(const NPKFrameCache&) = delete;
+    NPKFrameCache& operator=(const NPKFrameCache&) = delete;
+
+    static std::unique_ptr<NPKCachePolicy> createPolicy(FrameCachePolicy policy, uint64_t capacity);
+    /**
+     * @brief 帧在缓存中的占用，按画布大小计算
+     */
+    static uint64_t matrixSize(const NPKMatrix& matrix);
+
+    /**
+     * @brief 查询缓存，未命中返回nullptr
+     */
+    std::shared_ptr<NPKMatrix> get(const NPKFrameKey& key);
+    /**
+     * @brief 放入缓存，是否真正缓存由淘汰策略决定
+     */
+    void put(const NPKFrameKey& key, const std::shared_ptr<NPKMatrix>& matrix);
+    void clear();
+    NPKFrameCacheStats stats() const;
+
+private:
+    typedef struct Entry {
+        std::shared_ptr<NPKMatrix> matrix;
+        uint64_t size{0};
+    } Entry;
+
+private:
+    mutable std::mutex m_mutex;
+    uint64_t m_capacity{0};
+    std::unique_ptr<NPKCachePolicy> m_policy;
+    std::unordered_map<NPKFrameKey, Entry, NPKFrameKeyHash> m_entries;
+    NPKFrameCacheStats m_stats;
+};
+
+/**
+ * @brief 按字节计算的LRU
+ */
+class NPKLruPolicy : public NPKCachePolicy {
+public:
+    explicit NPKLruPolicy(uint64_t capacity);
+
+    void onAccess(const NPKFrameKey&) override {}
+    void onHit(const NPKFrameKey& key) override;
+    void onInsert(const NPKFrameKey& key, uint64_t size, std::vector<NPKFrameKey>& evicted) override;
+    void onErase(const NPKFrameKey& key) override;
+    void clear() override;
+
+private:
+    typedef struct Node {
+        std::list<NPKFrameKey>::iterator pos;
+        uint64_t size{0};
+    } Node;
+
+    uint64_t m_capacity{0};
+    uint64_t m_bytes{0};
+    std::list<NPKFrameKey> m_order; // 头部为最近使用
+    std::unordered_map<NPKFrameKey, Node, NPKFrameKeyHash> m_nodes;
+};
+
+/**
+ * @brief 按字节计算的W-TinyLFU
+ *
+ * 新帧先进入占预算1%的窗口LRU，被挤出窗口后与主区(SLRU)的淘汰候选比较访问频率，
+ * 频率更高的留下。访问频率由定期衰减的Count-Min Sketch估计，只访问一次的批量扫描
+ * 无法挤掉反复使用的帧。
+ */
+class NPKTinyLfuPolicy : public NPKCachePolicy {
+public:
+    explicit NPKTinyLfuPolicy(uint64_t capacity);
+
+    void onAccess(const NPKFrameKey& key) override;
+    void onHit(const NPKFrameKey& key) override;
+    void onInsert(const NPKFrameKey& key, uint64_t size, std::vector<NPKFrameKey>& evicted) override;
+    void onErase(const NPKFrameKey& key) override;
+    void clear() override;
+
+private:
+    enum Segment: uint32_t {
+        SEG_WINDOW = 0x00,
+        SEG_PROBATION = 0x01,
+        SEG_PROTECTED = 0x02
+    };
+
+    typedef struct Node {
+        std::list<NPKFrameKey>::iterator pos;
+        uint64_t size{0};
+        Segment segment{SEG_WINDOW};
+    } Node;
+
+    uint32_t frequency(const NPKFrameKey& key) const;
+    void increment(const NPKFrameKey& key);
+    void moveTo(const NPKFrameKey& key, Node& node, Segment segment);
+    void evictWindow(std::vector<NPKFrameKey>& evicted);
+    void remove(const NPKFrameKey& key, std::vector<NPKFrameKey>& evicted);
+
+private:
+    uint64_t m_windowCapacity{0};
+    uint64_t m_protectedCapacity{0};
+    uint64_t m_mainCapacity{0};
+    uint64_t m_bytes[3]{0, 0, 0};
+    std::list<NPKFrameKey> m_lists[3]; // 各分区，头部为最近使用
+    std::unordered_map<NPKFrameKey, Node, NPKFrameKeyHash> m_nodes;
+
+    // Count-Min Sketch，4行4位计数器，每个uint64_t存16个
+    std::vector<uint64_t> m_sketch;
+    uint64_t m_sketchMask{0};
+    uint64_t m_additions{0};
+    uint64_t m_sampleSize{0};
+};
+} // neapu
+
+#endif //NPKFRAMECACHE_H
@@ -3,20 +3,150 @@
 //
 
 #include "NPKFrameHandler.h"
+#include "NPKDDSHandler.h"
+#include "NPKDecompressor.h"
+#include "NPKInflate.h"
 #include "NPKPaletteManager.h"
+#include "NPKSimd.h"
 #include "logger.h"
-#include <zlib.h>
+#include <cstring>
+#include <vector>
 #include <format>
 
 namespace neapu {
+namespace {
+// V2各颜色格式的像素转换，按格式在编译期展开，16位格式优先使用SIMD内核
+template <ColorType Type>
+struct V2Pixel;
+
+template <>
+struct V2Pixel<CL_ARGB8888> {
+    static constexpr uint32_t colorSize = 4;
+    static simd::PixelRowKernel kernel() { return nullptr; }
+    static NPKColor convert(const uint8_t* data)
+    {
+        NPKColor color;
+        color.b = data[0];
+        color.g = data[1];
+        color.r = data[2];
+        color.a = data[3];
+        return color;
+    }
+};
+
+template <>
+struct V2Pixel<CL_ARGB4444> {
+    static constexpr uint32_t colorSize = 2;
+    static simd::PixelRowKernel kernel() { return simd::kernels().argb4444Row; }
+    static NPKColor convert(const uint8_t* data)
+    {
+        const uint16_t temp = data[1] << 8 | data[0];
+        NPKColor color;
+        color.a = ((temp & 0xF000) >> 12) * 0x11;
+        color.r = (temp & 0x0F00) >> 8 << 4;
+        color.g = (temp & 0x00F0) >> 4 << 4;
+        color.b = (temp & 0x000F) << 4;
+        return color;
+    }
+};
+
+template <>
+struct V2Pixel<CL_ARGB1555> {
+    static constexpr uint32_t colorSize = 2;
+    static simd::PixelRowKernel kernel() { return simd::kernels().argb1555Row; }
+    static NPKColor convert(const uint8_t* data)
+    {
+        const uint16_t temp = data[1] << 8 | data[0];
+        NPKColor color;
+        color.r = (temp & 0x7C00) >> 10 << 3;
+        color.g = (temp & 0x03E0) >> 5 << 3;
+        color.b = (temp & 0x001F) << 3;
+        color.a = ((temp & 0x8000) >> 15) * 0xFF;
+        return color;
+    }
+};
+
+template <>
+struct V2Pixel<CL_RGB565> {
+    static constexpr uint32_t colorSize = 2;
+    static simd::PixelRowKernel kernel() { return simd::kernels().rgb565Row; }
+    static NPKColor convert(const uint8_t* data)
+    {
+        const uint16_t temp = data[1] << 8 | data[0];
+        NPKColor color;
+        color.r = (temp & 0xF800) >> 11 << 3;
+        color.g = (temp & 0x07E0) >> 5 << 2;
+        color.b = (temp & 0x001F) << 3;
+        color.a = 0xFF;
+        return color;
+    }
+};
+
+template <ColorType Type>
+void convertV2Row(const uint8_t* src, const uint32_t count, uint8_t* dst, const simd::PixelRowKernel kernel)
+{
+    if constexpr (Type == CL_ARGB8888) {
+        // 内存布局与NPKColor相同，直接拷贝
+        memcpy(dst, src, static_cast<size_t>(count) * sizeof(NPKColor));
+    } else {
+        uint32_t i = kernel ? kernel(src, count, dst) : 0;
+        auto* colors = reinterpret_cast<NPKColor*>(dst);
+        for (; i < count; ++i) {
+            colors[i] = V2Pixel<Type>::convert(src + i * V2Pixel<Type>::colorSize);
+        }
+    }
+}
+
+template <ColorType Type>
+void convertV2Rows(const uint8_t* src, const uint32_t width, uint8_t* dst, const uint64_t dstStride, const uint32_t columns,
+                   const uint32_t rows, const OutputFormat format)
+{
+    const simd::PixelRowKernel kernel = V2Pixel<Type>::kernel();
+    const uint64_t srcStride = static_cast<uint64_t>(width) * V2Pixel<Type>::colorSize;
+    // 输出格式与帧的颜色格式相同时直接拷贝
+    const bool native = (Type == CL_ARGB8888 && format == OF_BGRA8) || (Type == CL_ARGB4444 && format == OF_ARGB4444) ||
+                        (Type == CL_RGB565 && format == OF_RGB565);
+    // 16位输出先把一行展开到线程内复用的缓冲区，32位输出直接在输出行上原地转换
+    const bool expandInPlace = outputPixelSize(format) == sizeof(NPKColor);
+    NPKScratchBuffer rowBuffer(native || expandInPlace ? 0 : static_cast<uint64_t>(columns) * sizeof(NPKColor));
+    for (uint32_t y = 0; y < rows; ++y) {
+        const uint8_t* srcRow = src + y * srcStride;
+        uint8_t* dstRow = dst + y * dstStride;
+        if (native) {
+            memcpy(dstRow, srcRow, static_cast<size_t>(columns) * V2Pixel<Type>::colorSize);
+        } else if constexpr (Type == CL_ARGB8888) {
+            convertPixelRow(reinterpret_cast<const NPKColor*>(srcRow), columns, format, dstRow);
+        } else {
+            uint8_t* expanded = expandInPlace ? dstRow : rowBuffer.data();
+            convertV2Row<Type>(srcRow, columns, expanded, kernel);
+            convertPixelRow(reinterpret_cast<const NPKColor*>(expanded), columns, format, dstRow);
+        }
+    }
+}
+
+// 图像从offset开始放到size大小的画布中时，在画布内的长度
+uint32_t visibleLength(const uint32_t offset, const uint32_t length, const uint32_t size)
+{
+    if (offset >= size) {
+        return 0;
+    }
+    return length < size - offset ? length : size - offset;
+}
+}
+
 NPKFrameHandler::NPKFrameHandler(std::shared_ptr<NPKPaletteManager> paletteManager)
-    : m_paletteManager(paletteManager)
+    : m_paletteManager(paletteManager.get()), m_paletteOwner(std::move(paletteManager))
+{
+}
+
+NPKFrameHandler::NPKFrameHandler(const NPKFrameIndex& index, const uint8_t* data, const NPKPaletteManager* paletteManager)
+    : m_index(index), m_data(data), m_paletteManager(paletteManager)
 {
 }
 
 NPKFrameHandler::~NPKFrameHandler()
 {
-    if (m_data != nullptr) {
+    if (m_ownData) {
         delete[] m_data;
     }
 }
@@ -61,11 +191,13 @@ int NPKFrameHandler::loadIndex(const uint8_t* data, const uint64_t dataLen)
     return copyLen;
 }
 
-int NPKFrameHandler::loadData(const uint8_t* data, const uint64_t dataLen)
+int NPKFrameHandler::loadData(const uint8_t* data, const uint64_t dataLen, const bool copyData)
 {
-    if (m_data != nullptr) {
+    if (m_ownData) {
         delete[] m_data;
     }
+    m_data = nullptr;
+    m_ownData = false;
 
     if (m_index.dataSize == 0) {
         return 0;
@@ -77,14 +209,20 @@ int NPKFrameHandler::loadData(const uint8_t* data, const uint64_t dataLen)
         return dataLen;
     }
 
-    m_data = new uint8_t[m_index.dataSize];
-    const int ret = memcpy_s(m_data, m_index.dataSize, data, m_index.dataSize);
+    if (!copyData) {
+        m_data = data;
+        return m_index.dataSize;
+    }
+
+    auto* buffer = new uint8_t[m_index.dataSize];
+    const int ret = memcpy_s(buffer, m_index.dataSize, data, m_index.dataSize);
     if (ret != 0) {
         LOG_ERROR << "Failed to copy origin data.";
-        delete[] m_data;
-        m_data = nullptr;
+        delete[] buffer;
         return -1;
     }
+    m_data = buffer;
+    m_ownData = true;
     return m_index.dataSize;
 }
 
@@ -96,117 +234,281 @@ std::string NPKFrameHandler::ddsClipInfo() const
     return std::format("{}.{}:{}.{}", m_index.ddsLeftEdge, m_index.ddsTopEdge, m_index.ddsRightEdge, m_index.ddsBottomEdge);
 }
 
-std::shared_ptr<NPKMatrix> NPKFrameHandler::toMatrix(int paletteIndex)
+bool NPKFrameHandler::decodeExtent(const DecodeArea area, uint32_t& width, uint32_t& height) const
 {
-    if (isLinkFrame()) {
-        return nullptr;
+    if (isDDSFrame()) {
+        if (m_index.ddsLeftEdge >= m_index.ddsRightEdge || m_index.ddsTopEdge >= m_index.ddsBottomEdge) {
+            return false;
+        }
+        width = m_index.ddsRightEdge - m_index.ddsLeftEdge;
+        height = m_index.ddsBottomEdge - m_index.ddsTopEdge;
+        return true;
+    }
+    if (!isMatrixFrame() || m_index.width == 0 || m_index.height == 0) {
+        return false;
+    }
+    width = m_index.width;
+    height = m_index.height;
+    if (area == DA_CANVAS) {
+        width = m_index.frameWidth == 0 ? m_index.width : m_index.frameWidth;
+        height = m_index.frameHeight == 0 ? m_index.height : m_index.frameHeight;
+    }
+    return true;
+}
+
+uint64_t NPKFrameHandler::decodeSize(const NPKPixelBuffer& buffer, const DecodeArea area) const
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (!decodeExtent(area, width, height)) {
+        return 0;
+    }
+    return pixelBufferSize(buffer, width, height);
+}
+
+bool NPKFrameHandler::decodeTo(const NPKPixelBuffer& buffer, const int paletteIndex, const DecodeArea area) const
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (!isMatrixFrame() || m_data == nullptr || !decodeExtent(area, width, height)) {
+        return false;
+    }
+    uint64_t stride = 0;
+    uint8_t* origin = pixelBufferOrigin(buffer, width, height, stride);
+    if (origin == nullptr) {
+        return false;
+    }
+    if (area == DA_IMAGE) {
+        return decodeRows(origin, stride, m_index.width, m_index.height, paletteIndex, buffer.format);
+    }
+
+    // 缓冲区内容是未知的，画布需要先清空，所有输出格式的透明色都是0
+    const uint32_t pixelSize = outputPixelSize(buffer.format);
+    for (uint32_t y = 0; y < height; ++y) {
+        memset(origin + y * stride, 0, static_cast<size_t>(width) * pixelSize);
     }
+    const uint32_t columns = visibleLength(m_index.posX, m_index.width, width);
+    const uint32_t rows = visibleLength(m_index.posY, m_index.height, height);
+    return decodeRows(origin + m_index.posY * stride + static_cast<uint64_t>(m_index.posX) * pixelSize, stride, columns, rows,
+                      paletteIndex, buffer.format);
+}
 
-    if (m_index.width == 0 || m_index.height == 0 || m_data == nullptr) {
+bool NPKFrameHandler::decodeTo(NPKMatrix& matrix, const int paletteIndex) const
+{
+    if (!isMatrixFrame() || m_index.width == 0 || m_index.height == 0 || m_data == nullptr) {
+        return false;
+    }
+
+    // 新画布已经是透明色，只写入图像在画布内的部分
+    matrix.reset(m_index.width, m_index.height, m_index.frameWidth, m_index.frameHeight, m_index.posX, m_index.posY);
+    const uint64_t stride = static_cast<uint64_t>(matrix.canvasWidth()) * sizeof(NPKColor);
+    const uint32_t columns = visibleLength(m_index.posX, m_index.width, matrix.canvasWidth());
+    const uint32_t rows = visibleLength(m_index.posY, m_index.height, matrix.canvasHeight());
+    uint8_t* first = nullptr;
+    if (columns > 0 && rows > 0) {
+        first = reinterpret_cast<uint8_t*>(matrix.data()) + m_index.posY * stride + static_cast<uint64_t>(m_index.posX) * sizeof(NPKColor);
+    }
+    return decodeRows(first, stride, columns, rows, paletteIndex, OF_BGRA8);
+}
+
+std::shared_ptr<NPKMatrix> NPKFrameHandler::toMatrix(const int paletteIndex) const
+{
+    auto matrix = std::make_shared<NPKMatrix>();
+    if (!decodeTo(*matrix, paletteIndex)) {
         return nullptr;
     }
+    return matrix;
+}
 
+bool NPKFrameHandler::uncompressedData(std::vector<uint8_t>& data) const
+{
+    data.clear();
+    if (!isMatrixFrame() || m_data == nullptr) {
+        return true;
+    }
+
+    if (m_index.compressType != CP_ZLIB && m_index.compressType != CP_ZLIB2) {
+        data.assign(m_data, m_data + m_index.dataSize);
+        return true;
+    }
+    data.resize(pixelDataSize());
+    return checkDecompress(getDecompressor()->decompress(m_data, m_index.dataSize, data.data(), data.size()));
+}
+
+bool NPKFrameHandler::decodeRows(uint8_t* first, const uint64_t stride, const uint32_t columns, const uint32_t rows,
+                                 const int paletteIndex, const OutputFormat format) const
+{
+    if (m_index.compressType != CP_ZLIB && m_index.compressType != CP_ZLIB2) {
+        // 数据直接位于文件映射或Image的数据块中，长度不足时读取会越过帧的末尾，当做无效帧处理
+        if (m_index.dataSize < pixelDataSize()) {
+            LOG_WARNING << "Data length is too short. [dataSize:" << m_index.dataSize << ", required:" << pixelDataSize() << "]";
+            return false;
+        }
+        return convertRows(m_data, first, stride, columns, rows, paletteIndex, format);
+    }
+
+    const auto decompressor = getDecompressor();
+    // ARGB8888与BGRA8输出相同，整个图像都要写入时直接按输出的行跨度解压
+    if (m_paletteManager == nullptr && m_index.colorType == CL_ARGB8888 && format == OF_BGRA8 && columns == m_index.width &&
+        rows == m_index.height) {
+        NPKDecompressTarget target;
+        target.data = first;
+        target.rowSize = static_cast<uint64_t>(m_index.width) * sizeof(NPKColor);
+        target.stride = stride;
+        target.rowCount = m_index.height;
+        return checkDecompress(decompressor->decompress(m_data, m_index.dataSize, target));
+    }
+
+    // 根据颜色类型，尺寸计算解压后的大小，解压到线程内复用的缓冲区
     uint32_t colorSize = 4;
     if (m_index.colorType == CL_ARGB4444 || m_index.colorType == CL_ARGB1555 || m_index.colorType == CL_RGB565) {
         colorSize = 2;
     }
+    NPKScratchBuffer data(static_cast<uint64_t>(m_index.width) * m_index.height * colorSize);
+    if (!checkDecompress(decompressor->decompress(m_data, m_index.dataSize, data.data(), data.size()))) {
+        return false;
+    }
+    return convertRows(data.data(), first, stride, columns, rows, paletteIndex, format);
+}
 
-    std::shared_ptr<NPKMatrix> retMatrix;
-    if (m_index.compressType == CP_ZLIB || m_index.compressType == CP_ZLIB2) {
-        // 根据颜色类型，尺寸计算解压后的大小
-        unsigned long dataSize = m_index.width * m_index.height * colorSize;
-        // 解压
-        auto* data = new uint8_t[dataSize];
-
-        int ret = uncompress(data, &dataSize, m_data, m_index.dataSize);
-        if (ret != Z_OK) {
-            if (ret == Z_BUF_ERROR) {
-                LOG_WARNING << "Failed to uncompress data. Buffer is too small.";
-            } else if (ret == Z_DATA_ERROR) {
-                LOG_WARNING << "Failed to uncompress data. Data is corrupted.";
-            } else {
-                LOG_WARNING << "Failed to uncompress data.";
-            }
-            delete[] data;
-            return nullptr;
-        }
+uint64_t NPKFrameHandler::pixelDataSize() const
+{
+    uint64_t colorSize = 1;
+    if (m_paletteManager == nullptr) {
+        colorSize = m_index.colorType == CL_ARGB8888 ? 4 : 2;
+    }
+    return static_cast<uint64_t>(m_index.width) * m_index.height * colorSize;
+}
 
-        if (m_paletteManager == nullptr) {
-            retMatrix = toMatrixV2(data);
-        } else {
-            retMatrix = toMatrixV4V6(data, paletteIndex);
-        }
-        delete[] data;
+bool NPKFrameHandler::checkDecompress(const DecompressResult ret)
+{
+    if (ret == DR_OK || ret == DR_TRUNCATED) {
+        return true;
+    }
+    if (ret == DR_OVERFLOW) {
+        LOG_WARNING << "Failed to uncompress data. Buffer is too small.";
     } else {
-        if (m_paletteManager == nullptr) {
-            retMatrix = toMatrixV2(m_data);
-        } else {
-            retMatrix = toMatrixV4V6(m_data, paletteIndex);
-        }
+        LOG_WARNING << "Failed to uncompress data. Data is corrupted.";
     }
-    return retMatrix;
+    return false;
 }
 
-std::shared_ptr<NPKMatrix> NPKFrameHandler::ddsClipMatrix(std::shared_ptr<NPKMatrix>&& matrix)
+std::shared_ptr<NPKMatrix> NPKFrameHandler::ddsClipMatrix(std::shared_ptr<NPKMatrix>&& matrix) const
 {
     return matrix->clip(m_index.ddsLeftEdge, m_index.ddsTopEdge, m_index.ddsRightEdge, m_index.ddsBottomEdge);
 }
 
-std::shared_ptr<NPKMatrix> NPKFrameHandler::toMatrixV2(const uint8_t* data)
+std::shared_ptr<NPKMatrix> NPKFrameHandler::ddsDecodeMatrix(const NPKDDSHandler& dds) const
 {
-    uint32_t colorSize = 4;
-    if (m_index.colorType == CL_ARGB4444 || m_index.colorType == CL_ARGB1555 || m_index.colorType == CL_RGB565) {
-        colorSize = 2;
+    if (m_index.ddsLeftEdge >= m_index.ddsRightEdge || m_index.ddsTopEdge >= m_index.ddsBottomEdge) {
+        LOG_ERROR << "Invalid clip area.";
+        return nullptr;
     }
-    auto matrix = NPKMatrix::createMatrix(m_index.width, m_index.height, m_index.frameWidth, m_index.frameHeight, m_index.posX, m_index.posY);
-    for (int x = 0; x < m_index.width; ++x) {
-        for (int y = 0; y < m_index.height; ++y) {
-            int index = (y * m_index.width + x) * colorSize;
-            NPKColor color{0};
-            if (m_index.colorType == CL_ARGB8888) {
-                color.r = data[index + 2];
-                color.g = data[index + 1];
-                color.b = data[index];
-                color.a = data[index + 3];
-            } else if (m_index.colorType == CL_ARGB4444) {
-                unsigned short temp = (data[index + 1] << 8) | data[index];
-                color.a = ((temp & 0xF000) >> 12) * 0x11;
-                color.r = (temp & 0x0F00) >> 8 << 4;
-                color.g = (temp & 0x00F0) >> 4 << 4;
-                color.b = temp & 0x000F << 4;
-            } else if (m_index.colorType == CL_ARGB1555) {
-                unsigned short temp = (data[index + 1] << 8) | data[index];
-                color.r = (temp & 0x7C00) >> 10 << 3;
-                color.g = (temp & 0x03E0) >> 5 << 3;
-                color.b = (temp & 0x001F) << 3;
-                color.a = ((temp & 0x8000) >> 15) * 0xFF;
-            } else if (m_index.colorType == CL_RGB565) {
-                unsigned short temp = (data[index + 1] << 8) | data[index];
-                color.r = (temp & 0xF800) >> 11 << 3;
-                color.g = (temp & 0x07E0) >> 5 << 2;
-                color.b = temp & 0x001F << 3;
-                color.a = 0xFF;
-            } else {
-                LOG_ERROR << "Unsupported color type: " << m_index.colorType;
-                return nullptr;
-            }
-            matrix->setPixel(x, y, color);
-        }
+
+    auto matrix = NPKMatrix::createMatrix(m_index.ddsRightEdge - m_index.ddsLeftEdge, m_index.ddsBottomEdge - m_index.ddsTopEdge);
+    if (!dds.decodeRegion(m_index.ddsLeftEdge, m_index.ddsTopEdge, m_index.ddsRightEdge, m_index.ddsBottomEdge, *matrix)) {
+        return nullptr;
     }
     return matrix;
 }
 
-std::shared_ptr<NPKMatrix> NPKFrameHandler::toMatrixV4V6(const uint8_t* data, int paletteIndex)
+bool NPKFrameHandler::ddsDecodeTo(const NPKDDSHandler& dds, const NPKPixelBuffer& buffer) const
+{
+    if (!isDDSFrame()) {
+        return false;
+    }
+    return dds.decodeRegion(m_index.ddsLeftEdge, m_index.ddsTopEdge, m_index.ddsRightEdge, m_index.ddsBottomEdge, buffer);
+}
+
+bool NPKFrameHandler::ddsClipTo(const NPKMatrix& atlas, const NPKPixelBuffer& buffer) const
 {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (!isDDSFrame() || !decodeExtent(DA_IMAGE, width, height) || m_index.ddsRightEdge > atlas.width() ||
+        m_index.ddsBottomEdge > atlas.height()) {
+        LOG_ERROR << "Invalid clip area.";
+        return false;
+    }
+    uint64_t stride = 0;
+    uint8_t* origin = pixelBufferOrigin(buffer, width, height, stride);
+    if (origin == nullptr) {
+        return false;
+    }
+    for (uint32_t y = 0; y < height; ++y) {
+        const NPKColor* src = atlas.data() + static_cast<uint64_t>(m_index.ddsTopEdge + y) * atlas.canvasWidth() + m_index.ddsLeftEdge;
+        convertPixelRow(src, width, buffer.format, origin + y * stride);
+    }
+    return true;
+}
+
+bool NPKFrameHandler::convertRows(const uint8_t* data, uint8_t* first, const uint64_t stride, const uint32_t columns, const uint32_t rows,
+                                  const int paletteIndex, const OutputFormat format) const
+{
+    if (m_paletteManager == nullptr) {
+        switch (m_index.colorType) {
+        case CL_ARGB8888: convertV2Rows<CL_ARGB8888>(data, m_index.width, first, stride, columns, rows, format);
+            break;
+        case CL_ARGB4444: convertV2Rows<CL_ARGB4444>(data, m_index.width, first, stride, columns, rows, format);
+            break;
+        case CL_ARGB1555: convertV2Rows<CL_ARGB1555>(data, m_index.width, first, stride, columns, rows, format);
+            break;
+        case CL_RGB565: convertV2Rows<CL_RGB565>(data, m_index.width, first, stride, columns, rows, format);
+            break;
+        default: LOG_ERROR << "Unsupported color type: " << m_index.colorType;
+            return false;
+        }
+        return true;
+    }
+
     // 对于V4和V6版本，为1字节的索引，索引到调色板中的颜色
-    auto matrix = NPKMatrix::createMatrix(m_index.width, m_index.height, m_index.frameWidth, m_index.frameHeight, m_index.posX, m_index.posY);
-    for (uint32_t y = 0; y < m_index.height; ++y) {
-        for (uint32_t x = 0; x < m_index.width; ++x) {
-            uint8_t index = data[y * m_index.width + x];
-            NPKColor color = m_paletteManager->getColor(paletteIndex, index);
-            matrix->setPixel(x, y, color);
+    const uint32_t pixelSize = outputPixelSize(format);
+    const NPKColor* lut = m_paletteManager->getLUT(paletteIndex);
+    if (lut == nullptr) {
+        // 调色板无效时所有像素都是透明色
+        LOG_ERROR << "Invalid palette index." << paletteIndex;
+        for (uint32_t y = 0; y < rows; ++y) {
+            memset(first + y * stride, 0, static_cast<size_t>(columns) * pixelSize);
         }
+        return true;
     }
-    return matrix;
+
+    // 查找表先转换为输出格式，每个像素只查表一次
+    alignas(4) uint8_t converted[256 * sizeof(NPKColor)];
+    if (format != OF_BGRA8) {
+        convertPixelRow(lut, 256, format, converted);
+    }
+    const uint32_t colorCount = m_paletteManager->getColorCount(paletteIndex);
+    uint32_t invalid = 0;
+    if (pixelSize == sizeof(NPKColor)) {
+        if (format != OF_BGRA8) {
+            lut = reinterpret_cast<const NPKColor*>(converted);
+        }
+        const simd::PaletteRowKernel kernel = simd::kernels().paletteRow;
+        for (uint32_t y = 0; y < rows; ++y) {
+            const uint8_t* src = data + static_cast<uint64_t>(y) * m_index.width;
+            uint8_t* dst = first + y * stride;
+            uint32_t x = kernel ? kernel(src, columns, lut, colorCount, dst, invalid) : 0;
+            auto* colors = reinterpret_cast<NPKColor*>(dst);
+            for (; x < columns; ++x) {
+                colors[x] = lut[src[x]];
+                invalid += src[x] >= colorCount;
+            }
+        }
+    } else {
+        for (uint32_t y = 0; y < rows; ++y) {
+            const uint8_t* src = data + static_cast<uint64_t>(y) * m_index.width;
+            uint8_t* dst = first + y * stride;
+            for (uint32_t x = 0; x < columns; ++x) {
+                memcpy(dst + x * 2, converted + src[x] * 2, 2);
+                invalid += src[x] >= colorCount;
+            }
+        }
+    }
+
+    // 无效索引按帧汇总报告一次
+    if (invalid > 0) {
+        LOG_WARNING << "Invalid color index. [count:" << invalid << "][colors:" << colorCount << "]";
+    }
+    return true;
 }
 } // neapu
\ No newline at end of file
@@ -6,7 +6,9 @@
 #define NPKFRAMEHANDLER_H
 #include <cstdint>
 #include <memory>
+#include <vector>
 
+#include "NPKDecompressor.h"
 #include "NPKMatrix.h"
 
 namespace neapu {
@@ -46,35 +48,116 @@ constexpr auto DDS_FRAME_INDEX_SIZE = sizeof(NPKFrameIndex);
 class NPKImageHandler;
 class NPKMatrix;
 class NPKPaletteManager;
+class NPKDDSHandler;
 
+/**
+ * @brief 单个帧的索引与解码
+ *
+ * 可以独立加载并持有数据，也可以作为NPKFrameTable中一帧的视图，视图不持有数据和调色板。
+ */
 class NPKFrameHandler {
 public:
     explicit NPKFrameHandler(std::shared_ptr<NPKPaletteManager> paletteManager);
+    /**
+     * @brief 构造不持有数据的帧，data与paletteManager需在帧使用期间有效
+     * @param index 帧索引
+     * @param data 帧数据，没有数据时为nullptr
+     * @param paletteManager 调色板，V2为nullptr
+     */
+    NPKFrameHandler(const NPKFrameIndex& index, const uint8_t* data, const NPKPaletteManager* paletteManager);
     virtual ~NPKFrameHandler();
+    NPKFrameHandler(const NPKFrameHandler&) = delete;
+    NPKFrameHandler& operator=(const NPKFrameHandler&) = delete;
 
     int loadIndex(const uint8_t* data, uint64_t dataLen);
-    int loadData(const uint8_t* data, const uint64_t dataLen);
+    /**
+     * @brief 加载帧数据
+     * @param data 帧数据
+     * @param dataLen 数据最大长度
+     * @param copyData 为true时拷贝数据，为false时只保存指针，调用者需保证data在帧释放前有效
+     * @return 成功返回读取的长度，失败返回-1
+     */
+    int loadData(const uint8_t* data, const uint64_t dataLen, bool copyData = true);
     bool isLinkFrame() const { return m_index.colorType == CL_LINK; }
     bool isMatrixFrame() const { return m_index.colorType < CL_LINK && m_index.colorType != CL_UNKNOWN; }
     bool isDDSFrame() const { return m_index.colorType > CL_LINK; }
     uint32_t linkTo() const { return m_index.linkTo; }
     uint32_t ddsIndex() const { return m_index.ddsIndex; }
     std::string ddsClipInfo() const;
-    std::shared_ptr<NPKMatrix> toMatrix(int paletteIndex = 0);
-    std::shared_ptr<NPKMatrix> ddsClipMatrix(std::shared_ptr<NPKMatrix>&& matrix);
+    /**
+     * @brief 解码时写入的宽高
+     * @param area DA_IMAGE为图像大小，DA_CANVAS为画布大小；DDS帧都是裁剪区域的大小
+     * @return 链接帧或尺寸无效返回false
+     */
+    bool decodeExtent(DecodeArea area, uint32_t& width, uint32_t& height) const;
+    /**
+     * @brief 解码到buffer需要的字节数，已考虑行跨度与写入位置
+     * @return 帧无法解码时返回0
+     */
+    uint64_t decodeSize(const NPKPixelBuffer& buffer, DecodeArea area = DA_IMAGE) const;
+    /**
+     * @brief 把点阵帧按缓冲区的输出格式解码到调用者的缓冲区，不分配内存，可多线程同时调用
+     * @param buffer 输出缓冲区，大小可通过decodeSize获取
+     * @param paletteIndex 调色板索引，只用于V4/V6
+     * @param area DA_CANVAS时图像超出画布的部分不写入
+     * @return 非点阵帧、没有数据、缓冲区不足或解码失败返回false，失败时缓冲区内容不确定
+     */
+    bool decodeTo(const NPKPixelBuffer& buffer, int paletteIndex = 0, DecodeArea area = DA_IMAGE) const;
+    /**
+     * @brief 解码帧画面到matrix，matrix的容量足够时不分配内存
+     * @return 与toMatrix返回nullptr的情况相同时返回false
+     */
+    bool decodeTo(NPKMatrix& matrix, int paletteIndex = 0) const;
+    /**
+     * @brief 解码帧画面，只读取加载时的数据，可多线程同时调用，不能与loadIndex、loadData同时调用
+     * @param paletteIndex 调色板索引，只用于V4/V6
+     * @return 链接帧、没有数据或解码失败返回nullptr
+     */
+    std::shared_ptr<NPKMatrix> toMatrix(int paletteIndex = 0) const;
+    std::shared_ptr<NPKMatrix> ddsClipMatrix(std::shared_ptr<NPKMatrix>&& matrix) const;
+    /**
+     * @brief 只解码DDS中帧所在的区域，结果与对完整图集调用ddsClipMatrix相同
+     * @param dds 帧所在的DDS
+     * @return 失败返回nullptr
+     */
+    std::shared_ptr<NPKMatrix> ddsDecodeMatrix(const NPKDDSHandler& dds) const;
+    /**
+     * @brief 把DDS帧所在的区域解码到缓冲区，结果与ddsDecodeMatrix相同
+     */
+    bool ddsDecodeTo(const NPKDDSHandler& dds, const NPKPixelBuffer& buffer) const;
+    /**
+     * @brief 从已解码的完整图集中把帧所在的区域拷贝到缓冲区
+     */
+    bool ddsClipTo(const NPKMatrix& atlas, const NPKPixelBuffer& buffer) const;
 
     ColorType colorType() const { return m_index.colorType; }
     uint32_t width() const { return m_index.width; }
     uint32_t height() const { return m_index.height; }
+    const NPKFrameIndex& index() const { return m_index; }
+    /**
+     * @brief 获取解压后的帧数据，V2为对应颜色格式的像素，V4/V6为1字节调色板索引，数据不足的部分补0
+     * @param data 输出数据，帧没有数据时为空
+     * @return 解压失败返回false
+     */
+    bool uncompressedData(std::vector<uint8_t>& data) const;
 
 private:
-    std::shared_ptr<NPKMatrix> toMatrixV2(const uint8_t* data);
-    std::shared_ptr<NPKMatrix> toMatrixV4V6(const uint8_t* data, int paletteIndex);
+    // 解压后写入图像左上角的columns*rows区域，压缩的ARGB8888帧整个写入时直接按行解压到输出，不经过中间缓冲区
+    bool decodeRows(uint8_t* first, uint64_t stride, uint32_t columns, uint32_t rows, int paletteIndex, OutputFormat format) const;
+    // 未压缩时图像数据的字节数，V2为对应颜色格式的像素，V4/V6为1字节调色板索引
+    uint64_t pixelDataSize() const;
+    // 解压失败时按结果输出日志
+    static bool checkDecompress(DecompressResult ret);
+    // 把解压后的数据转换为输出格式，每行只转换前columns个像素，格式转换在解码每行时完成
+    bool convertRows(const uint8_t* data, uint8_t* first, uint64_t stride, uint32_t columns, uint32_t rows, int paletteIndex,
+                     OutputFormat format) const;
 
 private:
     NPKFrameIndex m_index{};
-    uint8_t* m_data{nullptr}; // 为了加载时不等待太久，在真正读取帧画面时才解压缩
-    std::shared_ptr<NPKPaletteManager> m_paletteManager{nullptr};
+    const uint8_t* m_data{nullptr}; // 为了加载时不等待太久，在真正读取帧画面时才解压缩
+    bool m_ownData{false};
+    const NPKPaletteManager* m_paletteManager{nullptr};
+    std::shared_ptr<const NPKPaletteManager> m_paletteOwner{nullptr}; // 独立加载时持有调色板
 };
 } // neapu
 
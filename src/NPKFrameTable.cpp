@@ -0,0 +1,113 @@
+//
+// Created by liu86 on 24-8-20.
+//
+
+#include "NPKFrameTable.h"
+
+namespace neapu {
+void NPKFrameTable::clear()
+{
+    m_refs.clear();
+    m_links.clear();
+    m_matrices.clear();
+    m_dataOffsets.clear();
+    m_dds.clear();
+    m_payload = nullptr;
+}
+
+void NPKFrameTable::shrinkToFit()
+{
+    m_refs.shrink_to_fit();
+    m_links.shrink_to_fit();
+    m_matrices.shrink_to_fit();
+    m_dataOffsets.shrink_to_fit();
+    m_dds.shrink_to_fit();
+}
+
+uint32_t NPKFrameTable::add(const NPKFrameIndex& index)
+{
+    const auto frame = static_cast<uint32_t>(m_refs.size());
+    if (index.colorType == CL_LINK) {
+        m_refs.push_back(FK_LINK << KIND_SHIFT | static_cast<uint32_t>(m_links.size()));
+        m_links.push_back(index.linkTo);
+    } else if (index.colorType < CL_LINK) {
+        m_refs.push_back(FK_MATRIX << KIND_SHIFT | static_cast<uint32_t>(m_matrices.size()));
+        m_matrices.push_back(MatrixIndex{index.colorType, index.compressType, index.width, index.height, index.dataSize, index.posX,
+                                         index.posY, index.frameWidth, index.frameHeight});
+        m_dataOffsets.push_back(NO_DATA);
+    } else {
+        m_refs.push_back(FK_DDS << KIND_SHIFT | static_cast<uint32_t>(m_dds.size()));
+        m_dds.push_back(index);
+    }
+    return frame;
+}
+
+void NPKFrameTable::setDataOffset(const uint32_t frame, const uint32_t offset)
+{
+    if (kind(frame) == FK_MATRIX) {
+        m_dataOffsets[slot(frame)] = offset;
+    }
+}
+
+uint32_t NPKFrameTable::linkTo(const uint32_t frame) const
+{
+    return kind(frame) == FK_LINK ? m_links[slot(frame)] : 0;
+}
+
+ColorType NPKFrameTable::colorType(const uint32_t frame) const
+{
+    switch (kind(frame)) {
+    case FK_LINK: return CL_LINK;
+    case FK_MATRIX: return m_matrices[slot(frame)].colorType;
+    default: return m_dds[slot(frame)].colorType;
+    }
+}
+
+NPKFrameIndex NPKFrameTable::index(const uint32_t frame) const
+{
+    NPKFrameIndex index{};
+    switch (kind(frame)) {
+    case FK_LINK:
+        index.colorType = CL_LINK;
+        index.linkTo = m_links[slot(frame)];
+        break;
+    case FK_MATRIX: {
+        const MatrixIndex& matrix = m_matrices[slot(frame)];
+        index.colorType = matrix.colorType;
+        index.compressType = matrix.compressType;
+        index.width = matrix.width;
+        index.height = matrix.height;
+        index.dataSize = matrix.dataSize;
+        index.posX = matrix.posX;
+        index.posY = matrix.posY;
+        index.frameWidth = matrix.frameWidth;
+        index.frameHeight = matrix.frameHeight;
+        break;
+    }
+    default: index = m_dds[slot(frame)];
+        break;
+    }
+    return index;
+}
+
+const uint8_t* NPKFrameTable::data(const uint32_t frame) const
+{
+    if (kind(frame) != FK_MATRIX || m_payload == nullptr) {
+        return nullptr;
+    }
+    const uint32_t offset = m_dataOffsets[slot(frame)];
+    return offset == NO_DATA ? nullptr : m_payload + offset;
+}
+
+NPKFrameHandler NPKFrameTable::frame(const uint32_t frame, const NPKPaletteManager* paletteManager) const
+{
+    return NPKFrameHandler(index(frame), data(frame), paletteManager);
+}
+
+uint64_t NPKFrameTable::memoryUsage() const
+{
+    return sizeof(*this) + m_refs.capacity() * sizeof(uint32_t) + m_links.capacity() * sizeof(uint32_t) +
+           m_matrices.capacity() * sizeof(MatrixIndex) + m_dataOffsets.capacity() * sizeof(uint32_t) +
+           m_dds.capacity() * sizeof(NPKFrameIndex);
+}
+} // neapu
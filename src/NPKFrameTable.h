@@ -0,0 +1,105 @@
+//
+// Created by liu86 on 24-8-20.
+//
+
+#ifndef NPKFRAMETABLE_H
+#define NPKFRAMETABLE_H
+#include <cstdint>
+#include <vector>
+
+#include "NPKFrameHandler.h"
+
+namespace neapu {
+enum FrameKind: uint32_t {
+    FK_LINK = 0x00,   // 链接帧，只保存链接目标
+    FK_MATRIX = 0x01, // 点阵帧（V2/V4/V6），保存36字节索引与数据偏移
+    FK_DDS = 0x02     // DDS帧（V5），保存完整索引
+};
+
+/**
+ * @brief 一个Image的帧表，按索引类型分开保存
+ *
+ * 每帧只占4字节的引用，高2位为类型，低30位为在对应类型表中的序号。链接帧只保存链接目标，
+ * 点阵帧保存文件中的36字节索引和数据在payload中的偏移，只有DDS帧保存完整的索引。
+ * 帧数据不单独分配，都位于setPayload设置的连续内存中。
+ * 加载完成后只读，可多线程同时调用const方法。
+ */
+class NPKFrameTable {
+public:
+    static constexpr uint32_t NO_DATA = UINT32_MAX; // 没有数据或数据不完整
+
+    NPKFrameTable() = default;
+    virtual ~NPKFrameTable() = default;
+
+    void clear();
+    void shrinkToFit();
+    /**
+     * @brief 追加一帧，类型由颜色类型决定，与NPKFrameHandler::loadIndex读取的长度一致
+     * @param index 帧索引
+     * @return 帧序号
+     */
+    uint32_t add(const NPKFrameIndex& index);
+    /**
+     * @brief 设置点阵帧的数据偏移，其他类型的帧忽略
+     * @param frame 帧序号
+     * @param offset 数据在payload中的偏移，NO_DATA表示没有数据
+     */
+    void setDataOffset(uint32_t frame, uint32_t offset);
+    /**
+     * @brief 设置帧数据所在的内存，调用者保证在帧表使用期间有效
+     */
+    void setPayload(const uint8_t* payload) { m_payload = payload; }
+
+    uint32_t size() const { return static_cast<uint32_t>(m_refs.size()); }
+    FrameKind kind(uint32_t frame) const { return static_cast<FrameKind>(m_refs[frame] >> KIND_SHIFT); }
+    uint32_t linkTo(uint32_t frame) const;
+    ColorType colorType(uint32_t frame) const;
+    /**
+     * @brief 还原完整的帧索引，未保存的字段为0
+     */
+    NPKFrameIndex index(uint32_t frame) const;
+    /**
+     * @brief 帧数据，非点阵帧或没有数据时返回nullptr
+     */
+    const uint8_t* data(uint32_t frame) const;
+    /**
+     * @brief 构造用于解码的帧，不持有数据和调色板，只能在帧表和调色板有效期间使用
+     * @param frame 帧序号，需小于size()
+     * @param paletteManager 调色板，V2为nullptr
+     */
+    NPKFrameHandler frame(uint32_t frame, const NPKPaletteManager* paletteManager) const;
+    // 帧表本身占用的内存，不包括payload
+    uint64_t memoryUsage() const;
+
+private:
+#pragma pack(push, 1)
+    // 与文件中的点阵帧索引相同
+    typedef struct MatrixIndex {
+        ColorType colorType;
+        CompressType compressType;
+        uint32_t width;
+        uint32_t height;
+        uint32_t dataSize;
+        uint32_t posX;
+        uint32_t posY;
+        uint32_t frameWidth;
+        uint32_t frameHeight;
+    } MatrixIndex;
+#pragma pack(pop)
+    static_assert(sizeof(MatrixIndex) == MATRIX_FRAME_INDEX_SIZE);
+
+    static constexpr uint32_t KIND_SHIFT = 30;
+    static constexpr uint32_t SLOT_MASK = (1u << KIND_SHIFT) - 1;
+    uint32_t slot(const uint32_t frame) const { return m_refs[frame] & SLOT_MASK; }
+
+private:
+    std::vector<uint32_t> m_refs;
+    std::vector<uint32_t> m_links;
+    std::vector<MatrixIndex> m_matrices;
+    std::vector<uint32_t> m_dataOffsets; // 与m_matrices一一对应
+    std::vector<NPKFrameIndex> m_dds;
+    const uint8_t* m_payload{nullptr};
+};
+} // neapu
+
+#endif //NPKFRAMETABLE_H
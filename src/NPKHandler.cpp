@@ -3,12 +3,20 @@
 //
 
 #include "NPKHandler.h"
+#include <algorithm>
 #include <cstdint>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
 #include <logger.h>
 #include "NPKImageHandler.h"
-#ifndef _WIN32
-#define fopen_s(pFile, filename, mode) (((*(pFile)) = fopen((filename), (mode))) == NULL)
-#endif
+#include "NPKFrameHandler.h"
+#include "NPKFileMapping.h"
+#include "NPKFileReader.h"
+#include "NPKMatrix.h"
+#include "NPKSidecar.h"
+#include "NPKVerifyCache.h"
 #ifdef USE_OPENSSL
 #include <openssl/evp.h>
 #endif
@@ -58,99 +66,301 @@ funcSHA256 NPKHandler::sha256 = [](const uint8_t* source, const uint64_t sourceL
 funcSHA256 NPKHandler::sha256 = nullptr;
 #endif
 
-bool NPKHandler::loadNPK(const std::string& path)
+typedef struct NPKVerifyTask {
+    std::mutex mutex;
+    std::condition_variable cond;
+    VerifyState state{VS_NONE};
+    // 任务本身持有校验状态，不能再强引用线程池，否则线程池可能在自己的工作线程中析构
+    std::weak_ptr<NPKThreadPool> pool;
+
+    void finish(const VerifyState result)
+    {
+        std::lock_guard lock(mutex);
+        state = result;
+        cond.notify_all();
+    }
+} NPKVerifyTask;
+
+bool NPKHandler::loadNPK(const std::string& path, const NPKLoadOptions& options)
 {
-    if (sha256 == nullptr) {
+    m_loadError = LE_NONE;
+    if (options.verifyMode == VM_STRICT && sha256 == nullptr) {
         LOG_ERROR << "SHA256 function is not set";
+        m_loadError = LE_VERIFY;
         return false;
     }
 
     if (m_images.size() > 0) {
         m_images.clear();
     }
-
-    FILE* file = nullptr;
-    int ret = fopen_s(&file, path.c_str(), "rb");
-    if (ret != 0) {
-        LOG_ERROR << "Failed to open file: " << path;
-        return false;
+    m_source.reset();
+    m_verifyTask.reset();
+    m_fromSidecar = false;
+    m_filePath.clear();
+    m_names.reset();
+    if (m_frameCache) {
+        m_frameCache->clear();
     }
 
+    const uint8_t* buffer = nullptr;
+    uint64_t bufferSize = 0; // 不使用内存映射时只有文件头和索引表
     uint64_t fileSize = 0;
-    _fseeki64(file, 0, SEEK_END);
-    fileSize = _ftelli64(file);
-    _fseeki64(file, 0, SEEK_SET);
-    auto* buffer = new uint8_t[fileSize];
-    ret = fread(buffer, 1, fileSize, file);
-    fclose(file);
-    if (ret != fileSize) {
-        LOG_ERROR << "Failed to read file: " << path;
-        delete[] buffer;
-        return false;
+    std::shared_ptr<uint8_t[]> indexBuffer;
+    std::shared_ptr<NPKFileMapping> mapping;
+    std::shared_ptr<NPKFileReader> reader;
+    if (options.useMmap) {
+        mapping = std::make_shared<NPKFileMapping>();
+        if (!mapping->open(path)) {
+            m_loadError = LE_OPEN;
+            return false;
+        }
+        buffer = mapping->data();
+        fileSize = mapping->size();
+    } else {
+        // 先只读取文件头，索引表和校验值在确认范围后读取，Image数据在解析时按偏移读取，不需要整个文件的缓冲区
+        reader = std::make_shared<NPKFileReader>();
+        if (!reader->open(path)) {
+            m_loadError = LE_OPEN;
+            return false;
+        }
+        fileSize = reader->size();
     }
 
-    ret = memcpy_s(&m_header, sizeof(m_header), buffer, sizeof(m_header));
-    if (ret != 0) {
-        LOG_ERROR << "Failed to copy header";
-        delete[] buffer;
+    if (fileSize < sizeof(m_header)) {
+        LOG_ERROR << "File is too small: " << path;
+        m_loadError = LE_HEADER;
         return false;
     }
+    int ret = 0;
+    if (reader) {
+        if (!reader->read(0, sizeof(m_header), reinterpret_cast<uint8_t*>(&m_header))) {
+            LOG_ERROR << "Failed to read header: " << path;
+            m_loadError = LE_OPEN;
+            return false;
+        }
+    } else {
+        ret = memcpy_s(&m_header, sizeof(m_header), buffer, sizeof(m_header));
+        if (ret != 0) {
+            LOG_ERROR << "Failed to copy header";
+            m_loadError = LE_HEADER;
+            return false;
+        }
+    }
 
     static constexpr char magic[] = "NeoplePack_Bill";
     if (memcmp(m_header.magic, magic, sizeof(magic)) != 0) {
         LOG_ERROR << "Magic is not correct";
-        delete[] buffer;
+        m_loadError = LE_HEADER;
         return false;
     }
 
-    uint64_t verifyOffset = sizeof(NPKHeader) + m_header.imgCount * sizeof(NPKImageIndex);
-    uint64_t verifySize = (verifyOffset / 17) * 17;
-    uint8_t verify[32];
-    ret = memcpy_s(verify, sizeof(verify), buffer + verifyOffset, sizeof(verify));
-    if (ret != 0) {
-        LOG_ERROR << "Failed to copy verify";
-        delete[] buffer;
+    const uint64_t verifyOffset = sizeof(NPKHeader) + m_header.imgCount * sizeof(NPKImageIndex);
+    constexpr uint64_t verifyLen = 32; // 索引表之后的SHA256
+    if (verifyOffset + verifyLen > fileSize) {
+        LOG_ERROR << "Index table is out of range";
+        m_loadError = LE_INDEX;
         return false;
     }
-
-    uint8_t sha256[32];
-    if (!NPKHandler::sha256(buffer, verifySize, sha256, sizeof(sha256))) {
-        LOG_ERROR << "Failed to calculate sha256";
-        delete[] buffer;
-        return false;
+    bufferSize = fileSize;
+    if (reader) {
+        bufferSize = verifyOffset + verifyLen;
+        indexBuffer.reset(new uint8_t[bufferSize]);
+        if (!reader->read(0, bufferSize, indexBuffer.get())) {
+            LOG_ERROR << "Failed to read index table: " << path;
+            m_loadError = LE_OPEN;
+            return false;
+        }
+        buffer = indexBuffer.get();
+    }
+    if (mapping) {
+        // 索引表和校验区顺序读取一遍，之后对帧数据的访问都是随机的
+        mapping->advise(0, verifyOffset + verifyLen, MA_SEQUENTIAL);
+        mapping->advise(verifyOffset + verifyLen, fileSize, MA_RANDOM);
     }
 
-    if (memcmp(sha256, verify, sizeof(sha256)) != 0) {
-        LOG_ERROR << "SHA256 verify failed";
-        delete[] buffer;
-        return false;
+    // 校验缓存以加载时的文件状态为准
+    memcpy(m_fileHash, buffer + verifyOffset, sizeof(m_fileHash));
+    NPKFileStamp stamp;
+    const bool hasStamp = NPKVerifyCache::getStamp(path, stamp) && stamp.size == fileSize;
+    const bool useCache = options.verifyMode != VM_SKIP && options.verifyCache && hasStamp;
+    auto verifyTask = std::make_shared<NPKVerifyTask>();
+    if (options.verifyMode == VM_SKIP) {
+        verifyTask->state = VS_SKIPPED;
+    } else if (useCache && NPKVerifyCache::global().contains(path, stamp)) {
+        verifyTask->state = VS_VERIFIED;
+        if (options.verifyMode == VM_DEFERRED && options.verifyCallback) {
+            options.verifyCallback(path, true);
+        }
+    } else if (options.verifyMode == VM_STRICT) {
+        if (!verifyIndex(buffer, verifyOffset)) {
+            m_loadError = LE_VERIFY;
+            return false;
+        }
+        verifyTask->state = VS_VERIFIED;
+        if (useCache) {
+            NPKVerifyCache::global().insert(path, stamp);
+        }
+    } else if (sha256 == nullptr) {
+        LOG_WARNING << "SHA256 function is not set, deferred verify failed: " << path;
+        verifyTask->state = VS_FAILED;
+        if (options.verifyCallback) {
+            options.verifyCallback(path, false);
+        }
+    } else {
+        // 后台校验只需要文件头到校验值的部分：内存映射时直接引用映射的数据，否则引用只读取的这一段
+        std::shared_ptr<const uint8_t> region;
+        if (mapping) {
+            region = std::shared_ptr<const uint8_t>(mapping, mapping->data());
+        } else {
+            region = std::shared_ptr<const uint8_t>(indexBuffer, indexBuffer.get());
+        }
+        verifyTask->state = VS_PENDING;
+        const auto pool = options.verifyPool ? options.verifyPool : NPKThreadPool::global();
+        verifyTask->pool = pool;
+        pool->submit([verifyTask, region, verifyOffset, path, stamp, useCache, callback = options.verifyCallback] {
+            const bool verified = verifyIndex(region.get(), verifyOffset);
+            if (verified && useCache) {
+                NPKVerifyCache::global().insert(path, stamp);
+            }
+            if (!verified) {
+                LOG_WARNING << "Deferred verify failed: " << path;
+            }
+            if (callback) {
+                callback(path, verified);
+            }
+            verifyTask->finish(verified ? VS_VERIFIED : VS_FAILED);
+        });
     }
+    m_verifyTask = verifyTask;
 
-    // 读取img
+    // 读取img，内存映射模式下帧数据不拷贝，直接引用映射的文件数据
+    std::shared_ptr<const void> source;
+    if (mapping) {
+        source = mapping;
+    }
+    auto names = std::make_shared<NPKNameIndex>();
+    names->reserve(m_header.imgCount);
+    const std::string sidecarPath = options.sidecarPath.empty() ? NPKSidecar::defaultPath(path) : options.sidecarPath;
+    if (options.sidecarMode != SCM_NONE && hasStamp) {
+        // 内存映射时帧数据直接引用映射的文件数据，否则每个Image只读取自己的数据
+        if (NPKSidecar::load(sidecarPath, m_header, mapping ? buffer : nullptr, reader.get(), stamp, m_fileHash, m_images, names)) {
+            for (const auto& image : m_images) {
+                image->setDDSCachePolicy(options.ddsCachePolicy, options.ddsCacheCapacity);
+                image->setParallelDecode(options.parallelDecode);
+                image->m_source = source;
+            }
+            m_fromSidecar = true;
+        }
+    }
     uint64_t offset = sizeof(NPKHeader);
-    for (uint32_t i = 0; i < m_header.imgCount; ++i) {
+    for (uint32_t i = 0; !m_fromSidecar && i < m_header.imgCount; ++i) {
         auto image = std::make_shared<NPKImageHandler>();
-        ret = image->loadIndex(buffer + offset, fileSize - offset);
+        ret = image->loadIndex(buffer + offset, bufferSize - offset, names);
         if (ret < 0) {
             LOG_ERROR << "Failed to load index";
-            delete[] buffer;
+            m_images.clear();
+            m_loadError = LE_INDEX;
             return false;
         }
         offset += ret;
-        ret = image->loadData(buffer, fileSize);
+        image->setDDSCachePolicy(options.ddsCachePolicy, options.ddsCacheCapacity);
+        image->setParallelDecode(options.parallelDecode);
+        image->m_source = source;
+        if (options.lazyLoad) {
+            if (reader) {
+                image->m_pendingReader = reader;
+            } else {
+                image->m_pendingData = buffer;
+                image->m_pendingDataLen = fileSize;
+            }
+            m_images.push_back(image);
+            continue;
+        }
+        ret = reader ? image->loadData(*reader) : image->loadData(buffer, fileSize, false);
         if (ret < 0) {
             LOG_ERROR << "Failed to load data. index: " << i;
-            delete[] buffer;
+            m_images.clear();
+            m_loadError = LE_DATA;
             return false;
         }
         m_images.push_back(image);
     }
 
-    delete[] buffer;
+    m_source = source;
+    names->shrinkToFit();
+    m_names = names;
     m_fileName = path.substr(path.find_last_of('/') + 1);
+    m_filePath = path;
+    m_fileStamp = hasStamp ? stamp : NPKFileStamp{};
+    if (options.sidecarMode == SCM_UPDATE && !m_fromSidecar && hasStamp) {
+        saveSidecar(sidecarPath);
+    }
+    return true;
+}
+
+bool NPKHandler::saveSidecar(const std::string& path) const
+{
+    if (m_filePath.empty() || m_fileStamp.size == 0) {
+        LOG_ERROR << "No NPK file is loaded";
+        return false;
+    }
+    return NPKSidecar::save(path.empty() ? NPKSidecar::defaultPath(m_filePath) : path, getImages(), m_fileStamp, m_fileHash);
+}
+
+bool NPKHandler::verifyIndex(const uint8_t* data, const uint64_t verifyOffset)
+{
+    if (sha256 == nullptr) {
+        LOG_ERROR << "SHA256 function is not set";
+        return false;
+    }
+
+    // 只校验索引表中17的整数倍长度的部分
+    const uint64_t verifySize = (verifyOffset / 17) * 17;
+    uint8_t result[32];
+    if (!sha256(data, verifySize, result, sizeof(result))) {
+        LOG_ERROR << "Failed to calculate sha256";
+        return false;
+    }
+
+    if (memcmp(result, data + verifyOffset, sizeof(result)) != 0) {
+        LOG_ERROR << "SHA256 verify failed";
+        return false;
+    }
     return true;
 }
 
+VerifyState NPKHandler::getVerifyState() const
+{
+    const auto task = m_verifyTask;
+    if (!task) {
+        return VS_NONE;
+    }
+    std::lock_guard lock(task->mutex);
+    return task->state;
+}
+
+VerifyState NPKHandler::waitVerify() const
+{
+    const auto task = m_verifyTask;
+    if (!task) {
+        return VS_NONE;
+    }
+    while (true) {
+        {
+            std::lock_guard lock(task->mutex);
+            if (task->state != VS_PENDING) {
+                return task->state;
+            }
+        }
+        const auto pool = task->pool.lock();
+        if (!pool || !pool->runPendingTask()) {
+            std::unique_lock lock(task->mutex);
+            task->cond.wait(lock, [&task] { return task->state != VS_PENDING; });
+            return task->state;
+        }
+    }
+}
+
 uint32_t neapu::NPKHandler::getImageCount() const
 {
     return m_header.imgCount;
@@ -162,6 +372,390 @@ std::shared_ptr<neapu::NPKImageHandler> neapu::NPKHandler::getImage(uint32_t ind
         return nullptr;
     }
 
+    if (!m_images[index]->ensureLoaded()) {
+        return nullptr;
+    }
     return m_images[index];
 }
-}
\ No newline at end of file
+
+const std::vector<std::shared_ptr<NPKImageHandler>>& NPKHandler::getImages() const
+{
+    for (const auto& image : m_images) {
+        image->ensureLoaded();
+    }
+    return m_images;
+}
+
+std::shared_ptr<NPKImageHandler> NPKHandler::getImage(const std::string_view name) const
+{
+    const int64_t index = findImage(name);
+    return index < 0 ? nullptr : getImage(static_cast<uint32_t>(index));
+}
+
+int64_t NPKHandler::findImage(const std::string_view name) const
+{
+    return m_names ? m_names->find(name) : -1;
+}
+
+std::vector<uint32_t> NPKHandler::findImages(const std::string_view prefix) const
+{
+    return m_names ? m_names->findPrefix(prefix) : std::vector<uint32_t>{};
+}
+
+std::vector<uint32_t> NPKHandler::listDirectory(const std::string_view directory) const
+{
+    return m_names ? m_names->list(directory) : std::vector<uint32_t>{};
+}
+
+void NPKHandler::setFrameCache(const uint64_t capacity, const FrameCachePolicy policy)
+{
+    setFrameCache(capacity, NPKFrameCache::createPolicy(policy, capacity));
+}
+
+void NPKHandler::setFrameCache(const uint64_t capacity, std::unique_ptr<NPKCachePolicy> policy)
+{
+    if (capacity == 0) {
+        m_frameCache.reset();
+        return;
+    }
+    m_frameCache = std::make_shared<NPKFrameCache>(capacity, std::move(policy));
+}
+
+NPKFrameCacheStats NPKHandler::getFrameCacheStats() const
+{
+    if (!m_frameCache) {
+        return {};
+    }
+    return m_frameCache->stats();
+}
+
+bool NPKHandler::frameCacheKey(const NPKImageHandler& image, const NPKFrameKey& request, NPKFrameKey& key)
+{
+    const int64_t frameIndex = image.traceFrameIndex(request.frame);
+    if (frameIndex < 0) {
+        return false;
+    }
+    const bool usePalette = image.m_frames.kind(static_cast<uint32_t>(frameIndex)) == FK_MATRIX && image.m_paletteManager != nullptr;
+    key = NPKFrameKey{request.image, static_cast<uint32_t>(frameIndex), usePalette ? request.palette : 0};
+    return true;
+}
+
+std::shared_ptr<NPKMatrix> NPKHandler::getFrameMatrix(const uint32_t imageIndex, const uint32_t frameIndex, const int paletteIndex) const
+{
+    const auto image = getImage(imageIndex);
+    NPKFrameKey key;
+    if (!image || !frameCacheKey(*image, NPKFrameKey{imageIndex, frameIndex, paletteIndex}, key)) {
+        return nullptr;
+    }
+    if (m_frameCache) {
+        if (auto matrix = m_frameCache->get(key)) {
+            return matrix;
+        }
+    }
+
+    auto matrix = image->getFrameMatrix(key.frame, key.palette);
+    if (m_frameCache && matrix) {
+        m_frameCache->put(key, matrix);
+    }
+    return matrix;
+}
+
+std::vector<uint8_t> NPKHandler::getFramePngData(const uint32_t imageIndex, const uint32_t frameIndex, const int paletteIndex,
+                                                 const NPKPngOptions& options) const
+{
+    const auto matrix = getFrameMatrix(imageIndex, frameIndex, paletteIndex);
+    if (!matrix) {
+        return {};
+    }
+    return matrix->toPng(options);
+}
+
+// 一次批量解码的共享状态，任务可能在批量解码返回后才结束，所以用shared_ptr保存
+typedef struct NPKBatchState {
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint32_t remaining{0};
+    uint32_t succeeded{0};
+    std::function<void(uint32_t request, const std::shared_ptr<NPKMatrix>& matrix)> deliver;
+
+    // 持有锁调用deliver，保证回调串行且按完成顺序
+    void complete(const std::vector<uint32_t>& requests, const std::shared_ptr<NPKMatrix>& matrix)
+    {
+        std::lock_guard lock(mutex);
+        for (const auto request : requests) {
+            deliver(request, matrix);
+        }
+        if (matrix) {
+            succeeded += static_cast<uint32_t>(requests.size());
+        }
+        remaining -= static_cast<uint32_t>(requests.size());
+        if (remaining == 0) {
+            cond.notify_all();
+        }
+    }
+} NPKBatchState;
+
+namespace {
+// 去重后的解码单元，key中的帧为追踪链接后的帧，不使用调色板的帧调色板为0
+typedef struct BatchUnit {
+    std::shared_ptr<NPKImageHandler> image;
+    NPKFrameKey key;
+    std::vector<uint32_t> requests;
+} BatchUnit;
+
+std::shared_ptr<NPKMatrix> cachedFrame(const std::shared_ptr<NPKFrameCache>& cache, const NPKFrameKey& key)
+{
+    return cache ? cache->get(key) : nullptr;
+}
+
+void cacheFrame(const std::shared_ptr<NPKFrameCache>& cache, const NPKFrameKey& key, const std::shared_ptr<NPKMatrix>& matrix)
+{
+    if (cache && matrix) {
+        cache->put(key, matrix);
+    }
+}
+}
+
+std::vector<NPKFrameKey> NPKHandler::frameKeys(const uint32_t imageBegin, uint32_t imageEnd, const int paletteIndex) const
+{
+    std::vector<NPKFrameKey> keys;
+    imageEnd = imageEnd < m_images.size() ? imageEnd : static_cast<uint32_t>(m_images.size());
+    for (uint32_t i = imageBegin; i < imageEnd; ++i) {
+        const auto image = getImage(i);
+        if (!image) {
+            continue;
+        }
+        for (uint32_t frame = 0; frame < image->getFrameCount(); ++frame) {
+            keys.push_back(NPKFrameKey{i, frame, paletteIndex});
+        }
+    }
+    return keys;
+}
+
+uint32_t NPKHandler::decodeFrames(const std::vector<NPKFrameKey>& keys, const NPKFrameCallback& callback,
+                                  std::shared_ptr<NPKThreadPool> pool) const
+{
+    if (!pool) {
+        pool = NPKThreadPool::global();
+    }
+    const auto state = startBatch(keys, pool, [&keys, &callback](const uint32_t request, const std::shared_ptr<NPKMatrix>& matrix) {
+        if (callback) {
+            callback(keys[request], matrix);
+        }
+    });
+
+    // 等待期间帮忙执行线程池中的任务，队列为空时说明剩下的任务都在执行中
+    while (true) {
+        {
+            std::lock_guard lock(state->mutex);
+            if (state->remaining == 0) {
+                break;
+            }
+        }
+        if (!pool->runPendingTask()) {
+            std::unique_lock lock(state->mutex);
+            state->cond.wait(lock, [&state] { return state->remaining == 0; });
+            break;
+        }
+    }
+    return state->succeeded;
+}
+
+std::vector<std::future<std::shared_ptr<NPKMatrix>>> NPKHandler::decodeFramesAsync(const std::vector<NPKFrameKey>& keys,
+                                                                                    std::shared_ptr<NPKThreadPool> pool) const
+{
+    if (!pool) {
+        pool = NPKThreadPool::global();
+    }
+    auto promises = std::make_shared<std::vector<std::promise<std::shared_ptr<NPKMatrix>>>>(keys.size());
+    std::vector<std::future<std::shared_ptr<NPKMatrix>>> futures;
+    futures.reserve(keys.size());
+    for (auto& promise : *promises) {
+        futures.push_back(promise.get_future());
+    }
+    startBatch(keys, pool, [promises](const uint32_t request, const std::shared_ptr<NPKMatrix>& matrix) {
+        (*promises)[request].set_value(matrix);
+    });
+    return futures;
+}
+
+std::shared_ptr<NPKBatchState> NPKHandler::startBatch(const std::vector<NPKFrameKey>& keys, const std::shared_ptr<NPKThreadPool>& pool,
+                                                      std::function<void(uint32_t request, const std::shared_ptr<NPKMatrix>& matrix)> deliver)
+    const
+{
+    auto state = std::make_shared<NPKBatchState>();
+    state->deliver = std::move(deliver);
+    state->remaining = static_cast<uint32_t>(keys.size());
+
+    // 按追踪后的帧去重，同一个图集上的DDS帧分为一组
+    auto units = std::make_shared<std::vector<BatchUnit>>();
+    std::unordered_map<NPKFrameKey, uint32_t, NPKFrameKeyHash> unitIndex;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> ddsGroups;
+    std::vector<uint32_t> invalid;
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+        const auto image = getImage(keys[i].image);
+        NPKFrameKey key;
+        if (!image || !frameCacheKey(*image, keys[i], key)) {
+            invalid.push_back(i);
+            continue;
+        }
+        auto [it, inserted] = unitIndex.emplace(key, static_cast<uint32_t>(units->size()));
+        if (inserted) {
+            units->push_back(BatchUnit{image, key, {}});
+            if (image->m_frames.kind(key.frame) == FK_DDS) {
+                ddsGroups[static_cast<uint64_t>(key.image) << 32 | image->m_frames.index(key.frame).ddsIndex].push_back(it->second);
+            }
+        }
+        (*units)[it->second].requests.push_back(i);
+    }
+    if (!invalid.empty()) {
+        state->complete(invalid, nullptr);
+    }
+
+    // 多帧共用的图集先提交，只解码一次图集，再在线程池中分别裁剪
+    const auto cache = m_frameCache;
+    std::vector<bool> grouped(units->size(), false);
+    for (auto& [groupKey, members] : ddsGroups) {
+        if (members.size() < 2) {
+            continue;
+        }
+        for (const auto unit : members) {
+            grouped[unit] = true;
+        }
+        NPKThreadPool* poolPtr = pool.get(); // 任务在线程池中执行，期间线程池一定有效
+        pool->submit([state, units, cache, poolPtr, members = std::move(members), ddsIndex = static_cast<uint32_t>(groupKey)] {
+            // 所有帧都已缓存时不需要解码图集
+            std::vector<std::shared_ptr<NPKMatrix>> matrices(members.size());
+            bool needAtlas = false;
+            for (uint32_t i = 0; i < members.size(); ++i) {
+                matrices[i] = cachedFrame(cache, (*units)[members[i]].key);
+                needAtlas = needAtlas || !matrices[i];
+            }
+            const auto atlas = needAtlas ? (*units)[members[0]].image->getDDSMatrix(ddsIndex) : nullptr;
+            poolPtr->parallelFor(static_cast<uint32_t>(members.size()), [&](const uint32_t begin, const uint32_t end) {
+                for (uint32_t i = begin; i < end; ++i) {
+                    const auto& unit = (*units)[members[i]];
+                    if (!matrices[i]) {
+                        matrices[i] = unit.image->clipFrameMatrix(unit.key.frame, atlas);
+                        cacheFrame(cache, unit.key, matrices[i]);
+                    }
+                    state->complete(unit.requests, matrices[i]);
+                }
+            });
+        });
+    }
+    for (uint32_t i = 0; i < units->size(); ++i) {
+        if (grouped[i]) {
+            continue;
+        }
+        pool->submit([state, units, cache, i] {
+            const auto& unit = (*units)[i];
+            auto matrix = cachedFrame(cache, unit.key);
+            if (!matrix) {
+                matrix = unit.image->getFrameMatrix(unit.key.frame, unit.key.palette);
+                cacheFrame(cache, unit.key, matrix);
+            }
+            state->complete(unit.requests, matrix);
+        });
+    }
+    return state;
+}
+
+namespace {
+// 一次批量加载的共享状态，线程池中的任务可能在调用线程已经完成全部文件后才开始执行
+typedef struct BulkLoadState {
+    std::vector<std::string> paths;
+    NPKLoadOptions options;
+    NPKBulkOptions bulkOptions;
+    std::vector<uint32_t> order; // 按文件大小从大到小
+    std::atomic<uint32_t> next{0};
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<NPKBulkResult> results;
+    uint32_t finished{0};
+    uint32_t workers{0};
+
+    bool cancelled() const { return bulkOptions.cancel && bulkOptions.cancel->load(std::memory_order_relaxed); }
+
+    // 每个工作者依次领取下一个文件，工作者的数量就是同时加载的上限
+    void work()
+    {
+        while (!cancelled()) {
+            const uint32_t next = this->next.fetch_add(1);
+            if (next >= order.size()) {
+                break;
+            }
+            const uint32_t index = order[next];
+            auto handler = std::make_shared<NPKHandler>();
+            const bool loaded = handler->loadNPK(paths[index], options);
+
+            std::lock_guard lock(mutex);
+            auto& result = results[index];
+            result.status = loaded ? BLS_LOADED : BLS_FAILED;
+            result.error = handler->getLoadError();
+            result.handler = loaded ? std::move(handler) : nullptr;
+            finished++;
+            if (bulkOptions.callback) {
+                bulkOptions.callback(index, result, finished, static_cast<uint32_t>(results.size()));
+            }
+        }
+
+        std::lock_guard lock(mutex);
+        if (--workers == 0) {
+            cond.notify_all();
+        }
+    }
+} BulkLoadState;
+}
+
+std::vector<NPKBulkResult> NPKHandler::loadNPKs(const std::vector<std::string>& paths, const NPKLoadOptions& options,
+                                                const NPKBulkOptions& bulkOptions)
+{
+    if (paths.empty()) {
+        return {};
+    }
+    auto pool = bulkOptions.pool ? bulkOptions.pool : NPKThreadPool::global();
+    const auto state = std::make_shared<BulkLoadState>();
+    state->paths = paths;
+    state->options = options;
+    state->bulkOptions = bulkOptions;
+    state->results.resize(paths.size());
+    state->order.resize(paths.size());
+    for (uint32_t i = 0; i < paths.size(); ++i) {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(paths[i], ec);
+        state->results[i].path = paths[i];
+        state->results[i].fileSize = ec ? 0 : size;
+        state->order[i] = i;
+    }
+    std::stable_sort(state->order.begin(), state->order.end(), [&state](const uint32_t a, const uint32_t b) {
+        return state->results[a].fileSize > state->results[b].fileSize;
+    });
+
+    uint32_t workers = bulkOptions.maxConcurrency ? bulkOptions.maxConcurrency : pool->threadCount() + 1;
+    workers = std::min(workers, static_cast<uint32_t>(paths.size()));
+    state->workers = workers;
+    for (uint32_t i = 1; i < workers; ++i) {
+        pool->submit([state] { state->work(); });
+    }
+    state->work();
+
+    // 等待其他工作者结束，期间帮忙执行线程池中的任务
+    while (true) {
+        {
+            std::lock_guard lock(state->mutex);
+            if (state->workers == 0) {
+                break;
+            }
+        }
+        if (!pool->runPendingTask()) {
+            std::unique_lock lock(state->mutex);
+            state->cond.wait(lock, [&state] { return state->workers == 0; });
+            break;
+        }
+    }
+    std::lock_guard lock(state->mutex);
+    return std::move(state->results);
+}
+}
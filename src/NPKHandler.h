@@ -4,13 +4,28 @@
 
 #ifndef NPKLOADER_H
 #define NPKLOADER_H
+#include <atomic>
 #include <cstdint>
 #include <functional>
+#include <future>
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
+
+#include "NPKDDSCache.h"
+#include "NPKFrameCache.h"
+#include "NPKMatrix.h"
+#include "NPKNameIndex.h"
+#include "NPKThreadPool.h"
+#include "NPKVerifyCache.h"
 
 namespace neapu {
+class NPKHandler;
+class NPKImageHandler;
+class NPKFileMapping;
+struct NPKBatchState;
+struct NPKVerifyTask;
 using funcSHA256 = std::function<bool(const uint8_t* source, const uint64_t sourceLen, uint8_t* dst, const uint64_t dstLen)>;
 #pragma pack(push, 1)
 typedef struct NPKHeader {
@@ -19,6 +34,116 @@ typedef struct NPKHeader {
 } NPKHeader;
 #pragma pack(pop)
 
+enum VerifyMode: uint32_t {
+    VM_STRICT = 0x00,   // 加载时同步校验，校验失败则加载失败
+    VM_DEFERRED = 0x01, // 加载后在线程池中校验，通过回调或getVerifyState获取结果，校验失败不影响已加载的数据
+    VM_SKIP = 0x02      // 不校验，用于可信的文件，不需要设置sha256
+};
+
+enum VerifyState: uint32_t {
+    VS_NONE = 0x00,     // 没有加载NPK
+    VS_PENDING = 0x01,  // 后台校验中
+    VS_VERIFIED = 0x02, // 校验通过或命中校验缓存
+    VS_FAILED = 0x03,   // 后台校验失败
+    VS_SKIPPED = 0x04   // 没有校验
+};
+
+enum LoadError: uint32_t {
+    LE_NONE = 0x00,   // 加载成功
+    LE_OPEN = 0x01,   // 文件无法打开、映射或读取
+    LE_HEADER = 0x02, // 文件过小或文件头格式错误
+    LE_INDEX = 0x03,  // 索引表超出文件范围或无法解析
+    LE_VERIFY = 0x04, // 同步校验失败或没有设置sha256
+    LE_DATA = 0x05    // Image数据无法解析
+};
+
+enum SidecarMode: uint32_t {
+    SCM_NONE = 0x00,  // 不使用索引文件
+    SCM_READ = 0x01,  // 索引文件有效时从索引文件加载，否则正常解析
+    SCM_UPDATE = 0x02 // 同SCM_READ，索引文件不存在或已失效时在解析后重新生成
+};
+
+/**
+ * @brief VM_DEFERRED校验完成的回调
+ * @param path 传给loadNPK的路径
+ * @param verified 校验是否通过
+ */
+using NPKVerifyCallback = std::function<void(const std::string& path, bool verified)>;
+
+typedef struct NPKLoadOptions {
+    // 使用内存映射加载，帧数据直接引用映射内存而不再拷贝，映射在所有Image释放前保持有效；
+    // 不使用时只读取文件头和索引表，每个Image解析时从文件中读取自己的数据并拷贝帧数据
+    bool useMmap = false;
+    // 延迟加载，加载时只读取Image索引表，每个Image在第一次getImage()时才解析。
+    // 不使用内存映射时每个NPK占用一个文件描述符，全部Image解析完或NPK释放后才关闭，
+    // 通过loadNPKs或NPKFileSystem延迟加载大量NPK时要注意进程的文件描述符上限，可以改用useMmap
+    bool lazyLoad = false;
+    // V5图集缓存策略，应用到所有Image，之后也可以通过NPKImageHandler::setDDSCachePolicy单独设置
+    DDSCachePolicy ddsCachePolicy = DCP_NONE;
+    uint32_t ddsCacheCapacity = 1;
+    // V5图集多线程解码，应用到所有Image，pool可使用NPKThreadPool::global()
+    NPKParallelOptions parallelDecode{};
+    // SHA256校验方式
+    VerifyMode verifyMode = VM_STRICT;
+    // 通过NPKVerifyCache::global()跳过大小和修改时间都未变化的已校验文件，校验通过的文件会加入缓存
+    bool verifyCache = true;
+    // VM_DEFERRED校验完成后调用，可能在工作线程中执行，命中缓存或无法校验时在loadNPK中直接调用
+    NPKVerifyCallback verifyCallback{nullptr};
+    // VM_DEFERRED使用的线程池，为空时使用NPKThreadPool::global()
+    std::shared_ptr<NPKThreadPool> verifyPool{nullptr};
+    // 索引文件，从索引文件加载时忽略lazyLoad，帧数据总是引用保留的文件数据
+    SidecarMode sidecarMode = SCM_NONE;
+    std::string sidecarPath{}; // 为空时使用NPK路径加".idx"
+} NPKLoadOptions;
+
+/**
+ * @brief 批量解码时每帧完成的回调
+ * @param key 请求的帧，与传入时相同
+ * @param matrix 解码结果，失败时为nullptr，可能与同一批中的其他请求共享，不能修改
+ */
+using NPKFrameCallback = std::function<void(const NPKFrameKey& key, const std::shared_ptr<NPKMatrix>& matrix)>;
+
+enum BulkLoadStatus: uint32_t {
+    BLS_LOADED = 0x00,   // 加载成功
+    BLS_FAILED = 0x01,   // 文件无法读取、格式错误或校验失败，原因见NPKBulkResult::error，详细信息见日志
+    BLS_CANCELLED = 0x02 // 取消时还没有开始加载
+};
+
+typedef struct NPKBulkResult {
+    std::string path;
+    BulkLoadStatus status = BLS_CANCELLED;
+    LoadError error = LE_NONE;                    // 只在BLS_FAILED时不为LE_NONE
+    std::shared_ptr<NPKHandler> handler{nullptr}; // 只在BLS_LOADED时有效
+    uint64_t fileSize = 0;                        // 无法获取时为0
+} NPKBulkResult;
+
+/**
+ * @brief 批量加载时每个文件加载结束的回调，串行调用，可能在工作线程中执行
+ * @param index 文件在传入列表中的序号
+ * @param result 加载结果，不会是BLS_CANCELLED
+ * @param finished 已结束的文件数量，包括本次
+ * @param total 文件总数
+ */
+using NPKBulkCallback = std::function<void(uint32_t index, const NPKBulkResult& result, uint32_t finished, uint32_t total)>;
+
+typedef struct NPKBulkOptions {
+    // 线程池，为空时使用NPKThreadPool::global()，调用线程也会参与加载
+    std::shared_ptr<NPKThreadPool> pool{nullptr};
+    // 同时加载的文件数量上限，为0时为线程池线程数加1
+    uint32_t maxConcurrency = 0;
+    NPKBulkCallback callback{nullptr};
+    // 置为true后不再开始新的文件，正在加载的文件会继续完成，可以在回调中设置
+    const std::atomic<bool>* cancel{nullptr};
+} NPKBulkOptions;
+
+/**
+ * @brief NPK文件的加载与读取
+ *
+ * 线程安全：所有const方法（getImage、getFrameMatrix、getFramePngData、decodeFrames、名称查找等）都可以多线程同时调用，
+ * 调用者不需要加锁。内部只有延迟加载的一次性解析、DDS图集缓存和帧缓存各自持有短暂的锁，没有全局锁。
+ * loadNPK和setFrameCache会替换内部数据，不能与同一对象上的其他调用同时进行；
+ * 之前获取的NPKImageHandler和NPKMatrix不受重新加载影响，可以继续使用。
+ */
 class NPKHandler {
     friend class NPKImageHandler;
 public:
@@ -27,20 +152,176 @@ public:
     /**
      * @brief 加载NPK文件
      * @param path NPK文件路径
+     * @param options 加载选项
      * @return 成功返回true，失败返回false
      */
-    bool loadNPK(const std::string& path);
+    bool loadNPK(const std::string& path, const NPKLoadOptions& options = {});
     uint32_t getImageCount() const;
+    /**
+     * @brief 获取Image，延迟加载模式下首次访问时解析，可多线程同时调用
+     * @param index Image索引
+     * @return 索引无效或解析失败返回nullptr
+     */
     std::shared_ptr<NPKImageHandler> getImage(uint32_t index) const;
-    const std::vector<std::shared_ptr<NPKImageHandler>>& getImages() const { return m_images; }
+    /**
+     * @brief 获取所有Image，延迟加载模式下会先解析全部Image
+     */
+    const std::vector<std::shared_ptr<NPKImageHandler>>& getImages() const;
+    /**
+     * @brief 按完整名称获取Image，延迟加载模式下首次访问时解析
+     * @param name 完整名称，如sprite/character/xxx.img
+     * @return 不存在或解析失败返回nullptr
+     */
+    std::shared_ptr<NPKImageHandler> getImage(std::string_view name) const;
+    /**
+     * @brief 按完整名称查找Image，不会解析Image，名称重复时返回第一个
+     * @return Image索引，不存在返回-1
+     */
+    int64_t findImage(std::string_view name) const;
+    /**
+     * @brief 查找名称以prefix开头的Image，不会解析Image
+     * @return 按名称排序的Image索引
+     */
+    std::vector<uint32_t> findImages(std::string_view prefix) const;
+    /**
+     * @brief 列出目录中的Image，不包括子目录
+     * @param directory 目录，如sprite/character，末尾的'/'可以省略
+     * @return 按索引排序的Image索引
+     */
+    std::vector<uint32_t> listDirectory(std::string_view directory) const;
+    // 所有Image共用的名称表，名称编号与Image索引相同，没有加载NPK时为nullptr
+    std::shared_ptr<const NPKNameIndex> getNameIndex() const { return m_names; }
     std::string getNpkName() const { return m_fileName; }
+    VerifyState getVerifyState() const;
+    // 上一次loadNPK是否从索引文件加载
+    bool isLoadedFromSidecar() const { return m_fromSidecar; }
+    // 上一次loadNPK失败的原因，成功时为LE_NONE
+    LoadError getLoadError() const { return m_loadError; }
+    /**
+     * @brief 为已加载的NPK生成索引文件，延迟加载模式下会先解析全部Image
+     * @param path 索引文件路径，为空时使用NPK路径加".idx"
+     * @return 成功返回true
+     */
+    bool saveSidecar(const std::string& path = {}) const;
+    /**
+     * @brief 等待VM_DEFERRED的后台校验完成，等待期间调用线程也会执行线程池中的任务
+     * @return 最终的校验状态
+     */
+    VerifyState waitVerify() const;
+
+    /**
+     * @brief 开启解码帧缓存，重新加载NPK时会清空
+     * @param capacity 字节预算，为0时关闭缓存
+     * @param policy 淘汰策略
+     */
+    void setFrameCache(uint64_t capacity, FrameCachePolicy policy = FCP_TINYLFU);
+    /**
+     * @brief 使用自定义淘汰策略开启解码帧缓存
+     * @param capacity 字节预算，为0时关闭缓存
+     * @param policy 淘汰策略，为空时使用LRU
+     */
+    void setFrameCache(uint64_t capacity, std::unique_ptr<NPKCachePolicy> policy);
+    NPKFrameCacheStats getFrameCacheStats() const;
+    /**
+     * @brief 获取帧画面，开启缓存时优先从缓存获取，返回的矩阵可能与其他调用者共享，不能修改
+     * @param imageIndex Image索引
+     * @param frameIndex 帧索引
+     * @param paletteIndex 调色板索引
+     * @return 失败返回nullptr
+     */
+    std::shared_ptr<NPKMatrix> getFrameMatrix(uint32_t imageIndex, uint32_t frameIndex, int paletteIndex = 0) const;
+    /**
+     * @brief 获取帧画面并编码为PNG
+     * @param imageIndex Image索引
+     * @param frameIndex 帧索引
+     * @param paletteIndex 调色板索引
+     * @param options PNG编码选项
+     * @return 失败返回空
+     */
+    std::vector<uint8_t> getFramePngData(uint32_t imageIndex, uint32_t frameIndex, int paletteIndex = 0,
+                                         const NPKPngOptions& options = {}) const;
+    /**
+     * @brief 生成[imageBegin, imageEnd)中全部帧的解码请求，用于批量解码
+     * @param imageBegin 第一个Image索引
+     * @param imageEnd 最后一个Image索引加1，超出范围时截断
+     * @param paletteIndex 调色板索引
+     */
+    std::vector<NPKFrameKey> frameKeys(uint32_t imageBegin, uint32_t imageEnd, int paletteIndex = 0) const;
+    /**
+     * @brief 在线程池中批量解码帧，全部完成后返回
+     *
+     * 批内链接到同一帧的请求只解码一次；同一个DDS图集上的多个帧只解码一次图集再分别裁剪，
+     * 只有一帧时只解码帧所在的区域。开启帧缓存时优先从缓存获取，解码结果也会放入缓存。
+     * 等待期间调用线程也会执行线程池中的任务，所以可以在线程池的任务中调用。
+     * @param keys 要解码的帧
+     * @param callback 按完成顺序串行调用，可能在工作线程中执行
+     * @param pool 线程池，为空时使用NPKThreadPool::global()
+     * @return 解码成功的请求数量
+     */
+    uint32_t decodeFrames(const std::vector<NPKFrameKey>& keys, const NPKFrameCallback& callback,
+                          std::shared_ptr<NPKThreadPool> pool = nullptr) const;
+    /**
+     * @brief 异步批量解码，去重与缓存规则同decodeFrames
+     *
+     * 任务只持有用到的Image，NPKHandler可以在完成前释放或重新加载。
+     * @param keys 要解码的帧
+     * @param pool 线程池，为空时使用NPKThreadPool::global()
+     * @return 与keys一一对应的结果，失败时为nullptr
+     */
+    std::vector<std::future<std::shared_ptr<NPKMatrix>>> decodeFramesAsync(const std::vector<NPKFrameKey>& keys,
+                                                                           std::shared_ptr<NPKThreadPool> pool = nullptr) const;
+
+    /**
+     * @brief 在线程池中同时加载多个NPK，全部结束或取消后返回
+     *
+     * 按文件大小从大到小开始加载，避免最大的文件最后才开始而拖长总时间。
+     * 单个文件失败不影响其他文件。等待期间调用线程也会执行线程池中的任务，所以可以在线程池的任务中调用。
+     * @param paths NPK文件路径
+     * @param options 每个文件的加载选项
+     * @param bulkOptions 并发、进度与取消
+     * @return 与paths一一对应的结果
+     */
+    static std::vector<NPKBulkResult> loadNPKs(const std::vector<std::string>& paths, const NPKLoadOptions& options = {},
+                                               const NPKBulkOptions& bulkOptions = {});
 
     static funcSHA256 sha256;
+private:
+    /**
+     * @brief 校验索引表
+     * @param data 从文件头开始的数据，包括索引表之后的校验值
+     * @param verifyOffset 索引表结束的位置，即校验值的偏移
+     * @return 校验通过返回true
+     */
+    static bool verifyIndex(const uint8_t* data, uint64_t verifyOffset);
+    /**
+     * @brief 帧缓存与批量解码共用的帧键，链接帧换成最终指向的帧，没有调色板的帧调色板统一为0，
+     * 同一画面不论以哪种方式请求都只缓存一份
+     * @param image 帧所在的Image
+     * @param request 请求的帧
+     * @param key 输出的帧键
+     * @return 帧不存在或链接无效返回false
+     */
+    static bool frameCacheKey(const NPKImageHandler& image, const NPKFrameKey& request, NPKFrameKey& key);
+    /**
+     * @brief 对请求去重后提交到线程池，每个请求完成时以请求序号调用deliver
+     */
+    std::shared_ptr<NPKBatchState> startBatch(const std::vector<NPKFrameKey>& keys, const std::shared_ptr<NPKThreadPool>& pool,
+                                              std::function<void(uint32_t request, const std::shared_ptr<NPKMatrix>& matrix)> deliver) const;
+
 private:
     std::string m_fileName;
+    std::string m_filePath;
+    NPKFileStamp m_fileStamp{};
+    uint8_t m_fileHash[32]{}; // 索引表之后的SHA256
+    bool m_fromSidecar{false};
+    LoadError m_loadError{LE_NONE};
 
     NPKHeader m_header{0};
     std::vector<std::shared_ptr<NPKImageHandler>> m_images;
+    std::shared_ptr<NPKNameIndex> m_names{nullptr};
+    std::shared_ptr<const void> m_source{nullptr}; // 零拷贝或从索引文件加载时保持文件数据有效
+    std::shared_ptr<NPKFrameCache> m_frameCache{nullptr};
+    std::shared_ptr<NPKVerifyTask> m_verifyTask{nullptr};
 };
 }
 
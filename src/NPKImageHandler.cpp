@@ -6,45 +6,86 @@
 #include "NPKPaletteManager.h"
 #include "NPKFrameHandler.h"
 #include "NPKDDSHandler.h"
+#include "NPKFileReader.h"
+#include "NPKInflate.h"
 
+#include <cstring>
 #include "logger.h"
 
 namespace neapu {
-int NPKImageHandler::loadIndex(const uint8_t* data, const uint64_t dataLen)
+int NPKImageHandler::loadIndex(const uint8_t* data, const uint64_t dataLen, std::shared_ptr<NPKNameIndex> names)
 {
-    if (dataLen < sizeof(NPKImageHeader)) {
+    if (dataLen < sizeof(NPKImageIndex)) {
         LOG_ERROR << "Data length is too short.";
         return -1;
     }
 
-    int ret = memcpy_s(&m_index, sizeof(m_index), data, sizeof(m_index));
+    NPKImageIndex index{};
+    int ret = memcpy_s(&index, sizeof(index), data, sizeof(index));
     if (ret != 0) {
         LOG_ERROR << "Failed to copy header.";
         return -1;
     }
+    m_offset = index.offset;
+    m_size = index.size;
+
+    // 名称在索引表中就能解出，延迟加载时也可以直接获取
+    char temp[sizeof(index.name) + 1]{};
+    memcpy(temp, index.name, sizeof(index.name));
+    maskName(temp);
+    if (!names) {
+        names = std::make_shared<NPKNameIndex>();
+    }
+    m_nameId = names->add(temp);
+    m_names = std::move(names);
+
+    return sizeof(index);
+}
+
+int NPKImageHandler::loadData(const uint8_t* npkSourceData, const uint64_t dataLen, const bool copyData)
+{
+    if (m_offset + m_size > dataLen) {
+        LOG_ERROR << "Data length is too short.";
+        return -1;
+    }
 
-    return sizeof(m_index);
+    const uint8_t* data = npkSourceData + m_offset;
+    return loadNPKImage(data, m_size, copyData);
 }
 
-int NPKImageHandler::loadData(const uint8_t* npkSourceData, const uint64_t dataLen)
+int NPKImageHandler::loadData(const NPKFileReader& reader)
 {
-    if (m_index.offset + m_index.size > dataLen) {
+    if (static_cast<uint64_t>(m_offset) + m_size > reader.size()) {
         LOG_ERROR << "Data length is too short.";
         return -1;
     }
 
-    const uint8_t* data = npkSourceData + m_index.offset;
-    return loadNPKImage(data, m_index.size);
+    // 读取的数据只在解析期间使用，帧数据会拷贝到Image内
+    NPKScratchBuffer data(m_size);
+    if (!reader.read(m_offset, m_size, data.data())) {
+        LOG_ERROR << "Failed to read image. " << getName();
+        return -1;
+    }
+    return loadNPKImage(data.data(), m_size, true);
+}
+
+void NPKImageHandler::maskName(char name[256])
+{
+    static constexpr char mask[] =
+        "puchikon@neople dungeon and fighter DNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNF";
+    for (int i = 0; i < 256; i++) {
+        name[i] ^= mask[i];
+    }
 }
 
 std::string NPKImageHandler::getName() const
 {
-    return m_name;
+    return m_names ? m_names->name(m_nameId) : std::string{};
 }
 
 std::string NPKImageHandler::getShortName() const
 {
-    return m_shortName;
+    return m_names ? std::string(m_names->shortName(m_nameId)) : std::string{};
 }
 
 std::shared_ptr<NPKFrameHandler> NPKImageHandler::getFrame(const uint32_t index) const
@@ -52,7 +93,14 @@ std::shared_ptr<NPKFrameHandler> NPKImageHandler::getFrame(const uint32_t index)
     if (index >= m_frames.size()) {
         return nullptr;
     }
-    return m_frames[index];
+    // 帧表中没有单独的帧对象，返回一份独立的拷贝，不受Image释放影响
+    auto frame = std::make_shared<NPKFrameHandler>(m_paletteManager);
+    const NPKFrameIndex frameIndex = m_frames.index(index);
+    frame->loadIndex(reinterpret_cast<const uint8_t*>(&frameIndex), sizeof(frameIndex));
+    if (const uint8_t* data = m_frames.data(index)) {
+        frame->loadData(data, frameIndex.dataSize);
+    }
+    return frame;
 }
 
 int NPKImageHandler::getPalletCount() const
@@ -63,55 +111,120 @@ int NPKImageHandler::getPalletCount() const
     return 0;
 }
 
+std::vector<NPKColor> NPKImageHandler::getPaletteColors(const int paletteIndex) const
+{
+    if (m_paletteManager) {
+        return m_paletteManager->getColors(paletteIndex);
+    }
+    return {};
+}
+
 ColorType NPKImageHandler::getFrameColorType(const uint32_t index) const
 {
-    const auto frame = traceFrame(index, 0);
-    if (!frame) {
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0) {
         return ColorType::CL_UNKNOWN;
     }
 
-    return frame->colorType();
+    return m_frames.colorType(frame);
 }
 
 int NPKImageHandler::getFrameWidth(const uint32_t index) const
 {
-    const auto frame = traceFrame(index, 0);
-    if (!frame) {
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0) {
         return 0;
     }
 
-    return frame->width();
+    return m_frames.index(frame).width;
 }
 
 int NPKImageHandler::getFrameHeight(const uint32_t index) const
 {
-    const auto frame = traceFrame(index, 0);
-    if (!frame) {
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0) {
         return 0;
     }
 
-    return frame->height();
+    return m_frames.index(frame).height;
 }
 
 std::shared_ptr<NPKMatrix> NPKImageHandler::getFrameMatrix(const uint32_t index, const int paletteIndex) const
 {
-    const auto frame = traceFrame(index, 0);
-    if (!frame) {
+    auto matrix = std::make_shared<NPKMatrix>();
+    if (!decodeFrame(index, *matrix, paletteIndex)) {
         return nullptr;
     }
+    return matrix;
+}
+
+uint64_t NPKImageHandler::getFrameDecodeSize(const uint32_t index, const NPKPixelBuffer& buffer, const DecodeArea area) const
+{
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0) {
+        return 0;
+    }
 
-    if (frame->isMatrixFrame()) {
-        return m_frames[index]->toMatrix(paletteIndex);
-    } else if (frame->isDDSFrame()) {
-        auto ddsIndex = frame->ddsIndex();
-        if (ddsIndex >= m_ddsHandlers.size()) {
-            LOG_ERROR << "Invalid DDS index. [index:" << ddsIndex << "][size:" << m_ddsHandlers.size() << "]";
-            return nullptr;
+    return m_frames.frame(frame, nullptr).decodeSize(buffer, area);
+}
+
+bool NPKImageHandler::decodeFrame(const uint32_t index, const NPKPixelBuffer& buffer, const int paletteIndex, const DecodeArea area) const
+{
+    const int64_t traced = traceFrameIndex(index);
+    if (traced < 0) {
+        return false;
+    }
+
+    const NPKFrameHandler frame = m_frames.frame(traced, m_paletteManager.get());
+    if (frame.isMatrixFrame()) {
+        return frame.decodeTo(buffer, paletteIndex, area);
+    }
+    if (!frame.isDDSFrame()) {
+        return false;
+    }
+
+    // 图集已缓存或按策略需要缓存时从完整图集裁剪，否则只解码帧所在的区域
+    const uint32_t ddsIndex = frame.ddsIndex();
+    auto ddsMatrix = m_ddsCache.find(ddsIndex);
+    if (!ddsMatrix) {
+        const DDSCachePolicy policy = m_ddsCache.policy();
+        if (policy == DCP_NONE || policy == DCP_WEAK) {
+            if (ddsIndex >= m_ddsHandlers.size()) {
+                LOG_ERROR << "Invalid DDS index. [index:" << ddsIndex << "][size:" << m_ddsHandlers.size() << "]";
+                return false;
+            }
+            return frame.ddsDecodeTo(*m_ddsHandlers[ddsIndex], buffer);
         }
-        auto ddsMatrix = m_ddsHandlers[ddsIndex]->toMatrix();
-        return frame->ddsClipMatrix(std::move(ddsMatrix));
+        ddsMatrix = getDDSMatrix(ddsIndex);
+    }
+    if (!ddsMatrix) {
+        return false;
+    }
+    return frame.ddsClipTo(*ddsMatrix, buffer);
+}
+
+bool NPKImageHandler::decodeFrame(const uint32_t index, NPKMatrix& matrix, const int paletteIndex) const
+{
+    const int64_t traced = traceFrameIndex(index);
+    if (traced < 0) {
+        return false;
+    }
+
+    const NPKFrameHandler frame = m_frames.frame(traced, m_paletteManager.get());
+    if (frame.isMatrixFrame()) {
+        return frame.decodeTo(matrix, paletteIndex);
     }
-    return nullptr;
+    if (!frame.isDDSFrame()) {
+        return false;
+    }
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (!frame.decodeExtent(DA_IMAGE, width, height)) {
+        LOG_ERROR << "Invalid clip area.";
+        return false;
+    }
+    matrix.reset(width, height);
+    return decodeFrame(index, matrix.pixelBuffer(), paletteIndex, DA_IMAGE);
 }
 
 bool NPKImageHandler::getFrameIsLink(const uint32_t index) const
@@ -120,7 +233,7 @@ bool NPKImageHandler::getFrameIsLink(const uint32_t index) const
         return false;
     }
 
-    return m_frames[index]->isLinkFrame();
+    return m_frames.kind(index) == FK_LINK;
 }
 
 std::string NPKImageHandler::getFrameLinkInfo(const uint32_t index) const
@@ -131,8 +244,8 @@ std::string NPKImageHandler::getFrameLinkInfo(const uint32_t index) const
     uint32_t pos = index;
     std::string ret = std::to_string(pos);
     for (uint32_t i = 0; i < 2; i++) {
-        if (m_frames[pos]->isLinkFrame()) {
-            pos = m_frames[pos]->linkTo();
+        if (m_frames.kind(pos) == FK_LINK) {
+            pos = m_frames.linkTo(pos);
             ret += " -> " + std::to_string(pos);
         }
     }
@@ -141,43 +254,138 @@ std::string NPKImageHandler::getFrameLinkInfo(const uint32_t index) const
 
 bool NPKImageHandler::getFrameIsDDS(uint32_t index) const
 {
-    const auto frame = traceFrame(index, 0);
-    if (!frame) {
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0) {
         return false;
     }
 
-    return frame->isDDSFrame();
+    return m_frames.kind(frame) == FK_DDS;
 }
 
 uint32_t NPKImageHandler::getFrameDDSIndex(const uint32_t index) const
 {
-    const auto frame = traceFrame(index, 0);
-    if (!frame) {
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0) {
         return 0;
     }
 
-    if (!frame->isDDSFrame()) {
+    if (m_frames.kind(frame) != FK_DDS) {
         return 0;
     }
 
-    return frame->ddsIndex();
+    return m_frames.index(frame).ddsIndex;
 }
 
 std::string NPKImageHandler::getFrameDDSClipInfo(const uint32_t index) const
 {
-    const auto frame = traceFrame(index, 0);
-    if (!frame) {
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0) {
         return "";
     }
 
-    return frame->ddsClipInfo();
+    return m_frames.frame(frame, nullptr).ddsClipInfo();
+}
+
+bool NPKImageHandler::getFrameDDSBlocks(const uint32_t index, NPKDXTBlocks& blocks) const
+{
+    blocks.data.clear();
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0 || m_frames.kind(frame) != FK_DDS) {
+        return false;
+    }
+
+    const NPKFrameIndex frameIndex = m_frames.index(frame);
+    if (frameIndex.ddsIndex >= m_ddsHandlers.size()) {
+        LOG_ERROR << "Invalid DDS index. [index:" << frameIndex.ddsIndex << "][size:" << m_ddsHandlers.size() << "]";
+        return false;
+    }
+    return m_ddsHandlers[frameIndex.ddsIndex]->extractBlocks(frameIndex.ddsLeftEdge, frameIndex.ddsTopEdge, frameIndex.ddsRightEdge,
+                                                             frameIndex.ddsBottomEdge, blocks);
+}
+
+std::vector<uint8_t> NPKImageHandler::getFrameDDSData(const uint32_t index) const
+{
+    const int64_t frame = traceFrameIndex(index);
+    if (frame < 0 || m_frames.kind(frame) != FK_DDS) {
+        return {};
+    }
+
+    const NPKFrameIndex frameIndex = m_frames.index(frame);
+    if (frameIndex.ddsIndex >= m_ddsHandlers.size()) {
+        LOG_ERROR << "Invalid DDS index. [index:" << frameIndex.ddsIndex << "][size:" << m_ddsHandlers.size() << "]";
+        return {};
+    }
+    std::vector<uint8_t> dds;
+    m_ddsHandlers[frameIndex.ddsIndex]->extractDDS(frameIndex.ddsLeftEdge, frameIndex.ddsTopEdge, frameIndex.ddsRightEdge,
+                                                   frameIndex.ddsBottomEdge, dds);
+    return dds;
 }
-std::vector<uint8_t> NPKImageHandler::getFramePngData(uint32_t index, int paletteIndex) const
+std::vector<uint8_t> NPKImageHandler::getFramePngData(uint32_t index, int paletteIndex, const NPKPngOptions& options) const
 {
-    return getFrameMatrix(index, paletteIndex)->toPng();
+    const auto matrix = getFrameMatrix(index, paletteIndex);
+    if (!matrix) {
+        return {};
+    }
+    return matrix->toPng(options);
+}
+
+uint64_t NPKImageHandler::memoryUsage() const
+{
+    uint64_t usage = sizeof(*this) - sizeof(m_frames) + m_frames.memoryUsage() + m_payloadSize;
+    usage += m_ddsHandlers.capacity() * sizeof(std::shared_ptr<NPKDDSHandler>) + m_ddsHandlers.size() * sizeof(NPKDDSHandler);
+    if (m_paletteManager) {
+        usage += m_paletteManager->memoryUsage();
+    }
+    return usage;
+}
+
+void NPKImageHandler::setDDSCachePolicy(const DDSCachePolicy policy, const uint32_t lruCapacity)
+{
+    m_ddsCache.setPolicy(policy, lruCapacity);
+}
+
+std::shared_ptr<NPKMatrix> NPKImageHandler::getDDSMatrix(const uint32_t ddsIndex) const
+{
+    if (ddsIndex >= m_ddsHandlers.size()) {
+        LOG_ERROR << "Invalid DDS index. [index:" << ddsIndex << "][size:" << m_ddsHandlers.size() << "]";
+        return nullptr;
+    }
+
+    const auto& dds = m_ddsHandlers[ddsIndex];
+    return m_ddsCache.get(ddsIndex, [this, &dds] { return dds->toMatrix(m_parallel); });
 }
 
-int NPKImageHandler::loadNPKImage(const uint8_t* data, const uint32_t dataLen)
+uint64_t NPKImageHandler::getDDSDecodeSize(const uint32_t ddsIndex, const NPKPixelBuffer& buffer) const
+{
+    if (ddsIndex >= m_ddsHandlers.size()) {
+        return 0;
+    }
+    const NPKDDSIndex& index = m_ddsHandlers[ddsIndex]->index();
+    return pixelBufferSize(buffer, index.width, index.height);
+}
+
+bool NPKImageHandler::decodeDDS(const uint32_t ddsIndex, const NPKPixelBuffer& buffer) const
+{
+    if (ddsIndex >= m_ddsHandlers.size()) {
+        LOG_ERROR << "Invalid DDS index. [index:" << ddsIndex << "][size:" << m_ddsHandlers.size() << "]";
+        return false;
+    }
+    const auto& dds = m_ddsHandlers[ddsIndex];
+    return dds->decodeRegion(0, 0, dds->index().width, dds->index().height, buffer);
+}
+
+bool NPKImageHandler::getDDSBlocks(const uint32_t ddsIndex, NPKDXTBlocks& blocks) const
+{
+    blocks.data.clear();
+    if (ddsIndex >= m_ddsHandlers.size()) {
+        LOG_ERROR << "Invalid DDS index. [index:" << ddsIndex << "][size:" << m_ddsHandlers.size() << "]";
+        return false;
+    }
+    const auto& dds = m_ddsHandlers[ddsIndex];
+    return dds->extractBlocks(0, 0, dds->index().width, dds->index().height, blocks);
+}
+
+int NPKImageHandler::loadNPKImage(const uint8_t* data, const uint32_t dataLen, const bool copyData)
 {
     uint32_t offset = 0;
 
@@ -192,15 +400,6 @@ int NPKImageHandler::loadNPKImage(const uint8_t* data, const uint32_t dataLen)
     }
     offset += sizeof(NPKImageHeader);
 
-    const char mask[] =
-        "puchikon@neople dungeon and fighter DNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNFDNF";
-    char temp[256];
-    for (int i = 0; i < 256; i++) {
-        temp[i] = m_index.name[i] ^ mask[i];
-    }
-    m_name = temp;
-    m_shortName = m_name.substr(m_name.find_last_of('/') + 1);
-
     if (version() == 5) {
         ret = memcpy_s(&m_v5Info, sizeof(m_v5Info), data + offset, sizeof(m_v5Info));
         if (ret != 0) {
@@ -211,7 +410,7 @@ int NPKImageHandler::loadNPKImage(const uint8_t* data, const uint32_t dataLen)
     }
     if (version() == 4 || version() == 5 || version() == 6) {
         m_paletteManager = std::make_shared<NPKPaletteManager>();
-        uint32_t paletteSize = m_paletteManager->loadPalettes(data + offset, m_index.size - offset, version());
+        uint32_t paletteSize = m_paletteManager->loadPalettes(data + offset, m_size - offset, version());
         if (paletteSize == 0) {
             LOG_WARNING << "Palette size is 0. " << getName();
         }
@@ -225,7 +424,7 @@ int NPKImageHandler::loadNPKImage(const uint8_t* data, const uint32_t dataLen)
     if (version() == 5) {
         for (uint32_t i = 0; i < m_v5Info.ddsIndexCount; i++) {
             auto dds = std::make_shared<NPKDDSHandler>();
-            const int64_t len = dds->loadIndex(data + offset, m_index.size - offset);
+            const int64_t len = dds->loadIndex(data + offset, m_size - offset);
             if (len < 0) {
                 LOG_ERROR << "Failed to load DDS index. " << getName();
                 return -1;
@@ -233,28 +432,41 @@ int NPKImageHandler::loadNPKImage(const uint8_t* data, const uint32_t dataLen)
             offset += len;
             m_ddsHandlers.push_back(dds);
         }
+        m_ddsCache.reset(m_ddsHandlers.size());
     }
 
     // 读取索引表
     for (uint32_t i = 0; i < m_header.frameIndexCount; i++) {
-        auto frame = std::make_shared<NPKFrameHandler>(m_paletteManager);
-        const int len = frame->loadIndex(data + offset, m_index.size - offset);
+        NPKFrameHandler frame(nullptr);
+        const int len = frame.loadIndex(data + offset, m_size - offset);
         if (len < 0) {
             LOG_ERROR << "Failed to load frame index. " << getName();
             return -1;
         }
         offset += len;
-        m_frames.push_back(frame);
+        m_frames.add(frame.index());
+    }
+    m_frames.shrinkToFit();
+
+    // 帧与DDS数据拷贝时整块拷贝一次，之后的偏移都相对于数据块开头
+    const uint8_t* payload = data + offset;
+    const uint32_t payloadBegin = offset;
+    if (copyData && offset < m_size) {
+        m_payloadSize = m_size - offset;
+        m_payload.reset(new uint8_t[m_payloadSize]);
+        memcpy(m_payload.get(), payload, m_payloadSize);
+        payload = m_payload.get();
     }
+    m_frames.setPayload(payload);
 
     if (version() == 5) {
         for (uint32_t i = 0; i < m_v5Info.ddsIndexCount; ++i) {
-            if (offset >= m_index.size) {
+            if (offset >= m_size) {
                 LOG_WARNING << "Data length is too short. " << getName();
                 break;
             }
             const auto& dds = m_ddsHandlers[i];
-            const int64_t len = dds->loadData(data + offset, m_index.size - offset);
+            const int64_t len = dds->loadData(payload + (offset - payloadBegin), m_size - offset, false);
             if (len < 0) {
                 LOG_ERROR << "Failed to load DDS data. " << getName();
                 return -1;
@@ -263,41 +475,70 @@ int NPKImageHandler::loadNPKImage(const uint8_t* data, const uint32_t dataLen)
         }
     }
 
-
-        // 点阵图片
-        for (uint32_t i = 0; i < m_header.frameIndexCount; i++) {
-            if (offset >= m_index.size) {
-                LOG_WARNING << "Data length is too short. " << getName();
-                break;
-            }
-            const auto frame = m_frames[i];
-            if (!frame->isMatrixFrame()) {
-                continue;
-            }
-            const int len = frame->loadData(data + offset, m_index.size - offset);
-            if (len < 0) {
-                LOG_ERROR << "Failed to load frame data. [name:" << getName() << "][frame:" << i
-                    << "][version:" << version() << "][size:" << offset << "/" << m_index.size << "]";
-                return -1;
-            }
-            offset += len;
+    // 点阵图片，规则与NPKFrameHandler::loadData相同
+    for (uint32_t i = 0; i < m_header.frameIndexCount; i++) {
+        if (offset >= m_size) {
+            LOG_WARNING << "Data length is too short. " << getName();
+            break;
         }
-
+        if (m_frames.kind(i) != FK_MATRIX || m_frames.colorType(i) == CL_UNKNOWN) {
+            continue;
+        }
+        const uint32_t dataSize = m_frames.index(i).dataSize;
+        if (dataSize == 0) {
+            continue;
+        }
+        if (m_size - offset < dataSize) {
+            // 有时候DNF的IMG中最后一帧的数据长度不足（辣鸡DNF），直接当做无效帧处理
+            LOG_WARNING << "Data length is too short. [size:" << m_size - offset << ", dataSize:" << dataSize << "]";
+            offset = m_size;
+            continue;
+        }
+        m_frames.setDataOffset(i, offset - payloadBegin);
+        offset += dataSize;
+    }
 
     return true;
 }
 
-std::shared_ptr<NPKFrameHandler> NPKImageHandler::traceFrame(uint32_t index, uint32_t deep) const
+bool NPKImageHandler::ensureLoaded()
+{
+    std::call_once(m_loadFlag, [this] {
+        if (m_pendingData == nullptr && m_pendingReader == nullptr) {
+            return; // 非延迟加载，加载时已解析
+        }
+        const int ret = m_pendingReader ? loadData(*m_pendingReader) : loadData(m_pendingData, m_pendingDataLen, false);
+        if (ret < 0) {
+            LOG_ERROR << "Failed to load image. " << getName();
+            m_loadFailed = true;
+        }
+        m_pendingData = nullptr;
+        m_pendingDataLen = 0;
+        m_pendingReader.reset();
+    });
+    return !m_loadFailed;
+}
+
+int64_t NPKImageHandler::traceFrameIndex(uint32_t index) const
 {
     // DNF中，链接帧的深度最多为2
-    if (index >= m_frames.size() || deep > 2) {
-        return nullptr;
+    for (uint32_t deep = 0; deep <= 2; ++deep) {
+        if (index >= m_frames.size()) {
+            return -1;
+        }
+        if (m_frames.kind(index) != FK_LINK) {
+            return index;
+        }
+        index = m_frames.linkTo(index);
     }
+    return -1;
+}
 
-    auto frame = m_frames[index];
-    if (frame->isLinkFrame()) {
-        return traceFrame(frame->linkTo(), deep + 1);
+std::shared_ptr<NPKMatrix> NPKImageHandler::clipFrameMatrix(const uint32_t index, std::shared_ptr<NPKMatrix> atlas) const
+{
+    if (index >= m_frames.size() || m_frames.kind(index) != FK_DDS || !atlas) {
+        return nullptr;
     }
-    return frame;
+    return m_frames.frame(index, nullptr).ddsClipMatrix(std::move(atlas));
 }
 } // neapu
\ No newline at end of file
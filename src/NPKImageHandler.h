@@ -6,9 +6,15 @@
 #define NPKIMAGEHANDLER_H
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "NPKPublic.h"
+#include "NPKDDSCache.h"
+#include "NPKFrameTable.h"
+#include "NPKMatrix.h"
+#include "NPKNameIndex.h"
+#include "NPKThreadPool.h"
 
 namespace neapu {
 #pragma pack(push, 1)
@@ -33,10 +39,20 @@ typedef struct NPKImageV5Info {
 #pragma pack(pop)
 class NPKFrameHandler;
 class NPKPaletteManager;
-class NPKMatrix;
 class NPKDDSHandler;
+class NPKFileReader;
+struct NPKDXTBlocks;
+/**
+ * @brief IMG的解析与帧解码
+ *
+ * 线程安全：const方法（帧信息、getFrameMatrix、decodeFrame、getFramePngData、getDDSMatrix、decodeDDS、DXT块提取、调色板）都可以多线程同时调用，
+ * 解码只读取加载时的数据。loadIndex、loadData和setParallelDecode不能与其他调用同时进行，
+ * setDDSCachePolicy可以与解码同时调用。已废弃的getFrame返回的NPKFrameHandler只有const方法可以多线程调用。
+ */
 class NPKImageHandler {
     friend class NPKHandler;
+    friend class NPKWriter;
+    friend class NPKSidecar;
 public:
     NPKImageHandler() = default;
     virtual ~NPKImageHandler() = default;
@@ -45,54 +61,181 @@ public:
      * @brief loadIndex
      * @param data 索引表数据，需偏移到索引表开始位置
      * @param dataLen 数据最大长度
+     * @param names 名称加入的名称表，同一个NPK的Image共用，为空时单独创建
      * @return 成功返回索引表大小，失败返回-1
      */
-    int loadIndex(const uint8_t* data, uint64_t dataLen);
+    int loadIndex(const uint8_t* data, uint64_t dataLen, std::shared_ptr<NPKNameIndex> names = nullptr);
     /**
      * @brief loadData
      * @param npkSourceData NPK原始数据，因为所以中包含了img偏移量，所以输入为从0偏移开始的NPK数据
      * @param dataLen 数据最大长度
+     * @param copyData 为true时帧数据拷贝一份，为false时直接引用npkSourceData，调用者需保证其生命周期
      * @return 成功返回读取的长度，失败返回-1
      */
-    int loadData(const uint8_t* npkSourceData, uint64_t dataLen);
+    int loadData(const uint8_t* npkSourceData, uint64_t dataLen, bool copyData = true);
+    /**
+     * @brief 只从文件中读取本Image的数据，帧数据拷贝一份，不需要保留文件数据
+     * @param reader 已打开的NPK文件
+     * @return 成功返回读取的长度，失败返回-1
+     */
+    int loadData(const NPKFileReader& reader);
 
     std::string getName() const;
     std::string getShortName() const;
+    /**
+     * @brief 索引表中的名称与固定字符串逐字节异或，编码和解码相同
+     * @param name 长度为256的名称
+     */
+    static void maskName(char name[256]);
 
     int version() const { return m_header.version; }
 
     uint32_t getFrameCount() const { return m_frames.size(); }
 
+    /**
+     * @brief 获取帧的独立拷贝，帧数据会复制，调色板与Image共用
+     */
     [[deprecated("Use getFrame*() instead")]]
     std::shared_ptr<NPKFrameHandler> getFrame(uint32_t index) const;
 
     int getPalletCount() const;
+    /**
+     * @brief 获取调色板中的所有颜色，只用于V4/V6
+     * @param paletteIndex 调色板索引
+     * @return 调色板索引无效或没有调色板时返回空
+     */
+    std::vector<NPKColor> getPaletteColors(int paletteIndex) const;
 
     ColorType getFrameColorType(uint32_t index) const;
     int getFrameWidth(uint32_t index) const;
     int getFrameHeight(uint32_t index) const;
     std::shared_ptr<NPKMatrix> getFrameMatrix(uint32_t index, int paletteIndex = 0) const;
+    /**
+     * @brief 解码到buffer需要的字节数，链接帧按链接目标计算
+     * @param index 帧索引
+     * @param buffer 输出缓冲区，只使用行跨度与写入位置
+     * @param area 写入图像区域或整个画布，DDS帧都是裁剪区域
+     * @return 帧无法解码时返回0
+     */
+    uint64_t getFrameDecodeSize(uint32_t index, const NPKPixelBuffer& buffer = {}, DecodeArea area = DA_IMAGE) const;
+    /**
+     * @brief 把帧解码到调用者的缓冲区，可多线程同时调用
+     *
+     * 点阵帧和未缓存图集的DDS帧只使用线程内复用的解压缓冲区，不分配堆内存；
+     * DDS缓存策略为DCP_PIN或DCP_LRU且图集未缓存时会先解码完整图集。
+     * @param index 帧索引
+     * @param buffer 输出缓冲区，大小可通过getFrameDecodeSize获取
+     * @param paletteIndex 调色板索引，只用于V4/V6
+     * @param area 写入图像区域或整个画布
+     * @return 帧无法解码、缓冲区不足或解码失败返回false
+     */
+    bool decodeFrame(uint32_t index, const NPKPixelBuffer& buffer, int paletteIndex = 0, DecodeArea area = DA_IMAGE) const;
+    /**
+     * @brief 把帧解码到matrix，结果与getFrameMatrix相同，matrix的容量足够时复用其内存
+     * @return getFrameMatrix返回nullptr的情况返回false
+     */
+    bool decodeFrame(uint32_t index, NPKMatrix& matrix, int paletteIndex = 0) const;
     bool getFrameIsLink(uint32_t index) const;
     std::string getFrameLinkInfo(uint32_t index) const;
     bool getFrameIsDDS(uint32_t index) const;
     uint32_t getFrameDDSIndex(uint32_t index) const;
     std::string getFrameDDSClipInfo(uint32_t index) const;
-    std::vector<uint8_t> getFramePngData(uint32_t index, int paletteIndex = 0) const;
+    /**
+     * @brief 不解码，取出DDS帧裁剪区域的DXT块，链接帧按链接目标处理
+     * @param index 帧索引
+     * @param blocks 输出块，见NPKDDSHandler::extractBlocks
+     * @return 不是DDS帧或提取失败返回false
+     */
+    bool getFrameDDSBlocks(uint32_t index, NPKDXTBlocks& blocks) const;
+    /**
+     * @brief 把DDS帧裁剪区域的DXT块保存为独立的.dds文件
+     * @return 不是DDS帧或提取失败返回空
+     */
+    std::vector<uint8_t> getFrameDDSData(uint32_t index) const;
+    std::vector<uint8_t> getFramePngData(uint32_t index, int paletteIndex = 0, const NPKPngOptions& options = {}) const;
+
+    /**
+     * @brief 设置V5图集的缓存策略，默认不缓存
+     * @param policy 缓存策略
+     * @param lruCapacity DCP_LRU策略下最多保留的图集数量
+     */
+    void setDDSCachePolicy(DDSCachePolicy policy, uint32_t lruCapacity = 1);
+    uint32_t getDDSCount() const { return m_ddsHandlers.size(); }
+    /**
+     * @brief 获取解码后的完整DDS图集，按缓存策略复用，可多线程同时调用
+     * @param ddsIndex DDS索引
+     * @return 索引无效或解码失败返回nullptr
+     */
+    std::shared_ptr<NPKMatrix> getDDSMatrix(uint32_t ddsIndex) const;
+    /**
+     * @brief 把完整的DDS图集解码到buffer需要的字节数
+     * @return DDS索引无效时返回0
+     */
+    uint64_t getDDSDecodeSize(uint32_t ddsIndex, const NPKPixelBuffer& buffer = {}) const;
+    /**
+     * @brief 按缓冲区的输出格式把完整的DDS图集解码到调用者的缓冲区，不使用也不更新图集缓存
+     * @param ddsIndex DDS索引
+     * @param buffer 输出缓冲区，大小可通过getDDSDecodeSize获取
+     * @return 索引或缓冲区无效、解码失败返回false
+     */
+    bool decodeDDS(uint32_t ddsIndex, const NPKPixelBuffer& buffer) const;
+    /**
+     * @brief 不解码，取出完整DDS图集的DXT块
+     * @return 索引无效或提取失败返回false
+     */
+    bool getDDSBlocks(uint32_t ddsIndex, NPKDXTBlocks& blocks) const;
+    /**
+     * @brief 设置V5图集的多线程解码，需在解码前设置，不能与解码同时调用
+     * @param parallel 线程池与最小拆分块数量
+     */
+    void setParallelDecode(const NPKParallelOptions& parallel) { m_parallel = parallel; }
+    /**
+     * @brief 帧表、调色板、DDS索引和拷贝的帧数据占用的内存，不包括引用的文件数据和缓存的图集
+     */
+    uint64_t memoryUsage() const;
 
 private:
-    int loadNPKImage(const uint8_t* data, uint32_t dataLen);
-    std::shared_ptr<NPKFrameHandler> traceFrame(uint32_t index, uint32_t deep) const;
+    int loadNPKImage(const uint8_t* data, uint32_t dataLen, bool copyData);
+    /**
+     * @brief 延迟加载模式下解析Image，只会执行一次，可多线程同时调用
+     * @return 已解析或解析成功返回true
+     */
+    bool ensureLoaded();
+    /**
+     * @brief 追踪链接帧，链接深度最多为2
+     * @return 最终指向的帧索引，无效时返回-1
+     */
+    int64_t traceFrameIndex(uint32_t index) const;
+    /**
+     * @brief 从已解码的完整图集裁剪DDS帧
+     * @param index 非链接帧的DDS帧索引
+     * @param atlas 帧所在的图集
+     */
+    std::shared_ptr<NPKMatrix> clipFrameMatrix(uint32_t index, std::shared_ptr<NPKMatrix> atlas) const;
 
 private:
-    NPKImageIndex m_index{0};
+    uint32_t m_offset{0}; // Image在NPK中的偏移与大小
+    uint32_t m_size{0};
     NPKImageHeader m_header{0};
     NPKImageV5Info m_v5Info{0};
-    std::vector<std::shared_ptr<NPKFrameHandler>> m_frames;
+    NPKFrameTable m_frames;
     std::vector<std::shared_ptr<NPKDDSHandler>> m_ddsHandlers;
+    std::unique_ptr<uint8_t[]> m_payload{nullptr}; // 拷贝加载时所有帧与DDS数据所在的连续内存
+    uint32_t m_payloadSize{0};
 
-    std::string m_name{};
-    std::string m_shortName{};
+    std::shared_ptr<const NPKNameIndex> m_names{nullptr};
+    uint32_t m_nameId{0};
     std::shared_ptr<NPKPaletteManager> m_paletteManager{nullptr};
+    mutable NPKDDSCache m_ddsCache;
+    NPKParallelOptions m_parallel{};
+    std::shared_ptr<const void> m_source{nullptr}; // 零拷贝加载时帧数据引用的文件数据
+
+    // 延迟加载
+    std::once_flag m_loadFlag;
+    bool m_loadFailed{false};
+    const uint8_t* m_pendingData{nullptr};
+    uint64_t m_pendingDataLen{0};
+    std::shared_ptr<const NPKFileReader> m_pendingReader{nullptr}; // 不使用内存映射时从文件读取
 };
 
 } // neapu
@@ -0,0 +1,151 @@
+//
+// Created by liu86 on 24-8-8.
+//
+
+#include "NPKInflate.h"
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+
+namespace neapu {
+namespace {
+constexpr uint32_t MAX_IDLE_STREAMS = 4;
+constexpr uint32_t MAX_IDLE_BUFFERS = 4;
+constexpr uint64_t MAX_IDLE_BUFFER_SIZE = 64ULL * 1024 * 1024; // 超过的缓冲区用完直接释放，避免每个线程长期占用大块内存
+
+typedef struct StreamList {
+    std::vector<z_stream*> streams;
+
+    ~StreamList()
+    {
+        for (auto* stream : streams) {
+            inflateEnd(stream);
+            delete stream;
+        }
+    }
+} StreamList;
+
+typedef struct IdleBuffer {
+    std::unique_ptr<uint8_t[]> data;
+    uint64_t capacity;
+} IdleBuffer;
+
+thread_local StreamList t_streams;
+thread_local std::vector<IdleBuffer> t_buffers;
+}
+
+NPKInflateStream::NPKInflateStream()
+{
+    if (!t_streams.streams.empty()) {
+        m_stream = t_streams.streams.back();
+        t_streams.streams.pop_back();
+        return;
+    }
+
+    m_stream = new z_stream{};
+    if (inflateInit(m_stream) != Z_OK) {
+        delete m_stream;
+        m_stream = nullptr;
+    }
+}
+
+NPKInflateStream::~NPKInflateStream()
+{
+    if (m_stream == nullptr) {
+        return;
+    }
+    if (t_streams.streams.size() < MAX_IDLE_STREAMS) {
+        t_streams.streams.push_back(m_stream);
+    } else {
+        inflateEnd(m_stream);
+        delete m_stream;
+    }
+}
+
+int NPKInflateStream::reset(const uint8_t* src, const uint64_t srcLen)
+{
+    if (m_stream == nullptr) {
+        return Z_MEM_ERROR;
+    }
+    const int ret = inflateReset(m_stream);
+    if (ret != Z_OK) {
+        return ret;
+    }
+    m_stream->next_in = const_cast<Bytef*>(src);
+    m_stream->avail_in = static_cast<uInt>(srcLen);
+    m_ended = false;
+    m_truncated = false;
+    return Z_OK;
+}
+
+int NPKInflateStream::read(uint8_t* dst, const uint64_t len)
+{
+    if (m_stream == nullptr) {
+        return Z_MEM_ERROR;
+    }
+    m_stream->next_out = dst;
+    m_stream->avail_out = static_cast<uInt>(len);
+    while (m_stream->avail_out > 0 && !m_ended) {
+        const int ret = inflate(m_stream, Z_SYNC_FLUSH);
+        if (ret == Z_STREAM_END) {
+            m_ended = true;
+        } else if (ret == Z_BUF_ERROR && m_stream->avail_in == 0) {
+            m_ended = true; // 数据不完整，当做提前结束
+        } else if (ret != Z_OK) {
+            return ret;
+        }
+    }
+    if (m_stream->avail_out > 0) {
+        memset(m_stream->next_out, 0, m_stream->avail_out);
+        m_truncated = true;
+    }
+    return Z_OK;
+}
+
+int NPKInflateStream::finish()
+{
+    if (m_stream == nullptr) {
+        return Z_MEM_ERROR;
+    }
+    if (m_ended) {
+        return Z_OK;
+    }
+    uint8_t extra;
+    m_stream->next_out = &extra;
+    m_stream->avail_out = 1;
+    const int ret = inflate(m_stream, Z_SYNC_FLUSH);
+    if (m_stream->avail_out == 0) {
+        return Z_BUF_ERROR;
+    }
+    if (ret == Z_STREAM_END || ret == Z_BUF_ERROR) {
+        m_ended = true;
+        return Z_OK;
+    }
+    return ret;
+}
+
+NPKScratchBuffer::NPKScratchBuffer(const uint64_t size)
+    : m_size(size)
+{
+    // 优先取最后归还的缓冲区，容量不够时重新分配
+    if (!t_buffers.empty()) {
+        auto& buffer = t_buffers.back();
+        if (buffer.capacity >= size) {
+            m_data = std::move(buffer.data);
+            m_capacity = buffer.capacity;
+        }
+        t_buffers.pop_back();
+    }
+    if (!m_data) {
+        m_data.reset(new uint8_t[size]);
+        m_capacity = size;
+    }
+}
+
+NPKScratchBuffer::~NPKScratchBuffer()
+{
+    if (m_data && m_capacity <= MAX_IDLE_BUFFER_SIZE && t_buffers.size() < MAX_IDLE_BUFFERS) {
+        t_buffers.push_back(IdleBuffer{std::move(m_data), m_capacity});
+    }
+}
+} // neapu
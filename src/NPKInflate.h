@@ -0,0 +1,73 @@
+//
+// Created by liu86 on 24-8-8.
+//
+
+#ifndef NPKINFLATE_H
+#define NPKINFLATE_H
+#include <cstdint>
+#include <memory>
+
+struct z_stream_s;
+
+namespace neapu {
+/**
+ * @brief 可复用的zlib解压流
+ *
+ * 构造时从当前线程的空闲列表中取出一个已初始化的z_stream，析构时归还，
+ * 之后只需要inflateReset，避免每帧都inflateInit/inflateEnd。
+ * 每个对象同一时间只能在一个线程中使用。
+ */
+class NPKInflateStream {
+public:
+    NPKInflateStream();
+    virtual ~NPKInflateStream();
+    NPKInflateStream(const NPKInflateStream&) = delete;
+    NPKInflateStream& operator=(const NPKInflateStream&) = delete;
+
+    /**
+     * @brief 开始解压新的数据
+     * @return 成功返回Z_OK
+     */
+    int reset(const uint8_t* src, uint64_t srcLen);
+    /**
+     * @brief 按顺序解压出len字节，数据提前结束时剩余部分填0
+     * @return 成功返回Z_OK，数据损坏返回zlib错误码
+     */
+    int read(uint8_t* dst, uint64_t len);
+    /**
+     * @brief 检查数据是否已经全部解压
+     * @return 没有剩余输出返回Z_OK，还有剩余输出返回Z_BUF_ERROR，数据损坏返回zlib错误码
+     */
+    int finish();
+    /**
+     * @brief 数据是否比读取的长度短，剩余部分被填0
+     */
+    bool truncated() const { return m_truncated; }
+
+private:
+    z_stream_s* m_stream{nullptr};
+    bool m_ended{false};
+    bool m_truncated{false};
+};
+
+/**
+ * @brief 线程内复用的临时缓冲区，构造时从当前线程的空闲列表中取出，析构时归还，内容不会初始化
+ */
+class NPKScratchBuffer {
+public:
+    explicit NPKScratchBuffer(uint64_t size);
+    virtual ~NPKScratchBuffer();
+    NPKScratchBuffer(const NPKScratchBuffer&) = delete;
+    NPKScratchBuffer& operator=(const NPKScratchBuffer&) = delete;
+
+    uint8_t* data() { return m_data.get(); }
+    uint64_t size() const { return m_size; }
+
+private:
+    std::unique_ptr<uint8_t[]> m_data{nullptr};
+    uint64_t m_capacity{0};
+    uint64_t m_size{0};
+};
+} // neapu
+
+#endif //NPKINFLATE_H
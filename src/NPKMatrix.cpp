@@ -3,12 +3,132 @@
 //
 
 #include "NPKMatrix.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include "NPKSimd.h"
 #include "logger.h"
 #ifdef USE_PNG
 #include <png.h>
 #endif
 
 namespace neapu {
+namespace {
+// 与SIMD内核一致的round(c * a / 255)
+inline uint8_t premultiply(const uint8_t c, const uint8_t a)
+{
+    const uint32_t t = static_cast<uint32_t>(c) * a + 128;
+    return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+inline void storeRgb565(const NPKColor& color, uint8_t* dst)
+{
+    const uint16_t value = (color.r >> 3) << 11 | (color.g >> 2) << 5 | color.b >> 3;
+    dst[0] = static_cast<uint8_t>(value);
+    dst[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void storeArgb4444(const NPKColor& color, uint8_t* dst)
+{
+    dst[0] = static_cast<uint8_t>((color.g & 0xF0) | color.b >> 4);
+    dst[1] = static_cast<uint8_t>((color.a & 0xF0) | color.r >> 4);
+}
+}
+
+uint32_t outputPixelSize(const OutputFormat format)
+{
+    switch (format) {
+    case OF_BGRA8:
+    case OF_RGBA8:
+    case OF_BGRA8_PREMULTIPLIED:
+    case OF_RGBA8_PREMULTIPLIED: return 4;
+    case OF_RGB565:
+    case OF_ARGB4444: return 2;
+    default: return 0;
+    }
+}
+
+void convertPixelRow(const NPKColor* src, const uint32_t count, const OutputFormat format, uint8_t* dst)
+{
+    const auto& kernels = simd::kernels();
+    uint32_t i = 0;
+    switch (format) {
+    case OF_BGRA8:
+        if (reinterpret_cast<const uint8_t*>(src) != dst) {
+            memmove(dst, src, static_cast<size_t>(count) * sizeof(NPKColor));
+        }
+        break;
+    case OF_RGBA8:
+        i = kernels.rgbaRow ? kernels.rgbaRow(reinterpret_cast<const uint8_t*>(src), count, dst) : 0;
+        for (; i < count; ++i) {
+            const NPKColor color = src[i];
+            uint8_t* pixel = dst + i * 4;
+            pixel[0] = color.r;
+            pixel[1] = color.g;
+            pixel[2] = color.b;
+            pixel[3] = color.a;
+        }
+        break;
+    case OF_BGRA8_PREMULTIPLIED:
+    case OF_RGBA8_PREMULTIPLIED: {
+        const bool rgba = format == OF_RGBA8_PREMULTIPLIED;
+        const simd::FormatRowKernel kernel = rgba ? kernels.rgbaPremultipliedRow : kernels.premultipliedRow;
+        i = kernel ? kernel(reinterpret_cast<const uint8_t*>(src), count, dst) : 0;
+        for (; i < count; ++i) {
+            const NPKColor color = src[i];
+            uint8_t* pixel = dst + i * 4;
+            pixel[0] = premultiply(rgba ? color.r : color.b, color.a);
+            pixel[1] = premultiply(color.g, color.a);
+            pixel[2] = premultiply(rgba ? color.b : color.r, color.a);
+            pixel[3] = color.a;
+        }
+        break;
+    }
+    case OF_RGB565:
+        i = kernels.rgb565PackRow ? kernels.rgb565PackRow(reinterpret_cast<const uint8_t*>(src), count, dst) : 0;
+        for (; i < count; ++i) {
+            storeRgb565(src[i], dst + i * 2);
+        }
+        break;
+    case OF_ARGB4444:
+        i = kernels.argb4444PackRow ? kernels.argb4444PackRow(reinterpret_cast<const uint8_t*>(src), count, dst) : 0;
+        for (; i < count; ++i) {
+            storeArgb4444(src[i], dst + i * 2);
+        }
+        break;
+    default: LOG_ERROR << "Unsupported output format: " << format;
+        break;
+    }
+}
+
+uint64_t pixelBufferSize(const NPKPixelBuffer& buffer, const uint32_t width, const uint32_t height)
+{
+    const uint32_t pixelSize = outputPixelSize(buffer.format);
+    if (width == 0 || height == 0 || pixelSize == 0) {
+        return 0;
+    }
+    const uint64_t stride = buffer.stride ? buffer.stride : static_cast<uint64_t>(width) * pixelSize;
+    return (static_cast<uint64_t>(buffer.offsetY) + height - 1) * stride + (static_cast<uint64_t>(buffer.offsetX) + width) * pixelSize;
+}
+
+uint8_t* pixelBufferOrigin(const NPKPixelBuffer& buffer, const uint32_t width, const uint32_t height, uint64_t& stride)
+{
+    const uint32_t pixelSize = outputPixelSize(buffer.format);
+    const uint64_t rowSize = static_cast<uint64_t>(width) * pixelSize;
+    stride = buffer.stride ? buffer.stride : rowSize;
+    if (buffer.data == nullptr || width == 0 || height == 0 || pixelSize == 0 || stride < rowSize) {
+        LOG_ERROR << "Invalid pixel buffer. [width:" << width << "][height:" << height << "][stride:" << stride << "][format:"
+            << buffer.format << "]";
+        return nullptr;
+    }
+    const uint64_t required = pixelBufferSize(buffer, width, height);
+    if (buffer.size < required) {
+        LOG_ERROR << "Pixel buffer is too small. [size:" << buffer.size << "][required:" << required << "]";
+        return nullptr;
+    }
+    return buffer.data + buffer.offsetY * stride + static_cast<uint64_t>(buffer.offsetX) * pixelSize;
+}
+
 NPKMatrix::~NPKMatrix()
 {
     if (m_data) {
@@ -16,69 +136,181 @@ NPKMatrix::~NPKMatrix()
     }
 }
 
-std::vector<uint8_t> NPKMatrix::toPng() const
+NPKMatrix::NPKMatrix(NPKMatrix&& other) noexcept
 {
-    FUNC_TRACE;
-    std::vector<uint8_t> pngData;
+    *this = std::move(other);
+}
+
+NPKMatrix& NPKMatrix::operator=(NPKMatrix&& other) noexcept
+{
+    if (this != &other) {
+        delete[] m_data;
+        m_width = std::exchange(other.m_width, 0);
+        m_height = std::exchange(other.m_height, 0);
+        m_canvasWidth = std::exchange(other.m_canvasWidth, 0);
+        m_canvasHeight = std::exchange(other.m_canvasHeight, 0);
+        m_offsetX = std::exchange(other.m_offsetX, 0);
+        m_offsetY = std::exchange(other.m_offsetY, 0);
+        m_data = std::exchange(other.m_data, nullptr);
+        m_capacity = std::exchange(other.m_capacity, 0);
+    }
+    return *this;
+}
+
 #ifdef USE_PNG
-    if (isEmpty()) {
-        return pngData;
+namespace {
+int pngFilterFlags(const PngFilter filter)
+{
+    switch (filter) {
+    case PF_NONE: return PNG_FILTER_NONE;
+    case PF_SUB: return PNG_FILTER_SUB;
+    case PF_UP: return PNG_FILTER_UP;
+    case PF_AVERAGE: return PNG_FILTER_AVG;
+    case PF_PAETH: return PNG_FILTER_PAETH;
+    default: return -1;
     }
+}
 
+/**
+ * @brief 把origin开始、每行stride个像素的width*height区域编码为PNG
+ *
+ * libpng出错时通过longjmp返回，单独放在一个函数内，setjmp之后用到的变量都是不再修改的参数
+ * @param left 区域在画布中的偏移，只在options.cropToImage时写入oFFs块
+ * @param top 同left
+ * @param opaque 为true时输出RGB
+ * @param pngData 输出，失败时为空
+ */
+void writePng(const NPKColor* const origin, const uint32_t stride, const uint32_t width, const uint32_t height, const uint32_t left,
+              const uint32_t top, const bool opaque, const NPKPngOptions& options, std::vector<uint8_t>& pngData)
+{
     auto pngPtr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
     if (!pngPtr) {
         LOG_ERROR << "Failed to create png write struct.";
-        return pngData;
+        return;
     }
 
     auto infoPtr = png_create_info_struct(pngPtr);
     if (!infoPtr) {
         png_destroy_write_struct(&pngPtr, nullptr);
         LOG_ERROR << "Failed to create png info struct.";
-        return pngData;
+        return;
     }
 
     if (setjmp(png_jmpbuf(pngPtr))) {
         png_destroy_write_struct(&pngPtr, &infoPtr);
         LOG_ERROR << "Failed to setjmp.";
-        return pngData;
+        pngData.clear();
+        return;
     }
 
     // PNG文件头
-    png_set_IHDR(pngPtr, infoPtr, m_canvasWidth, m_canvasHeight, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
+    png_set_IHDR(pngPtr, infoPtr, width, height, 8, opaque ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
                  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+    if (options.cropToImage) {
+        png_set_oFFs(pngPtr, infoPtr, static_cast<png_int_32>(left), static_cast<png_int_32>(top), PNG_OFFSET_PIXEL);
+    }
+    if (options.compressionLevel >= 0) {
+        png_set_compression_level(pngPtr, options.compressionLevel);
+    }
+    if (options.compressionStrategy >= 0) {
+        png_set_compression_strategy(pngPtr, options.compressionStrategy);
+    }
+    const int filterFlags = pngFilterFlags(options.filter);
+    if (filterFlags >= 0) {
+        png_set_filter(pngPtr, PNG_FILTER_TYPE_BASE, filterFlags);
+    }
 
-    // 绑定输出流到内存
+    // 绑定输出流到内存，预留空间后按块追加，避免逐字节插入和反复扩容
+    pngData.reserve(options.reserveSize ? options.reserveSize : static_cast<uint64_t>(width) * height / 4 + 1024);
     png_set_write_fn(pngPtr, &pngData, [](png_structp pngPtr, png_bytep data, png_size_t length) {
         auto pngData = reinterpret_cast<std::vector<uint8_t>*>(png_get_io_ptr(pngPtr));
-        std::copy(data, data + length, std::back_inserter(*pngData));
+        pngData->insert(pngData->end(), data, data + length);
     }, nullptr);
 
-    // 将图像数据写入内存缓冲区
+    // 将图像数据写入内存缓冲区，NPKColor为BGRA顺序，由libpng交换为RGBA；RGB时再去掉每个像素的第4个字节
     png_write_info(pngPtr, infoPtr);
-    for (uint32_t y = 0; y < m_canvasHeight; ++y) {
-        png_write_row(pngPtr, reinterpret_cast<png_bytep>(m_data + y * m_canvasWidth));
+    png_set_bgr(pngPtr);
+    if (opaque) {
+        png_set_filler(pngPtr, 0, PNG_FILLER_AFTER);
+    }
+    for (uint32_t y = 0; y < height; ++y) {
+        png_write_row(pngPtr, reinterpret_cast<png_const_bytep>(origin + static_cast<uint64_t>(y) * stride));
     }
     png_write_end(pngPtr, infoPtr);
 
-    // 释放资源
     png_destroy_write_struct(&pngPtr, &infoPtr);
+}
+}
+#endif
+
+std::vector<uint8_t> NPKMatrix::toPng(const NPKPngOptions& options) const
+{
+    FUNC_TRACE;
+    std::vector<uint8_t> pngData;
+#ifdef USE_PNG
+    if (isEmpty()) {
+        return pngData;
+    }
+
+    // 输出区域，图像超出画布的部分不输出
+    uint32_t left = 0;
+    uint32_t top = 0;
+    uint32_t width = m_canvasWidth;
+    uint32_t height = m_canvasHeight;
+    if (options.cropToImage) {
+        if (m_offsetX >= m_canvasWidth || m_offsetY >= m_canvasHeight) {
+            return pngData;
+        }
+        left = m_offsetX;
+        top = m_offsetY;
+        width = m_width < m_canvasWidth - left ? m_width : m_canvasWidth - left;
+        height = m_height < m_canvasHeight - top ? m_height : m_canvasHeight - top;
+    }
+
+    bool opaque = false;
+    if (options.rgbIfOpaque) {
+        opaque = true;
+        for (uint32_t y = 0; y < height && opaque; ++y) {
+            const NPKColor* row = m_data + (y + top) * m_canvasWidth + left;
+            for (uint32_t x = 0; x < width; ++x) {
+                if (row[x].a != 0xFF) {
+                    opaque = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    writePng(m_data + static_cast<uint64_t>(top) * m_canvasWidth + left, m_canvasWidth, width, height, left, top, opaque, options, pngData);
 #endif
     return pngData;
 }
 
 void NPKMatrix::reset(uint32_t width, uint32_t height, uint32_t canvasWidth, uint32_t canvasHeight, uint32_t offsetX, uint32_t offsetY)
 {
-    if (m_data) {
-        delete[] m_data;
-    }
     m_width = width;
     m_height = height;
     m_canvasWidth = canvasWidth == 0 ? width : canvasWidth;
     m_canvasHeight = canvasHeight == 0 ? height : canvasHeight;
     m_offsetX = offsetX;
     m_offsetY = offsetY;
-    m_data = new NPKColor[m_canvasWidth * m_canvasHeight];
+    const uint64_t size = static_cast<uint64_t>(m_canvasWidth) * m_canvasHeight;
+    if (size > m_capacity) {
+        delete[] m_data;
+        m_data = new NPKColor[size];
+        m_capacity = size;
+    } else {
+        std::fill_n(m_data, size, NPKColor{});
+    }
+}
+
+NPKPixelBuffer NPKMatrix::pixelBuffer()
+{
+    NPKPixelBuffer buffer;
+    buffer.data = reinterpret_cast<uint8_t*>(m_data);
+    buffer.size = static_cast<uint64_t>(m_canvasWidth) * m_canvasHeight * sizeof(NPKColor);
+    buffer.stride = static_cast<uint64_t>(m_canvasWidth) * sizeof(NPKColor);
+    return buffer;
 }
 
 void NPKMatrix::setPixel(const uint32_t x, const uint32_t y, const NPKColor color)
@@ -94,6 +326,35 @@ void NPKMatrix::setPixel(const uint32_t x, const uint32_t y, const NPKColor colo
     m_data[pos] = color;
 }
 
+void NPKMatrix::setRow(const uint32_t x, const uint32_t y, const NPKColor* colors, uint32_t count)
+{
+    if (x >= m_width || y >= m_height) {
+        return;
+    }
+    const uint64_t canvasX = static_cast<uint64_t>(x) + m_offsetX;
+    const uint64_t canvasY = static_cast<uint64_t>(y) + m_offsetY;
+    if (canvasX >= m_canvasWidth || canvasY >= m_canvasHeight) {
+        return;
+    }
+
+    count = count < m_width - x ? count : m_width - x;
+    count = count < m_canvasWidth - canvasX ? count : static_cast<uint32_t>(m_canvasWidth - canvasX);
+    memcpy(m_data + canvasY * m_canvasWidth + canvasX, colors, count * sizeof(NPKColor));
+}
+
+NPKColor* NPKMatrix::pixelRow(const uint32_t x, const uint32_t y, const uint32_t count)
+{
+    if (static_cast<uint64_t>(x) + count > m_width || y >= m_height) {
+        return nullptr;
+    }
+    const uint64_t canvasX = static_cast<uint64_t>(x) + m_offsetX;
+    const uint64_t canvasY = static_cast<uint64_t>(y) + m_offsetY;
+    if (canvasX + count > m_canvasWidth || canvasY >= m_canvasHeight) {
+        return nullptr;
+    }
+    return m_data + canvasY * m_canvasWidth + canvasX;
+}
+
 std::shared_ptr<NPKMatrix> NPKMatrix::clip(const uint32_t left, const uint32_t top, const uint32_t right, const uint32_t bottom,
                                            const uint32_t canvasWidth, const uint32_t canvasHeight, const uint32_t offsetX,
                                            const uint32_t offsetY) const
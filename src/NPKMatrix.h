@@ -10,21 +10,134 @@
 #include "NPKPublic.h"
 
 namespace neapu {
+enum PngFilter: uint32_t {
+    PF_DEFAULT = 0x00, // 由libpng决定，8位真彩色时逐行尝试所有过滤器
+    PF_NONE = 0x01,
+    PF_SUB = 0x02,
+    PF_UP = 0x03,
+    PF_AVERAGE = 0x04,
+    PF_PAETH = 0x05
+};
+
+typedef struct NPKPngOptions {
+    // zlib压缩级别0-9，-1使用libpng默认值
+    int compressionLevel = -1;
+    // zlib压缩策略，如Z_RLE、Z_FILTERED，-1使用libpng默认值
+    int compressionStrategy = -1;
+    // 行过滤器，固定一种过滤器比逐行尝试快很多，图像很小时PF_NONE通常压缩率也不差
+    PngFilter filter = PF_DEFAULT;
+    // 输出缓冲区预留大小，为0时按原始像素大小的1/16估算
+    uint64_t reserveSize = 0;
+    // 所有像素都不透明时输出RGB
+    bool rgbIfOpaque = false;
+    // 只输出width*height的图像区域，图像在画布中的偏移写入oFFs块
+    bool cropToImage = false;
+} NPKPngOptions;
+
+enum DecodeArea: uint32_t {
+    DA_IMAGE = 0x00, // 只写入width*height的图像区域
+    DA_CANVAS = 0x01 // 写入整个画布，图像以外的部分为透明色，与解码得到的NPKMatrix相同
+};
+
+enum OutputFormat: uint32_t {
+    OF_BGRA8 = 0x00,               // 与NPKColor相同
+    OF_RGBA8 = 0x01,
+    OF_BGRA8_PREMULTIPLIED = 0x02, // 颜色乘以透明度，round(c * a / 255)
+    OF_RGBA8_PREMULTIPLIED = 0x03,
+    OF_RGB565 = 0x04,              // 小端16位，丢弃透明度
+    OF_ARGB4444 = 0x05             // 小端16位，与IMG中的ARGB4444相同
+};
+
+/**
+ * @brief 输出格式每个像素的字节数
+ */
+uint32_t outputPixelSize(OutputFormat format);
+/**
+ * @brief 把一行BGRA8像素转换为输出格式，解码时每行写入后立即转换，不再单独遍历整个图像
+ * @param src 输入像素
+ * @param count 像素数量
+ * @param format 输出格式
+ * @param dst 输出，可以与src相同
+ */
+void convertPixelRow(const NPKColor* src, uint32_t count, OutputFormat format, uint8_t* dst);
+
+/**
+ * @brief 调用者提供的像素缓冲区
+ */
+typedef struct NPKPixelBuffer {
+    uint8_t* data = nullptr;        // 缓冲区起始地址
+    uint64_t size = 0;              // 缓冲区字节数，写入范围超出时解码失败
+    uint64_t stride = 0;            // 每行字节数，为0时等于写入宽度*像素大小
+    uint32_t offsetX = 0;           // 写入位置的左上角，单位为像素
+    uint32_t offsetY = 0;
+    OutputFormat format = OF_BGRA8; // 像素格式
+} NPKPixelBuffer;
+
+/**
+ * @brief 在缓冲区中按其行跨度和写入位置写入width*height像素需要的字节数
+ */
+uint64_t pixelBufferSize(const NPKPixelBuffer& buffer, uint32_t width, uint32_t height);
+/**
+ * @brief 检查缓冲区能否写入width*height像素
+ * @param buffer 像素缓冲区
+ * @param width 写入宽度
+ * @param height 写入高度
+ * @param stride 输出实际的行跨度
+ * @return 写入位置左上角的地址，缓冲区为空、行跨度小于写入宽度或大小不足时返回nullptr
+ */
+uint8_t* pixelBufferOrigin(const NPKPixelBuffer& buffer, uint32_t width, uint32_t height, uint64_t& stride);
+
+/**
+ * @brief 解码得到的画布，拥有像素数据，只能移动不能拷贝
+ *
+ * 可以直接作为值使用，重复解码到同一个对象时复用已分配的内存；需要共享时使用createMatrix。
+ */
 class NPKMatrix {
 public:
     NPKMatrix() = default;
     virtual ~NPKMatrix();
+    NPKMatrix(const NPKMatrix&) = delete;
+    NPKMatrix& operator=(const NPKMatrix&) = delete;
+    NPKMatrix(NPKMatrix&& other) noexcept;
+    NPKMatrix& operator=(NPKMatrix&& other) noexcept;
     uint32_t width() const { return m_width; }
     uint32_t height() const { return m_height; }
     uint32_t canvasWidth() const { return m_canvasWidth; }
     uint32_t canvasHeight() const { return m_canvasHeight; }
+    /**
+     * @brief 图像左上角在画布中的位置
+     */
+    uint32_t offsetX() const { return m_offsetX; }
+    uint32_t offsetY() const { return m_offsetY; }
     const NPKColor* data() const { return m_data; }
+    NPKColor* data() { return m_data; }
     bool isEmpty() const { return m_width == 0 || m_height == 0; }
-    std::vector<uint8_t> toPng() const;
+    /**
+     * @brief 编码为PNG
+     * @param options 编码选项，默认输出整个画布的RGBA
+     * @return 失败或未启用PNG时返回空
+     */
+    std::vector<uint8_t> toPng(const NPKPngOptions& options = {}) const;
 
+    /**
+     * @brief 重新设置尺寸并清空为透明色，容量足够时不重新分配内存
+     */
     void reset(uint32_t width, uint32_t height, uint32_t canvasWidth = 0, uint32_t canvasHeight = 0, uint32_t offsetX = 0,
                uint32_t offsetY = 0);
+    /**
+     * @brief 整个画布作为BGRA8像素缓冲区
+     */
+    NPKPixelBuffer pixelBuffer();
     void setPixel(const uint32_t x, const uint32_t y, NPKColor color);
+    /**
+     * @brief 从(x, y)开始写入一行连续的像素，超出图像或画布的部分忽略
+     */
+    void setRow(uint32_t x, uint32_t y, const NPKColor* colors, uint32_t count);
+    /**
+     * @brief 获取(x, y)开始的count个像素在画布中的地址，用于直接写入整行
+     * @return 这些像素不完全在图像和画布内时返回nullptr，此时应使用setRow
+     */
+    NPKColor* pixelRow(uint32_t x, uint32_t y, uint32_t count);
 
     std::shared_ptr<NPKMatrix> clip(const uint32_t left, const uint32_t top, const uint32_t right, const uint32_t bottom,
         const uint32_t canvasWidth = 0, const uint32_t canvasHeight = 0, const uint32_t offsetX = 0, const uint32_t offsetY = 0) const;
@@ -40,6 +153,7 @@ private:
     uint32_t m_offsetX{0};
     uint32_t m_offsetY{0};
     NPKColor* m_data{nullptr};
+    uint64_t m_capacity{0}; // 已分配的像素数量
 };
 } // neapu
 
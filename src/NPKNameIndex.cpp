@@ -0,0 +1,256 @@
+//
+// Created by liu86 on 24-8-16.
+//
+
+#include "NPKNameIndex.h"
+#include <algorithm>
+
+namespace neapu {
+namespace {
+constexpr uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+constexpr uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+// 比较两个由两段拼接成的字符串
+int comparePieces(std::string_view a0, std::string_view a1, std::string_view b0, std::string_view b1)
+{
+    while (true) {
+        if (a0.empty()) {
+            if (a1.empty()) {
+                return b0.empty() && b1.empty() ? 0 : -1;
+            }
+            a0 = a1;
+            a1 = {};
+        }
+        if (b0.empty()) {
+            if (b1.empty()) {
+                return 1;
+            }
+            b0 = b1;
+            b1 = {};
+        }
+        const size_t len = std::min(a0.size(), b0.size());
+        if (const int ret = a0.substr(0, len).compare(b0.substr(0, len)); ret != 0) {
+            return ret;
+        }
+        a0.remove_prefix(len);
+        b0.remove_prefix(len);
+    }
+}
+
+bool startsWith(std::string_view piece0, std::string_view piece1, std::string_view prefix)
+{
+    const size_t len = std::min(piece0.size(), prefix.size());
+    if (piece0.substr(0, len) != prefix.substr(0, len)) {
+        return false;
+    }
+    prefix.remove_prefix(len);
+    return piece1.substr(0, prefix.size()) == prefix;
+}
+}
+
+uint32_t NPKNameIndex::add(const std::string_view name)
+{
+    const size_t pos = name.find_last_of('/');
+    const std::string_view directory = pos == std::string_view::npos ? std::string_view{} : name.substr(0, pos + 1);
+    const std::string_view shortName = name.substr(directory.size());
+
+    uint32_t directoryId = 0;
+    if (const auto it = m_directoryIds.find(directory); it != m_directoryIds.end()) {
+        directoryId = it->second;
+    } else {
+        directoryId = static_cast<uint32_t>(m_directories.size());
+        m_directories.emplace_back(directory);
+        m_directoryIds.emplace(m_directories.back(), directoryId);
+        m_directoryHashes.push_back(hashBytes(FNV_OFFSET, directory));
+        m_directoryEntries.emplace_back();
+    }
+
+    const auto id = static_cast<uint32_t>(m_entries.size());
+    m_entries.push_back(Entry{directoryId, static_cast<uint32_t>(m_shortNames.size()), static_cast<uint32_t>(shortName.size())});
+    m_shortNames.insert(m_shortNames.end(), shortName.begin(), shortName.end());
+    m_directoryEntries[directoryId].push_back(id);
+
+    if ((static_cast<uint64_t>(m_entries.size()) * 2) > m_slots.size()) {
+        rehash(std::max<uint64_t>(16, m_slots.size() * 2));
+    } else {
+        insertSlot(id, hashOf(id));
+    }
+    return id;
+}
+
+void NPKNameIndex::reserve(const uint32_t count)
+{
+    m_entries.reserve(count);
+    // 文件名一般在32字节以内
+    m_shortNames.reserve(static_cast<size_t>(count) * 32);
+    uint64_t capacity = 16;
+    while (capacity < static_cast<uint64_t>(count) * 2) {
+        capacity *= 2;
+    }
+    if (capacity > m_slots.size()) {
+        rehash(capacity);
+    }
+}
+
+void NPKNameIndex::shrinkToFit()
+{
+    m_entries.shrink_to_fit();
+    m_shortNames.shrink_to_fit();
+    m_directoryHashes.shrink_to_fit();
+    for (auto& entries : m_directoryEntries) {
+        entries.shrink_to_fit();
+    }
+}
+
+std::string NPKNameIndex::name(const uint32_t id) const
+{
+    if (id >= m_entries.size()) {
+        return {};
+    }
+    const auto& entry = m_entries[id];
+    std::string result;
+    result.reserve(directoryOf(entry).size() + entry.nameLength);
+    result.append(directoryOf(entry));
+    result.append(shortNameOf(entry));
+    return result;
+}
+
+std::string_view NPKNameIndex::shortName(const uint32_t id) const
+{
+    if (id >= m_entries.size()) {
+        return {};
+    }
+    return shortNameOf(m_entries[id]);
+}
+
+std::string_view NPKNameIndex::directory(const uint32_t id) const
+{
+    if (id >= m_entries.size()) {
+        return {};
+    }
+    const std::string_view directory = directoryOf(m_entries[id]);
+    return directory.empty() ? directory : directory.substr(0, directory.size() - 1);
+}
+
+int64_t NPKNameIndex::find(const std::string_view name) const
+{
+    if (m_slots.empty()) {
+        return -1;
+    }
+    const uint64_t mask = m_slots.size() - 1;
+    for (uint64_t slot = hashBytes(FNV_OFFSET, name) & mask;; slot = (slot + 1) & mask) {
+        const uint32_t id = m_slots[slot];
+        if (id == EMPTY_SLOT) {
+            return -1;
+        }
+        if (equals(id, name)) {
+            return id;
+        }
+    }
+}
+
+std::vector<uint32_t> NPKNameIndex::findPrefix(const std::string_view prefix) const
+{
+    std::lock_guard lock(m_sortedMutex);
+    if (m_sorted.size() != m_entries.size()) {
+        m_sorted.resize(m_entries.size());
+        for (uint32_t i = 0; i < m_sorted.size(); ++i) {
+            m_sorted[i] = i;
+        }
+        std::stable_sort(m_sorted.begin(), m_sorted.end(), [this](const uint32_t a, const uint32_t b) {
+            const auto& ea = m_entries[a];
+            const auto& eb = m_entries[b];
+            return comparePieces(directoryOf(ea), shortNameOf(ea), directoryOf(eb), shortNameOf(eb)) < 0;
+        });
+    }
+
+    auto it = std::lower_bound(m_sorted.begin(), m_sorted.end(), prefix, [this](const uint32_t id, const std::string_view value) {
+        const auto& entry = m_entries[id];
+        return comparePieces(directoryOf(entry), shortNameOf(entry), value, {}) < 0;
+    });
+    std::vector<uint32_t> result;
+    for (; it != m_sorted.end(); ++it) {
+        const auto& entry = m_entries[*it];
+        if (!startsWith(directoryOf(entry), shortNameOf(entry), prefix)) {
+            break;
+        }
+        result.push_back(*it);
+    }
+    return result;
+}
+
+std::vector<uint32_t> NPKNameIndex::list(std::string_view directory) const
+{
+    std::string key(directory);
+    if (!key.empty() && key.back() != '/') {
+        key.push_back('/');
+    }
+    const auto it = m_directoryIds.find(key);
+    if (it == m_directoryIds.end()) {
+        return {};
+    }
+    return m_directoryEntries[it->second];
+}
+
+uint64_t NPKNameIndex::memoryUsage() const
+{
+    uint64_t usage = m_entries.capacity() * sizeof(Entry) + m_shortNames.capacity() + m_slots.capacity() * sizeof(uint32_t) +
+                     m_directoryHashes.capacity() * sizeof(uint64_t) + m_directoryEntries.capacity() * sizeof(std::vector<uint32_t>);
+    for (uint32_t i = 0; i < m_directories.size(); ++i) {
+        usage += sizeof(std::string) + m_directories[i].capacity() + m_directoryEntries[i].capacity() * sizeof(uint32_t);
+    }
+    // 哈希表每个节点包括键、值和链表指针
+    usage += m_directoryIds.size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void*)) +
+             m_directoryIds.bucket_count() * sizeof(void*);
+    std::lock_guard lock(m_sortedMutex);
+    return usage + m_sorted.capacity() * sizeof(uint32_t);
+}
+
+uint64_t NPKNameIndex::hashBytes(uint64_t hash, const std::string_view bytes)
+{
+    for (const char c : bytes) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t NPKNameIndex::hashOf(const uint32_t id) const
+{
+    const auto& entry = m_entries[id];
+    return hashBytes(m_directoryHashes[entry.directory], shortNameOf(entry));
+}
+
+bool NPKNameIndex::equals(const uint32_t id, const std::string_view name) const
+{
+    const auto& entry = m_entries[id];
+    const std::string_view directory = directoryOf(entry);
+    return name.size() == directory.size() + entry.nameLength && name.substr(0, directory.size()) == directory &&
+           name.substr(directory.size()) == shortNameOf(entry);
+}
+
+void NPKNameIndex::insertSlot(const uint32_t id, const uint64_t hash)
+{
+    const uint64_t mask = m_slots.size() - 1;
+    for (uint64_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        const uint32_t existing = m_slots[slot];
+        if (existing == EMPTY_SLOT) {
+            m_slots[slot] = id;
+            return;
+        }
+        // 重复的名称只保留最先加入的，目录去重过，编号相同即目录相同
+        const auto& a = m_entries[existing];
+        const auto& b = m_entries[id];
+        if (a.directory == b.directory && shortNameOf(a) == shortNameOf(b)) {
+            return;
+        }
+    }
+}
+
+void NPKNameIndex::rehash(const uint64_t capacity)
+{
+    m_slots.assign(capacity, EMPTY_SLOT);
+    for (uint32_t id = 0; id < m_entries.size(); ++id) {
+        insertSlot(id, hashOf(id));
+    }
+}
+} // neapu
@@ -0,0 +1,99 @@
+//
+// Created by liu86 on 24-8-16.
+//
+
+#ifndef NPKNAMEINDEX_H
+#define NPKNAMEINDEX_H
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace neapu {
+/**
+ * @brief Image名称表，按加入顺序编号
+ *
+ * 名称拆成目录和文件名保存：目录去重后只保存一份，文件名连续保存在同一块内存中，
+ * 每个名称另外只有一个12字节的记录、一个哈希槽和所在目录列表中的一项。
+ * 支持按完整名称O(1)查找、按前缀查找和列出目录。
+ * 加入名称不能与查询同时进行，加入完成后所有查询都可以多线程调用。
+ */
+class NPKNameIndex {
+public:
+    NPKNameIndex() = default;
+    virtual ~NPKNameIndex() = default;
+    NPKNameIndex(const NPKNameIndex&) = delete;
+    NPKNameIndex& operator=(const NPKNameIndex&) = delete;
+
+    /**
+     * @brief 加入名称
+     * @param name 完整名称，如sprite/character/xxx.img
+     * @return 名称编号，与加入顺序相同，重复的名称也会分配新编号
+     */
+    uint32_t add(std::string_view name);
+    void reserve(uint32_t count);
+    // 加入全部名称后释放多余的预留空间
+    void shrinkToFit();
+    uint32_t size() const { return static_cast<uint32_t>(m_entries.size()); }
+
+    std::string name(uint32_t id) const;
+    // 最后一个'/'之后的部分
+    std::string_view shortName(uint32_t id) const;
+    // 最后一个'/'之前的部分，没有'/'时为空
+    std::string_view directory(uint32_t id) const;
+
+    /**
+     * @brief 按完整名称查找，重复的名称返回最先加入的编号
+     * @return 不存在返回-1
+     */
+    int64_t find(std::string_view name) const;
+    /**
+     * @brief 查找以prefix开头的所有名称
+     * @return 按名称排序的编号
+     */
+    std::vector<uint32_t> findPrefix(std::string_view prefix) const;
+    /**
+     * @brief 列出目录中的名称，不包括子目录
+     * @param directory 目录，末尾的'/'可以省略
+     * @return 按加入顺序的编号
+     */
+    std::vector<uint32_t> list(std::string_view directory) const;
+    // 名称表占用的内存
+    uint64_t memoryUsage() const;
+
+private:
+    typedef struct Entry {
+        uint32_t directory;  // 目录编号，目录字符串包括末尾的'/'
+        uint32_t nameOffset; // 文件名在m_shortNames中的偏移
+        uint32_t nameLength;
+    } Entry;
+
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    static uint64_t hashBytes(uint64_t hash, std::string_view bytes);
+    std::string_view directoryOf(const Entry& entry) const { return m_directories[entry.directory]; }
+    std::string_view shortNameOf(const Entry& entry) const { return {m_shortNames.data() + entry.nameOffset, entry.nameLength}; }
+    uint64_t hashOf(uint32_t id) const;
+    bool equals(uint32_t id, std::string_view name) const;
+    void insertSlot(uint32_t id, uint64_t hash);
+    void rehash(uint64_t capacity);
+
+private:
+    std::deque<std::string> m_directories; // deque保证已有元素地址不变，m_directoryIds的键引用这里的字符串
+    std::unordered_map<std::string_view, uint32_t> m_directoryIds;
+    std::vector<uint64_t> m_directoryHashes; // 目录字符串的哈希状态，名称的哈希从这里继续计算
+    std::vector<std::vector<uint32_t>> m_directoryEntries;
+    std::vector<char> m_shortNames;
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_slots; // 开放寻址哈希表，保存名称编号
+
+    // 前缀查找用的排序结果，第一次查找时生成
+    mutable std::mutex m_sortedMutex;
+    mutable std::vector<uint32_t> m_sorted;
+};
+} // neapu
+
+#endif //NPKNAMEINDEX_H
@@ -7,6 +7,10 @@
 #include "logger.h"
 
 namespace neapu {
+namespace {
+constexpr uint32_t LUT_SIZE = 256;
+}
+
 NPKPaletteManager::NPKPaletteManager()
 = default;
 
@@ -14,12 +18,11 @@ int NPKPaletteManager::loadPalettes(const uint8_t* data, const uint64_t dataLen,
 {
     if (version == 4 || version == 5) {
         m_paletteCount = 1;
-        auto palette = std::make_shared<NPKPalette>();
-        const int ret = palette->loadPalette(data, dataLen);
+        const int ret = loadPalette(data, dataLen);
         if (ret == 0) {
             return 0;
         }
-        m_palette.push_back(palette);
+        m_dataSize = ret;
         return ret;
     } else if (version == 6) {
         if (dataLen < sizeof(uint32_t)) {
@@ -34,14 +37,14 @@ int NPKPaletteManager::loadPalettes(const uint8_t* data, const uint64_t dataLen,
         }
         int offset = sizeof(uint32_t);
         for (int i = 0; i < m_paletteCount; ++i) {
-            auto palette = std::make_shared<NPKPalette>();
-            ret = palette->loadPalette(data + offset, dataLen - offset);
+            ret = loadPalette(data + offset, dataLen - offset);
             if (ret == 0) {
                 return 0;
             }
-            m_palette.push_back(palette);
             offset += ret;
         }
+        m_colors.shrink_to_fit();
+        m_dataSize = offset;
         return offset;
     }
     LOG_WARNING << "Unsupported version." << version;
@@ -50,52 +53,80 @@ int NPKPaletteManager::loadPalettes(const uint8_t* data, const uint64_t dataLen,
 
 NPKColor NPKPaletteManager::getColor(int paletteIndex, int colorIndex) const
 {
-    if (paletteIndex < 0 || paletteIndex >= m_paletteCount) {
+    if (paletteIndex < 0 || paletteIndex >= static_cast<int>(m_offsets.size())) {
         LOG_ERROR << "Invalid palette index." << paletteIndex;
         return {};
     }
 
-    if (colorIndex < 0 || colorIndex >= m_palette[paletteIndex]->m_colorCount) {
+    if (colorIndex < 0 || static_cast<uint32_t>(colorIndex) >= m_colorCounts[paletteIndex]) {
         LOG_WARNING << "Invalid color index." << colorIndex;
         return {};
     }
 
-    return m_palette[paletteIndex]->m_colors[colorIndex];
+    return m_colors[m_offsets[paletteIndex] + colorIndex];
+}
+
+const NPKColor* NPKPaletteManager::getLUT(const int paletteIndex) const
+{
+    if (paletteIndex < 0 || paletteIndex >= static_cast<int>(m_offsets.size())) {
+        return nullptr;
+    }
+    return m_colors.data() + m_offsets[paletteIndex];
 }
 
-NPKPaletteManager::NPKPalette::~NPKPalette()
+uint32_t NPKPaletteManager::getColorCount(const int paletteIndex) const
 {
-    if (m_colors) {
-        delete[] m_colors;
+    if (paletteIndex < 0 || paletteIndex >= static_cast<int>(m_offsets.size())) {
+        return 0;
     }
+    return m_colorCounts[paletteIndex];
+}
+
+std::vector<NPKColor> NPKPaletteManager::getColors(const int paletteIndex) const
+{
+    if (paletteIndex < 0 || paletteIndex >= static_cast<int>(m_offsets.size())) {
+        return {};
+    }
+    const NPKColor* colors = m_colors.data() + m_offsets[paletteIndex];
+    return std::vector<NPKColor>(colors, colors + m_colorCounts[paletteIndex]);
+}
+
+uint64_t NPKPaletteManager::memoryUsage() const
+{
+    return sizeof(*this) + m_colors.capacity() * sizeof(NPKColor) + (m_offsets.capacity() + m_colorCounts.capacity()) * sizeof(uint32_t);
 }
 
-int NPKPaletteManager::NPKPalette::loadPalette(const uint8_t* data, int dataLen)
+int NPKPaletteManager::loadPalette(const uint8_t* data, const uint64_t dataLen)
 {
     if (dataLen < sizeof(uint32_t)) {
         LOG_WARNING << "Data length is too short.";
         return 0;
     }
 
-    const int ret = memcpy_s(&m_colorCount, sizeof(uint32_t), data, sizeof(uint32_t));
+    uint32_t colorCount = 0;
+    const int ret = memcpy_s(&colorCount, sizeof(uint32_t), data, sizeof(uint32_t));
     if (ret != 0) {
         LOG_WARNING << "Failed to read color count.";
         return 0;
     }
 
-    if (dataLen < (sizeof(uint32_t) + m_colorCount * 4)) {
+    if (dataLen < sizeof(uint32_t) + static_cast<uint64_t>(colorCount) * 4) {
         LOG_WARNING << "Data length is too short.";
         return 0;
     }
 
-    m_colors = new NPKColor[m_colorCount];
-    for (int i = 0; i < m_colorCount; ++i) {
-        m_colors[i].a = data[i * 4 + sizeof(uint32_t)];
-        m_colors[i].b = data[i * 4 + 1 + sizeof(uint32_t)];
-        m_colors[i].g = data[i * 4 + 2 + sizeof(uint32_t)];
-        m_colors[i].r = data[i * 4 + 3 + sizeof(uint32_t)];
+    const auto offset = static_cast<uint32_t>(m_colors.size());
+    m_colors.resize(offset + (colorCount > LUT_SIZE ? colorCount : LUT_SIZE), NPKColor{});
+    NPKColor* colors = m_colors.data() + offset;
+    for (uint32_t i = 0; i < colorCount; ++i) {
+        colors[i].a = data[i * 4 + sizeof(uint32_t)];
+        colors[i].b = data[i * 4 + 1 + sizeof(uint32_t)];
+        colors[i].g = data[i * 4 + 2 + sizeof(uint32_t)];
+        colors[i].r = data[i * 4 + 3 + sizeof(uint32_t)];
     }
+    m_offsets.push_back(offset);
+    m_colorCounts.push_back(colorCount);
 
-    return sizeof(uint32_t) + m_colorCount * 4;
+    return static_cast<int>(sizeof(uint32_t) + colorCount * 4);
 }
-} // neapu
\ No newline at end of file
+} // neapu
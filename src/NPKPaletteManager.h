@@ -18,23 +18,40 @@ public:
     // void setPalette(int index, const uint8_t* colorData, int colorCount);
     int loadPalettes(const uint8_t* data, uint64_t dataLen, uint32_t version);
     NPKColor getColor(int paletteIndex, int colorIndex) const;
+    /**
+     * @brief 获取展开为256项的调色板查找表，超出颜色数量的索引对应透明色，可直接用1字节索引查表
+     * @param paletteIndex 调色板索引
+     * @return 调色板索引无效返回nullptr
+     */
+    const NPKColor* getLUT(int paletteIndex) const;
+    /**
+     * @brief 调色板中实际的颜色数量，不小于它的索引为无效索引
+     */
+    uint32_t getColorCount(int paletteIndex) const;
+    /**
+     * @brief 调色板中的所有颜色，调色板索引无效时返回空
+     */
+    std::vector<NPKColor> getColors(int paletteIndex) const;
 
     int paletteCount() const { return m_paletteCount; }
+    // loadPalettes成功时读取的字节数，失败时为0
+    uint32_t dataSize() const { return m_dataSize; }
+    uint64_t memoryUsage() const;
 
 private:
-    typedef struct NPKPalette {
-        NPKPalette() = default;
-        ~NPKPalette();
-
-        int loadPalette(const uint8_t* data, int dataLen);
-
-        int m_colorCount{0};
-        NPKColor* m_colors{nullptr};
-    } NPKPalette;
+    /**
+     * @brief 读取一个调色板追加到m_colors
+     * @return 读取的字节数，失败返回0
+     */
+    int loadPalette(const uint8_t* data, uint64_t dataLen);
 
 private:
     int m_paletteCount{0};
-    std::vector<std::shared_ptr<NPKPalette>> m_palette;
+    uint32_t m_dataSize{0};
+    // 所有调色板的颜色连续保存，每个调色板至少占256项，超出颜色数量的部分为透明色，所以开头的256项就是查找表
+    std::vector<NPKColor> m_colors;
+    std::vector<uint32_t> m_offsets; // 每个调色板在m_colors中的起点
+    std::vector<uint32_t> m_colorCounts;
 };
 } // neapu
 
@@ -0,0 +1,320 @@
+//
+// Created by liu86 on 24-8-15.
+//
+
+#include "NPKSidecar.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "logger.h"
+#include "NPKDDSHandler.h"
+#include "NPKFileMapping.h"
+#include "NPKFileReader.h"
+#include "NPKFrameHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKPaletteManager.h"
+#ifndef _WIN32
+#define fopen_s(pFile, filename, mode) (((*(pFile)) = fopen((filename), (mode))) == NULL)
+#endif
+
+namespace neapu {
+namespace {
+constexpr char SIDECAR_MAGIC[16] = "NPK Sidecar";
+constexpr uint32_t SIDECAR_VERSION = 1;
+constexpr uint32_t NO_DATA = UINT32_MAX; // 没有数据或数据不完整，加载时不读取
+
+#pragma pack(push, 1)
+typedef struct SidecarHeader {
+    char magic[16];
+    uint32_t version;
+    uint32_t imageCount;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint8_t sourceHash[32];
+    uint64_t ddsCount;
+    uint64_t frameCount;
+    uint64_t namesSize;
+} SidecarHeader;
+
+typedef struct SidecarImage {
+    uint32_t offset; // Image在NPK中的偏移与大小
+    uint32_t size;
+    NPKImageHeader header;
+    NPKImageV5Info v5Info;
+    uint32_t paletteOffset; // 调色板在Image中的偏移与大小，大小为0时没有调色板
+    uint32_t paletteSize;
+    uint32_t nameOffset; // 名称在名称表中的偏移与长度
+    uint32_t nameLength;
+    uint32_t ddsCount;
+    uint32_t frameCount;
+} SidecarImage;
+
+typedef struct SidecarDDS {
+    NPKDDSIndex index;
+    uint32_t dataOffset; // 数据在Image中的偏移
+} SidecarDDS;
+
+typedef struct SidecarFrame {
+    NPKFrameIndex index;
+    uint32_t dataOffset;
+} SidecarFrame;
+#pragma pack(pop)
+
+uint32_t frameIndexSize(const NPKFrameIndex& index)
+{
+    if (index.colorType == CL_LINK) {
+        return LINK_FRAME_INDEX_SIZE;
+    }
+    return index.colorType < CL_LINK ? MATRIX_FRAME_INDEX_SIZE : DDS_FRAME_INDEX_SIZE;
+}
+
+// 数据完整时返回偏移并前移，与loadData的截断规则相同
+uint32_t takeData(uint64_t& offset, const uint64_t imageSize, const uint64_t dataSize)
+{
+    if (imageSize - offset < dataSize) {
+        offset = imageSize;
+        return NO_DATA;
+    }
+    const auto dataOffset = static_cast<uint32_t>(offset);
+    offset += dataSize;
+    return dataOffset;
+}
+
+template <typename T>
+void appendRecord(std::vector<uint8_t>& buffer, const T& record)
+{
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&record);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+}
+
+bool NPKSidecar::save(const std::string& path, const std::vector<std::shared_ptr<NPKImageHandler>>& images, const NPKFileStamp& source,
+                      const uint8_t sourceHash[32])
+{
+    std::vector<SidecarImage> imageRecords;
+    std::vector<SidecarDDS> ddsRecords;
+    std::vector<SidecarFrame> frameRecords;
+    std::string names;
+    imageRecords.reserve(images.size());
+    for (const auto& image : images) {
+        if (!image || image->m_pendingData || image->m_pendingReader || image->m_loadFailed) {
+            LOG_ERROR << "Image is not loaded, cannot write sidecar: " << path;
+            return false;
+        }
+
+        SidecarImage record{};
+        record.offset = image->m_offset;
+        record.size = image->m_size;
+        record.header = image->m_header;
+        record.v5Info = image->m_v5Info;
+        const std::string name = image->getName();
+        record.nameOffset = static_cast<uint32_t>(names.size());
+        record.nameLength = static_cast<uint32_t>(name.size());
+        record.ddsCount = static_cast<uint32_t>(image->m_ddsHandlers.size());
+        record.frameCount = static_cast<uint32_t>(image->m_frames.size());
+        names += name;
+
+        // 按loadNPKImage的顺序重新计算各部分的偏移
+        const uint64_t imageSize = image->m_size;
+        uint64_t offset = sizeof(NPKImageHeader) + (image->version() == 5 ? sizeof(NPKImageV5Info) : 0);
+        record.paletteOffset = static_cast<uint32_t>(offset);
+        record.paletteSize = image->m_paletteManager ? image->m_paletteManager->dataSize() : 0;
+        offset += record.paletteSize + image->m_ddsHandlers.size() * sizeof(NPKDDSIndex);
+        const auto& frames = image->m_frames;
+        for (uint32_t i = 0; i < frames.size(); ++i) {
+            offset += frameIndexSize(frames.index(i));
+        }
+        for (const auto& dds : image->m_ddsHandlers) {
+            const uint32_t dataOffset = offset < imageSize ? takeData(offset, imageSize, dds->index().compressSize) : NO_DATA;
+            ddsRecords.push_back(SidecarDDS{dds->index(), dataOffset});
+        }
+        for (uint32_t i = 0; i < frames.size(); ++i) {
+            const NPKFrameIndex index = frames.index(i);
+            uint32_t dataOffset = NO_DATA;
+            if (offset < imageSize && frames.kind(i) == FK_MATRIX && index.colorType != CL_UNKNOWN && index.dataSize > 0) {
+                dataOffset = takeData(offset, imageSize, index.dataSize);
+            }
+            frameRecords.push_back(SidecarFrame{index, dataOffset});
+        }
+        imageRecords.push_back(record);
+    }
+
+    SidecarHeader header{};
+    memcpy(header.magic, SIDECAR_MAGIC, sizeof(header.magic));
+    header.version = SIDECAR_VERSION;
+    header.imageCount = static_cast<uint32_t>(imageRecords.size());
+    header.sourceSize = source.size;
+    header.sourceMtime = source.mtime;
+    memcpy(header.sourceHash, sourceHash, sizeof(header.sourceHash));
+    header.ddsCount = ddsRecords.size();
+    header.frameCount = frameRecords.size();
+    header.namesSize = names.size();
+
+    std::vector<uint8_t> buffer;
+    buffer.reserve(sizeof(header) + imageRecords.size() * sizeof(SidecarImage) + ddsRecords.size() * sizeof(SidecarDDS) +
+                   frameRecords.size() * sizeof(SidecarFrame) + names.size());
+    appendRecord(buffer, header);
+    for (const auto& record : imageRecords) {
+        appendRecord(buffer, record);
+    }
+    for (const auto& record : ddsRecords) {
+        appendRecord(buffer, record);
+    }
+    for (const auto& record : frameRecords) {
+        appendRecord(buffer, record);
+    }
+    buffer.insert(buffer.end(), names.begin(), names.end());
+
+    const std::string tempPath = path + ".tmp";
+    FILE* file = nullptr;
+    if (fopen_s(&file, tempPath.c_str(), "wb") != 0) {
+        LOG_ERROR << "Failed to open file: " << tempPath;
+        return false;
+    }
+    const bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    if (fclose(file) != 0 || !ok) {
+        LOG_ERROR << "Failed to write file: " << tempPath;
+        std::filesystem::remove(tempPath);
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        LOG_ERROR << "Failed to replace sidecar: " << path << " " << ec.message();
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool NPKSidecar::load(const std::string& path, const NPKHeader& header, const uint8_t* source, const NPKFileReader* reader,
+                      const NPKFileStamp& sourceStamp, const uint8_t sourceHash[32], std::vector<std::shared_ptr<NPKImageHandler>>& images,
+                      std::shared_ptr<NPKNameIndex>& names)
+{
+    if (source == nullptr && reader == nullptr) {
+        return false;
+    }
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+        return false;
+    }
+    NPKFileMapping mapping;
+    if (!mapping.open(path)) {
+        return false;
+    }
+    mapping.advise(0, mapping.size(), MA_SEQUENTIAL);
+
+    const uint8_t* data = mapping.data();
+    const uint64_t size = mapping.size();
+    SidecarHeader sidecar{};
+    if (size < sizeof(sidecar)) {
+        LOG_WARNING << "Sidecar is too small: " << path;
+        return false;
+    }
+    memcpy(&sidecar, data, sizeof(sidecar));
+    if (memcmp(sidecar.magic, SIDECAR_MAGIC, sizeof(sidecar.magic)) != 0 || sidecar.version != SIDECAR_VERSION) {
+        LOG_WARNING << "Unsupported sidecar: " << path;
+        return false;
+    }
+    if (sidecar.sourceSize != sourceStamp.size || sidecar.sourceMtime != sourceStamp.mtime || sidecar.imageCount != header.imgCount ||
+        memcmp(sidecar.sourceHash, sourceHash, sizeof(sidecar.sourceHash)) != 0) {
+        LOG_WARNING << "Sidecar is out of date: " << path;
+        return false;
+    }
+    // 各部分的数量由文件头给出，总大小必须完全一致
+    const uint64_t imagesOffset = sizeof(sidecar);
+    const uint64_t ddsOffset = imagesOffset + static_cast<uint64_t>(sidecar.imageCount) * sizeof(SidecarImage);
+    const uint64_t framesOffset = ddsOffset + sidecar.ddsCount * sizeof(SidecarDDS);
+    const uint64_t namesOffset = framesOffset + sidecar.frameCount * sizeof(SidecarFrame);
+    if (sidecar.ddsCount > size || sidecar.frameCount > size || sidecar.namesSize > size || namesOffset + sidecar.namesSize != size) {
+        LOG_WARNING << "Sidecar size mismatch: " << path;
+        return false;
+    }
+
+    const char* nameData = reinterpret_cast<const char*>(data + namesOffset);
+    auto nameIndex = std::make_shared<NPKNameIndex>();
+    nameIndex->reserve(sidecar.imageCount);
+    std::vector<std::shared_ptr<NPKImageHandler>> result;
+    result.reserve(sidecar.imageCount);
+    uint64_t ddsBegin = 0;
+    uint64_t frameBegin = 0;
+    for (uint32_t i = 0; i < sidecar.imageCount; ++i) {
+        SidecarImage record{};
+        memcpy(&record, data + imagesOffset + i * sizeof(SidecarImage), sizeof(record));
+        if (static_cast<uint64_t>(record.offset) + record.size > sourceStamp.size ||
+            static_cast<uint64_t>(record.nameOffset) + record.nameLength > sidecar.namesSize || ddsBegin + record.ddsCount > sidecar.ddsCount ||
+            frameBegin + record.frameCount > sidecar.frameCount ||
+            static_cast<uint64_t>(record.paletteOffset) + record.paletteSize > record.size) {
+            LOG_WARNING << "Invalid sidecar image record: " << path << " " << i;
+            return false;
+        }
+
+        auto image = std::make_shared<NPKImageHandler>();
+        const uint8_t* imageData = source ? source + record.offset : nullptr;
+        if (imageData == nullptr) {
+            // 整个Image拷贝到m_payload，帧和DDS的偏移同样相对于Image开头
+            image->m_payloadSize = record.size;
+            image->m_payload.reset(new uint8_t[record.size]);
+            if (!reader->read(record.offset, record.size, image->m_payload.get())) {
+                LOG_WARNING << "Failed to read image data: " << path << " " << i;
+                return false;
+            }
+            imageData = image->m_payload.get();
+        }
+        image->m_offset = record.offset;
+        image->m_size = record.size;
+        image->m_header = record.header;
+        image->m_v5Info = record.v5Info;
+        image->m_nameId = nameIndex->add(std::string_view(nameData + record.nameOffset, record.nameLength));
+        image->m_names = nameIndex;
+        if (image->version() == 4 || image->version() == 5 || image->version() == 6) {
+            image->m_paletteManager = std::make_shared<NPKPaletteManager>();
+            if (record.paletteSize > 0) {
+                image->m_paletteManager->loadPalettes(imageData + record.paletteOffset, record.paletteSize, image->version());
+            }
+        }
+
+        for (uint32_t j = 0; j < record.ddsCount; ++j) {
+            SidecarDDS dds{};
+            memcpy(&dds, data + ddsOffset + (ddsBegin + j) * sizeof(SidecarDDS), sizeof(dds));
+            auto handler = std::make_shared<NPKDDSHandler>();
+            handler->loadIndex(reinterpret_cast<const uint8_t*>(&dds.index), sizeof(dds.index));
+            if (dds.dataOffset != NO_DATA) {
+                if (static_cast<uint64_t>(dds.dataOffset) + dds.index.compressSize > record.size) {
+                    LOG_WARNING << "Invalid sidecar DDS record: " << path << " " << i;
+                    return false;
+                }
+                handler->loadData(imageData + dds.dataOffset, dds.index.compressSize, false);
+            }
+            image->m_ddsHandlers.push_back(handler);
+        }
+        image->m_ddsCache.reset(image->m_ddsHandlers.size());
+
+        // 帧数据直接引用文件数据或Image的拷贝，偏移与索引文件中一样相对于Image开头
+        image->m_frames.setPayload(imageData);
+        for (uint32_t j = 0; j < record.frameCount; ++j) {
+            SidecarFrame frame{};
+            memcpy(&frame, data + framesOffset + (frameBegin + j) * sizeof(SidecarFrame), sizeof(frame));
+            // 与NPKFrameHandler::loadIndex一样只保留文件中存在的字段
+            NPKFrameHandler handler(nullptr);
+            handler.loadIndex(reinterpret_cast<const uint8_t*>(&frame.index), sizeof(frame.index));
+            const uint32_t index = image->m_frames.add(handler.index());
+            if (frame.dataOffset != NO_DATA) {
+                if (static_cast<uint64_t>(frame.dataOffset) + frame.index.dataSize > record.size) {
+                    LOG_WARNING << "Invalid sidecar frame record: " << path << " " << i;
+                    return false;
+                }
+                image->m_frames.setDataOffset(index, frame.dataOffset);
+            }
+        }
+        image->m_frames.shrinkToFit();
+        ddsBegin += record.ddsCount;
+        frameBegin += record.frameCount;
+        result.push_back(image);
+    }
+
+    images = std::move(result);
+    names = std::move(nameIndex);
+    return true;
+}
+} // neapu
@@ -0,0 +1,60 @@
+//
+// Created by liu86 on 24-8-15.
+//
+
+#ifndef NPKSIDECAR_H
+#define NPKSIDECAR_H
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKNameIndex.h"
+#include "NPKVerifyCache.h"
+
+namespace neapu {
+class NPKImageHandler;
+class NPKFileReader;
+
+/**
+ * @brief NPK的索引文件，保存解析后的全部元数据：Image名称与偏移、调色板位置、DDS索引和帧索引，
+ * 以及每个DDS和帧的数据在Image中的偏移
+ *
+ * 索引文件记录生成时NPK文件的大小、修改时间和索引表之后的SHA256，三者都一致时才会使用，
+ * 使用时只映射索引文件并按记录创建Image，不再解析NPK中的Image数据。
+ * NPK使用内存映射时帧数据直接引用映射的文件数据，否则每个Image只读取自己的数据范围。
+ */
+class NPKSidecar {
+public:
+    static std::string defaultPath(const std::string& npkPath) { return npkPath + ".idx"; }
+
+    /**
+     * @brief 生成索引文件，先写入临时文件再替换，写入失败时不影响已有的索引文件
+     * @param path 索引文件路径
+     * @param images 已全部解析的Image
+     * @param source NPK文件的大小和修改时间
+     * @param sourceHash NPK索引表之后的SHA256
+     * @return 成功返回true
+     */
+    static bool save(const std::string& path, const std::vector<std::shared_ptr<NPKImageHandler>>& images, const NPKFileStamp& source,
+                     const uint8_t sourceHash[32]);
+    /**
+     * @brief 读取索引文件并创建Image
+     * @param path 索引文件路径
+     * @param header NPK文件头
+     * @param source NPK文件数据，帧数据直接引用，调用者需保证其生命周期；为空时使用reader
+     * @param reader source为空时从文件读取每个Image的数据，拷贝到Image自己的内存中
+     * @param sourceStamp NPK文件的大小和修改时间
+     * @param sourceHash NPK索引表之后的SHA256
+     * @param images 输出
+     * @param names 输出，images使用的名称表
+     * @return 索引文件不存在、已失效或格式错误返回false
+     */
+    static bool load(const std::string& path, const NPKHeader& header, const uint8_t* source, const NPKFileReader* reader,
+                     const NPKFileStamp& sourceStamp, const uint8_t sourceHash[32], std::vector<std::shared_ptr<NPKImageHandler>>& images,
+                     std::shared_ptr<NPKNameIndex>& names);
+};
+} // neapu
+
+#endif //NPKSIDECAR_H
@@ -0,0 +1,107 @@
+//
+// Created by liu86 on 24-8-6.
+//
+
+#include "NPKSimd.h"
+#include <atomic>
+#if NPK_SIMD_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace neapu {
+namespace {
+constexpr uint32_t SIMD_LEVEL_UNSET = 0xFFFFFFFF;
+std::atomic<uint32_t> g_simdLevel{SIMD_LEVEL_UNSET};
+
+SimdLevel detect()
+{
+#if NPK_SIMD_X86
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x06) == 0x06) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2 && sse41) {
+        return SIMD_AVX2;
+    }
+    if (sse41) {
+        return SIMD_SSE41;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+simd::NPKSimdKernels makeKernels(const SimdLevel level)
+{
+    simd::NPKSimdKernels ret;
+#if NPK_SIMD_X86
+    if (level == SIMD_AVX2) {
+        ret.dxt1BlockRow = simd::dxt1BlockRowAVX2;
+        ret.dxt3BlockRow = simd::dxt3BlockRowAVX2;
+        ret.dxt5BlockRow = simd::dxt5BlockRowAVX2;
+        ret.argb4444Row = simd::argb4444RowAVX2;
+        ret.argb1555Row = simd::argb1555RowAVX2;
+        ret.rgb565Row = simd::rgb565RowAVX2;
+        ret.paletteRow = simd::paletteRowAVX2;
+    } else if (level == SIMD_SSE41) {
+        ret.dxt1BlockRow = simd::dxt1BlockRowSSE41;
+        ret.dxt3BlockRow = simd::dxt3BlockRowSSE41;
+        ret.dxt5BlockRow = simd::dxt5BlockRowSSE41;
+        ret.argb4444Row = simd::argb4444RowSSE41;
+        ret.argb1555Row = simd::argb1555RowSSE41;
+        ret.rgb565Row = simd::rgb565RowSSE41;
+    }
+    if (level >= SIMD_SSE41) {
+        ret.rgbaRow = simd::rgbaRowSSE41;
+        ret.premultipliedRow = simd::premultipliedRowSSE41;
+        ret.rgbaPremultipliedRow = simd::rgbaPremultipliedRowSSE41;
+        ret.rgb565PackRow = simd::rgb565PackRowSSE41;
+        ret.argb4444PackRow = simd::argb4444PackRowSSE41;
+    }
+#endif
+    return ret;
+}
+}
+
+SimdLevel detectSimdLevel()
+{
+    static const SimdLevel level = detect();
+    return level;
+}
+
+SimdLevel getSimdLevel()
+{
+    const uint32_t level = g_simdLevel.load(std::memory_order_relaxed);
+    if (level == SIMD_LEVEL_UNSET) {
+        return detectSimdLevel();
+    }
+    return static_cast<SimdLevel>(level);
+}
+
+void setSimdLevel(const SimdLevel level)
+{
+    g_simdLevel.store(level < detectSimdLevel() ? level : detectSimdLevel(), std::memory_order_relaxed);
+}
+
+namespace simd {
+const NPKSimdKernels& kernels()
+{
+    static const NPKSimdKernels table[] = {makeKernels(SIMD_SCALAR), makeKernels(SIMD_SSE41), makeKernels(SIMD_AVX2)};
+    return table[getSimdLevel()];
+}
+} // simd
+} // neapu
@@ -0,0 +1,124 @@
+//
+// Created by liu86 on 24-8-6.
+//
+
+#ifndef NPKSIMD_H
+#define NPKSIMD_H
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NPK_SIMD_X86 1
+#else
+#define NPK_SIMD_X86 0
+#endif
+
+namespace neapu {
+struct NPKColor; // 不包含NPKPublic.h，避免标准库模板进入按指令集单独编译的文件
+
+enum SimdLevel: uint32_t {
+    SIMD_SCALAR = 0x00,
+    SIMD_SSE41 = 0x01,
+    SIMD_AVX2 = 0x02
+};
+
+/**
+ * @brief CPU支持的最高SIMD级别
+ */
+SimdLevel detectSimdLevel();
+/**
+ * @brief 当前使用的SIMD级别，默认为CPU支持的最高级别
+ */
+SimdLevel getSimdLevel();
+/**
+ * @brief 设置使用的SIMD级别，超过CPU支持的级别时按支持的最高级别处理，主要用于测试和性能对比
+ */
+void setSimdLevel(SimdLevel level);
+
+namespace simd {
+/**
+ * @brief 解码一行DXT块，即4行像素
+ * @param src 第一个块的数据
+ * @param blockCount 块数量
+ * @param dst 输出的第一行像素，BGRA8
+ * @param dstStride 输出每行的字节数
+ */
+using DXTBlockRowKernel = void (*)(const uint8_t* src, uint32_t blockCount, uint8_t* dst, size_t dstStride);
+
+/**
+ * @brief 把一行16位像素转换为BGRA8，只处理向量宽度整数倍的部分
+ * @param src 输入像素，小端16位
+ * @param count 像素数量
+ * @param dst 输出像素，BGRA8
+ * @return 已转换的像素数量，剩余部分由调用者处理
+ */
+using PixelRowKernel = uint32_t (*)(const uint8_t* src, uint32_t count, uint8_t* dst);
+
+/**
+ * @brief 用256项查找表把一行1字节索引转换为BGRA8，只处理向量宽度整数倍的部分
+ * @param indices 输入索引
+ * @param count 像素数量
+ * @param lut 256项查找表
+ * @param colorCount 有效颜色数量，不小于它的索引计入invalid
+ * @param dst 输出像素，BGRA8
+ * @param invalid 累加无效索引的数量
+ * @return 已转换的像素数量，剩余部分由调用者处理
+ */
+using PaletteRowKernel = uint32_t (*)(const uint8_t* indices, uint32_t count, const NPKColor* lut, uint32_t colorCount, uint8_t* dst,
+                                      uint32_t& invalid);
+
+/**
+ * @brief 把一行BGRA8像素转换为输出格式，只处理向量宽度整数倍的部分
+ * @param src 输入像素，BGRA8
+ * @param count 像素数量
+ * @param dst 输出像素，可以与src相同
+ * @return 已转换的像素数量，剩余部分由调用者处理
+ */
+using FormatRowKernel = uint32_t (*)(const uint8_t* src, uint32_t count, uint8_t* dst);
+
+typedef struct NPKSimdKernels {
+    DXTBlockRowKernel dxt1BlockRow = nullptr;
+    DXTBlockRowKernel dxt3BlockRow = nullptr;
+    DXTBlockRowKernel dxt5BlockRow = nullptr;
+    PixelRowKernel argb4444Row = nullptr;
+    PixelRowKernel argb1555Row = nullptr;
+    PixelRowKernel rgb565Row = nullptr;
+    PaletteRowKernel paletteRow = nullptr; // 需要gather指令，只有AVX2实现
+    // 输出格式转换，每行只有几十到几百个像素，AVX2级别也使用SSE4.1实现
+    FormatRowKernel rgbaRow = nullptr;
+    FormatRowKernel premultipliedRow = nullptr;
+    FormatRowKernel rgbaPremultipliedRow = nullptr;
+    FormatRowKernel rgb565PackRow = nullptr;
+    FormatRowKernel argb4444PackRow = nullptr;
+} NPKSimdKernels;
+
+/**
+ * @brief 当前SIMD级别下的内核，标量级别时都为nullptr，由调用者走标量实现
+ */
+const NPKSimdKernels& kernels();
+
+#if NPK_SIMD_X86
+void dxt1BlockRowSSE41(const uint8_t* src, uint32_t blockCount, uint8_t* dst, size_t dstStride);
+void dxt3BlockRowSSE41(const uint8_t* src, uint32_t blockCount, uint8_t* dst, size_t dstStride);
+void dxt5BlockRowSSE41(const uint8_t* src, uint32_t blockCount, uint8_t* dst, size_t dstStride);
+uint32_t argb4444RowSSE41(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t argb1555RowSSE41(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t rgb565RowSSE41(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t rgbaRowSSE41(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t premultipliedRowSSE41(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t rgbaPremultipliedRowSSE41(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t rgb565PackRowSSE41(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t argb4444PackRowSSE41(const uint8_t* src, uint32_t count, uint8_t* dst);
+
+void dxt1BlockRowAVX2(const uint8_t* src, uint32_t blockCount, uint8_t* dst, size_t dstStride);
+void dxt3BlockRowAVX2(const uint8_t* src, uint32_t blockCount, uint8_t* dst, size_t dstStride);
+void dxt5BlockRowAVX2(const uint8_t* src, uint32_t blockCount, uint8_t* dst, size_t dstStride);
+uint32_t argb4444RowAVX2(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t argb1555RowAVX2(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t rgb565RowAVX2(const uint8_t* src, uint32_t count, uint8_t* dst);
+uint32_t paletteRowAVX2(const uint8_t* indices, uint32_t count, const NPKColor* lut, uint32_t colorCount, uint8_t* dst, uint32_t& invalid);
+#endif
+} // simd
+} // neapu
+
+#endif //NPKSIMD_H
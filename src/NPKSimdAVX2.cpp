@@ -0,0 +1,363 @@
+//
+// Created by liu86 on 24-8-6.
+//
+// AVX2内核，此文件单独以-mavx2编译，不要包含标准库模板，避免内联函数带出高级指令
+
+#include "NPKSimd.h"
+
+#if NPK_SIMD_X86
+#include <cstring>
+#include <immintrin.h>
+
+namespace neapu::simd {
+namespace {
+struct IndexShuffleTable {
+    alignas(16) uint8_t mask[256][16];
+
+    constexpr IndexShuffleTable() : mask{}
+    {
+        for (int v = 0; v < 256; ++v) {
+            for (int p = 0; p < 4; ++p) {
+                const int idx = (v >> (p * 2)) & 0x03;
+                for (int c = 0; c < 4; ++c) {
+                    mask[v][p * 4 + c] = static_cast<uint8_t>(idx * 4 + c);
+                }
+            }
+        }
+    }
+};
+
+constexpr IndexShuffleTable INDEX_SHUFFLE{};
+
+inline uint32_t load32(const uint8_t* data)
+{
+    uint32_t ret;
+    memcpy(&ret, data, sizeof(ret));
+    return ret;
+}
+
+inline uint64_t load64(const uint8_t* data)
+{
+    uint64_t ret;
+    memcpy(&ret, data, sizeof(ret));
+    return ret;
+}
+
+// 两个相邻块同一行的shuffle掩码，低128位对应左边的块
+inline __m256i indexShuffle2(const uint32_t indices0, const uint32_t indices1, const int row)
+{
+    const __m128i m0 = _mm_load_si128(reinterpret_cast<const __m128i*>(INDEX_SHUFFLE.mask[(indices0 >> (row * 8)) & 0xFF]));
+    const __m128i m1 = _mm_load_si128(reinterpret_cast<const __m128i*>(INDEX_SHUFFLE.mask[(indices1 >> (row * 8)) & 0xFF]));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(m0), m1, 1);
+}
+
+/**
+ * 计算四个块的4色调色板，与SSE4.1版本算法相同
+ * @param colorPart 每128位包含两个块的颜色部分，低128位为块0和块2，高128位为块1和块3
+ * @param pal01 输出块0和块1的调色板
+ * @param pal23 输出块2和块3的调色板
+ */
+inline void blockPalettes(const __m256i colorPart, const bool threeColor, __m256i& pal01, __m256i& pal23)
+{
+    const __m256i c0 = _mm256_shuffle_epi8(colorPart, _mm256_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1, 8, 9, 8, 9, 8, 9, 8, 9,
+                                                                       0, 1, 0, 1, 0, 1, 0, 1, 8, 9, 8, 9, 8, 9, 8, 9));
+    const __m256i c1 = _mm256_shuffle_epi8(colorPart, _mm256_setr_epi8(2, 3, 2, 3, 2, 3, 2, 3, 10, 11, 10, 11, 10, 11, 10, 11,
+                                                                       2, 3, 2, 3, 2, 3, 2, 3, 10, 11, 10, 11, 10, 11, 10, 11));
+
+    const __m256i channelMask = _mm256_setr_epi16(0x001F, 0x07E0, static_cast<short>(0xF800), 0, 0x001F, 0x07E0, static_cast<short>(0xF800), 0,
+                                                  0x001F, 0x07E0, static_cast<short>(0xF800), 0, 0x001F, 0x07E0, static_cast<short>(0xF800), 0);
+    const __m256i shiftLeft = _mm256_setr_epi16(8, 0, 0, 0, 8, 0, 0, 0, 8, 0, 0, 0, 8, 0, 0, 0);
+    const __m256i shiftRight = _mm256_setr_epi16(0, 1 << 13, 1 << 8, 0, 0, 1 << 13, 1 << 8, 0, 0, 1 << 13, 1 << 8, 0, 0, 1 << 13, 1 << 8, 0);
+    const __m256i alpha = _mm256_setr_epi16(0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF);
+    const __m256i m0 = _mm256_and_si256(c0, channelMask);
+    const __m256i m1 = _mm256_and_si256(c1, channelMask);
+    const __m256i e0 = _mm256_or_si256(_mm256_add_epi16(_mm256_mullo_epi16(m0, shiftLeft), _mm256_mulhi_epu16(m0, shiftRight)), alpha);
+    const __m256i e1 = _mm256_or_si256(_mm256_add_epi16(_mm256_mullo_epi16(m1, shiftLeft), _mm256_mulhi_epu16(m1, shiftRight)), alpha);
+
+    const __m256i div3 = _mm256_set1_epi16(21846);
+    __m256i p2 = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_add_epi16(e0, e0), e1), div3);
+    __m256i p3 = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_add_epi16(e1, e1), e0), div3);
+    if (threeColor) {
+        const __m256i le = _mm256_cmpeq_epi16(_mm256_max_epu16(c0, c1), c1);
+        p2 = _mm256_blendv_epi8(p2, _mm256_srli_epi16(_mm256_add_epi16(e0, e1), 1), le);
+        p3 = _mm256_andnot_si256(le, p3);
+    }
+
+    const __m256i pal0 = _mm256_packus_epi16(e0, e1);
+    const __m256i pal1 = _mm256_packus_epi16(p2, p3);
+    const __m256i t0 = _mm256_unpacklo_epi32(pal0, pal1);
+    const __m256i t1 = _mm256_unpackhi_epi32(pal0, pal1);
+    pal01 = _mm256_unpacklo_epi32(t0, t1); // 低128位: 块0，高128位: 块1
+    pal23 = _mm256_unpackhi_epi32(t0, t1); // 低128位: 块2，高128位: 块3
+}
+
+inline void storeColorRows(const __m256i palettes, const uint32_t indices0, const uint32_t indices1, uint8_t* dst, const size_t dstStride)
+{
+    for (int row = 0; row < 4; ++row) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + row * dstStride),
+                            _mm256_shuffle_epi8(palettes, indexShuffle2(indices0, indices1, row)));
+    }
+}
+
+inline __m128i dxt3Alpha(const uint8_t* block)
+{
+    const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i lo = _mm_and_si128(packed, nibble);
+    const __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), nibble);
+    const __m128i alpha = _mm_unpacklo_epi8(lo, hi);
+    return _mm_or_si128(alpha, _mm_slli_epi16(alpha, 4));
+}
+
+inline __m256i alphaRowShuffle(const int row)
+{
+    const char b = static_cast<char>(row * 4);
+    return _mm256_setr_epi8(-128, -128, -128, b, -128, -128, -128, b + 1, -128, -128, -128, b + 2, -128, -128, -128, b + 3,
+                            -128, -128, -128, b, -128, -128, -128, b + 1, -128, -128, -128, b + 2, -128, -128, -128, b + 3);
+}
+
+inline void storeRowsWithAlpha(const __m256i palettes, const uint32_t indices0, const uint32_t indices1, const __m256i alpha,
+                               uint8_t* dst, const size_t dstStride)
+{
+    const __m256i rgbMask = _mm256_set1_epi32(0x00FFFFFF);
+    for (int row = 0; row < 4; ++row) {
+        const __m256i color = _mm256_and_si256(_mm256_shuffle_epi8(palettes, indexShuffle2(indices0, indices1, row)), rgbMask);
+        const __m256i a = _mm256_shuffle_epi8(alpha, alphaRowShuffle(row));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + row * dstStride), _mm256_or_si256(color, a));
+    }
+}
+
+// 两个块的DXT5 8级alpha调色板，每128位的低8字节有效
+inline __m256i dxt5AlphaPalettes(const uint8_t* block0, const uint8_t* block1)
+{
+    const __m256i a0 = _mm256_setr_epi16(block0[0], block0[0], block0[0], block0[0], block0[0], block0[0], block0[0], block0[0],
+                                         block1[0], block1[0], block1[0], block1[0], block1[0], block1[0], block1[0], block1[0]);
+    const __m256i a1 = _mm256_setr_epi16(block0[1], block0[1], block0[1], block0[1], block0[1], block0[1], block0[1], block0[1],
+                                         block1[1], block1[1], block1[1], block1[1], block1[1], block1[1], block1[1], block1[1]);
+
+    const __m256i sum7 = _mm256_add_epi16(_mm256_mullo_epi16(a0, _mm256_setr_epi16(1, 0, 6, 5, 4, 3, 2, 1, 1, 0, 6, 5, 4, 3, 2, 1)),
+                                          _mm256_mullo_epi16(a1, _mm256_setr_epi16(0, 1, 1, 2, 3, 4, 5, 6, 0, 1, 1, 2, 3, 4, 5, 6)));
+    const __m256i div7 = _mm256_blend_epi16(_mm256_mulhi_epu16(sum7, _mm256_set1_epi16(9363)), sum7, 0x03);
+
+    const __m256i sum5 = _mm256_add_epi16(_mm256_mullo_epi16(a0, _mm256_setr_epi16(1, 0, 4, 3, 2, 1, 0, 0, 1, 0, 4, 3, 2, 1, 0, 0)),
+                                          _mm256_mullo_epi16(a1, _mm256_setr_epi16(0, 1, 1, 2, 3, 4, 0, 0, 0, 1, 1, 2, 3, 4, 0, 0)));
+    __m256i div5 = _mm256_blend_epi16(_mm256_mulhi_epu16(sum5, _mm256_set1_epi16(13108)), sum5, 0x03);
+    div5 = _mm256_blend_epi16(div5, _mm256_setr_epi16(0, 0, 0, 0, 0, 0, 0, 0xFF, 0, 0, 0, 0, 0, 0, 0, 0xFF), 0xC0);
+
+    // a0 > a1时使用7级插值，否则使用5级插值
+    const __m256i gt = _mm256_cmpgt_epi16(a0, a1);
+    const __m256i div = _mm256_blendv_epi8(div5, div7, gt);
+    return _mm256_packus_epi16(div, div);
+}
+
+inline __m128i dxt5Indices(const uint8_t* block)
+{
+    uint64_t bits = load64(block) >> 16;
+    alignas(16) uint8_t indices[16];
+    for (int i = 0; i < 16; ++i) {
+        indices[i] = static_cast<uint8_t>(bits & 0x07);
+        bits >>= 3;
+    }
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(indices));
+}
+
+inline __m256i dxt5Alpha2(const uint8_t* block0, const uint8_t* block1)
+{
+    const __m256i indices = _mm256_inserti128_si256(_mm256_castsi128_si256(dxt5Indices(block0)), dxt5Indices(block1), 1);
+    return _mm256_shuffle_epi8(dxt5AlphaPalettes(block0, block1), indices);
+}
+
+inline __m256i dxt3Alpha2(const uint8_t* block0, const uint8_t* block1)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(dxt3Alpha(block0)), dxt3Alpha(block1), 1);
+}
+
+/**
+ * 两个块的颜色部分(各8字节)组成SSE版本的布局后解码，用于尾部不足4块的情况
+ */
+template <bool HasAlpha>
+inline void tailBlocks(const __m128i colorPart, const bool threeColor, const uint32_t count, const uint32_t indices0,
+                       const uint32_t indices1, const __m256i alpha, uint8_t* dst, const size_t dstStride)
+{
+    __m256i pal01, pal23;
+    blockPalettes(_mm256_inserti128_si256(_mm256_castsi128_si256(colorPart), colorPart, 1), threeColor, pal01, pal23);
+    // 低128位计算的是块0和块1，分别在pal01和pal23的低128位
+    const __m256i palettes = _mm256_permute2x128_si256(pal01, pal23, 0x20);
+    if (count == 2) {
+        if constexpr (HasAlpha) {
+            storeRowsWithAlpha(palettes, indices0, indices1, alpha, dst, dstStride);
+        } else {
+            storeColorRows(palettes, indices0, indices1, dst, dstStride);
+        }
+        return;
+    }
+
+    alignas(32) uint8_t rows[4][32];
+    if constexpr (HasAlpha) {
+        storeRowsWithAlpha(palettes, indices0, indices0, alpha, rows[0], 32);
+    } else {
+        storeColorRows(palettes, indices0, indices0, rows[0], 32);
+    }
+    for (int row = 0; row < 4; ++row) {
+        memcpy(dst + row * dstStride, rows[row], 16);
+    }
+}
+}
+
+void dxt1BlockRowAVX2(const uint8_t* src, const uint32_t blockCount, uint8_t* dst, const size_t dstStride)
+{
+    uint32_t i = 0;
+    __m256i pal01, pal23;
+    for (; i + 4 <= blockCount; i += 4) {
+        const uint8_t* block = src + i * 8;
+        // 调整为低128位: 块0和块2，高128位: 块1和块3
+        const __m256i part = _mm256_permute4x64_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(block)), 0xD8);
+        blockPalettes(part, true, pal01, pal23);
+        storeColorRows(pal01, load32(block + 4), load32(block + 12), dst + i * 16, dstStride);
+        storeColorRows(pal23, load32(block + 20), load32(block + 28), dst + i * 16 + 32, dstStride);
+    }
+    for (; i < blockCount; i += 2) {
+        const uint8_t* block = src + i * 8;
+        const uint32_t count = blockCount - i >= 2 ? 2 : 1;
+        const __m128i part = count == 2 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(block))
+                                        : _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block));
+        tailBlocks<false>(part, true, count, load32(block + 4), count == 2 ? load32(block + 12) : 0, _mm256_setzero_si256(),
+                          dst + i * 16, dstStride);
+    }
+}
+
+void dxt3BlockRowAVX2(const uint8_t* src, const uint32_t blockCount, uint8_t* dst, const size_t dstStride)
+{
+    uint32_t i = 0;
+    __m256i pal01, pal23;
+    for (; i + 4 <= blockCount; i += 4) {
+        const uint8_t* block = src + i * 16;
+        const __m256i b01 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        const __m256i b23 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+        // 低128位: 块0和块2的颜色部分，高128位: 块1和块3的颜色部分
+        blockPalettes(_mm256_unpackhi_epi64(b01, b23), false, pal01, pal23);
+        storeRowsWithAlpha(pal01, load32(block + 12), load32(block + 28), dxt3Alpha2(block, block + 16), dst + i * 16, dstStride);
+        storeRowsWithAlpha(pal23, load32(block + 44), load32(block + 60), dxt3Alpha2(block + 32, block + 48), dst + i * 16 + 32, dstStride);
+    }
+    for (; i < blockCount; i += 2) {
+        const uint8_t* block = src + i * 16;
+        const uint32_t count = blockCount - i >= 2 ? 2 : 1;
+        const uint8_t* next = count == 2 ? block + 16 : block;
+        const __m128i part = _mm_unpackhi_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)),
+                                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(next)));
+        tailBlocks<true>(part, false, count, load32(block + 12), load32(next + 12), dxt3Alpha2(block, next), dst + i * 16, dstStride);
+    }
+}
+
+void dxt5BlockRowAVX2(const uint8_t* src, const uint32_t blockCount, uint8_t* dst, const size_t dstStride)
+{
+    uint32_t i = 0;
+    __m256i pal01, pal23;
+    for (; i + 4 <= blockCount; i += 4) {
+        const uint8_t* block = src + i * 16;
+        const __m256i b01 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        const __m256i b23 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+        blockPalettes(_mm256_unpackhi_epi64(b01, b23), false, pal01, pal23);
+        storeRowsWithAlpha(pal01, load32(block + 12), load32(block + 28), dxt5Alpha2(block, block + 16), dst + i * 16, dstStride);
+        storeRowsWithAlpha(pal23, load32(block + 44), load32(block + 60), dxt5Alpha2(block + 32, block + 48), dst + i * 16 + 32, dstStride);
+    }
+    for (; i < blockCount; i += 2) {
+        const uint8_t* block = src + i * 16;
+        const uint32_t count = blockCount - i >= 2 ? 2 : 1;
+        const uint8_t* next = count == 2 ? block + 16 : block;
+        const __m128i part = _mm_unpackhi_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)),
+                                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(next)));
+        tailBlocks<true>(part, false, count, load32(block + 12), load32(next + 12), dxt5Alpha2(block, next), dst + i * 16, dstStride);
+    }
+}
+
+// 每次16个像素，unpack按128位分别进行，输出前需要重新组合两半
+namespace {
+inline void storePixels16(const __m256i lo, const __m256i hi, uint8_t* dst)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+}
+
+uint32_t argb4444RowAVX2(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+    const __m256i highMask = _mm256_set1_epi8(static_cast<char>(0xF0));
+    const __m256i alphaMask = _mm256_set1_epi16(0x0F00);
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 2));
+        const __m256i br = _mm256_slli_epi16(_mm256_and_si256(pixels, lowMask), 4);
+        __m256i ga = _mm256_and_si256(pixels, highMask);
+        ga = _mm256_or_si256(ga, _mm256_and_si256(_mm256_srli_epi16(ga, 4), alphaMask));
+        storePixels16(_mm256_unpacklo_epi8(br, ga), _mm256_unpackhi_epi8(br, ga), dst + i * 4);
+    }
+    return i;
+}
+
+uint32_t argb1555RowAVX2(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m256i mask5 = _mm256_set1_epi16(0x00F8);
+    const __m256i maskG = _mm256_set1_epi16(static_cast<short>(0xF800));
+    const __m256i maskA = _mm256_set1_epi16(static_cast<short>(0xFF00));
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 2));
+        const __m256i bg = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(pixels, 3), mask5),
+                                           _mm256_and_si256(_mm256_slli_epi16(pixels, 6), maskG));
+        const __m256i ra = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(pixels, 7), mask5),
+                                           _mm256_and_si256(_mm256_srai_epi16(pixels, 15), maskA));
+        storePixels16(_mm256_unpacklo_epi16(bg, ra), _mm256_unpackhi_epi16(bg, ra), dst + i * 4);
+    }
+    return i;
+}
+
+uint32_t rgb565RowAVX2(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m256i mask5 = _mm256_set1_epi16(0x00F8);
+    const __m256i maskG = _mm256_set1_epi16(static_cast<short>(0xFC00));
+    const __m256i alpha = _mm256_set1_epi16(static_cast<short>(0xFF00));
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 2));
+        const __m256i bg = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(pixels, 3), mask5),
+                                           _mm256_and_si256(_mm256_slli_epi16(pixels, 5), maskG));
+        const __m256i ra = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(pixels, 8), mask5), alpha);
+        storePixels16(_mm256_unpacklo_epi16(bg, ra), _mm256_unpackhi_epi16(bg, ra), dst + i * 4);
+    }
+    return i;
+}
+
+uint32_t paletteRowAVX2(const uint8_t* indices, const uint32_t count, const NPKColor* lut, const uint32_t colorCount, uint8_t* dst,
+                        uint32_t& invalid)
+{
+    const auto* table = reinterpret_cast<const int*>(lut);
+    // 颜色数量在1到255之间时才可能出现无效索引，为0时所有索引都无效
+    const bool checkInvalid = colorCount > 0 && colorCount < 256;
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(colorCount - 1));
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i invalidSum = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+        if (checkInvalid) {
+            const __m128i valid = _mm_cmpeq_epi8(_mm_max_epu8(idx, limit), limit);
+            invalidSum = _mm_add_epi64(invalidSum, _mm_sad_epu8(_mm_andnot_si128(valid, one), _mm_setzero_si128()));
+        }
+        const __m256i lo = _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(idx), 4);
+        const __m256i hi = _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8)), 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4 + 32), hi);
+    }
+    if (colorCount == 0) {
+        invalid += i;
+    } else if (checkInvalid) {
+        alignas(16) uint64_t sums[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(sums), invalidSum);
+        invalid += static_cast<uint32_t>(sums[0] + sums[1]);
+    }
+    return i;
+}
+} // neapu::simd
+#endif
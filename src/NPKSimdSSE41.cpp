@@ -0,0 +1,367 @@
+//
+// Created by liu86 on 24-8-6.
+//
+// SSE4.1内核，此文件单独以-msse4.1编译，不要包含标准库模板，避免内联函数带出高级指令
+
+#include "NPKSimd.h"
+
+#if NPK_SIMD_X86
+#include <cstring>
+#include <immintrin.h>
+
+namespace neapu::simd {
+namespace {
+// 一行4个像素的2位颜色索引(1字节)到调色板字节的shuffle掩码
+struct IndexShuffleTable {
+    alignas(16) uint8_t mask[256][16];
+
+    constexpr IndexShuffleTable() : mask{}
+    {
+        for (int v = 0; v < 256; ++v) {
+            for (int p = 0; p < 4; ++p) {
+                const int idx = (v >> (p * 2)) & 0x03;
+                for (int c = 0; c < 4; ++c) {
+                    mask[v][p * 4 + c] = static_cast<uint8_t>(idx * 4 + c);
+                }
+            }
+        }
+    }
+};
+
+constexpr IndexShuffleTable INDEX_SHUFFLE{};
+
+inline __m128i indexShuffle(const uint32_t indices, const int row)
+{
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(INDEX_SHUFFLE.mask[(indices >> (row * 8)) & 0xFF]));
+}
+
+inline uint32_t load32(const uint8_t* data)
+{
+    uint32_t ret;
+    memcpy(&ret, data, sizeof(ret));
+    return ret;
+}
+
+inline uint64_t load64(const uint8_t* data)
+{
+    uint64_t ret;
+    memcpy(&ret, data, sizeof(ret));
+    return ret;
+}
+
+/**
+ * 计算两个块的4色调色板
+ * @param colorPart 两个块的颜色部分(各8字节: c0, c1, 索引)
+ * @param threeColor 是否按DXT1规则在c0<=c1时使用3色+透明模式
+ * @param pal0 输出第一个块的调色板，BGRA8 x4
+ * @param pal1 输出第二个块的调色板
+ */
+inline void blockPalettes(const __m128i colorPart, const bool threeColor, __m128i& pal0, __m128i& pal1)
+{
+    // 每个块的c0/c1复制到4个16位通道(b, g, r, a)
+    const __m128i c0 = _mm_shuffle_epi8(colorPart, _mm_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1, 8, 9, 8, 9, 8, 9, 8, 9));
+    const __m128i c1 = _mm_shuffle_epi8(colorPart, _mm_setr_epi8(2, 3, 2, 3, 2, 3, 2, 3, 10, 11, 10, 11, 10, 11, 10, 11));
+
+    // RGB565展开，与NPKDDSHandler::RGB565ToNPKColor一致，b左移3位，g右移3位，r右移8位
+    const __m128i channelMask = _mm_setr_epi16(0x001F, 0x07E0, static_cast<short>(0xF800), 0, 0x001F, 0x07E0, static_cast<short>(0xF800), 0);
+    const __m128i shiftLeft = _mm_setr_epi16(8, 0, 0, 0, 8, 0, 0, 0);
+    const __m128i shiftRight = _mm_setr_epi16(0, 1 << 13, 1 << 8, 0, 0, 1 << 13, 1 << 8, 0);
+    const __m128i alpha = _mm_setr_epi16(0, 0, 0, 0xFF, 0, 0, 0, 0xFF);
+    const __m128i m0 = _mm_and_si128(c0, channelMask);
+    const __m128i m1 = _mm_and_si128(c1, channelMask);
+    const __m128i e0 = _mm_or_si128(_mm_add_epi16(_mm_mullo_epi16(m0, shiftLeft), _mm_mulhi_epu16(m0, shiftRight)), alpha);
+    const __m128i e1 = _mm_or_si128(_mm_add_epi16(_mm_mullo_epi16(m1, shiftLeft), _mm_mulhi_epu16(m1, shiftRight)), alpha);
+
+    // x/3用乘以21846再取高16位代替，在x<=765时结果与整数除法完全一致
+    const __m128i div3 = _mm_set1_epi16(21846);
+    __m128i p2 = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(e0, e0), e1), div3);
+    __m128i p3 = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(e1, e1), e0), div3);
+    if (threeColor) {
+        // c0 <= c1时: p2 = (c0 + c1) / 2, p3 = 透明黑
+        const __m128i le = _mm_cmpeq_epi16(_mm_max_epu16(c0, c1), c1);
+        p2 = _mm_blendv_epi8(p2, _mm_srli_epi16(_mm_add_epi16(e0, e1), 1), le);
+        p3 = _mm_andnot_si128(le, p3);
+    }
+
+    const __m128i pal01 = _mm_packus_epi16(e0, e1); // c0块0, c0块1, c1块0, c1块1
+    const __m128i pal23 = _mm_packus_epi16(p2, p3);
+    const __m128i t0 = _mm_unpacklo_epi32(pal01, pal23);
+    const __m128i t1 = _mm_unpackhi_epi32(pal01, pal23);
+    pal0 = _mm_unpacklo_epi32(t0, t1);
+    pal1 = _mm_unpackhi_epi32(t0, t1);
+}
+
+inline void storeColorRows(const __m128i palette, const uint32_t indices, uint8_t* dst, const size_t dstStride)
+{
+    for (int row = 0; row < 4; ++row) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + row * dstStride), _mm_shuffle_epi8(palette, indexShuffle(indices, row)));
+    }
+}
+
+// DXT3的16个4位alpha展开为16个字节，按像素顺序
+inline __m128i dxt3Alpha(const uint8_t* block)
+{
+    const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i lo = _mm_and_si128(packed, nibble);
+    const __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), nibble);
+    const __m128i alpha = _mm_unpacklo_epi8(lo, hi);
+    return _mm_or_si128(alpha, _mm_slli_epi16(alpha, 4)); // x * 0x11
+}
+
+// 把按像素顺序排列的16个alpha中第row行的4个放到每个像素的a通道
+inline __m128i alphaRowShuffle(const int row)
+{
+    const int base = row * 4;
+    return _mm_setr_epi8(-128, -128, -128, static_cast<char>(base), -128, -128, -128, static_cast<char>(base + 1),
+                         -128, -128, -128, static_cast<char>(base + 2), -128, -128, -128, static_cast<char>(base + 3));
+}
+
+inline void storeRowsWithAlpha(const __m128i palette, const uint32_t indices, const __m128i alpha, uint8_t* dst, const size_t dstStride)
+{
+    const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+    for (int row = 0; row < 4; ++row) {
+        const __m128i color = _mm_and_si128(_mm_shuffle_epi8(palette, indexShuffle(indices, row)), rgbMask);
+        const __m128i a = _mm_shuffle_epi8(alpha, alphaRowShuffle(row));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + row * dstStride), _mm_or_si128(color, a));
+    }
+}
+
+// DXT5的8级alpha调色板，低8字节有效
+inline __m128i dxt5AlphaPalette(const uint8_t* block)
+{
+    const __m128i a0 = _mm_set1_epi16(block[0]);
+    const __m128i a1 = _mm_set1_epi16(block[1]);
+    if (block[0] > block[1]) {
+        // (8-k)*a0 + (k-1)*a1) / 7，除法用乘以9363再取高16位代替，x<=1785时结果一致
+        const __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a0, _mm_setr_epi16(1, 0, 6, 5, 4, 3, 2, 1)),
+                                          _mm_mullo_epi16(a1, _mm_setr_epi16(0, 1, 1, 2, 3, 4, 5, 6)));
+        const __m128i div = _mm_blend_epi16(_mm_mulhi_epu16(sum, _mm_set1_epi16(9363)), sum, 0x03);
+        return _mm_packus_epi16(div, div);
+    }
+    // ((6-k)*a0 + (k-1)*a1) / 5，除法用乘以13108再取高16位代替，x<=1275时结果一致，最后两级固定为0和255
+    const __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a0, _mm_setr_epi16(1, 0, 4, 3, 2, 1, 0, 0)),
+                                      _mm_mullo_epi16(a1, _mm_setr_epi16(0, 1, 1, 2, 3, 4, 0, 0)));
+    __m128i div = _mm_blend_epi16(_mm_mulhi_epu16(sum, _mm_set1_epi16(13108)), sum, 0x03);
+    div = _mm_blend_epi16(div, _mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, 0xFF), 0xC0);
+    return _mm_packus_epi16(div, div);
+}
+
+// DXT5每个像素3位的alpha索引转换为16个字节，按像素顺序
+inline __m128i dxt5Alpha(const uint8_t* block)
+{
+    const __m128i palette = dxt5AlphaPalette(block);
+    uint64_t bits = load64(block) >> 16;
+    alignas(16) uint8_t indices[16];
+    for (int i = 0; i < 16; ++i) {
+        indices[i] = static_cast<uint8_t>(bits & 0x07);
+        bits >>= 3;
+    }
+    return _mm_shuffle_epi8(palette, _mm_load_si128(reinterpret_cast<const __m128i*>(indices)));
+}
+}
+
+void dxt1BlockRowSSE41(const uint8_t* src, const uint32_t blockCount, uint8_t* dst, const size_t dstStride)
+{
+    uint32_t i = 0;
+    __m128i pal0, pal1;
+    for (; i + 2 <= blockCount; i += 2) {
+        const uint8_t* block = src + i * 8;
+        blockPalettes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)), true, pal0, pal1);
+        storeColorRows(pal0, load32(block + 4), dst + i * 16, dstStride);
+        storeColorRows(pal1, load32(block + 12), dst + i * 16 + 16, dstStride);
+    }
+    if (i < blockCount) {
+        const uint8_t* block = src + i * 8;
+        const __m128i part = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block));
+        blockPalettes(_mm_unpacklo_epi64(part, part), true, pal0, pal1);
+        storeColorRows(pal0, load32(block + 4), dst + i * 16, dstStride);
+    }
+}
+
+void dxt3BlockRowSSE41(const uint8_t* src, const uint32_t blockCount, uint8_t* dst, const size_t dstStride)
+{
+    uint32_t i = 0;
+    __m128i pal0, pal1;
+    for (; i + 2 <= blockCount; i += 2) {
+        const uint8_t* block = src + i * 16;
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16));
+        blockPalettes(_mm_unpackhi_epi64(b0, b1), false, pal0, pal1);
+        storeRowsWithAlpha(pal0, load32(block + 12), dxt3Alpha(block), dst + i * 16, dstStride);
+        storeRowsWithAlpha(pal1, load32(block + 28), dxt3Alpha(block + 16), dst + i * 16 + 16, dstStride);
+    }
+    if (i < blockCount) {
+        const uint8_t* block = src + i * 16;
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        blockPalettes(_mm_unpackhi_epi64(b0, b0), false, pal0, pal1);
+        storeRowsWithAlpha(pal0, load32(block + 12), dxt3Alpha(block), dst + i * 16, dstStride);
+    }
+}
+
+void dxt5BlockRowSSE41(const uint8_t* src, const uint32_t blockCount, uint8_t* dst, const size_t dstStride)
+{
+    uint32_t i = 0;
+    __m128i pal0, pal1;
+    for (; i + 2 <= blockCount; i += 2) {
+        const uint8_t* block = src + i * 16;
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16));
+        blockPalettes(_mm_unpackhi_epi64(b0, b1), false, pal0, pal1);
+        storeRowsWithAlpha(pal0, load32(block + 12), dxt5Alpha(block), dst + i * 16, dstStride);
+        storeRowsWithAlpha(pal1, load32(block + 28), dxt5Alpha(block + 16), dst + i * 16 + 16, dstStride);
+    }
+    if (i < blockCount) {
+        const uint8_t* block = src + i * 16;
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        blockPalettes(_mm_unpackhi_epi64(b0, b0), false, pal0, pal1);
+        storeRowsWithAlpha(pal0, load32(block + 12), dxt5Alpha(block), dst + i * 16, dstStride);
+    }
+}
+
+// 16位像素展开为BGRA8，每次8个像素，位运算与NPKFrameHandler中的标量实现一致
+uint32_t argb4444RowSSE41(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+    const __m128i highMask = _mm_set1_epi8(static_cast<char>(0xF0));
+    const __m128i alphaMask = _mm_set1_epi16(0x0F00);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        // 每个像素低字节为g b，高字节为a r
+        const __m128i br = _mm_slli_epi16(_mm_and_si128(pixels, lowMask), 4);
+        __m128i ga = _mm_and_si128(pixels, highMask);
+        ga = _mm_or_si128(ga, _mm_and_si128(_mm_srli_epi16(ga, 4), alphaMask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_unpacklo_epi8(br, ga));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_unpackhi_epi8(br, ga));
+    }
+    return i;
+}
+
+uint32_t argb1555RowSSE41(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x00F8);
+    const __m128i maskG = _mm_set1_epi16(static_cast<short>(0xF800));
+    const __m128i maskA = _mm_set1_epi16(static_cast<short>(0xFF00));
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        const __m128i bg = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(pixels, 3), mask5), _mm_and_si128(_mm_slli_epi16(pixels, 6), maskG));
+        const __m128i ra = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(pixels, 7), mask5), _mm_and_si128(_mm_srai_epi16(pixels, 15), maskA));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_unpackhi_epi16(bg, ra));
+    }
+    return i;
+}
+
+uint32_t rgb565RowSSE41(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x00F8);
+    const __m128i maskG = _mm_set1_epi16(static_cast<short>(0xFC00));
+    const __m128i alpha = _mm_set1_epi16(static_cast<short>(0xFF00));
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        const __m128i bg = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(pixels, 3), mask5), _mm_and_si128(_mm_slli_epi16(pixels, 5), maskG));
+        const __m128i ra = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(pixels, 8), mask5), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_unpackhi_epi16(bg, ra));
+    }
+    return i;
+}
+
+namespace {
+// 4个BGRA8像素的颜色乘以透明度，结果为round(c * a / 255)，与标量实现一致
+inline __m128i premultiply4(const __m128i pixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    // 每个像素的a复制到b、g、r三个16位通道，a通道乘以255保持不变
+    const __m128i alphaLo = _mm_shuffle_epi8(pixels, _mm_setr_epi8(3, -128, 3, -128, 3, -128, -128, -128, 7, -128, 7, -128, 7, -128, -128, -128));
+    const __m128i alphaHi = _mm_shuffle_epi8(pixels, _mm_setr_epi8(11, -128, 11, -128, 11, -128, -128, -128, 15, -128, 15, -128, 15, -128, -128, -128));
+    const __m128i keep = _mm_setr_epi16(0, 0, 0, 0xFF, 0, 0, 0, 0xFF);
+    const __m128i round = _mm_set1_epi16(128);
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_or_si128(alphaLo, keep)), round);
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), _mm_or_si128(alphaHi, keep)), round);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+inline __m128i swapRedBlue()
+{
+    return _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+}
+}
+
+// 输出格式转换，每次4个像素；16位格式每次8个像素，先读后写，可以原地转换
+uint32_t rgbaRowSSE41(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m128i mask = swapRedBlue();
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(pixels, mask));
+    }
+    return i;
+}
+
+uint32_t premultipliedRowSSE41(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), premultiply4(pixels));
+    }
+    return i;
+}
+
+uint32_t rgbaPremultipliedRowSSE41(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m128i mask = swapRedBlue();
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(premultiply4(pixels), mask));
+    }
+    return i;
+}
+
+uint32_t rgb565PackRowSSE41(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m128i maskB = _mm_set1_epi32(0x001F);
+    const __m128i maskG = _mm_set1_epi32(0x07E0);
+    const __m128i maskR = _mm_set1_epi32(0xF800);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed[2];
+        for (int half = 0; half < 2; ++half) {
+            const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + half * 16));
+            packed[half] = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 3), maskB), _mm_and_si128(_mm_srli_epi32(p, 5), maskG)),
+                                        _mm_and_si128(_mm_srli_epi32(p, 8), maskR));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), _mm_packus_epi32(packed[0], packed[1]));
+    }
+    return i;
+}
+
+uint32_t argb4444PackRowSSE41(const uint8_t* src, const uint32_t count, uint8_t* dst)
+{
+    const __m128i maskB = _mm_set1_epi32(0x000F);
+    const __m128i maskG = _mm_set1_epi32(0x00F0);
+    const __m128i maskR = _mm_set1_epi32(0x0F00);
+    const __m128i maskA = _mm_set1_epi32(0xF000);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed[2];
+        for (int half = 0; half < 2; ++half) {
+            const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + half * 16));
+            const __m128i bg = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 4), maskB), _mm_and_si128(_mm_srli_epi32(p, 8), maskG));
+            const __m128i ra = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 12), maskR), _mm_and_si128(_mm_srli_epi32(p, 16), maskA));
+            packed[half] = _mm_or_si128(bg, ra);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), _mm_packus_epi32(packed[0], packed[1]));
+    }
+    return i;
+}
+} // neapu::simd
+#endif
@@ -0,0 +1,188 @@
+//
+// Created by liu86 on 24-8-7.
+//
+
+#include "NPKThreadPool.h"
+#include <atomic>
+
+namespace neapu {
+namespace {
+// 一次parallelFor的共享状态，辅助任务可能在parallelFor返回后才被取出，所以用shared_ptr保存
+typedef struct RangeJob {
+    NPKThreadPool::RangeFunc func;
+    uint32_t count{0};
+    uint32_t grain{1};
+    uint32_t chunkCount{0};
+    std::atomic<uint32_t> next{0};
+    std::atomic<uint32_t> done{0};
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    // 领取并执行分段，直到没有剩余分段
+    void run()
+    {
+        uint32_t finished = 0;
+        for (uint32_t chunk = next.fetch_add(1); chunk < chunkCount; chunk = next.fetch_add(1)) {
+            const uint32_t begin = chunk * grain;
+            const uint32_t end = count - begin < grain ? count : begin + grain;
+            func(begin, end);
+            finished++;
+        }
+        if (finished > 0 && done.fetch_add(finished) + finished == chunkCount) {
+            std::lock_guard lock(mutex);
+            cond.notify_all();
+        }
+    }
+} RangeJob;
+
+// 当前线程所属的线程池与工作线程序号，用于把工作线程提交的任务放入自己的队列
+thread_local const NPKThreadPool* t_currentPool = nullptr;
+thread_local uint32_t t_workerIndex = 0;
+}
+
+NPKThreadPool::NPKThreadPool(uint32_t threadCount)
+{
+    if (threadCount == 0) {
+        const uint32_t cores = std::thread::hardware_concurrency();
+        threadCount = cores > 1 ? cores - 1 : 1;
+    }
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        m_queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        m_threads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+NPKThreadPool::~NPKThreadPool()
+{
+    {
+        std::lock_guard lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void NPKThreadPool::parallelFor(const uint32_t count, const RangeFunc& func, uint32_t grain)
+{
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    const uint32_t chunkCount = (count - 1) / grain + 1;
+    if (chunkCount == 1 || m_threads.empty()) {
+        func(0, count);
+        return;
+    }
+
+    auto job = std::make_shared<RangeJob>();
+    job->func = func;
+    job->count = count;
+    job->grain = grain;
+    job->chunkCount = chunkCount;
+
+    // 调用线程自己也会领取分段，辅助任务数量不超过剩余分段数
+    const uint32_t helpers = chunkCount - 1 < threadCount() ? chunkCount - 1 : threadCount();
+    for (uint32_t i = 0; i < helpers; ++i) {
+        submit([job] { job->run(); });
+    }
+    job->run();
+
+    std::unique_lock lock(job->mutex);
+    job->cond.wait(lock, [&job] { return job->done.load() == job->chunkCount; });
+}
+
+std::shared_ptr<NPKThreadPool> NPKThreadPool::global()
+{
+    static const auto pool = std::make_shared<NPKThreadPool>();
+    return pool;
+}
+
+void NPKThreadPool::submit(Task task)
+{
+    TaskQueue& queue = t_currentPool == this ? *m_queues[t_workerIndex] : m_injected;
+    // 先计数再入队，取任务的线程看到的计数不会小于实际数量
+    m_pending.fetch_add(1);
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(m_sleepMutex);
+    }
+    m_cond.notify_one();
+}
+
+bool NPKThreadPool::runPendingTask()
+{
+    Task task;
+    if (!popTask(task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+bool NPKThreadPool::popTask(Task& task)
+{
+    if (m_pending.load() == 0) {
+        return false;
+    }
+
+    const bool isWorker = t_currentPool == this;
+    if (isWorker) {
+        auto& own = *m_queues[t_workerIndex];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            m_pending.fetch_sub(1);
+            return true;
+        }
+    }
+
+    auto steal = [this, &task](TaskQueue& queue) {
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        m_pending.fetch_sub(1);
+        return true;
+    };
+    if (steal(m_injected)) {
+        return true;
+    }
+    const uint32_t start = isWorker ? t_workerIndex + 1 : 0;
+    for (uint32_t i = 0; i < m_queues.size(); ++i) {
+        if (steal(*m_queues[(start + i) % m_queues.size()])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void NPKThreadPool::workerLoop(const uint32_t index)
+{
+    t_currentPool = this;
+    t_workerIndex = index;
+    while (true) {
+        Task task;
+        if (popTask(task)) {
+            task();
+            continue;
+        }
+        std::unique_lock lock(m_sleepMutex);
+        m_cond.wait(lock, [this] { return m_stop || m_pending.load() > 0; });
+        if (m_stop && m_pending.load() == 0) {
+            return;
+        }
+    }
+}
+} // neapu
@@ -0,0 +1,89 @@
+//
+// Created by liu86 on 24-8-7.
+//
+
+#ifndef NPKTHREADPOOL_H
+#define NPKTHREADPOOL_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace neapu {
+/**
+ * @brief 固定大小的工作窃取线程池，用于把一次解码或一批解码分散到多个核心上
+ *
+ * 每个工作线程有自己的任务队列，工作线程提交的任务放入自己的队列并从队尾取出，
+ * 自己的队列为空时从外部提交的队列和其他线程的队头窃取。
+ * parallelFor的调用线程也会参与计算，所以在线程池的任务里嵌套调用不会死锁。
+ */
+class NPKThreadPool {
+public:
+    using Task = std::function<void()>;
+    using RangeFunc = std::function<void(uint32_t begin, uint32_t end)>;
+
+    /**
+     * @param threadCount 工作线程数量，为0时取CPU核心数减1（调用线程也参与计算）
+     */
+    explicit NPKThreadPool(uint32_t threadCount = 0);
+    virtual ~NPKThreadPool();
+    NPKThreadPool(const NPKThreadPool&) = delete;
+    NPKThreadPool& operator=(const NPKThreadPool&) = delete;
+
+    uint32_t threadCount() const { return static_cast<uint32_t>(m_threads.size()); }
+
+    /**
+     * @brief 提交任务，在本线程池的工作线程中调用时放入当前线程的队列
+     */
+    void submit(Task task);
+    /**
+     * @brief 在当前线程执行一个排队中的任务，等待其他任务完成时可以用来帮忙
+     * @return 没有排队中的任务返回false
+     */
+    bool runPendingTask();
+
+    /**
+     * @brief 把[0, count)按grain切分后并行执行，所有分段完成后返回
+     * @param count 总数量
+     * @param func 处理[begin, end)的函数，可能在多个线程同时调用
+     * @param grain 每个分段的数量，为0时按1处理
+     */
+    void parallelFor(uint32_t count, const RangeFunc& func, uint32_t grain = 1);
+
+    /**
+     * @brief 进程内共享的线程池，第一次调用时创建
+     */
+    static std::shared_ptr<NPKThreadPool> global();
+
+private:
+    typedef struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    } TaskQueue;
+
+    void workerLoop(uint32_t index);
+    // 依次从当前线程的队尾、外部提交的队列、其他线程的队头取任务
+    bool popTask(Task& task);
+
+private:
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<TaskQueue>> m_queues; // 每个工作线程一个
+    TaskQueue m_injected;                             // 非工作线程提交的任务
+    std::atomic<uint32_t> m_pending{0};               // 所有队列中的任务总数
+    std::mutex m_sleepMutex;
+    std::condition_variable m_cond;
+    bool m_stop{false};
+};
+
+typedef struct NPKParallelOptions {
+    std::shared_ptr<NPKThreadPool> pool{nullptr}; // 为空时在调用线程解码
+    uint32_t minBlocks = 16384;                   // DXT块数量少于此值时不拆分，小纹理单线程更快
+} NPKParallelOptions;
+} // neapu
+
+#endif //NPKTHREADPOOL_H
@@ -0,0 +1,160 @@
+//
+// Created by liu86 on 24-8-14.
+//
+
+#include "NPKVerifyCache.h"
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+#include "logger.h"
+#ifndef _WIN32
+#define fopen_s(pFile, filename, mode) (((*(pFile)) = fopen((filename), (mode))) == NULL)
+#endif
+
+namespace neapu {
+namespace {
+constexpr uint32_t CACHE_MAGIC = 0x564B504E; // "NPKV"
+constexpr uint32_t CACHE_VERSION = 1;
+
+#pragma pack(push, 1)
+typedef struct CacheEntryHeader {
+    uint32_t pathLen;
+    uint64_t size;
+    int64_t mtime;
+} CacheEntryHeader;
+#pragma pack(pop)
+}
+
+NPKVerifyCache& NPKVerifyCache::global()
+{
+    static NPKVerifyCache cache;
+    return cache;
+}
+
+bool NPKVerifyCache::getStamp(const std::string& path, NPKFileStamp& stamp)
+{
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    stamp.size = size;
+    stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    return true;
+}
+
+bool NPKVerifyCache::contains(const std::string& path, const NPKFileStamp& stamp) const
+{
+    const auto key = normalize(path);
+    std::lock_guard lock(m_mutex);
+    const auto it = m_entries.find(key);
+    return it != m_entries.end() && it->second == stamp;
+}
+
+void NPKVerifyCache::insert(const std::string& path, const NPKFileStamp& stamp)
+{
+    auto key = normalize(path);
+    std::lock_guard lock(m_mutex);
+    m_entries[std::move(key)] = stamp;
+}
+
+void NPKVerifyCache::remove(const std::string& path)
+{
+    const auto key = normalize(path);
+    std::lock_guard lock(m_mutex);
+    m_entries.erase(key);
+}
+
+void NPKVerifyCache::clear()
+{
+    std::lock_guard lock(m_mutex);
+    m_entries.clear();
+}
+
+uint32_t NPKVerifyCache::size() const
+{
+    std::lock_guard lock(m_mutex);
+    return static_cast<uint32_t>(m_entries.size());
+}
+
+bool NPKVerifyCache::load(const std::string& cachePath)
+{
+    FILE* file = nullptr;
+    if (fopen_s(&file, cachePath.c_str(), "rb") != 0) {
+        return false;
+    }
+
+    uint32_t header[3]{};
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION) {
+        LOG_WARNING << "Invalid verify cache: " << cachePath;
+        fclose(file);
+        return false;
+    }
+
+    // 先全部读出，格式正确才合并
+    std::vector<std::pair<std::string, NPKFileStamp>> entries;
+    for (uint32_t i = 0; i < header[2]; ++i) {
+        CacheEntryHeader entry{};
+        if (fread(&entry, sizeof(entry), 1, file) != 1 || entry.pathLen == 0 || entry.pathLen > 0xFFFF) {
+            break;
+        }
+        std::string path(entry.pathLen, '\0');
+        if (fread(path.data(), 1, entry.pathLen, file) != entry.pathLen) {
+            break;
+        }
+        entries.emplace_back(std::move(path), NPKFileStamp{entry.size, entry.mtime});
+    }
+    fclose(file);
+    if (entries.size() != header[2]) {
+        LOG_WARNING << "Verify cache is truncated: " << cachePath;
+        return false;
+    }
+
+    std::lock_guard lock(m_mutex);
+    for (auto& [path, stamp] : entries) {
+        m_entries[std::move(path)] = stamp;
+    }
+    return true;
+}
+
+bool NPKVerifyCache::save(const std::string& cachePath) const
+{
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard lock(m_mutex);
+        const uint32_t header[3] = {CACHE_MAGIC, CACHE_VERSION, static_cast<uint32_t>(m_entries.size())};
+        buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(header), reinterpret_cast<const uint8_t*>(header) + sizeof(header));
+        for (const auto& [path, stamp] : m_entries) {
+            const CacheEntryHeader entry{static_cast<uint32_t>(path.size()), stamp.size, stamp.mtime};
+            buffer.insert(buffer.end(), reinterpret_cast<const uint8_t*>(&entry), reinterpret_cast<const uint8_t*>(&entry) + sizeof(entry));
+            buffer.insert(buffer.end(), path.begin(), path.end());
+        }
+    }
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, cachePath.c_str(), "wb") != 0) {
+        LOG_ERROR << "Failed to open file: " << cachePath;
+        return false;
+    }
+    const bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    if (fclose(file) != 0 || !ok) {
+        LOG_ERROR << "Failed to write file: " << cachePath;
+        return false;
+    }
+    return true;
+}
+
+std::string NPKVerifyCache::normalize(const std::string& path)
+{
+    std::error_code ec;
+    auto absolute = std::filesystem::absolute(path, ec);
+    if (ec) {
+        return path;
+    }
+    return absolute.lexically_normal().string();
+}
+} // neapu
@@ -0,0 +1,66 @@
+//
+// Created by liu86 on 24-8-14.
+//
+
+#ifndef NPKVERIFYCACHE_H
+#define NPKVERIFYCACHE_H
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace neapu {
+typedef struct NPKFileStamp {
+    uint64_t size = 0;
+    int64_t mtime = 0; // 文件系统时钟的计数，只用于比较是否相同
+
+    bool operator==(const NPKFileStamp& other) const { return size == other.size && mtime == other.mtime; }
+} NPKFileStamp;
+
+/**
+ * @brief 记录通过SHA256校验的NPK文件，以(路径, 大小, 修改时间)为键，文件变化后自动失效
+ *
+ * 可以保存到文件，进程重启后加载，已校验过的文件不需要重新计算。所有方法都可以多线程调用。
+ */
+class NPKVerifyCache {
+public:
+    NPKVerifyCache() = default;
+    virtual ~NPKVerifyCache() = default;
+
+    /**
+     * @brief loadNPK使用的全局实例
+     */
+    static NPKVerifyCache& global();
+    /**
+     * @brief 获取文件的大小和修改时间
+     * @param path 文件路径
+     * @param stamp 输出
+     * @return 文件不存在时返回false
+     */
+    static bool getStamp(const std::string& path, NPKFileStamp& stamp);
+
+    bool contains(const std::string& path, const NPKFileStamp& stamp) const;
+    void insert(const std::string& path, const NPKFileStamp& stamp);
+    void remove(const std::string& path);
+    void clear();
+    uint32_t size() const;
+
+    /**
+     * @brief 从文件加载记录，与已有记录合并
+     * @param cachePath 由save生成的文件
+     * @return 文件不存在或格式不正确返回false
+     */
+    bool load(const std::string& cachePath);
+    bool save(const std::string& cachePath) const;
+
+private:
+    // 统一为绝对路径，同一个文件通过不同的相对路径打开时也能命中
+    static std::string normalize(const std::string& path);
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, NPKFileStamp> m_entries;
+};
+} // neapu
+
+#endif //NPKVERIFYCACHE_H
@@ -0,0 +1,389 @@
+//
+// Created by liu86 on 24-8-13.
+//
+
+#include "NPKWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+#include "logger.h"
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKPaletteManager.h"
+#ifndef _WIN32
+#define fopen_s(pFile, filename, mode) (((*(pFile)) = fopen((filename), (mode))) == NULL)
+#endif
+
+namespace neapu {
+namespace {
+constexpr char IMAGE_MAGIC[16] = "Neople Img File";
+constexpr char NPK_MAGIC[16] = "NeoplePack_Bill";
+constexpr uint64_t VERIFY_SIZE = 32;
+const std::vector<uint8_t> EMPTY_DATA;
+
+// 一段要写出的数据，压缩后指向压缩结果，否则直接指向原始数据
+typedef struct Payload {
+    const std::vector<uint8_t>* source{nullptr};
+    std::vector<uint8_t> compressed;
+    bool compress{false};
+
+    const uint8_t* data() const { return compress ? compressed.data() : source->data(); }
+    uint64_t size() const { return compress ? compressed.size() : source->size(); }
+} Payload;
+
+typedef struct ImageLayout {
+    std::vector<uint8_t> head; // Image头、V5信息、调色板、DDS索引和帧索引
+    std::vector<Payload> dds;
+    std::vector<Payload> frames;
+    uint64_t size{0};
+} ImageLayout;
+
+template <typename T>
+void append(std::vector<uint8_t>& out, const T& value)
+{
+    const auto* data = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), data, data + sizeof(T));
+}
+
+void appendPalette(std::vector<uint8_t>& out, const std::vector<NPKColor>& palette)
+{
+    append(out, static_cast<uint32_t>(palette.size()));
+    for (const auto& color : palette) {
+        // 与NPKPaletteManager读取的顺序相同
+        const uint8_t bytes[4] = {color.a, color.b, color.g, color.r};
+        append(out, bytes);
+    }
+}
+
+bool isCompressed(const NPKFrameIndex& index)
+{
+    return index.compressType == CP_ZLIB || index.compressType == CP_ZLIB2;
+}
+
+bool buildHead(const NPKWriteImage& image, const ImageLayout& layout, std::vector<uint8_t>& head)
+{
+    std::vector<uint8_t> frameIndex;
+    for (uint32_t i = 0; i < image.frames.size(); ++i) {
+        NPKFrameIndex index = image.frames[i].index;
+        const auto* data = reinterpret_cast<const uint8_t*>(&index);
+        if (index.colorType == CL_LINK) {
+            frameIndex.insert(frameIndex.end(), data, data + LINK_FRAME_INDEX_SIZE);
+        } else if (index.colorType < CL_LINK) {
+            index.dataSize = static_cast<uint32_t>(layout.frames[i].size());
+            frameIndex.insert(frameIndex.end(), data, data + MATRIX_FRAME_INDEX_SIZE);
+        } else {
+            index.dataSize = 0;
+            frameIndex.insert(frameIndex.end(), data, data + DDS_FRAME_INDEX_SIZE);
+        }
+    }
+
+    NPKImageHeader header{};
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.frameIndexSize = static_cast<uint32_t>(frameIndex.size());
+    header.version = image.version;
+    header.frameIndexCount = static_cast<uint32_t>(image.frames.size());
+    append(head, header);
+
+    if (image.version == 5) {
+        NPKImageV5Info info{};
+        info.ddsIndexCount = static_cast<uint32_t>(image.dds.size());
+        info.imageSize = static_cast<uint32_t>(layout.size);
+        append(head, info);
+    }
+    if (image.version == 4 || image.version == 5) {
+        appendPalette(head, image.palettes.empty() ? std::vector<NPKColor>{} : image.palettes.front());
+    } else if (image.version == 6) {
+        append(head, static_cast<uint32_t>(image.palettes.size()));
+        for (const auto& palette : image.palettes) {
+            appendPalette(head, palette);
+        }
+    } else if (image.version != 2) {
+        LOG_ERROR << "Unsupported version: " << image.version << " " << image.name;
+        return false;
+    }
+
+    if (image.version == 5) {
+        for (uint32_t i = 0; i < image.dds.size(); ++i) {
+            NPKDDSIndex index = image.dds[i].index;
+            index.compressSize = static_cast<uint32_t>(layout.dds[i].size());
+            index.uncompressSize = static_cast<uint32_t>(image.dds[i].data.size());
+            append(head, index);
+        }
+    }
+    head.insert(head.end(), frameIndex.begin(), frameIndex.end());
+    return true;
+}
+
+uint16_t toColor16(const NPKColor& color, const ColorType colorType)
+{
+    switch (colorType) {
+    case CL_ARGB4444: return static_cast<uint16_t>((color.a >> 4) << 12 | (color.r >> 4) << 8 | (color.g >> 4) << 4 | color.b >> 4);
+    case CL_ARGB1555: return static_cast<uint16_t>((color.a >= 0x80 ? 0x8000 : 0) | (color.r >> 3) << 10 | (color.g >> 3) << 5 | color.b >> 3);
+    default: return static_cast<uint16_t>((color.r >> 3) << 11 | (color.g >> 2) << 5 | color.b >> 3);
+    }
+}
+}
+
+void NPKWriter::addImage(NPKWriteImage image)
+{
+    m_images.push_back(std::move(image));
+}
+
+bool NPKWriter::save(const std::string& path, const NPKWriteOptions& options) const
+{
+    FILE* file = nullptr;
+    uint64_t position = 0;
+    const bool ok = write(options, [&](uint64_t) {
+        if (fopen_s(&file, path.c_str(), "wb") != 0) {
+            LOG_ERROR << "Failed to open file: " << path;
+            return false;
+        }
+        return true;
+    }, [&](const uint64_t offset, const uint8_t* data, const uint64_t len) {
+        if (offset != position && _fseeki64(file, static_cast<int64_t>(offset), SEEK_SET) != 0) {
+            return false;
+        }
+        position = offset + len;
+        return fwrite(data, 1, len, file) == len;
+    });
+    if (file && fclose(file) != 0) {
+        LOG_ERROR << "Failed to write file: " << path;
+        return false;
+    }
+    return ok;
+}
+
+std::vector<uint8_t> NPKWriter::serialize(const NPKWriteOptions& options) const
+{
+    std::vector<uint8_t> output;
+    const bool ok = write(options, [&](const uint64_t totalSize) {
+        output.resize(totalSize);
+        return true;
+    }, [&](const uint64_t offset, const uint8_t* data, const uint64_t len) {
+        memcpy(output.data() + offset, data, len);
+        return true;
+    });
+    if (!ok) {
+        return {};
+    }
+    return output;
+}
+
+bool NPKWriter::write(const NPKWriteOptions& options, const std::function<bool(uint64_t totalSize)>& prepare,
+                      const WriteFunc& output) const
+{
+    if (NPKHandler::sha256 == nullptr) {
+        LOG_ERROR << "SHA256 function is not set";
+        return false;
+    }
+
+    // 收集所有需要压缩的数据，在线程池中并行压缩
+    std::vector<ImageLayout> layouts(m_images.size());
+    std::vector<Payload*> jobs;
+    for (uint32_t i = 0; i < m_images.size(); ++i) {
+        const auto& image = m_images[i];
+        auto& layout = layouts[i];
+        if (image.name.size() >= sizeof(NPKImageIndex::name)) {
+            LOG_ERROR << "Image name is too long: " << image.name;
+            return false;
+        }
+        layout.dds.resize(image.version == 5 ? image.dds.size() : 0);
+        for (uint32_t j = 0; j < layout.dds.size(); ++j) {
+            layout.dds[j].source = &image.dds[j].data;
+            layout.dds[j].compress = !image.dds[j].data.empty();
+        }
+        layout.frames.resize(image.frames.size());
+        for (uint32_t j = 0; j < image.frames.size(); ++j) {
+            const auto& frame = image.frames[j];
+            // 只有点阵帧有数据
+            const bool matrixFrame = frame.index.colorType < CL_LINK && frame.index.colorType != CL_UNKNOWN;
+            layout.frames[j].source = matrixFrame ? &frame.data : &EMPTY_DATA;
+            layout.frames[j].compress = matrixFrame && isCompressed(frame.index) && !frame.data.empty();
+        }
+        for (auto& payload : layout.dds) {
+            if (payload.compress) {
+                jobs.push_back(&payload);
+            }
+        }
+        for (auto& payload : layout.frames) {
+            if (payload.compress) {
+                jobs.push_back(&payload);
+            }
+        }
+    }
+
+    const auto pool = options.pool ? options.pool : NPKThreadPool::global();
+    std::atomic<bool> compressFailed{false};
+    pool->parallelFor(static_cast<uint32_t>(jobs.size()), [&](const uint32_t begin, const uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            Payload& payload = *jobs[i];
+            uLongf len = compressBound(static_cast<uLong>(payload.source->size()));
+            payload.compressed.resize(len);
+            if (compress2(payload.compressed.data(), &len, payload.source->data(), static_cast<uLong>(payload.source->size()),
+                          options.compressionLevel) != Z_OK) {
+                compressFailed = true;
+                continue;
+            }
+            payload.compressed.resize(len);
+        }
+    });
+    if (compressFailed) {
+        LOG_ERROR << "Failed to compress data.";
+        return false;
+    }
+
+    // 计算每个Image的大小和位置，生成NPK头与索引表
+    std::vector<uint8_t> head;
+    NPKHeader header{};
+    memcpy(header.magic, NPK_MAGIC, sizeof(header.magic));
+    header.imgCount = static_cast<uint32_t>(m_images.size());
+    append(head, header);
+
+    uint64_t offset = sizeof(NPKHeader) + m_images.size() * sizeof(NPKImageIndex) + VERIFY_SIZE;
+    for (uint32_t i = 0; i < m_images.size(); ++i) {
+        auto& layout = layouts[i];
+        uint64_t payloadSize = 0;
+        for (const auto& payload : layout.dds) {
+            payloadSize += payload.size();
+        }
+        for (const auto& payload : layout.frames) {
+            payloadSize += payload.size();
+        }
+        // V5信息中包含Image大小，先生成一次得到头部大小
+        if (!buildHead(m_images[i], layout, layout.head)) {
+            return false;
+        }
+        layout.size = layout.head.size() + payloadSize;
+        layout.head.clear();
+        buildHead(m_images[i], layout, layout.head);
+
+        if (offset + layout.size > UINT32_MAX) {
+            LOG_ERROR << "NPK file is too large.";
+            return false;
+        }
+        NPKImageIndex index{};
+        index.offset = static_cast<uint32_t>(offset);
+        index.size = static_cast<uint32_t>(layout.size);
+        memcpy(index.name, m_images[i].name.data(), m_images[i].name.size());
+        NPKImageHandler::maskName(index.name);
+        append(head, index);
+        offset += layout.size;
+    }
+
+    uint8_t verify[VERIFY_SIZE]{};
+    if (!NPKHandler::sha256(head.data(), head.size() / 17 * 17, verify, sizeof(verify))) {
+        LOG_ERROR << "Failed to calculate sha256";
+        return false;
+    }
+    head.insert(head.end(), verify, verify + sizeof(verify));
+
+    // 按偏移依次写出
+    if (!prepare(offset) || !output(0, head.data(), head.size())) {
+        LOG_ERROR << "Failed to write NPK header.";
+        return false;
+    }
+    uint64_t position = head.size();
+    for (const auto& layout : layouts) {
+        if (!output(position, layout.head.data(), layout.head.size())) {
+            LOG_ERROR << "Failed to write image.";
+            return false;
+        }
+        position += layout.head.size();
+        for (const auto* payloads : {&layout.dds, &layout.frames}) {
+            for (const auto& payload : *payloads) {
+                if (payload.size() == 0) {
+                    continue;
+                }
+                if (!output(position, payload.data(), payload.size())) {
+                    LOG_ERROR << "Failed to write image.";
+                    return false;
+                }
+                position += payload.size();
+            }
+        }
+    }
+    return true;
+}
+
+NPKWriteFrame NPKWriter::matrixFrame(const NPKMatrix& matrix, const ColorType colorType, const CompressType compressType)
+{
+    NPKWriteFrame frame;
+    frame.index.colorType = colorType;
+    frame.index.compressType = compressType;
+    frame.index.posX = matrix.offsetX();
+    frame.index.posY = matrix.offsetY();
+    frame.index.frameWidth = matrix.canvasWidth();
+    frame.index.frameHeight = matrix.canvasHeight();
+
+    // 只有画布内的部分有数据
+    if (matrix.isEmpty() || matrix.offsetX() >= matrix.canvasWidth() || matrix.offsetY() >= matrix.canvasHeight()) {
+        return frame;
+    }
+    const uint32_t width = std::min(matrix.width(), matrix.canvasWidth() - matrix.offsetX());
+    const uint32_t height = std::min(matrix.height(), matrix.canvasHeight() - matrix.offsetY());
+    frame.index.width = width;
+    frame.index.height = height;
+
+    const uint32_t colorSize = colorType == CL_ARGB8888 ? 4 : 2;
+    frame.data.resize(static_cast<uint64_t>(width) * height * colorSize);
+    for (uint32_t y = 0; y < height; ++y) {
+        const NPKColor* src = matrix.data() + static_cast<uint64_t>(y + matrix.offsetY()) * matrix.canvasWidth() + matrix.offsetX();
+        uint8_t* dst = frame.data.data() + static_cast<uint64_t>(y) * width * colorSize;
+        if (colorType == CL_ARGB8888) {
+            // 内存布局与NPKColor相同
+            memcpy(dst, src, static_cast<uint64_t>(width) * sizeof(NPKColor));
+            continue;
+        }
+        for (uint32_t x = 0; x < width; ++x) {
+            const uint16_t color = toColor16(src[x], colorType);
+            dst[x * 2] = static_cast<uint8_t>(color & 0xFF);
+            dst[x * 2 + 1] = static_cast<uint8_t>(color >> 8);
+        }
+    }
+    return frame;
+}
+
+NPKWriteFrame NPKWriter::linkFrame(const uint32_t linkTo)
+{
+    NPKWriteFrame frame;
+    frame.index.colorType = CL_LINK;
+    frame.index.linkTo = linkTo;
+    return frame;
+}
+
+bool NPKWriter::fromImage(const NPKImageHandler& image, NPKWriteImage& result)
+{
+    result = NPKWriteImage{};
+    result.name = image.getName();
+    result.version = image.version();
+
+    if (image.m_paletteManager) {
+        for (int i = 0; i < image.m_paletteManager->paletteCount(); ++i) {
+            result.palettes.push_back(image.m_paletteManager->getColors(i));
+        }
+    }
+    for (const auto& dds : image.m_ddsHandlers) {
+        NPKWriteDDS writeDDS;
+        writeDDS.index = dds->index();
+        if (!dds->uncompressedData(writeDDS.data)) {
+            LOG_ERROR << "Failed to read DDS data. " << image.getName();
+            return false;
+        }
+        result.dds.push_back(std::move(writeDDS));
+    }
+    for (uint32_t i = 0; i < image.m_frames.size(); ++i) {
+        const NPKFrameHandler frame = image.m_frames.frame(i, image.m_paletteManager.get());
+        NPKWriteFrame writeFrame;
+        writeFrame.index = frame.index();
+        if (!frame.uncompressedData(writeFrame.data)) {
+            LOG_ERROR << "Failed to read frame data. " << image.getName();
+            return false;
+        }
+        result.frames.push_back(std::move(writeFrame));
+    }
+    return true;
+}
+} // neapu
@@ -0,0 +1,111 @@
+//
+// Created by liu86 on 24-8-13.
+//
+
+#ifndef NPKWRITER_H
+#define NPKWRITER_H
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NPKDDSHandler.h"
+#include "NPKFrameHandler.h"
+#include "NPKThreadPool.h"
+
+namespace neapu {
+class NPKImageHandler;
+
+typedef struct NPKWriteFrame {
+    // 帧索引，dataSize在写入时填写；链接帧只使用colorType和linkTo，V5帧使用DDS裁剪信息
+    NPKFrameIndex index{};
+    // 未压缩的帧数据，V2为对应颜色格式的像素，V4/V6为1字节调色板索引，链接帧与V5帧为空
+    std::vector<uint8_t> data;
+} NPKWriteFrame;
+
+typedef struct NPKWriteDDS {
+    // DDS索引，compressSize与uncompressSize在写入时填写
+    NPKDDSIndex index{};
+    // 未压缩的完整DDS数据，包括DDS头
+    std::vector<uint8_t> data;
+} NPKWriteDDS;
+
+typedef struct NPKWriteImage {
+    std::string name; // 完整路径，如sprite/character/xxx.img，不超过255字节
+    uint32_t version = 2;
+    // V4/V5只写入第一个调色板，V6写入全部
+    std::vector<std::vector<NPKColor>> palettes;
+    std::vector<NPKWriteDDS> dds; // 只用于V5
+    std::vector<NPKWriteFrame> frames;
+} NPKWriteImage;
+
+typedef struct NPKWriteOptions {
+    // zlib压缩级别0-9，-1使用zlib默认值
+    int compressionLevel = -1;
+    // 压缩用的线程池，为空时使用NPKThreadPool::global()
+    std::shared_ptr<NPKThreadPool> pool{nullptr};
+} NPKWriteOptions;
+
+/**
+ * @brief 生成NPK文件
+ *
+ * 写入时先在线程池中并行压缩所有帧和DDS数据，再计算每个Image的位置和校验值，
+ * 最后按偏移依次写出，每个字节只写一次。
+ */
+class NPKWriter {
+public:
+    NPKWriter() = default;
+    virtual ~NPKWriter() = default;
+
+    void addImage(NPKWriteImage image);
+    uint32_t getImageCount() const { return static_cast<uint32_t>(m_images.size()); }
+    void clear() { m_images.clear(); }
+
+    /**
+     * @brief 写入文件
+     * @param path 文件路径
+     * @param options 写入选项
+     * @return 成功返回true
+     */
+    bool save(const std::string& path, const NPKWriteOptions& options = {}) const;
+    /**
+     * @brief 生成NPK文件数据
+     * @param options 写入选项
+     * @return 失败返回空
+     */
+    std::vector<uint8_t> serialize(const NPKWriteOptions& options = {}) const;
+
+    /**
+     * @brief 把帧画面的图像区域编码为V2帧，16位格式会损失精度
+     * @param matrix 帧画面，画布大小与偏移写入帧索引
+     * @param colorType CL_ARGB8888、CL_ARGB4444、CL_ARGB1555或CL_RGB565
+     * @param compressType CP_NONE或CP_ZLIB
+     */
+    static NPKWriteFrame matrixFrame(const NPKMatrix& matrix, ColorType colorType = CL_ARGB8888, CompressType compressType = CP_ZLIB);
+    static NPKWriteFrame linkFrame(uint32_t linkTo);
+    /**
+     * @brief 从已加载的Image生成写入数据，帧和DDS数据会解压，写入时重新压缩
+     * @param image 已解析的Image，延迟加载时需通过NPKHandler::getImage获取
+     * @param result 输出
+     * @return Image无效或数据解压失败返回false
+     */
+    static bool fromImage(const NPKImageHandler& image, NPKWriteImage& result);
+
+private:
+    // 按偏移写入数据，同一次写入中偏移递增
+    using WriteFunc = std::function<bool(uint64_t offset, const uint8_t* data, uint64_t len)>;
+    /**
+     * @brief 压缩并按偏移写出所有数据
+     * @param options 写入选项
+     * @param prepare 压缩完成、文件总大小确定后调用，返回false时中止
+     * @param output 写入函数
+     */
+    bool write(const NPKWriteOptions& options, const std::function<bool(uint64_t totalSize)>& prepare, const WriteFunc& output) const;
+
+private:
+    std::vector<NPKWriteImage> m_images;
+};
+} // neapu
+
+#endif //NPKWRITER_H
@@ -0,0 +1,146 @@
+//
+// Created by liu86 on 24-8-9.
+//
+// 对比各解压后端在真实NPK数据上的速度
+// 先用记录用的解压后端解码一遍所有帧，收集其中CP_ZLIB/CP_ZLIB2的压缩数据，
+// 再分别用各后端重复解压这些数据，同时检查结果与zlib一致
+// 用法：npk_bench_decompress <file.npk> [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "NPKDecompressor.h"
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+
+using namespace neapu;
+
+namespace {
+typedef struct Payload {
+    const uint8_t* src;
+    uint64_t srcLen;
+    uint64_t outputSize;
+} Payload;
+
+// 转发给zlib后端，同时记录每次解压的输入和完整输出大小
+class RecordingDecompressor : public NPKDecompressor {
+public:
+    const char* name() const override { return "recording"; }
+
+    DecompressResult decompress(const uint8_t* src, const uint64_t srcLen, const NPKDecompressTarget& target) const override
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_payloads.push_back(Payload{src, srcLen, target.skip + target.rowSize * target.rowCount});
+        }
+        return m_zlib.decompress(src, srcLen, target);
+    }
+
+    std::vector<Payload> payloads() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_payloads;
+    }
+
+private:
+    NPKZlibDecompressor m_zlib;
+    mutable std::mutex m_mutex;
+    mutable std::vector<Payload> m_payloads;
+};
+
+double decodeFrames(const NPKHandler& npk)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& image : npk.getImages()) {
+        for (uint32_t i = 0; i < image->getFrameCount(); ++i) {
+            image->getFrameMatrix(i);
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        printf("usage: %s <file.npk> [rounds]\n", argv[0]);
+        return -1;
+    }
+    const int rounds = argc > 2 ? atoi(argv[2]) : 5;
+
+    NPKHandler npk;
+    if (!npk.loadNPK(argv[1])) {
+        printf("failed to load %s\n", argv[1]);
+        return -1;
+    }
+
+    // DDS图集不缓存，每次都解压
+    for (const auto& image : npk.getImages()) {
+        image->setDDSCachePolicy(DCP_NONE);
+    }
+    const auto recorder = std::make_shared<RecordingDecompressor>();
+    setDecompressor(recorder);
+    decodeFrames(npk);
+    const auto payloads = recorder->payloads();
+
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+    uint64_t maxOutput = 0;
+    for (const auto& payload : payloads) {
+        inputBytes += payload.srcLen;
+        outputBytes += payload.outputSize;
+        maxOutput = payload.outputSize > maxOutput ? payload.outputSize : maxOutput;
+    }
+    printf("%zu compressed payloads, %.2f MB -> %.2f MB\n", payloads.size(), inputBytes / 1048576.0, outputBytes / 1048576.0);
+    if (payloads.empty()) {
+        return 0;
+    }
+
+    std::vector<uint8_t> expected(maxOutput);
+    std::vector<uint8_t> actual(maxOutput);
+    const DecompressBackend backends[] = {DB_ZLIB, DB_FAST};
+    const auto reference = createDecompressor(DB_ZLIB);
+    int failed = 0;
+    for (const auto backend : backends) {
+        const auto decompressor = createDecompressor(backend);
+        for (const auto& payload : payloads) {
+            const auto expectedRet = reference->decompress(payload.src, payload.srcLen, expected.data(), payload.outputSize);
+            const auto actualRet = decompressor->decompress(payload.src, payload.srcLen, actual.data(), payload.outputSize);
+            if (expectedRet != actualRet || memcmp(expected.data(), actual.data(), payload.outputSize) != 0) {
+                failed++;
+            }
+        }
+
+        double best = 0;
+        for (int round = 0; round < rounds; ++round) {
+            const auto start = std::chrono::steady_clock::now();
+            for (const auto& payload : payloads) {
+                decompressor->decompress(payload.src, payload.srcLen, actual.data(), payload.outputSize);
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = round == 0 || seconds < best ? seconds : best;
+        }
+
+        // 整帧解码包含像素转换，反映实际使用时的差距
+        setDecompressor(decompressor);
+        double frameBest = 0;
+        for (int round = 0; round < rounds; ++round) {
+            const double seconds = decodeFrames(npk);
+            frameBest = round == 0 || seconds < frameBest ? seconds : frameBest;
+        }
+
+        printf("%-6s inflate %8.2f ms %8.1f MB/s, frames %8.2f ms\n", decompressor->name(), best * 1000, outputBytes / 1048576.0 / best,
+               frameBest * 1000);
+    }
+    setDecompressor(nullptr);
+
+    if (failed) {
+        printf("%d payloads differ from zlib\n", failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+//
+// Created by liu86 on 24-8-21.
+//
+// 替换全局operator new/delete，统计测试进程中的堆分配次数与单次分配的最大字节数。
+// 替换的是整个程序的分配函数，一个测试程序只能有一个源文件包含本头文件。
+
+#ifndef NPK_TEST_ALLOCATIONS_H
+#define NPK_TEST_ALLOCATIONS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace npk_test {
+inline std::atomic<uint64_t> g_allocations{0};
+inline std::atomic<uint64_t> g_largestAllocation{0};
+
+inline uint64_t allocationCount()
+{
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+// 从调用时开始重新统计单次分配的最大字节数
+inline void resetLargestAllocation()
+{
+    g_largestAllocation.store(0, std::memory_order_relaxed);
+}
+
+inline uint64_t largestAllocation()
+{
+    return g_largestAllocation.load(std::memory_order_relaxed);
+}
+
+inline void* allocate(std::size_t size, const std::size_t alignment)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    uint64_t largest = g_largestAllocation.load(std::memory_order_relaxed);
+    while (size > largest && !g_largestAllocation.compare_exchange_weak(largest, size, std::memory_order_relaxed)) {
+    }
+    size = size ? size : 1;
+    void* ptr = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        ptr = std::malloc(size);
+    } else {
+#ifdef _WIN32
+        ptr = _aligned_malloc(size, alignment);
+#else
+        ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    }
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+inline void release(void* ptr, const std::size_t alignment) noexcept
+{
+#ifdef _WIN32
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(ptr);
+        return;
+    }
+#else
+    (void)alignment;
+#endif
+    std::free(ptr);
+}
+} // npk_test
+
+// 分配和释放成对使用malloc/free（或对齐版本），GCC把operator delete中的free视为与new不匹配，这里是有意的
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(const std::size_t size)
+{
+    return npk_test::allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](const std::size_t size)
+{
+    return npk_test::allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment)
+{
+    return npk_test::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t alignment)
+{
+    return npk_test::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept
+{
+    npk_test::release(ptr, alignof(std::max_align_t));
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    npk_test::release(ptr, alignof(std::max_align_t));
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    npk_test::release(ptr, alignof(std::max_align_t));
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    npk_test::release(ptr, alignof(std::max_align_t));
+}
+
+void operator delete(void* ptr, const std::align_val_t alignment) noexcept
+{
+    npk_test::release(ptr, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* ptr, const std::align_val_t alignment) noexcept
+{
+    npk_test::release(ptr, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* ptr, std::size_t, const std::align_val_t alignment) noexcept
+{
+    npk_test::release(ptr, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* ptr, std::size_t, const std::align_val_t alignment) noexcept
+{
+    npk_test::release(ptr, static_cast<std::size_t>(alignment));
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif //NPK_TEST_ALLOCATIONS_H
@@ -0,0 +1,194 @@
+//
+// Created by liu86 on 24-8-6.
+//
+// 多个测试共用的数据构造与辅助函数
+
+#ifndef NPK_TEST_FIXTURES_H
+#define NPK_TEST_FIXTURES_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "NPKDDSHandler.h"
+#include "NPKHandler.h"
+#include "NPKMatrix.h"
+#include "NPKWriter.h"
+
+namespace npk_test {
+using namespace neapu;
+
+// 没有OpenSSL时摘要全为0，写入和校验使用同一个函数，结果一致
+inline void useStubSha256()
+{
+    if (!NPKHandler::sha256) {
+        NPKHandler::sha256 = [](const uint8_t*, uint64_t, uint8_t* dst, const uint64_t dstLen) {
+            memset(dst, 0, dstLen);
+            return true;
+        };
+    }
+}
+
+inline std::string tempPath(const std::string& name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+inline bool writeFile(const std::string& path, const std::vector<uint8_t>& data)
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return file.good();
+}
+
+inline std::vector<NPKColor> randomPalette(const uint32_t count, std::mt19937& rng)
+{
+    std::vector<NPKColor> palette(count);
+    for (auto& color : palette) {
+        color = NPKColor{static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng())};
+    }
+    return palette;
+}
+
+// 与DNF中的DDS文件头相同，只有尺寸、数据长度和DXT格式不同
+inline std::vector<uint8_t> ddsHeader(const uint32_t width, const uint32_t height, const DDSPixelDTXFormat fourCC, const uint32_t blocksSize)
+{
+    const uint32_t header[32] = {0x20534444, 124, 0x81007, height, width, blocksSize, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                 0, 0, 0, 32, 4, fourCC, 0, 0, 0, 0, 0, 0x1000};
+    std::vector<uint8_t> data(sizeof(header));
+    memcpy(data.data(), header, sizeof(header));
+    return data;
+}
+
+// 文件头加上随机的块，宽高不是4的倍数时最后不足一块的像素没有对应的块
+inline std::vector<uint8_t> ddsData(const uint32_t width, const uint32_t height, const DDSPixelDTXFormat fourCC, std::mt19937& rng)
+{
+    const uint32_t blocksSize = width / 4 * (height / 4) * (fourCC == DXT1 ? 8 : 16);
+    auto data = ddsHeader(width, height, fourCC, blocksSize);
+    const uint64_t headerSize = data.size();
+    data.resize(headerSize + blocksSize);
+    for (uint64_t i = headerSize; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+// V2帧，直接写入随机的原始像素；overflow时画布比图像小，图像右下部分不在画布内
+inline NPKWriteFrame v2Frame(std::mt19937& rng, const ColorType colorType, const CompressType compressType, const bool overflow = false)
+{
+    const uint32_t width = 1 + rng() % 40;
+    const uint32_t height = 1 + rng() % 40;
+    const uint32_t posX = rng() % 8;
+    const uint32_t posY = rng() % 8;
+    auto matrix = NPKMatrix::createMatrix(width, height, overflow ? posX + width / 2 + 1 : posX + width + rng() % 5,
+                                          overflow ? posY + height / 2 + 1 : posY + height + rng() % 5, posX, posY);
+    NPKWriteFrame frame = NPKWriter::matrixFrame(*matrix, colorType, compressType);
+    // matrixFrame只编码画布内的像素
+    const uint32_t colorSize = colorType == CL_ARGB8888 ? 4 : 2;
+    frame.data.resize(static_cast<size_t>(width) * height * colorSize);
+    for (auto& byte : frame.data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    frame.index.width = width;
+    frame.index.height = height;
+    return frame;
+}
+
+// 1字节索引的帧，宽高在[1, maxSize]内，偏移在[0, maxPos)内
+inline NPKWriteFrame indexedFrame(const uint32_t colorCount, const CompressType compressType, std::mt19937& rng, const uint32_t maxSize = 40,
+                                  const uint32_t maxPos = 6)
+{
+    NPKWriteFrame frame;
+    frame.index.colorType = CL_ARGB1555;
+    frame.index.compressType = compressType;
+    frame.index.width = 1 + rng() % maxSize;
+    frame.index.height = 1 + rng() % maxSize;
+    frame.index.posX = maxPos ? rng() % maxPos : 0;
+    frame.index.posY = maxPos ? rng() % maxPos : 0;
+    frame.index.frameWidth = frame.index.width + frame.index.posX;
+    frame.index.frameHeight = frame.index.height + frame.index.posY;
+    frame.data.resize(frame.index.width * frame.index.height);
+    for (auto& index : frame.data) {
+        index = static_cast<uint8_t>(rng() % colorCount);
+    }
+    return frame;
+}
+
+// V4/V6的Image，所有调色板颜色数相同，超过256色时只有前256色可以被引用，压缩与不压缩的帧交替出现
+inline NPKWriteImage indexedImage(const std::string& name, const uint32_t version, const uint32_t paletteCount, const uint32_t colorCount,
+                                  const uint32_t frameCount, std::mt19937& rng)
+{
+    NPKWriteImage image;
+    image.name = name;
+    image.version = version;
+    for (uint32_t p = 0; p < paletteCount; ++p) {
+        image.palettes.push_back(randomPalette(colorCount, rng));
+    }
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        image.frames.push_back(indexedFrame(std::min(colorCount, 256u), i % 2 ? CP_NONE : CP_ZLIB, rng));
+    }
+    return image;
+}
+
+inline NPKWriteDDS randomDDS(const DDSFormat format, const uint32_t width, const uint32_t height, const uint32_t index, std::mt19937& rng)
+{
+    NPKWriteDDS dds;
+    dds.index.unknown1 = 1;
+    dds.index.format = format;
+    dds.index.index = index;
+    dds.index.width = width;
+    dds.index.height = height;
+    dds.data = ddsData(width, height, format == DDS_FXT1 ? DXT1 : format == DDS_FXT3 ? DXT3 : DXT5, rng);
+    return dds;
+}
+
+// 图集上(left, top)到(right, bottom)的帧
+inline NPKWriteFrame ddsFrame(const DDSFormat format, const uint32_t ddsIndex, const uint32_t left, const uint32_t top, const uint32_t right,
+                              const uint32_t bottom)
+{
+    NPKWriteFrame frame;
+    frame.index.colorType = static_cast<ColorType>(format);
+    frame.index.compressType = CP_ZLIB;
+    frame.index.ddsIndex = ddsIndex;
+    frame.index.ddsLeftEdge = left;
+    frame.index.ddsTopEdge = top;
+    frame.index.ddsRightEdge = right;
+    frame.index.ddsBottomEdge = bottom;
+    frame.index.width = right - left;
+    frame.index.height = bottom - top;
+    frame.index.frameWidth = frame.index.width;
+    frame.index.frameHeight = frame.index.height;
+    return frame;
+}
+
+// 图集上随机区域的帧
+inline NPKWriteFrame ddsFrame(const NPKWriteDDS& dds, std::mt19937& rng)
+{
+    const uint32_t left = rng() % (dds.index.width / 2);
+    const uint32_t top = rng() % (dds.index.height / 2);
+    const uint32_t right = left + 1 + rng() % (dds.index.width - left);
+    const uint32_t bottom = top + 1 + rng() % (dds.index.height - top);
+    return ddsFrame(dds.index.format, dds.index.index, left, top, right, bottom);
+}
+
+// 只有一个DXT5图集的V5 Image，第i帧从图集四周各裁掉一部分
+inline NPKWriteImage ddsImage(const std::string& name, const uint32_t width, const uint32_t height, const uint32_t frameCount, std::mt19937& rng)
+{
+    NPKWriteImage image;
+    image.name = name;
+    image.version = 5;
+    image.palettes.push_back(std::vector<NPKColor>(4));
+    image.dds.push_back(randomDDS(DDS_FXT5, width, height, 0, rng));
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        image.frames.push_back(ddsFrame(DDS_FXT5, 0, i * 3, i * 2, width - i, height - i * 3));
+    }
+    return image;
+}
+} // npk_test
+
+#endif //NPK_TEST_FIXTURES_H
@@ -0,0 +1,187 @@
+//
+// Created by liu86 on 24-8-12.
+//
+// 把随机的帧分批加入图集，检查帧之间不重叠、页面中的像素与裁剪后的帧一致、
+// 被裁掉的部分完全透明，以及之后加入的帧不会改动已有的帧
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "NPKAtlas.h"
+#include "NPKMatrix.h"
+
+using namespace neapu;
+
+namespace {
+// 四周带透明边的帧，部分帧完全透明或超出画布
+std::shared_ptr<NPKMatrix> makeFrame(std::mt19937& rng)
+{
+    const uint32_t width = 1 + rng() % 90;
+    const uint32_t height = 1 + rng() % 90;
+    const uint32_t offsetX = rng() % 30;
+    const uint32_t offsetY = rng() % 30;
+    const bool overflow = rng() % 10 == 0;
+    const uint32_t canvasWidth = overflow ? offsetX + 1 + rng() % width : width + offsetX + rng() % 30;
+    const uint32_t canvasHeight = overflow ? offsetY + 1 + rng() % height : height + offsetY + rng() % 30;
+    auto matrix = NPKMatrix::createMatrix(width, height, canvasWidth, canvasHeight, offsetX, offsetY);
+    if (rng() % 15 == 0) {
+        return matrix;
+    }
+
+    const uint32_t left = rng() % width;
+    const uint32_t top = rng() % height;
+    const uint32_t right = left + 1 + rng() % (width - left);
+    const uint32_t bottom = top + 1 + rng() % (height - top);
+    // setRow会裁掉超出画布的部分
+    std::vector<NPKColor> row(right - left);
+    for (uint32_t y = top; y < bottom; ++y) {
+        for (auto& color : row) {
+            color.b = static_cast<uint8_t>(rng());
+            color.g = static_cast<uint8_t>(rng());
+            color.r = static_cast<uint8_t>(rng());
+            color.a = static_cast<uint8_t>(rng() % 4 ? rng() : 0);
+        }
+        matrix->setRow(left, y, row.data(), static_cast<uint32_t>(row.size()));
+    }
+    return matrix;
+}
+
+int checkEntry(const NPKAtlasBuilder& atlas, const NPKAtlasOptions& options, const NPKFrameKey& key, const NPKMatrix& frame)
+{
+    const auto entry = atlas.find(key);
+    if (!entry) {
+        printf("frame %u missing\n", key.frame);
+        return 1;
+    }
+    if (entry->canvasWidth != frame.canvasWidth() || entry->canvasHeight != frame.canvasHeight()) {
+        printf("frame %u canvas mismatch\n", key.frame);
+        return 1;
+    }
+    const auto page = atlas.page(entry->page);
+    if (entry->width && (!page || entry->x + entry->width > options.pageWidth || entry->y + entry->height > options.pageHeight)) {
+        printf("frame %u outside page\n", key.frame);
+        return 1;
+    }
+
+    // 内容区域与页面一致，其余部分透明
+    for (uint32_t y = 0; y < frame.canvasHeight(); ++y) {
+        for (uint32_t x = 0; x < frame.canvasWidth(); ++x) {
+            const NPKColor& color = frame.data()[y * frame.canvasWidth() + x];
+            const bool inside = x >= entry->offsetX && x < entry->offsetX + entry->width && y >= entry->offsetY &&
+                                y < entry->offsetY + entry->height;
+            if (!inside) {
+                if (color.a != 0) {
+                    printf("frame %u: opaque pixel (%u, %u) trimmed\n", key.frame, x, y);
+                    return 1;
+                }
+                continue;
+            }
+            const NPKColor& packed = page->data()[(entry->y + y - entry->offsetY) * options.pageWidth + entry->x + x - entry->offsetX];
+            if (memcmp(&packed, &color, sizeof(NPKColor)) != 0) {
+                printf("frame %u: pixel (%u, %u) mismatch\n", key.frame, x, y);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int checkOverlap(const NPKAtlasBuilder& atlas, const uint32_t padding)
+{
+    std::vector<const NPKAtlasEntry*> entries;
+    for (const auto& [key, entry] : atlas.entries()) {
+        if (entry.width) {
+            entries.push_back(&entry);
+        }
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        for (size_t j = i + 1; j < entries.size(); ++j) {
+            const auto& a = *entries[i];
+            const auto& b = *entries[j];
+            if (a.page == b.page && a.x < b.x + b.width + padding && b.x < a.x + a.width + padding && a.y < b.y + b.height + padding &&
+                b.y < a.y + a.height + padding) {
+                printf("entries overlap on page %u\n", a.page);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+}
+
+int main()
+{
+    std::mt19937 rng(20240812);
+    int failed = 0;
+
+    const uint32_t paddings[] = {0, 1, 2};
+    for (const auto padding : paddings) {
+        NPKAtlasOptions options;
+        options.pageWidth = 256;
+        options.pageHeight = 200;
+        options.padding = padding;
+        options.trim = padding != 2;
+        NPKAtlasBuilder atlas(options);
+
+        std::map<uint32_t, std::shared_ptr<NPKMatrix>> frames;
+        for (uint32_t batch = 0; batch < 4; ++batch) {
+            const auto pagesBefore = atlas.pageCount();
+            for (uint32_t i = 0; i < 60; ++i) {
+                const uint32_t index = static_cast<uint32_t>(frames.size());
+                frames[index] = makeFrame(rng);
+                if (!atlas.addFrame(NPKFrameKey{1, index, 0}, *frames[index])) {
+                    printf("failed to add frame %u\n", index);
+                    failed++;
+                }
+            }
+            // 重复加入不改变位置
+            const NPKAtlasEntry before = *atlas.find(NPKFrameKey{1, 0, 0});
+            atlas.addFrame(NPKFrameKey{1, 0, 0}, *makeFrame(rng));
+            if (memcmp(&before, atlas.find(NPKFrameKey{1, 0, 0}), sizeof(NPKAtlasEntry)) != 0) {
+                printf("re-adding a frame moved it\n");
+                failed++;
+            }
+
+            // 每批之后检查所有帧，包括之前批次加入的
+            for (const auto& [index, frame] : frames) {
+                failed += checkEntry(atlas, options, NPKFrameKey{1, index, 0}, *frame);
+            }
+            failed += checkOverlap(atlas, padding);
+
+            const auto dirty = atlas.takeDirtyPages();
+            if (dirty.empty() || atlas.pageCount() < pagesBefore || !atlas.takeDirtyPages().empty()) {
+                printf("dirty pages not tracked\n");
+                failed++;
+            }
+        }
+    }
+
+    // 超出页面和页面数量上限
+    NPKAtlasOptions options;
+    options.pageWidth = 64;
+    options.pageHeight = 64;
+    options.maxPages = 1;
+    NPKAtlasBuilder atlas(options);
+    auto big = NPKMatrix::createMatrix(65, 10);
+    big->data()[0].a = 0xFF;
+    big->data()[64].a = 0xFF;
+    auto full = NPKMatrix::createMatrix(64, 64);
+    full->data()[0].a = 0xFF;
+    full->data()[64 * 64 - 1].a = 0xFF;
+    if (atlas.addFrame(NPKFrameKey{0, 0, 0}, *big) || !atlas.addFrame(NPKFrameKey{0, 1, 0}, *full) ||
+        atlas.addFrame(NPKFrameKey{0, 2, 0}, *full) || atlas.pageCount() != 1 || atlas.find(NPKFrameKey{0, 2, 0})) {
+        printf("page limits not enforced\n");
+        failed++;
+    }
+    const auto uv = atlas.uv(*atlas.find(NPKFrameKey{0, 1, 0}));
+    if (uv.u0 != 0.0f || uv.v0 != 0.0f || uv.u1 != 1.0f || uv.v1 != 1.0f) {
+        printf("uv mismatch\n");
+        failed++;
+    }
+
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
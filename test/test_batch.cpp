@@ -0,0 +1,298 @@
+//
+// Created by liu86 on 24-8-10.
+//
+// 生成包含链接帧和共享DDS图集的NPK，批量解码的结果必须与逐帧解码一致，
+// 回调不能并发执行，在线程池任务中嵌套调用decodeFrames也不能死锁；
+// 批量解码与getFrameMatrix共用帧缓存，同一画面只缓存一份
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+#include <zlib.h>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+// Image名称与"puchikon@neople dungeon and fighter "加上重复的"DNF"异或
+char nameMask(const uint32_t i)
+{
+    constexpr char PREFIX[] = "puchikon@neople dungeon and fighter ";
+    return i < sizeof(PREFIX) - 1 ? PREFIX[i] : "DNF"[(i - sizeof(PREFIX) + 1) % 3];
+}
+
+void append(std::vector<uint8_t>& out, const void* data, const size_t len)
+{
+    out.insert(out.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + len);
+}
+
+void appendU32(std::vector<uint8_t>& out, std::initializer_list<uint32_t> values)
+{
+    for (const auto value : values) {
+        append(out, &value, sizeof(value));
+    }
+}
+
+std::vector<uint8_t> compressData(const std::vector<uint8_t>& data)
+{
+    uLongf len = compressBound(static_cast<uLong>(data.size()));
+    std::vector<uint8_t> out(len);
+    compress(out.data(), &len, data.data(), static_cast<uLong>(data.size()));
+    out.resize(len);
+    return out;
+}
+
+std::vector<uint8_t> imageHeader(const uint32_t indexSize, const uint32_t version, const uint32_t frameCount)
+{
+    std::vector<uint8_t> out;
+    append(out, "Neople Img File", 16);
+    appendU32(out, {indexSize, 0, version, frameCount});
+    return out;
+}
+
+// V2：ARGB8888帧，第2、5帧链接到前面的帧，第4帧链接到链接帧
+std::vector<uint8_t> makeV2(std::mt19937& rng)
+{
+    std::vector<uint8_t> index;
+    std::vector<uint8_t> data;
+    const uint32_t links[] = {0xFFFFFFFF, 0xFFFFFFFF, 0, 0xFFFFFFFF, 2, 3, 0xFFFFFFFF};
+    for (const auto link : links) {
+        if (link != 0xFFFFFFFF) {
+            appendU32(index, {0x11, link});
+            continue;
+        }
+        const uint32_t w = 1 + rng() % 48;
+        const uint32_t h = 1 + rng() % 48;
+        std::vector<uint8_t> raw(w * h * 4);
+        for (auto& byte : raw) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        const auto payload = compressData(raw);
+        const uint32_t x = rng() % 8;
+        const uint32_t y = rng() % 8;
+        appendU32(index, {0x10, 6, w, h, static_cast<uint32_t>(payload.size()), x, y, w + x + 2, h + y + 2});
+        append(data, payload.data(), payload.size());
+    }
+    auto out = imageHeader(static_cast<uint32_t>(index.size()), 2, static_cast<uint32_t>(std::size(links)));
+    append(out, index.data(), index.size());
+    append(out, data.data(), data.size());
+    return out;
+}
+
+// V5：两个图集，每个图集上有多个帧，另有一个链接帧
+std::vector<uint8_t> makeV5(std::mt19937& rng)
+{
+    typedef struct Atlas {
+        uint32_t format;
+        DDSPixelDTXFormat fourCC;
+        uint32_t width;
+        uint32_t height;
+    } Atlas;
+    const Atlas atlases[] = {{0x14, DXT5, 128, 64}, {0x12, DXT1, 64, 32}};
+
+    std::vector<uint8_t> ddsIndex;
+    std::vector<uint8_t> ddsData;
+    for (uint32_t i = 0; i < std::size(atlases); ++i) {
+        const auto& atlas = atlases[i];
+        const auto raw = npk_test::ddsData(atlas.width, atlas.height, atlas.fourCC, rng);
+        const auto payload = compressData(raw);
+        appendU32(ddsIndex, {1, atlas.format, i, static_cast<uint32_t>(payload.size()), static_cast<uint32_t>(raw.size()), atlas.width,
+                             atlas.height});
+        append(ddsData, payload.data(), payload.size());
+    }
+
+    std::vector<uint8_t> index;
+    const uint32_t frameAtlas[] = {0, 0, 1, 0, 1, 0xFFFFFFFF, 0};
+    for (const auto k : frameAtlas) {
+        if (k == 0xFFFFFFFF) {
+            appendU32(index, {0x11, 1});
+            continue;
+        }
+        const auto& atlas = atlases[k];
+        const uint32_t l = rng() % (atlas.width / 2);
+        const uint32_t t = rng() % (atlas.height / 2);
+        const uint32_t r = l + 1 + rng() % (atlas.width - l);
+        const uint32_t b = t + 1 + rng() % (atlas.height - t);
+        appendU32(index, {atlas.format, 6, r - l, b - t, 0, 0, 0, r - l, b - t, 0, k, l, t, r, b, 0});
+    }
+
+    auto out = imageHeader(static_cast<uint32_t>(index.size()), 5, static_cast<uint32_t>(std::size(frameAtlas)));
+    appendU32(out, {static_cast<uint32_t>(std::size(atlases)), 0, 0});
+    append(out, ddsIndex.data(), ddsIndex.size());
+    append(out, index.data(), index.size());
+    append(out, ddsData.data(), ddsData.size());
+    return out;
+}
+
+bool writeNPK(const std::string& path, const std::vector<std::vector<uint8_t>>& images)
+{
+    NPKHeader header{};
+    memcpy(header.magic, "NeoplePack_Bill", 16);
+    header.imgCount = static_cast<uint32_t>(images.size());
+
+    std::vector<uint8_t> out;
+    append(out, &header, sizeof(header));
+    uint32_t offset = static_cast<uint32_t>(sizeof(header) + images.size() * sizeof(NPKImageIndex) + 32);
+    for (uint32_t i = 0; i < images.size(); ++i) {
+        NPKImageIndex index{};
+        index.offset = offset;
+        index.size = static_cast<uint32_t>(images[i].size());
+        snprintf(index.name, sizeof(index.name), "sprite/test/%u.img", i);
+        for (uint32_t j = 0; j < sizeof(index.name); ++j) {
+            index.name[j] ^= nameMask(j);
+        }
+        append(out, &index, sizeof(index));
+        offset += index.size;
+    }
+    uint8_t digest[32]{};
+    if (!NPKHandler::sha256(out.data(), out.size() / 17 * 17, digest, sizeof(digest))) {
+        return false;
+    }
+    append(out, digest, sizeof(digest));
+    for (const auto& image : images) {
+        append(out, image.data(), image.size());
+    }
+
+    return npk_test::writeFile(path, out);
+}
+
+bool sameMatrix(const std::shared_ptr<NPKMatrix>& a, const std::shared_ptr<NPKMatrix>& b)
+{
+    if (!a || !b) {
+        return !a && !b;
+    }
+    if (a->width() != b->width() || a->height() != b->height() || a->canvasWidth() != b->canvasWidth() ||
+        a->canvasHeight() != b->canvasHeight()) {
+        return false;
+    }
+    return memcmp(a->data(), b->data(), static_cast<size_t>(a->canvasWidth()) * a->canvasHeight() * sizeof(NPKColor)) == 0;
+}
+
+int checkBatch(const char* name, const NPKHandler& npk, const std::vector<NPKFrameKey>& keys,
+               const std::vector<std::shared_ptr<NPKMatrix>>& expected, const std::shared_ptr<NPKThreadPool>& pool)
+{
+    int failed = 0;
+    std::vector<std::shared_ptr<NPKMatrix>> actual(keys.size());
+    std::vector<uint32_t> calls(keys.size(), 0);
+    std::atomic<bool> inCallback{false};
+    bool overlapped = false;
+    const auto succeeded = npk.decodeFrames(keys, [&](const NPKFrameKey& key, const std::shared_ptr<NPKMatrix>& matrix) {
+        if (inCallback.exchange(true)) {
+            overlapped = true;
+        }
+        for (uint32_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] == key && calls[i] == 0) {
+                actual[i] = matrix;
+                calls[i]++;
+                break;
+            }
+        }
+        inCallback = false;
+    }, pool);
+
+    uint32_t expectedSucceeded = 0;
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+        expectedSucceeded += expected[i] ? 1 : 0;
+        if (calls[i] != 1 || !sameMatrix(actual[i], expected[i])) {
+            printf("%s: frame %u/%u mismatch\n", name, keys[i].image, keys[i].frame);
+            failed++;
+        }
+    }
+    if (overlapped) {
+        printf("%s: callbacks overlapped\n", name);
+        failed++;
+    }
+    if (succeeded != expectedSucceeded) {
+        printf("%s: %u succeeded, expected %u\n", name, succeeded, expectedSucceeded);
+        failed++;
+    }
+
+    auto futures = npk.decodeFramesAsync(keys, pool);
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+        if (!sameMatrix(futures[i].get(), expected[i])) {
+            printf("%s: async frame %u/%u mismatch\n", name, keys[i].image, keys[i].frame);
+            failed++;
+        }
+    }
+    return failed;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    std::mt19937 rng(20240810);
+    const auto path = (std::filesystem::temp_directory_path() / "npk_test_batch.npk").string();
+    if (!writeNPK(path, {makeV2(rng), makeV5(rng), makeV2(rng)})) {
+        printf("failed to write %s\n", path.c_str());
+        return 1;
+    }
+
+    int failed = 0;
+    const DDSCachePolicy policies[] = {DCP_NONE, DCP_PIN, DCP_LRU};
+    for (const auto policy : policies) {
+        NPKLoadOptions options;
+        options.ddsCachePolicy = policy;
+        NPKHandler npk;
+        if (!npk.loadNPK(path, options)) {
+            printf("failed to load %s\n", path.c_str());
+            return 1;
+        }
+
+        // 重复的请求和无效的请求也要各自回调一次
+        auto keys = npk.frameKeys(0, npk.getImageCount());
+        keys.push_back(keys.front());
+        keys.push_back(NPKFrameKey{1, 100, 0});
+        keys.push_back(NPKFrameKey{100, 0, 0});
+        std::vector<std::shared_ptr<NPKMatrix>> expected;
+        for (const auto& key : keys) {
+            const auto image = npk.getImage(key.image);
+            expected.push_back(image ? image->getFrameMatrix(key.frame, key.palette) : nullptr);
+        }
+
+        const auto pool = std::make_shared<NPKThreadPool>(4);
+        failed += checkBatch("pool", npk, keys, expected, pool);
+        failed += checkBatch("single", npk, keys, expected, std::make_shared<NPKThreadPool>(1));
+
+        npk.setFrameCache(64 << 20);
+        failed += checkBatch("cached", npk, keys, expected, pool);
+        failed += checkBatch("cache hit", npk, keys, expected, pool);
+
+        // 逐帧获取与批量解码使用相同的缓存键，链接帧与目标帧、没有调色板的帧在不同调色板下都只缓存一份
+        npk.setFrameCache(64 << 20);
+        for (const auto& key : keys) {
+            npk.getFrameMatrix(key.image, key.frame, key.palette + 3);
+        }
+        const auto single = npk.getFrameCacheStats();
+        failed += checkBatch("shared key", npk, keys, expected, pool);
+        bool reused = true;
+        for (uint32_t i = 0; i < keys.size(); ++i) {
+            reused = reused && sameMatrix(npk.getFrameMatrix(keys[i].image, keys[i].frame, 7), expected[i]);
+        }
+        const auto shared = npk.getFrameCacheStats();
+        if (!reused || shared.misses != single.misses || shared.entries != single.entries || shared.entries >= keys.size() - 3) {
+            printf("shared key: frames cached twice [misses:%llu/%llu][entries:%llu/%llu]\n", static_cast<unsigned long long>(shared.misses),
+                   static_cast<unsigned long long>(single.misses), static_cast<unsigned long long>(shared.entries),
+                   static_cast<unsigned long long>(single.entries));
+            failed++;
+        }
+        npk.setFrameCache(0);
+
+        // 在线程池的任务中嵌套批量解码
+        std::promise<int> nested;
+        pool->submit([&]() { nested.set_value(checkBatch("nested", npk, keys, expected, pool)); });
+        failed += nested.get_future().get();
+    }
+    std::filesystem::remove(path);
+
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+//
+// Created by liu86 on 24-8-18.
+//
+// 批量加载的结果与逐个加载一致，失败的文件不影响其他文件并给出原因，按文件大小从大到小开始，
+// 回调串行执行且进度递增，取消后不再开始新的文件，在线程池任务中调用也不能死锁
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+// 第i个NPK有(i * 7) % 11 + 1个Image，每个Image的帧数不同，文件大小各不相同
+bool writePack(const std::string& path, const uint32_t i)
+{
+    NPKWriter writer;
+    const uint32_t imageCount = (i * 7) % 11 + 1;
+    for (uint32_t image = 0; image < imageCount; ++image) {
+        NPKWriteImage write;
+        write.name = "sprite/pack" + std::to_string(i) + "/" + std::to_string(image) + ".img";
+        auto matrix = NPKMatrix::createMatrix(8 + image, 8 + i);
+        matrix->data()[0].a = 0xFF;
+        write.frames.push_back(NPKWriter::matrixFrame(*matrix, CL_ARGB8888, CP_NONE));
+        writer.addImage(write);
+    }
+    return writer.save(path);
+}
+
+int checkResult(const NPKBulkResult& result, const std::string& path)
+{
+    NPKHandler expected;
+    const bool loaded = expected.loadNPK(path);
+    if (result.path != path || (result.status == BLS_LOADED) != loaded || (result.handler != nullptr) != loaded ||
+        result.error != expected.getLoadError()) {
+        printf("%s: status mismatch\n", path.c_str());
+        return 1;
+    }
+    if (!loaded) {
+        return 0;
+    }
+    if (result.handler->getImageCount() != expected.getImageCount() || result.fileSize != std::filesystem::file_size(path)) {
+        printf("%s: content mismatch\n", path.c_str());
+        return 1;
+    }
+    for (uint32_t i = 0; i < expected.getImageCount(); ++i) {
+        if (result.handler->getImage(i)->getName() != expected.getImage(i)->getName() ||
+            result.handler->getImage(i)->getFrameWidth(0) != expected.getImage(i)->getFrameWidth(0)) {
+            printf("%s: image %u mismatch\n", path.c_str(), i);
+            return 1;
+        }
+    }
+    return 0;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    int failed = 0;
+    const auto directory = std::filesystem::temp_directory_path() / "npk_test_bulk";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    std::vector<std::string> paths;
+    for (uint32_t i = 0; i < 24; ++i) {
+        paths.push_back((directory / (std::to_string(i) + ".npk")).string());
+        if (!writePack(paths.back(), i)) {
+            printf("failed to write %s\n", paths.back().c_str());
+            return 1;
+        }
+    }
+    // 损坏和不存在的文件
+    paths.insert(paths.begin() + 5, (directory / "missing.npk").string());
+    paths.insert(paths.begin() + 9, (directory / "broken.npk").string());
+    FILE* file = fopen(paths[9].c_str(), "wb");
+    fputs("not a npk", file);
+    fclose(file);
+    // 索引表超出文件范围
+    paths.push_back((directory / "truncated.npk").string());
+    NPKHeader header{};
+    memcpy(header.magic, "NeoplePack_Bill", sizeof("NeoplePack_Bill"));
+    header.imgCount = 1000;
+    file = fopen(paths.back().c_str(), "wb");
+    fwrite(&header, sizeof(header), 1, file);
+    fclose(file);
+    // 索引表之后的SHA256被改动，使用只有一个Image的小文件，不影响下面按大小取消的数量
+    paths.push_back((directory / "badhash.npk").string());
+    std::filesystem::copy_file(paths[0], paths.back());
+    file = fopen(paths.back().c_str(), "r+b");
+    fseek(file, sizeof(NPKHeader) + sizeof(NPKImageIndex), SEEK_SET);
+    fputc(0xFF, file);
+    fclose(file);
+    const std::pair<uint32_t, LoadError> failures[] = {{5, LE_OPEN}, {9, LE_HEADER}, {static_cast<uint32_t>(paths.size() - 2), LE_INDEX},
+                                                       {static_cast<uint32_t>(paths.size() - 1), LE_VERIFY}};
+
+    const auto pool = std::make_shared<NPKThreadPool>(3);
+    for (const uint32_t concurrency : {0u, 1u, 2u, 64u}) {
+        std::atomic<int> inCallback{0};
+        std::vector<uint32_t> reported;
+        uint32_t lastFinished = 0;
+        NPKBulkOptions bulkOptions;
+        bulkOptions.pool = pool;
+        bulkOptions.maxConcurrency = concurrency;
+        bulkOptions.callback = [&](const uint32_t index, const NPKBulkResult& result, const uint32_t finished, const uint32_t total) {
+            if (inCallback.fetch_add(1) != 0 || finished != lastFinished + 1 || total != paths.size() || result.status == BLS_CANCELLED) {
+                printf("bad callback for %u\n", index);
+                failed++;
+            }
+            lastFinished = finished;
+            reported.push_back(index);
+            inCallback.fetch_sub(1);
+        };
+        const auto results = NPKHandler::loadNPKs(paths, {}, bulkOptions);
+        if (results.size() != paths.size() || reported.size() != paths.size()) {
+            printf("concurrency %u: missing results\n", concurrency);
+            failed++;
+            continue;
+        }
+        for (uint32_t i = 0; i < paths.size(); ++i) {
+            failed += checkResult(results[i], paths[i]);
+        }
+        for (const auto& [index, error] : failures) {
+            if (results[index].status != BLS_FAILED || results[index].error != error) {
+                printf("%s: error %u, expected %u\n", paths[index].c_str(), results[index].error, error);
+                failed++;
+            }
+        }
+        // 只有一个工作者时按文件大小从大到小加载，不存在的文件最后
+        if (concurrency == 1) {
+            for (uint32_t i = 1; i < reported.size(); ++i) {
+                if (results[reported[i - 1]].fileSize < results[reported[i]].fileSize) {
+                    printf("not loaded largest first\n");
+                    failed++;
+                    break;
+                }
+            }
+            if (reported.back() != 5) {
+                printf("missing file not loaded last\n");
+                failed++;
+            }
+        }
+    }
+
+    // 在回调中取消，只有一个工作者时正好加载3个
+    std::atomic<bool> cancel{false};
+    NPKBulkOptions bulkOptions;
+    bulkOptions.pool = pool;
+    bulkOptions.maxConcurrency = 1;
+    bulkOptions.cancel = &cancel;
+    bulkOptions.callback = [&cancel](uint32_t, const NPKBulkResult&, const uint32_t finished, uint32_t) {
+        if (finished == 3) {
+            cancel = true;
+        }
+    };
+    auto results = NPKHandler::loadNPKs(paths, {}, bulkOptions);
+    uint32_t loaded = 0;
+    uint32_t cancelled = 0;
+    for (const auto& result : results) {
+        loaded += result.status == BLS_LOADED;
+        cancelled += result.status == BLS_CANCELLED && !result.handler;
+    }
+    if (loaded != 3 || cancelled != paths.size() - 3) {
+        printf("cancel mismatch: %u loaded, %u cancelled\n", loaded, cancelled);
+        failed++;
+    }
+    // 开始前已经取消
+    results = NPKHandler::loadNPKs(paths, {}, bulkOptions);
+    if (results.size() != paths.size() || results[0].status != BLS_CANCELLED) {
+        printf("cancelled batch loaded\n");
+        failed++;
+    }
+
+    // 只有一个工作线程时在它的任务中嵌套调用
+    const auto single = std::make_shared<NPKThreadPool>(1);
+    std::atomic<uint32_t> nested{0};
+    std::atomic<bool> done{false};
+    single->submit([&] {
+        NPKBulkOptions nestedOptions;
+        nestedOptions.pool = single;
+        NPKLoadOptions options;
+        options.lazyLoad = true;
+        for (const auto& result : NPKHandler::loadNPKs(paths, options, nestedOptions)) {
+            nested += result.status == BLS_LOADED;
+        }
+        done = true;
+    });
+    while (!done) {
+        single->runPendingTask();
+    }
+    if (nested != paths.size() - std::size(failures) || !NPKHandler::loadNPKs({}).empty()) {
+        printf("nested load mismatch: %u\n", nested.load());
+        failed++;
+    }
+
+    std::filesystem::remove_all(directory);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+//
+// Created by liu86 on 24-8-19.
+//
+// 多个线程以不同顺序同时读取同一个NPKHandler，包括延迟加载的首次解析、DDS图集缓存、帧缓存和PNG编码，
+// 同时切换解压后端和DDS缓存策略，所有结果必须与单线程读取的结果一致
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "NPKDecompressor.h"
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+constexpr uint32_t THREAD_COUNT = 8;
+
+std::shared_ptr<NPKMatrix> randomMatrix(std::mt19937& rng)
+{
+    const uint32_t width = 1 + rng() % 48;
+    const uint32_t height = 1 + rng() % 48;
+    auto matrix = NPKMatrix::createMatrix(width, height, width + rng() % 8, height + rng() % 8);
+    for (uint32_t i = 0; i < width * height; ++i) {
+        matrix->data()[i] = NPKColor{static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()),
+                                     static_cast<uint8_t>(rng())};
+    }
+    return matrix;
+}
+
+// 每个版本各若干个Image，包括链接帧
+NPKWriter makeWriter(std::mt19937& rng)
+{
+    NPKWriter writer;
+    const ColorType colorTypes[] = {CL_ARGB8888, CL_ARGB4444, CL_ARGB1555, CL_RGB565};
+    for (uint32_t i = 0; i < 24; ++i) {
+        NPKWriteImage image;
+        image.name = "sprite/concurrency/" + std::to_string(i) + ".img";
+        image.version = i % 4 == 0 ? 2 : i % 4 == 1 ? 4 : i % 4 == 2 ? 5 : 6;
+        if (image.version != 2) {
+            image.palettes.push_back(npk_test::randomPalette(40, rng));
+        }
+        if (image.version == 6) {
+            image.palettes.push_back(npk_test::randomPalette(200, rng));
+        }
+        if (image.version == 5) {
+            image.dds.push_back(npk_test::randomDDS(DDS_FXT5, 128, 64, 0, rng));
+            image.dds.push_back(npk_test::randomDDS(DDS_FXT5, 64, 64, 1, rng));
+        }
+        for (uint32_t frame = 0; frame < 10; ++frame) {
+            if (image.version == 2) {
+                image.frames.push_back(NPKWriter::matrixFrame(*randomMatrix(rng), colorTypes[frame % 4], frame % 3 ? CP_ZLIB : CP_NONE));
+            } else if (image.version == 5) {
+                image.frames.push_back(npk_test::ddsFrame(image.dds[frame % 2], rng));
+            } else {
+                image.frames.push_back(npk_test::indexedFrame(40, rng() % 2 ? CP_ZLIB : CP_NONE, rng, 48, 0));
+            }
+        }
+        image.frames.push_back(NPKWriter::linkFrame(3));
+        writer.addImage(image);
+    }
+    return writer;
+}
+
+typedef struct Request {
+    uint32_t image;
+    uint32_t frame;
+    int palette;
+} Request;
+
+typedef struct Expected {
+    std::shared_ptr<NPKMatrix> matrix;
+    std::vector<uint8_t> png;
+} Expected;
+
+bool sameMatrix(const std::shared_ptr<NPKMatrix>& a, const std::shared_ptr<NPKMatrix>& b)
+{
+    if (!a || !b) {
+        return !a && !b;
+    }
+    return a->width() == b->width() && a->height() == b->height() && a->canvasWidth() == b->canvasWidth() &&
+           a->canvasHeight() == b->canvasHeight() &&
+           memcmp(a->data(), b->data(), static_cast<size_t>(a->canvasWidth()) * a->canvasHeight() * sizeof(NPKColor)) == 0;
+}
+
+// 每个线程按自己的顺序读取全部请求，每个请求随机使用不同的接口
+uint32_t readAll(const NPKHandler& npk, const std::vector<Request>& requests, const std::vector<Expected>& expected,
+                 const std::vector<std::vector<std::vector<NPKColor>>>& palettes, const uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> order(requests.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+
+    uint32_t failed = 0;
+    for (const auto i : order) {
+        const auto& request = requests[i];
+        const auto image = rng() % 2 ? npk.getImage(request.image) : npk.getImage("sprite/concurrency/" + std::to_string(request.image) + ".img");
+        if (!image) {
+            failed++;
+            continue;
+        }
+        switch (rng() % 4) {
+        case 0: failed += !sameMatrix(npk.getFrameMatrix(request.image, request.frame, request.palette), expected[i].matrix);
+            break;
+        case 1: failed += !sameMatrix(image->getFrameMatrix(request.frame, request.palette), expected[i].matrix);
+            break;
+        case 2: failed += image->getFramePngData(request.frame, request.palette) != expected[i].png;
+            break;
+        default: {
+            const auto colors = image->getPaletteColors(request.palette);
+            const auto& palette = palettes[request.image][request.palette];
+            failed += colors.size() != palette.size() ||
+                      (!colors.empty() && memcmp(colors.data(), palette.data(), colors.size() * sizeof(NPKColor)) != 0);
+            break;
+        }
+        }
+    }
+    return failed;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    std::mt19937 rng(20240819);
+    const auto path = (std::filesystem::temp_directory_path() / "npk_test_concurrency.npk").string();
+    if (!makeWriter(rng).save(path)) {
+        printf("failed to save %s\n", path.c_str());
+        return 1;
+    }
+
+    // 单线程读取的结果
+    NPKHandler reference;
+    if (!reference.loadNPK(path)) {
+        printf("failed to load %s\n", path.c_str());
+        return 1;
+    }
+    std::vector<Request> requests;
+    std::vector<Expected> expected;
+    std::vector<std::vector<std::vector<NPKColor>>> palettes(reference.getImageCount());
+    for (uint32_t i = 0; i < reference.getImageCount(); ++i) {
+        const auto image = reference.getImage(i);
+        for (int palette = 0; palette < std::max(image->getPalletCount(), 1); ++palette) {
+            palettes[i].push_back(image->getPaletteColors(palette));
+            for (uint32_t frame = 0; frame < image->getFrameCount(); ++frame) {
+                requests.push_back(Request{i, frame, palette});
+                expected.push_back(Expected{image->getFrameMatrix(frame, palette), image->getFramePngData(frame, palette)});
+            }
+        }
+    }
+
+    int failed = 0;
+    const DDSCachePolicy ddsPolicies[] = {DCP_NONE, DCP_WEAK, DCP_LRU, DCP_PIN};
+    for (uint32_t mode = 0; mode < 8; ++mode) {
+        NPKLoadOptions options;
+        options.useMmap = mode & 1;
+        options.lazyLoad = mode & 2;
+        options.ddsCachePolicy = ddsPolicies[mode % 4];
+        NPKHandler npk;
+        if (!npk.loadNPK(path, options)) {
+            printf("mode %u: failed to load\n", mode);
+            failed++;
+            continue;
+        }
+        if (mode & 4) {
+            npk.setFrameCache(256 * 1024);
+        }
+
+        // 读取的同时切换解压后端和DDS缓存策略，这两者允许与解码同时进行
+        std::atomic<uint32_t> errors{0};
+        std::atomic<bool> stop{false};
+        std::thread toggler([&npk, &stop, &ddsPolicies] {
+            for (uint32_t i = 0; !stop; ++i) {
+                setDecompressor(i % 2 ? DB_FAST : DB_ZLIB);
+                if (const auto image = npk.getImage(2 + 4 * (i % 6))) {
+                    image->setDDSCachePolicy(ddsPolicies[i % 4], 1 + i % 2);
+                }
+                std::this_thread::yield();
+            }
+        });
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < THREAD_COUNT; ++t) {
+            threads.emplace_back([&, t] { errors += readAll(npk, requests, expected, palettes, mode * THREAD_COUNT + t); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        stop = true;
+        toggler.join();
+        setDecompressor(nullptr);
+
+        if (errors) {
+            printf("mode %u: %u mismatches\n", mode, errors.load());
+            failed++;
+        }
+        // 重新加载不影响已获取的Image，Image 5的第一个请求是帧0、调色板0
+        const auto held = npk.getImage(5);
+        const auto first = std::find_if(requests.begin(), requests.end(), [](const Request& request) { return request.image == 5; });
+        npk.loadNPK(path, options);
+        if (!held || !sameMatrix(held->getFrameMatrix(0, 0), expected[first - requests.begin()].matrix)) {
+            printf("mode %u: image invalid after reload\n", mode);
+            failed++;
+        }
+    }
+
+    std::filesystem::remove(path);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+//
+// Created by liu86 on 24-8-23.
+//
+// 不解码取出的DXT块与图集中的原始块一致，不足一块的部分用透明块补齐；
+// 帧导出的.dds重新打包为V5后解码结果与原帧相同
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "NPKDDSHandler.h"
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+typedef struct Atlas {
+    DDSFormat format;
+    DDSPixelDTXFormat fourCC;
+    uint32_t blockSize;
+    uint32_t width;
+    uint32_t height;
+} Atlas;
+
+constexpr uint32_t DDS_HEADER_SIZE = 128;
+
+bool writeNPK(const NPKWriteImage& image, const std::string& path)
+{
+    NPKWriter writer;
+    writer.addImage(image);
+    return npk_test::writeFile(path, writer.serialize());
+}
+
+bool sameMatrix(const std::shared_ptr<NPKMatrix>& a, const std::shared_ptr<NPKMatrix>& b)
+{
+    if (!a || !b) {
+        return false;
+    }
+    return a->canvasWidth() == b->canvasWidth() && a->canvasHeight() == b->canvasHeight() &&
+           memcmp(a->data(), b->data(), static_cast<size_t>(a->canvasWidth()) * a->canvasHeight() * sizeof(NPKColor)) == 0;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    int failed = 0;
+    auto check = [&failed](const bool ok, const char* message, const uint32_t index) {
+        if (!ok) {
+            printf("%s [%u]\n", message, index);
+            failed++;
+        }
+    };
+
+    // 宽高不是4的倍数的图集最后不足一块的像素没有对应的块
+    const Atlas atlases[] = {{DDS_FXT1, DXT1, 8, 30, 30}, {DDS_FXT3, DXT3, 16, 32, 32}, {DDS_FXT5, DXT5, 16, 30, 26}};
+    std::mt19937 rng(20240823);
+    NPKWriteImage image;
+    image.name = "sprite/test/v5.img";
+    image.version = 5;
+    image.palettes.push_back(std::vector<NPKColor>(4));
+    for (uint32_t d = 0; d < 3; ++d) {
+        const Atlas& atlas = atlases[d];
+        NPKWriteDDS dds;
+        dds.index.unknown1 = 1;
+        dds.index.format = atlas.format;
+        dds.index.width = atlas.width;
+        dds.index.height = atlas.height;
+        dds.data = npk_test::ddsData(atlas.width, atlas.height, atlas.fourCC, rng);
+        image.dds.push_back(dds);
+        image.frames.push_back(npk_test::ddsFrame(atlas.format, d, 0, 0, atlas.width, atlas.height));
+        image.frames.push_back(npk_test::ddsFrame(atlas.format, d, 4, 8, 20, 16));
+        image.frames.push_back(npk_test::ddsFrame(atlas.format, d, 3, 5, 17, 11));
+        image.frames.push_back(npk_test::ddsFrame(atlas.format, d, atlas.width - 7, atlas.height - 6, atlas.width, atlas.height));
+        image.frames.push_back(npk_test::ddsFrame(atlas.format, d, 9, 1, 10, 2));
+    }
+    image.frames.push_back(NPKWriter::linkFrame(2));
+
+    const auto path = npk_test::tempPath("npk_test_dds_blocks.npk");
+    const auto repackPath = npk_test::tempPath("npk_test_dds_blocks_repack.npk");
+    NPKHandler npk;
+    if (!writeNPK(image, path) || !npk.loadNPK(path)) {
+        printf("FAILED, load\n");
+        return 1;
+    }
+    const auto loaded = npk.getImage(0);
+
+    // 完整图集的块与原始数据逐块相同
+    for (uint32_t d = 0; d < 3; ++d) {
+        const Atlas& atlas = atlases[d];
+        NPKDXTBlocks blocks;
+        check(loaded->getDDSBlocks(d, blocks), "atlas extract failed", d);
+        check(blocks.format == atlas.fourCC && blocks.blockSize == atlas.blockSize && blocks.blockColumns == (atlas.width + 3) / 4 &&
+              blocks.blockRows == (atlas.height + 3) / 4 && blocks.offsetX == 0 && blocks.offsetY == 0 &&
+              blocks.data.size() == static_cast<uint64_t>(blocks.blockColumns) * blocks.blockRows * blocks.blockSize, "atlas layout mismatch", d);
+        const uint32_t sourceRow = atlas.width / 4 * atlas.blockSize;
+        for (uint32_t y = 0; y < atlas.height / 4 && blocks.data.size() >= (y + 1) * sourceRow; ++y) {
+            check(memcmp(blocks.data.data() + y * blocks.blockColumns * blocks.blockSize,
+                         image.dds[d].data.data() + DDS_HEADER_SIZE + y * sourceRow, sourceRow) == 0, "atlas block mismatch", d);
+        }
+    }
+    NPKDXTBlocks invalid;
+    check(!loaded->getDDSBlocks(3, invalid) && invalid.data.empty(), "invalid atlas accepted", 3);
+
+    // 每帧导出的.dds作为新的图集，帧在块中的偏移作为裁剪区域，解码结果应与原帧相同
+    NPKWriteImage repack;
+    repack.name = "sprite/test/repack.img";
+    repack.version = 5;
+    repack.palettes.push_back(std::vector<NPKColor>(4));
+    for (uint32_t j = 0; j < loaded->getFrameCount(); ++j) {
+        NPKDXTBlocks blocks;
+        check(loaded->getFrameDDSBlocks(j, blocks), "frame extract failed", j);
+        const auto dds = loaded->getFrameDDSData(j);
+        check(dds.size() == DDS_HEADER_SIZE + blocks.data.size() &&
+              memcmp(dds.data() + DDS_HEADER_SIZE, blocks.data.data(), blocks.data.size()) == 0, "dds data mismatch", j);
+        NPKDDSHeader header{};
+        memcpy(&header, dds.data(), std::min<size_t>(sizeof(header), dds.size()));
+        check(header.width == blocks.blockColumns * 4 && header.height == blocks.blockRows * 4 &&
+              header.pitchOrLinearSize == blocks.data.size() && header.pixelFormat.fourCC == blocks.format, "dds header mismatch", j);
+
+        const auto width = static_cast<uint32_t>(loaded->getFrameWidth(j));
+        const auto height = static_cast<uint32_t>(loaded->getFrameHeight(j));
+        const DDSFormat format = static_cast<DDSFormat>(loaded->getFrameColorType(j));
+        NPKWriteDDS atlas;
+        atlas.index.unknown1 = 1;
+        atlas.index.format = format;
+        atlas.index.width = header.width;
+        atlas.index.height = header.height;
+        atlas.data = dds;
+        repack.dds.push_back(atlas);
+        repack.frames.push_back(npk_test::ddsFrame(format, j, blocks.offsetX, blocks.offsetY, blocks.offsetX + width, blocks.offsetY + height));
+    }
+    NPKHandler repacked;
+    if (!writeNPK(repack, repackPath) || !repacked.loadNPK(repackPath)) {
+        printf("FAILED, load repack\n");
+        return 1;
+    }
+    for (uint32_t j = 0; j < loaded->getFrameCount(); ++j) {
+        check(sameMatrix(loaded->getFrameMatrix(j), repacked.getImage(0)->getFrameMatrix(j)), "repacked decode mismatch", j);
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(repackPath);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,213 @@
+//
+// Created by liu86 on 24-8-4.
+//
+// 各种缓存策略下图集的解码次数：DCP_NONE每次都解码，DCP_PIN只解码一次，DCP_LRU按容量淘汰最久未使用的，
+// DCP_WEAK在外部仍持有时复用；缓存中有图集时切换策略，保留的图集与新策略一致；多个线程同时请求同一个图集只解码一次
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "NPKDDSCache.h"
+#include "NPKMatrix.h"
+
+using namespace neapu;
+
+namespace {
+constexpr uint32_t DDS_COUNT = 4;
+constexpr uint32_t THREAD_COUNT = 8;
+
+// 统计每个图集的解码次数
+typedef struct CountingDecoder {
+    std::atomic<uint32_t> calls[DDS_COUNT]{};
+
+    NPKDDSCache::Decoder operator()(const uint32_t ddsIndex)
+    {
+        return [this, ddsIndex] {
+            ++calls[ddsIndex];
+            return NPKMatrix::createMatrix(4, 4);
+        };
+    }
+
+    uint32_t total() const
+    {
+        uint32_t sum = 0;
+        for (const auto& count : calls) {
+            sum += count;
+        }
+        return sum;
+    }
+} CountingDecoder;
+
+uint32_t cachedCount(NPKDDSCache& cache)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < DDS_COUNT; ++i) {
+        count += cache.find(i) != nullptr;
+    }
+    return count;
+}
+}
+
+int main()
+{
+    int failed = 0;
+    auto check = [&failed](const bool ok, const char* message) {
+        if (!ok) {
+            printf("%s\n", message);
+            failed++;
+        }
+    };
+
+    // 不缓存：每次都解码，find总是为空
+    {
+        NPKDDSCache cache;
+        cache.reset(DDS_COUNT);
+        CountingDecoder decoder;
+        for (uint32_t i = 0; i < 3; ++i) {
+            check(cache.get(0, decoder(0)) != nullptr, "none: decode failed");
+        }
+        check(decoder.calls[0] == 3 && cache.find(0) == nullptr, "none: cached");
+    }
+
+    // 一直保留：每个图集只解码一次，返回同一个对象
+    {
+        NPKDDSCache cache;
+        cache.reset(DDS_COUNT);
+        cache.setPolicy(DCP_PIN);
+        CountingDecoder decoder;
+        const auto first = cache.get(1, decoder(1));
+        for (uint32_t i = 0; i < 3; ++i) {
+            check(cache.get(1, decoder(1)) == first, "pin: different atlas");
+        }
+        check(decoder.calls[1] == 1 && cache.find(1) == first, "pin: decoded more than once");
+        // 解码失败不缓存
+        check(cache.get(2, [] { return std::shared_ptr<NPKMatrix>(); }) == nullptr && cache.find(2) == nullptr, "pin: failure cached");
+        // 超出DDS数量时直接解码
+        check(cache.get(DDS_COUNT, decoder(0)) != nullptr && decoder.calls[0] == 1 && cache.find(DDS_COUNT) == nullptr,
+              "pin: out of range cached");
+        cache.reset(DDS_COUNT);
+        check(cache.find(1) == nullptr && cache.policy() == DCP_PIN, "pin: reset kept atlas");
+    }
+
+    // 最近使用：容量为2，访问过的图集移到最前，淘汰最久未使用的
+    {
+        NPKDDSCache cache;
+        cache.reset(DDS_COUNT);
+        cache.setPolicy(DCP_LRU, 2);
+        CountingDecoder decoder;
+        cache.get(0, decoder(0));
+        cache.get(1, decoder(1));
+        cache.get(0, decoder(0));
+        check(decoder.total() == 2, "lru: hit decoded");
+        cache.get(2, decoder(2));
+        check(cachedCount(cache) == 2 && cache.find(0) && cache.find(2) && !cache.find(1), "lru: wrong atlas evicted");
+        cache.get(1, decoder(1));
+        check(decoder.calls[1] == 2 && !cache.find(0), "lru: evicted atlas not decoded again");
+        // 容量为0按1处理
+        cache.setPolicy(DCP_LRU, 0);
+        check(cachedCount(cache) == 1 && cache.find(1), "lru: zero capacity");
+    }
+
+    // 弱引用：外部持有时复用，释放后重新解码
+    {
+        NPKDDSCache cache;
+        cache.reset(DDS_COUNT);
+        cache.setPolicy(DCP_WEAK);
+        CountingDecoder decoder;
+        auto held = cache.get(3, decoder(3));
+        check(cache.get(3, decoder(3)) == held && decoder.calls[3] == 1, "weak: live atlas decoded again");
+        held.reset();
+        check(cache.find(3) == nullptr, "weak: released atlas found");
+        cache.get(3, decoder(3));
+        check(decoder.calls[3] == 2, "weak: released atlas not decoded again");
+    }
+
+    // 有图集时切换策略
+    {
+        NPKDDSCache cache;
+        cache.reset(DDS_COUNT);
+        cache.setPolicy(DCP_PIN);
+        CountingDecoder decoder;
+        for (uint32_t i = 0; i < 3; ++i) {
+            cache.get(i, decoder(i));
+        }
+
+        // PIN -> LRU：保留的图集进入LRU并按新容量淘汰
+        cache.setPolicy(DCP_LRU, 1);
+        check(cachedCount(cache) == 1, "pin to lru: not trimmed");
+        uint32_t kept = 0;
+        while (!cache.find(kept)) {
+            ++kept;
+        }
+
+        // LRU -> WEAK：只有外部持有的图集可以复用
+        auto held = cache.find(kept);
+        cache.setPolicy(DCP_WEAK);
+        const uint32_t before = decoder.total();
+        check(cache.get(kept, decoder(kept)) == held && decoder.total() == before, "lru to weak: held atlas decoded again");
+        const uint32_t other = (kept + 1) % DDS_COUNT;
+        cache.get(other, decoder(other));
+        check(decoder.total() == before + 1 && cache.find(other) == nullptr, "lru to weak: unheld atlas kept");
+
+        // WEAK -> PIN：仍然存活的图集转为强引用，外部释放后仍然保留
+        cache.setPolicy(DCP_PIN);
+        const auto* pinned = held.get();
+        held.reset();
+        check(cache.find(kept).get() == pinned, "weak to pin: live atlas dropped");
+        check(cache.get(kept, decoder(kept)).get() == pinned && decoder.total() == before + 1, "weak to pin: decoded again");
+
+        // PIN -> NONE：全部释放，之后每次都解码
+        cache.setPolicy(DCP_NONE);
+        check(cachedCount(cache) == 0, "pin to none: atlas kept");
+        cache.get(kept, decoder(kept));
+        check(decoder.total() == before + 2, "pin to none: not decoded");
+
+        // NONE -> LRU：从空缓存开始
+        cache.setPolicy(DCP_LRU, 2);
+        cache.get(0, decoder(0));
+        cache.get(0, decoder(0));
+        check(decoder.total() == before + 3 && cachedCount(cache) == 1, "none to lru: not cached");
+        cache.clear();
+        check(cachedCount(cache) == 0 && cache.policy() == DCP_LRU, "clear kept atlas");
+    }
+
+    // 多个线程同时请求同一个图集，只有一个线程解码
+    for (const DDSCachePolicy policy : {DCP_PIN, DCP_LRU, DCP_WEAK}) {
+        NPKDDSCache cache;
+        cache.reset(DDS_COUNT);
+        cache.setPolicy(policy, 1);
+        CountingDecoder decoder;
+        std::atomic<bool> start{false};
+        std::vector<std::shared_ptr<NPKMatrix>> results(THREAD_COUNT);
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < THREAD_COUNT; ++t) {
+            threads.emplace_back([&, t] {
+                while (!start) {
+                    std::this_thread::yield();
+                }
+                results[t] = cache.get(2, [&decoder] {
+                    ++decoder.calls[2];
+                    // 让其他线程在解码期间到达
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    return NPKMatrix::createMatrix(4, 4);
+                });
+            });
+        }
+        start = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        bool same = true;
+        for (const auto& result : results) {
+            same = same && result && result == results[0];
+        }
+        check(decoder.calls[2] == 1 && same, "concurrent: decoded more than once");
+    }
+
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+//
+// Created by liu86 on 24-8-21.
+//
+// 解码到调用者缓冲区的结果与getFrameMatrix一致，不写入区域以外的字节，预热后不再分配堆内存；
+// NPKMatrix可以移动并复用内存
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKWriter.h"
+#include "npk_test_allocations.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+constexpr uint8_t GUARD = 0xCD;
+
+// 缓冲区中(offsetX, offsetY)开始的width*height区域与expected中(left, top)开始的区域相同，区域以外都是GUARD
+bool checkBuffer(const std::vector<uint8_t>& buffer, const NPKPixelBuffer& target, const uint32_t width, const uint32_t height,
+                 const NPKMatrix& expected, const uint32_t left, const uint32_t top, const uint32_t columns, const uint32_t rows)
+{
+    for (uint64_t i = 0; i < buffer.size(); ++i) {
+        const uint64_t y = i / target.stride;
+        const uint64_t x = i % target.stride / sizeof(NPKColor);
+        const bool inside = y >= target.offsetY && y < target.offsetY + height && i % target.stride < (target.offsetX + width) * sizeof(NPKColor) &&
+                            x >= target.offsetX;
+        if (!inside) {
+            if (buffer[i] != GUARD) {
+                return false;
+            }
+            continue;
+        }
+        const uint32_t bx = static_cast<uint32_t>(x - target.offsetX);
+        const uint32_t by = static_cast<uint32_t>(y - target.offsetY);
+        if (bx >= columns || by >= rows) {
+            continue;
+        }
+        const NPKColor& color = expected.data()[(top + by) * expected.canvasWidth() + left + bx];
+        if (buffer[i] != reinterpret_cast<const uint8_t*>(&color)[i % sizeof(NPKColor)]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t visible(const uint32_t offset, const uint32_t length, const uint32_t size)
+{
+    return offset >= size ? 0 : std::min(length, size - offset);
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    std::mt19937 rng(20240821);
+    NPKWriter writer;
+    NPKWriteImage v2;
+    v2.name = "sprite/test/v2.img";
+    const ColorType colorTypes[] = {CL_ARGB8888, CL_ARGB4444, CL_ARGB1555, CL_RGB565};
+    for (uint32_t i = 0; i < 16; ++i) {
+        v2.frames.push_back(npk_test::v2Frame(rng, colorTypes[i % 4], i / 4 % 2 ? CP_NONE : CP_ZLIB, i >= 8 && i % 3 == 0));
+    }
+    v2.frames.push_back(NPKWriter::linkFrame(5));
+    writer.addImage(v2);
+    // 第5帧的画布比图像小
+    auto v4 = npk_test::indexedImage("sprite/test/v4.img", 4, 1, 200, 6, rng);
+    v4.frames[4].index.frameWidth = v4.frames[4].index.width / 2 + 1;
+    v4.frames[4].index.frameHeight = v4.frames[4].index.height / 2 + 1;
+    v4.frames.push_back(NPKWriter::linkFrame(2));
+    writer.addImage(v4);
+    // 宽高不是4的倍数，最后不足一块的像素保持透明
+    writer.addImage(npk_test::ddsImage("sprite/test/v5.img", 30, 30, 4, rng));
+    const auto path = npk_test::tempPath("npk_test_decode_buffer.npk");
+    npk_test::writeFile(path, writer.serialize());
+
+    int failed = 0;
+    auto check = [&failed](const bool ok, const char* message, const uint32_t image, const uint32_t frame) {
+        if (!ok) {
+            printf("%s [image:%u][frame:%u]\n", message, image, frame);
+            failed++;
+        }
+    };
+
+    for (const DDSCachePolicy policy : {DCP_NONE, DCP_PIN}) {
+        NPKLoadOptions options;
+        options.ddsCachePolicy = policy;
+        NPKHandler npk;
+        if (!npk.loadNPK(path, options)) {
+            printf("FAILED, load\n");
+            return 1;
+        }
+
+        std::vector<uint8_t> buffer;
+        for (uint32_t i = 0; i < npk.getImageCount(); ++i) {
+            const auto image = npk.getImage(i);
+            for (uint32_t j = 0; j < image->getFrameCount(); ++j) {
+                const auto expected = image->getFrameMatrix(j);
+                if (!expected) {
+                    check(false, "reference decode failed", i, j);
+                    continue;
+                }
+                for (const DecodeArea area : {DA_IMAGE, DA_CANVAS}) {
+                    const bool dds = image->getFrameIsDDS(j);
+                    const uint32_t width = area == DA_IMAGE || dds ? expected->width() : expected->canvasWidth();
+                    const uint32_t height = area == DA_IMAGE || dds ? expected->height() : expected->canvasHeight();
+                    NPKPixelBuffer target;
+                    target.stride = (width + 3 + j % 5) * sizeof(NPKColor);
+                    target.offsetX = 1 + j % 3;
+                    target.offsetY = j % 4;
+                    const uint64_t size = image->getFrameDecodeSize(j, target, area);
+                    check(size == pixelBufferSize(target, width, height), "decode size mismatch", i, j);
+
+                    // 末尾多留一行检查越界
+                    buffer.assign(size + target.stride, GUARD);
+                    target.data = buffer.data();
+                    target.size = size;
+                    check(image->decodeFrame(j, target, 0, area), "decode failed", i, j);
+                    // DA_IMAGE只比较图像在画布内的部分
+                    const uint32_t left = area == DA_IMAGE ? expected->offsetX() : 0;
+                    const uint32_t top = area == DA_IMAGE ? expected->offsetY() : 0;
+                    const uint32_t columns = area == DA_IMAGE ? visible(left, width, expected->canvasWidth()) : width;
+                    const uint32_t rows = area == DA_IMAGE ? visible(top, height, expected->canvasHeight()) : height;
+                    check(checkBuffer(buffer, target, width, height, *expected, left, top, columns, rows), "buffer mismatch", i, j);
+
+                    target.size = size - 1;
+                    check(!image->decodeFrame(j, target, 0, area), "small buffer accepted", i, j);
+                    target.stride = width * sizeof(NPKColor) - 1;
+                    target.size = buffer.size();
+                    check(!image->decodeFrame(j, target, 0, area), "small stride accepted", i, j);
+                }
+
+                NPKMatrix matrix;
+                check(image->decodeFrame(j, matrix) && matrix.canvasWidth() == expected->canvasWidth() &&
+                      matrix.canvasHeight() == expected->canvasHeight() &&
+                      memcmp(matrix.data(), expected->data(), static_cast<size_t>(matrix.canvasWidth()) * matrix.canvasHeight() *
+                             sizeof(NPKColor)) == 0, "matrix mismatch", i, j);
+                NPKMatrix moved = std::move(matrix);
+                check(matrix.data() == nullptr && matrix.isEmpty() && moved.width() == expected->width(), "move failed", i, j);
+            }
+        }
+
+        // 预热后重复解码到同一个缓冲区或矩阵不再分配内存，DCP_PIN的图集在预热时缓存
+        NPKMatrix reused;
+        std::vector<std::shared_ptr<NPKImageHandler>> images;
+        for (uint32_t i = 0; i < npk.getImageCount(); ++i) {
+            images.push_back(npk.getImage(i));
+        }
+        buffer.assign(1 << 16, 0);
+        NPKPixelBuffer target;
+        target.data = buffer.data();
+        target.size = buffer.size();
+        target.stride = 64 * sizeof(NPKColor);
+        for (int pass = 0; pass < 2; ++pass) {
+            const uint64_t before = npk_test::allocationCount();
+            for (const auto& image : images) {
+                for (uint32_t j = 0; j < image->getFrameCount(); ++j) {
+                    image->decodeFrame(j, target, 0, DA_CANVAS);
+                    image->decodeFrame(j, reused);
+                }
+            }
+            if (pass == 1 && npk_test::allocationCount() != before) {
+                printf("hot path allocated %llu times [policy:%u]\n", static_cast<unsigned long long>(npk_test::allocationCount() - before), policy);
+                failed++;
+            }
+        }
+    }
+
+    std::filesystem::remove(path);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+//
+// Created by liu86 on 24-8-9.
+//
+// 用不同压缩级别和策略生成zlib数据，对比内置inflate与zlib后端的结果必须一致，
+// 包括输出写满、数据截断、校验错误以及按行输出的情况
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <zlib.h>
+
+#include "NPKDecompressor.h"
+#include "NPKFastInflate.h"
+
+using namespace neapu;
+
+namespace {
+std::vector<uint8_t> compressData(const std::vector<uint8_t>& data, const int level, const int strategy)
+{
+    z_stream stream{};
+    deflateInit2(&stream, level, Z_DEFLATED, 15, 8, strategy);
+    std::vector<uint8_t> out(deflateBound(&stream, static_cast<uLong>(data.size())));
+    stream.next_in = const_cast<Bytef*>(data.data());
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+// 类似帧数据：大片透明、重复的短图案、渐变与噪声混合
+std::vector<uint8_t> makeData(const uint32_t kind, const uint32_t size, std::mt19937& rng)
+{
+    std::vector<uint8_t> data(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        switch (kind) {
+        case 0: data[i] = static_cast<uint8_t>(rng());
+            break;
+        case 1: data[i] = (i / 4096) % 2 ? static_cast<uint8_t>(i % 7) : 0;
+            break;
+        case 2: data[i] = static_cast<uint8_t>(i / 64 + (rng() % 4 == 0 ? rng() % 3 : 0));
+            break;
+        default: data[i] = i >= 16 && rng() % 8 != 0 ? data[i - 1 - rng() % 16] : static_cast<uint8_t>(rng() % 16);
+            break;
+        }
+    }
+    return data;
+}
+
+int compareBackends(const char* name, const std::vector<uint8_t>& compressed, const uint64_t compressedLen, const uint64_t outputSize)
+{
+    NPKZlibDecompressor zlib;
+    NPKFastInflate fast;
+    // 输出前后各多留一段，检查没有越界写
+    constexpr uint64_t GUARD = 512;
+    std::vector<uint8_t> expected(outputSize + 2 * GUARD, 0xCD);
+    std::vector<uint8_t> actual(outputSize + 2 * GUARD, 0xCD);
+    const auto expectedRet = zlib.decompress(compressed.data(), compressedLen, expected.data() + GUARD, outputSize);
+    const auto actualRet = fast.decompress(compressed.data(), compressedLen, actual.data() + GUARD, outputSize);
+    if (expectedRet != actualRet) {
+        printf("%s: result mismatch, zlib %u fast %u, input %llu output %llu\n", name, expectedRet, actualRet,
+               static_cast<unsigned long long>(compressedLen), static_cast<unsigned long long>(outputSize));
+        return 1;
+    }
+    if (expectedRet != DR_ERROR && expected != actual) {
+        printf("%s: output mismatch, input %llu output %llu\n", name, static_cast<unsigned long long>(compressedLen),
+               static_cast<unsigned long long>(outputSize));
+        return 1;
+    }
+    return 0;
+}
+
+int compareRows(const std::vector<uint8_t>& data, const std::vector<uint8_t>& compressed, std::mt19937& rng)
+{
+    NPKZlibDecompressor zlib;
+    NPKFastInflate fast;
+    int failed = 0;
+    for (uint32_t i = 0; i < 8; ++i) {
+        NPKDecompressTarget target;
+        target.skip = rng() % (data.size() / 2);
+        target.rowSize = 1 + rng() % 300;
+        target.stride = target.rowSize + rng() % 40;
+        target.rowCount = static_cast<uint32_t>((data.size() - target.skip) / target.rowSize);
+        std::vector<uint8_t> expected(target.stride * target.rowCount, 0xCD);
+        std::vector<uint8_t> actual(target.stride * target.rowCount, 0xCD);
+
+        target.data = expected.data();
+        const auto expectedRet = zlib.decompress(compressed.data(), compressed.size(), target);
+        target.data = actual.data();
+        const auto actualRet = fast.decompress(compressed.data(), compressed.size(), target);
+        if (expectedRet != actualRet || expected != actual) {
+            printf("row target mismatch, skip %llu row %llu stride %llu\n", static_cast<unsigned long long>(target.skip),
+                   static_cast<unsigned long long>(target.rowSize), static_cast<unsigned long long>(target.stride));
+            failed++;
+            continue;
+        }
+        for (uint32_t y = 0; y < target.rowCount; ++y) {
+            if (memcmp(actual.data() + y * target.stride, data.data() + target.skip + y * target.rowSize, target.rowSize) != 0) {
+                printf("row target content mismatch, row %u\n", y);
+                failed++;
+                break;
+            }
+        }
+    }
+    return failed;
+}
+}
+
+int main()
+{
+    std::mt19937 rng(20240809);
+    const int levels[] = {0, 1, 6, 9};
+    const int strategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED};
+    const uint32_t sizes[] = {1, 7, 258, 4096, 100000, 1 << 20};
+    int failed = 0;
+
+    for (uint32_t kind = 0; kind < 4; ++kind) {
+        for (const auto size : sizes) {
+            const auto data = makeData(kind, size, rng);
+            for (const auto level : levels) {
+                for (const auto strategy : strategies) {
+                    const auto compressed = compressData(data, level, strategy);
+
+                    // 正常解压结果必须与原始数据一致
+                    std::vector<uint8_t> output(size);
+                    if (NPKFastInflate::inflate(compressed.data(), compressed.size(), output.data(), size) != DR_OK || output != data) {
+                        printf("decode failed, kind %u size %u level %d strategy %d\n", kind, size, level, strategy);
+                        failed++;
+                        continue;
+                    }
+
+                    // 输出写满、输出比数据大、数据被截断
+                    failed += compareBackends("exact", compressed, compressed.size(), size);
+                    failed += compareBackends("short", compressed, compressed.size(), size / 2);
+                    failed += compareBackends("long", compressed, compressed.size(), size + 100);
+                    failed += compareBackends("cut", compressed, rng() % compressed.size(), size);
+                    failed += compareBackends("no check", compressed, compressed.size() - 4, size);
+
+                    // 校验错误
+                    auto corrupted = compressed;
+                    corrupted.back() ^= 0x01;
+                    failed += compareBackends("check", corrupted, corrupted.size(), size);
+
+                    if (size >= 4096) {
+                        failed += compareRows(data, compressed, rng);
+                    }
+                }
+            }
+        }
+    }
+
+    // 随机改动压缩数据，两种后端对损坏数据的判断也必须一致
+    const auto data = makeData(3, 65536, rng);
+    const auto compressed = compressData(data, 6, Z_DEFAULT_STRATEGY);
+    for (uint32_t i = 0; i < 2000; ++i) {
+        auto corrupted = compressed;
+        const uint32_t flips = 1 + rng() % 3;
+        for (uint32_t j = 0; j < flips; ++j) {
+            corrupted[2 + rng() % (corrupted.size() - 2)] ^= static_cast<uint8_t>(1 << rng() % 8);
+        }
+        failed += compareBackends("corrupted", corrupted, corrupted.size(), data.size());
+    }
+
+    // 反复切换内置后端得到的是同一个实例
+    setDecompressor(DB_FAST);
+    const NPKDecompressor* fast = getDecompressor().get();
+    setDecompressor(DB_ZLIB);
+    const NPKDecompressor* zlib = getDecompressor().get();
+    for (uint32_t i = 0; i < 100; ++i) {
+        setDecompressor(i % 2 ? DB_ZLIB : DB_FAST);
+        if (getDecompressor().get() != (i % 2 ? zlib : fast) || fast == zlib) {
+            printf("builtin backend instance changed\n");
+            failed++;
+            break;
+        }
+    }
+    setDecompressor(nullptr);
+
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+//
+// Created by liu86 on 24-8-17.
+//
+// 多个NPK挂载后按优先级和挂载顺序覆盖同名Image，NPK在访问时才加载，关闭后可以重新加载
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NPKFileSystem.h"
+#include "NPKImageHandler.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+// 用帧数量标记Image来自哪个NPK
+bool writePack(const std::string& path, const std::vector<std::string>& names, const uint32_t marker)
+{
+    NPKWriter writer;
+    for (const auto& name : names) {
+        NPKWriteImage image;
+        image.name = name;
+        for (uint32_t i = 0; i < marker; ++i) {
+            image.frames.push_back(NPKWriter::linkFrame(0));
+        }
+        writer.addImage(image);
+    }
+    return writer.save(path);
+}
+
+int checkImage(const NPKFileSystem& fs, const std::string& name, const uint32_t marker)
+{
+    const auto image = fs.getImage(name);
+    if (!image || image->getName() != name || image->getFrameCount() != marker) {
+        printf("%s: expected pack %u, got %u\n", name.c_str(), marker, image ? image->getFrameCount() : 0);
+        return 1;
+    }
+    return 0;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    int failed = 0;
+    const auto directory = std::filesystem::temp_directory_path() / "npk_test_filesystem";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "patch");
+
+    // 文件名的顺序与写入顺序不同，B.NPK覆盖a.npk，patch中的覆盖两者
+    const auto a = (directory / "a.npk").string();
+    const auto b = (directory / "B.NPK").string();
+    const auto c = (directory / "patch" / "c.npk").string();
+    if (!writePack(b, {"sprite/shared.img", "sprite/b.img", "sprite/all.img"}, 2) ||
+        !writePack(a, {"sprite/shared.img", "sprite/a.img", "sprite/all.img", "sprite/a.img"}, 1) ||
+        !writePack(c, {"sprite/all.img", "map/c.img"}, 3)) {
+        printf("failed to write packs\n");
+        return 1;
+    }
+    FILE* file = fopen((directory / "broken.npk").string().c_str(), "wb");
+    fputs("not a npk", file);
+    fclose(file);
+    file = fopen((directory / "readme.txt").string().c_str(), "wb");
+    fclose(file);
+
+    {
+        NPKFileSystem fs;
+        // broken.npk挂载失败，readme.txt不是NPK
+        if (fs.mountDirectory(directory.string()) != 2 || fs.getPackCount() != 2 || fs.getPackPath(0) != b || fs.getPackPath(1) != a) {
+            printf("directory mount mismatch\n");
+            failed++;
+        }
+        if (fs.getImageCount() != 4 || fs.getOpenPackCount() != 0) {
+            printf("unexpected image count %u\n", fs.getImageCount());
+            failed++;
+        }
+        // 优先级相同，后挂载的a.npk覆盖B.NPK，同一NPK中的重复名称保留第一个
+        NPKImageLocation location;
+        if (!fs.find("sprite/a.img", location) || location.pack != 1 || location.image != 1 || fs.find("map/c.img", location)) {
+            printf("find mismatch\n");
+            failed++;
+        }
+        failed += checkImage(fs, "sprite/shared.img", 1);
+        failed += checkImage(fs, "sprite/b.img", 2);
+        if (fs.getOpenPackCount() != 2 || fs.getImage("sprite/missing.img")) {
+            printf("packs not loaded on access\n");
+            failed++;
+        }
+        const std::vector<std::string> expected = {"sprite/a.img", "sprite/all.img", "sprite/b.img", "sprite/shared.img"};
+        if (fs.findImages("sprite/") != expected) {
+            printf("prefix mismatch\n");
+            failed++;
+        }
+
+        // 高优先级的NPK先挂载也会覆盖，之后挂载的低优先级NPK不覆盖
+        if (!fs.mount(c, 10) || !fs.mount(b, 0)) {
+            printf("failed to mount\n");
+            failed++;
+        }
+        failed += checkImage(fs, "sprite/all.img", 3);
+        failed += checkImage(fs, "map/c.img", 3);
+        failed += checkImage(fs, "sprite/shared.img", 2);
+        if (fs.getImageCount() != 5) {
+            printf("unexpected image count %u\n", fs.getImageCount());
+            failed++;
+        }
+
+        // 只有c.npk在等待后访问过，关闭后已获取的Image仍然可用，再次访问时重新加载
+        const auto held = fs.getImage("sprite/a.img");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        fs.getImage("map/c.img");
+        const uint32_t closed = fs.closeIdlePacks(std::chrono::milliseconds(10));
+        if (closed != 3 || fs.getOpenPackCount() != 1 || !held || held->getFrameCount() != 1) {
+            printf("idle packs not closed: %u\n", closed);
+            failed++;
+        }
+        failed += checkImage(fs, "sprite/a.img", 1);
+        if (fs.closeIdlePacks(std::chrono::milliseconds(0)) != 2 || fs.getOpenPackCount() != 0) {
+            printf("packs not closed\n");
+            failed++;
+        }
+
+        // 挂载后文件改变时拒绝加载
+        writePack(a, {"sprite/a.img"}, 1);
+        if (fs.getImage("sprite/a.img") || fs.getPack(100)) {
+            printf("changed pack loaded\n");
+            failed++;
+        }
+    }
+
+    {
+        NPKFileSystem fs;
+        if (fs.mountDirectory(directory.string(), 0, true) != 3 || fs.getPackPath(2) != c) {
+            printf("recursive mount mismatch\n");
+            failed++;
+        }
+        if (fs.mountDirectory((directory / "missing").string()) != 0 || fs.mount((directory / "missing.npk").string())) {
+            printf("missing path mounted\n");
+            failed++;
+        }
+        failed += checkImage(fs, "sprite/all.img", 3);
+    }
+
+    // 文件头中的Image数量远超文件大小时拒绝挂载，而不是按数量分配索引表
+    {
+        const auto hostile = (std::filesystem::temp_directory_path() / "npk_test_filesystem_hostile.npk").string();
+        NPKHeader header{};
+        memcpy(header.magic, "NeoplePack_Bill", sizeof(header.magic));
+        header.imgCount = 0xFFFFFFFF;
+        file = fopen(hostile.c_str(), "wb");
+        fwrite(&header, sizeof(header), 1, file);
+        fclose(file);
+        NPKFileSystem fs;
+        if (fs.mount(hostile) || fs.getPackCount() != 0) {
+            printf("hostile index count mounted\n");
+            failed++;
+        }
+        std::filesystem::remove(hostile);
+    }
+
+    std::filesystem::remove_all(directory);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
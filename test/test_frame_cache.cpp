@@ -0,0 +1,173 @@
+//
+// Created by liu86 on 24-8-5.
+//
+// 两种淘汰策略下缓存占用都不超过字节预算，超过预算的帧被拒绝并计入rejections；LRU淘汰最久未使用的帧；
+// 反复使用的帧在一次性扫描大量新帧后，W-TinyLFU仍然保留而LRU全部淘汰；NPKHandler的帧缓存统计命中与未命中
+
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "NPKFrameCache.h"
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+constexpr FrameCachePolicy POLICIES[] = {FCP_LRU, FCP_TINYLFU};
+const char* const POLICY_NAMES[] = {"lru", "tinylfu"};
+
+// 与解码时的用法相同：未命中时放入新解码的帧
+std::shared_ptr<NPKMatrix> access(NPKFrameCache& cache, const NPKFrameKey& key, const uint32_t size)
+{
+    if (auto matrix = cache.get(key)) {
+        return matrix;
+    }
+    auto matrix = NPKMatrix::createMatrix(size, size);
+    cache.put(key, matrix);
+    return matrix;
+}
+
+bool cached(NPKFrameCache& cache, const NPKFrameKey& key)
+{
+    return cache.get(key) != nullptr;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    int failed = 0;
+    auto check = [&failed](const bool ok, const char* policy, const char* message) {
+        if (!ok) {
+            printf("%s: %s\n", policy, message);
+            failed++;
+        }
+    };
+
+    const uint64_t frameSize = NPKFrameCache::matrixSize(*NPKMatrix::createMatrix(16, 16));
+    for (uint32_t p = 0; p < std::size(POLICIES); ++p) {
+        const char* name = POLICY_NAMES[p];
+
+        // 随机大小的帧反复访问，占用始终不超过预算，统计数字前后一致
+        {
+            const uint64_t capacity = frameSize * 64;
+            NPKFrameCache cache(capacity, NPKFrameCache::createPolicy(POLICIES[p], capacity));
+            std::mt19937 rng(20240805);
+            bool withinBudget = true;
+            for (uint32_t i = 0; i < 20000; ++i) {
+                access(cache, NPKFrameKey{static_cast<uint32_t>(rng() % 4), static_cast<uint32_t>(rng() % 100), 0}, 1 + rng() % 40);
+                withinBudget = withinBudget && cache.stats().bytes <= capacity;
+            }
+            const auto stats = cache.stats();
+            check(withinBudget, name, "bytes over capacity");
+            check(stats.capacity == capacity && stats.hits + stats.misses == 20000 && stats.hits > 0, name, "access count mismatch");
+            check(stats.entries == stats.insertions - stats.evictions && stats.insertions + stats.rejections <= stats.misses, name,
+                  "entry count mismatch");
+            cache.clear();
+            check(cache.stats().bytes == 0 && cache.stats().entries == 0 && !cached(cache, NPKFrameKey{0, 0, 0}), name, "clear kept frames");
+        }
+
+        // 单帧超过预算时拒绝缓存，已缓存的帧不受影响
+        {
+            const uint64_t capacity = frameSize * 4;
+            NPKFrameCache cache(capacity, NPKFrameCache::createPolicy(POLICIES[p], capacity));
+            access(cache, NPKFrameKey{0, 1, 0}, 16);
+            const auto before = cache.stats();
+            cache.put(NPKFrameKey{0, 2, 0}, NPKMatrix::createMatrix(64, 64));
+            const auto after = cache.stats();
+            check(after.rejections == before.rejections + 1 && after.bytes == before.bytes && after.entries == before.entries, name,
+                  "oversize frame not rejected");
+            check(!cached(cache, NPKFrameKey{0, 2, 0}) && cached(cache, NPKFrameKey{0, 1, 0}), name, "oversize frame cached");
+            // 同一个键重复放入时保留先放入的
+            const auto first = cache.get(NPKFrameKey{0, 1, 0});
+            cache.put(NPKFrameKey{0, 1, 0}, NPKMatrix::createMatrix(16, 16));
+            check(cache.get(NPKFrameKey{0, 1, 0}) == first && cache.stats().insertions == after.insertions, name, "duplicate put replaced frame");
+        }
+
+        // 只使用一次的帧扫描整个缓存20遍，反复使用的帧能否保留
+        {
+            const uint64_t capacity = frameSize * 1024;
+            NPKFrameCache cache(capacity, NPKFrameCache::createPolicy(POLICIES[p], capacity));
+            constexpr uint32_t HOT_COUNT = 511;
+            for (uint32_t round = 0; round < 4; ++round) {
+                for (uint32_t i = 0; i < HOT_COUNT; ++i) {
+                    access(cache, NPKFrameKey{0, i, 0}, 16);
+                }
+                // 窗口中的命中不会晋升，第一遍之后用少量新帧把最后放入的热点帧挤出窗口
+                for (uint32_t i = 0; round == 0 && i < 32; ++i) {
+                    access(cache, NPKFrameKey{2, i, 0}, 16);
+                }
+            }
+            bool withinBudget = true;
+            for (uint32_t i = 0; i < 1024 * 20; ++i) {
+                access(cache, NPKFrameKey{1, i, 0}, 16);
+                withinBudget = withinBudget && cache.stats().bytes <= capacity;
+            }
+            check(withinBudget, name, "bytes over capacity during scan");
+            uint32_t kept = 0;
+            for (uint32_t i = 0; i < HOT_COUNT; ++i) {
+                kept += cached(cache, NPKFrameKey{0, i, 0});
+            }
+            if (POLICIES[p] == FCP_TINYLFU) {
+                check(kept == HOT_COUNT, name, "hot frames evicted by scan");
+            } else {
+                check(kept == 0, name, "hot frames survived scan");
+            }
+        }
+    }
+
+    // LRU按最近使用的顺序淘汰
+    {
+        const uint64_t capacity = frameSize * 3;
+        NPKFrameCache cache(capacity, NPKFrameCache::createPolicy(FCP_LRU, capacity));
+        for (uint32_t i = 0; i < 3; ++i) {
+            access(cache, NPKFrameKey{0, i, 0}, 16);
+        }
+        access(cache, NPKFrameKey{0, 0, 0}, 16);
+        access(cache, NPKFrameKey{0, 3, 0}, 16);
+        check(cache.stats().evictions == 1 && !cached(cache, NPKFrameKey{0, 1, 0}), "lru", "least recently used frame kept");
+        check(cached(cache, NPKFrameKey{0, 0, 0}) && cached(cache, NPKFrameKey{0, 2, 0}) && cached(cache, NPKFrameKey{0, 3, 0}), "lru",
+              "recently used frame evicted");
+        // 命中也会更新顺序，上面的查询之后帧0成为最久未使用的
+        access(cache, NPKFrameKey{0, 4, 0}, 16);
+        check(!cached(cache, NPKFrameKey{0, 0, 0}) && cached(cache, NPKFrameKey{0, 2, 0}), "lru", "eviction order mismatch");
+    }
+
+    // NPKHandler的帧缓存：第二次获取同一帧命中缓存，返回同一个矩阵
+    std::mt19937 rng(20240805);
+    NPKWriter writer;
+    NPKWriteImage v2;
+    v2.name = "sprite/test/v2.img";
+    for (uint32_t i = 0; i < 4; ++i) {
+        v2.frames.push_back(npk_test::v2Frame(rng, CL_ARGB8888, CP_ZLIB));
+    }
+    writer.addImage(v2);
+    const auto path = npk_test::tempPath("npk_test_frame_cache.npk");
+    npk_test::writeFile(path, writer.serialize());
+    NPKHandler npk;
+    if (!npk.loadNPK(path)) {
+        printf("FAILED, load\n");
+        return 1;
+    }
+    check(npk.getFrameCacheStats().capacity == 0, "handler", "cache enabled by default");
+    npk.setFrameCache(1 << 20, FCP_TINYLFU);
+    const auto first = npk.getFrameMatrix(0, 1);
+    const auto second = npk.getFrameMatrix(0, 1);
+    const auto stats = npk.getFrameCacheStats();
+    check(first && first == second, "handler", "cached frame not reused");
+    check(stats.hits == 1 && stats.misses == 1 && stats.entries == 1 && stats.capacity == 1 << 20, "handler", "stats mismatch");
+    npk.setFrameCache(0);
+    check(npk.getFrameCacheStats().entries == 0 && npk.getFrameMatrix(0, 1) != first, "handler", "cache not disabled");
+
+    std::filesystem::remove(path);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,185 @@
+//
+// Created by liu86 on 24-8-20.
+//
+// 帧表还原的索引与解码结果与写入时一致，getFrame得到的拷贝在NPK释放后仍然可用，
+// 各种加载方式下memoryUsage只统计帧表与拷贝的数据，不使用内存映射时加载和校验都不会一次读取整个文件，使用索引文件时也一样；
+// 数据不足的未压缩帧在各种加载方式下都作为无效帧，不会越过帧数据读取
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKSidecar.h"
+#include "NPKWriter.h"
+#include "npk_test_allocations.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+std::shared_ptr<NPKMatrix> randomMatrix(std::mt19937& rng)
+{
+    const uint32_t width = 1 + rng() % 30;
+    const uint32_t height = 1 + rng() % 30;
+    auto matrix = NPKMatrix::createMatrix(width, height, width + 3, height + 5, 3, 5);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            matrix->setPixel(x, y, NPKColor{static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), 0xFF});
+        }
+    }
+    return matrix;
+}
+
+// 第3帧和第6帧链接到前一帧，V6有两个超过256色的调色板
+NPKWriteImage indexedImage(const std::string& name, const uint32_t version, std::mt19937& rng)
+{
+    const uint32_t colorCount = version == 6 ? 300 : 1 + rng() % 200;
+    auto image = npk_test::indexedImage(name, version, version == 6 ? 2 : 1, colorCount, 6, rng);
+    image.frames[2] = NPKWriter::linkFrame(1);
+    image.frames[5] = NPKWriter::linkFrame(4);
+    return image;
+}
+
+bool sameMatrix(const std::shared_ptr<NPKMatrix>& a, const std::shared_ptr<NPKMatrix>& b)
+{
+    if (!a || !b) {
+        return !a && !b;
+    }
+    return a->width() == b->width() && a->height() == b->height() && a->canvasWidth() == b->canvasWidth() &&
+           a->canvasHeight() == b->canvasHeight() &&
+           memcmp(a->data(), b->data(), static_cast<size_t>(a->canvasWidth()) * a->canvasHeight() * sizeof(NPKColor)) == 0;
+}
+
+bool sameIndex(const NPKFrameIndex& expected, const NPKFrameIndex& actual)
+{
+    if (expected.colorType == CL_LINK) {
+        return actual.colorType == CL_LINK && actual.linkTo == expected.linkTo;
+    }
+    return actual.colorType == expected.colorType && actual.compressType == expected.compressType && actual.width == expected.width &&
+           actual.height == expected.height && actual.posX == expected.posX && actual.posY == expected.posY &&
+           actual.frameWidth == expected.frameWidth && actual.frameHeight == expected.frameHeight;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    std::mt19937 rng(20240820);
+    std::vector<NPKWriteImage> images;
+    NPKWriteImage v2;
+    v2.name = "sprite/test/v2.img";
+    for (uint32_t i = 0; i < 6; ++i) {
+        v2.frames.push_back(NPKWriter::matrixFrame(*randomMatrix(rng), i % 2 ? CL_ARGB4444 : CL_ARGB8888, i % 3 ? CP_ZLIB : CP_NONE));
+    }
+    v2.frames.push_back(NPKWriter::linkFrame(3));
+    images.push_back(v2);
+    images.push_back(indexedImage("sprite/test/v4.img", 4, rng));
+    images.push_back(indexedImage("sprite/test/v6.img", 6, rng));
+    // 未压缩帧的数据比图像小，作为文件的最后一帧，按图像大小读取会越过文件末尾
+    NPKWriteImage truncated;
+    truncated.name = "sprite/test/truncated.img";
+    truncated.frames.push_back(NPKWriter::matrixFrame(*NPKMatrix::createMatrix(300, 300), CL_ARGB8888, CP_NONE));
+    truncated.frames.back().data.resize(16);
+    images.push_back(truncated);
+
+    NPKWriter writer;
+    for (const auto& image : images) {
+        writer.addImage(image);
+    }
+    const auto path = npk_test::tempPath("npk_test_memory.npk");
+    const auto data = writer.serialize();
+    const uint64_t fileSize = data.size();
+    npk_test::writeFile(path, data);
+
+    int failed = 0;
+    auto check = [&failed](const bool ok, const char* mode, const char* message) {
+        if (!ok) {
+            printf("%s: %s\n", mode, message);
+            failed++;
+        }
+    };
+
+    NPKHandler reference;
+    if (!reference.loadNPK(path)) {
+        printf("FAILED, load reference\n");
+        return 1;
+    }
+
+    // 先生成索引文件，索引模式不使用内存映射
+    NPKLoadOptions update;
+    update.sidecarMode = SCM_UPDATE;
+    if (!NPKHandler().loadNPK(path, update)) {
+        printf("FAILED, write sidecar\n");
+        return 1;
+    }
+
+    const char* modeNames[] = {"copy", "mmap", "lazy", "sidecar"};
+    for (int mode = 0; mode < 4; ++mode) {
+        NPKLoadOptions options;
+        options.useMmap = mode == 1;
+        options.lazyLoad = mode == 2;
+        options.sidecarMode = mode == 3 ? SCM_READ : SCM_NONE;
+        std::vector<std::shared_ptr<NPKFrameHandler>> copies;
+        std::vector<std::shared_ptr<NPKMatrix>> expected;
+        {
+            auto npk = std::make_shared<NPKHandler>();
+            npk_test::resetLargestAllocation();
+            if (!npk->loadNPK(path, options)) {
+                check(false, modeNames[mode], "load failed");
+                continue;
+            }
+            check(npk->isLoadedFromSidecar() == (mode == 3), modeNames[mode], "sidecar usage mismatch");
+            // 不使用内存映射时只读取文件头和索引表，再逐个读取Image的数据，延迟加载在首次访问时才读取，索引模式按记录读取
+            check(mode == 1 || npk_test::largestAllocation() < fileSize, modeNames[mode], "whole file allocated on load");
+            npk_test::resetLargestAllocation();
+            npk->getImage(0);
+            check(mode == 1 || npk_test::largestAllocation() < fileSize, modeNames[mode], "whole file allocated on first access");
+            for (uint32_t i = 0; i < images.size(); ++i) {
+                const auto image = npk->getImage(i);
+                const auto& written = images[i];
+                check(image->getFrameCount() == written.frames.size(), modeNames[mode], "frame count mismatch");
+                // 复制模式和索引模式下帧数据都在Image内
+                uint64_t frameBytes = 0;
+                for (uint32_t j = 0; j < image->getFrameCount(); ++j) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+                    const auto frame = image->getFrame(j);
+#pragma GCC diagnostic pop
+                    check(frame != nullptr && sameIndex(written.frames[j].index, frame->index()), modeNames[mode], "frame index mismatch");
+                    check(image->getFrameIsLink(j) == (written.frames[j].index.colorType == CL_LINK), modeNames[mode], "link mismatch");
+                    if (frame && !frame->isLinkFrame()) {
+                        frameBytes += frame->index().dataSize;
+                    }
+                    const auto matrix = image->getFrameMatrix(j);
+                    check(sameMatrix(reference.getImage(i)->getFrameMatrix(j), matrix), modeNames[mode], "decode mismatch");
+                    copies.push_back(frame);
+                    expected.push_back(frame && !frame->isLinkFrame() ? matrix : nullptr);
+                }
+                if (written.name == truncated.name) {
+                    check(image->getFrameMatrix(0) == nullptr, modeNames[mode], "short uncompressed frame decoded");
+                }
+                const uint64_t usage = image->memoryUsage();
+                check(usage > 0, modeNames[mode], "memory usage is zero");
+                check((mode != 0 && mode != 3) || usage >= frameBytes, modeNames[mode], "payload not counted");
+            }
+        }
+        // NPK与Image都已释放，拷贝仍然持有数据与调色板
+        for (size_t k = 0; k < copies.size(); ++k) {
+            if (copies[k] && expected[k]) {
+                check(sameMatrix(expected[k], copies[k]->toMatrix()), modeNames[mode], "copy invalid after release");
+            }
+        }
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(NPKSidecar::defaultPath(path));
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
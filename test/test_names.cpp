@@ -0,0 +1,187 @@
+//
+// Created by liu86 on 24-8-16.
+//
+// 名称表的查找、前缀查找和目录列表与逐个比较的结果一致，NPKHandler在各种加载方式下都能按名称获取Image
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKNameIndex.h"
+#include "NPKSidecar.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+std::string randomName(std::mt19937& rng)
+{
+    static const char* parts[] = {"sprite", "character", "swordman", "gunner", "equipment", "avatar", "skin", "weapon", "monster", "map"};
+    std::string name;
+    const uint32_t depth = rng() % 5;
+    for (uint32_t i = 0; i < depth; ++i) {
+        name += parts[rng() % 10];
+        name += '/';
+    }
+    name += parts[rng() % 10];
+    name += "_" + std::to_string(rng() % 200) + ".img";
+    return name;
+}
+
+int checkIndex(const NPKNameIndex& index, const std::vector<std::string>& names, std::mt19937& rng)
+{
+    int failed = 0;
+    for (uint32_t i = 0; i < names.size(); ++i) {
+        const auto first = std::find(names.begin(), names.end(), names[i]) - names.begin();
+        const size_t pos = names[i].find_last_of('/');
+        const std::string directory = pos == std::string::npos ? "" : names[i].substr(0, pos);
+        if (index.name(i) != names[i] || index.find(names[i]) != first || index.shortName(i) != names[i].substr(pos + 1) ||
+            index.directory(i) != directory) {
+            printf("name %u mismatch: %s\n", i, names[i].c_str());
+            failed++;
+        }
+    }
+    if (index.find("missing.img") != -1 || index.find("sprite") != -1) {
+        printf("missing name found\n");
+        failed++;
+    }
+
+    // 前缀与目录与逐个比较的结果一致
+    std::vector<std::string> prefixes = {"", "sprite", "sprite/", "sprite/character/", "z"};
+    for (uint32_t i = 0; i < 50; ++i) {
+        const auto& name = names[rng() % names.size()];
+        prefixes.push_back(name.substr(0, rng() % (name.size() + 1)));
+    }
+    for (const auto& prefix : prefixes) {
+        std::vector<uint32_t> expected;
+        for (uint32_t i = 0; i < names.size(); ++i) {
+            if (names[i].compare(0, prefix.size(), prefix) == 0) {
+                expected.push_back(i);
+            }
+        }
+        std::stable_sort(expected.begin(), expected.end(), [&names](const uint32_t a, const uint32_t b) { return names[a] < names[b]; });
+        if (index.findPrefix(prefix) != expected) {
+            printf("prefix mismatch: %s\n", prefix.c_str());
+            failed++;
+        }
+
+        // 目录包括末尾的'/'，参数末尾的'/'可以省略
+        std::vector<uint32_t> listed;
+        const std::string directory = prefix.empty() || prefix.back() == '/' ? prefix : prefix + '/';
+        for (uint32_t i = 0; i < names.size(); ++i) {
+            const size_t pos = names[i].find_last_of('/');
+            if ((pos == std::string::npos ? "" : names[i].substr(0, pos + 1)) == directory) {
+                listed.push_back(i);
+            }
+        }
+        if (index.list(prefix) != listed) {
+            printf("directory mismatch: %s\n", prefix.c_str());
+            failed++;
+        }
+    }
+    return failed;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    std::mt19937 rng(20240816);
+    int failed = 0;
+
+    // 名称表，包括重复的名称和特殊的路径
+    std::vector<std::string> names = {"root.img", "/abs.img", "dir/", "dir/a.img", "dir//b.img", ""};
+    for (uint32_t i = 0; i < 3000; ++i) {
+        names.push_back(randomName(rng));
+    }
+    NPKNameIndex index;
+    for (const auto& name : names) {
+        index.add(name);
+    }
+    failed += checkIndex(index, names, rng);
+
+    // 实际的NPK中目录很少，比每个Image保存两个std::string更小
+    NPKNameIndex large;
+    uint64_t stringUsage = 0;
+    for (uint32_t i = 0; i < 100000; ++i) {
+        const std::string name = "sprite/character/" + std::to_string(i % 20) + "/equipment/avatar/" + std::to_string(i % 10) +
+                                 "/sm_body" + std::to_string(i) + ".img";
+        large.add(name);
+        const std::string shortName = name.substr(name.find_last_of('/') + 1);
+        stringUsage += 2 * sizeof(std::string) + (name.size() > 15 ? name.size() + 1 : 0) + (shortName.size() > 15 ? shortName.size() + 1 : 0);
+    }
+    if (large.memoryUsage() * 2 >= stringUsage) {
+        printf("name index is not smaller: %llu, %llu\n", static_cast<unsigned long long>(large.memoryUsage()),
+               static_cast<unsigned long long>(stringUsage));
+        failed++;
+    }
+
+    // 通过NPKHandler按名称查找
+    NPKWriter writer;
+    std::vector<std::string> imageNames;
+    for (uint32_t i = 0; i < 300; ++i) {
+        NPKWriteImage image;
+        image.name = randomName(rng);
+        image.frames.push_back(NPKWriter::linkFrame(0));
+        imageNames.push_back(image.name);
+        writer.addImage(image);
+    }
+    const auto path = (std::filesystem::temp_directory_path() / "npk_test_names.npk").string();
+    std::filesystem::remove(NPKSidecar::defaultPath(path));
+    if (!writer.save(path)) {
+        printf("failed to save %s\n", path.c_str());
+        return 1;
+    }
+    const SidecarMode sidecarModes[] = {SCM_NONE, SCM_UPDATE, SCM_READ};
+    for (const bool lazyLoad : {false, true}) {
+        for (const auto sidecarMode : sidecarModes) {
+            NPKLoadOptions options;
+            options.lazyLoad = lazyLoad;
+            options.sidecarMode = sidecarMode;
+            NPKHandler npk;
+            if (!npk.loadNPK(path, options) || !npk.getNameIndex() || npk.getNameIndex()->size() != imageNames.size()) {
+                printf("failed to load %s\n", path.c_str());
+                failed++;
+                continue;
+            }
+            // 第一轮SCM_UPDATE生成索引文件
+            if (npk.isLoadedFromSidecar() != (sidecarMode == SCM_READ || (sidecarMode == SCM_UPDATE && lazyLoad))) {
+                printf("unexpected sidecar state\n");
+                failed++;
+            }
+            failed += checkIndex(*npk.getNameIndex(), imageNames, rng);
+            for (uint32_t i = 0; i < imageNames.size(); ++i) {
+                const auto first = std::find(imageNames.begin(), imageNames.end(), imageNames[i]) - imageNames.begin();
+                const auto image = npk.getImage(imageNames[i]);
+                if (npk.findImage(imageNames[i]) != first || !image || image != npk.getImage(static_cast<uint32_t>(first)) ||
+                    image->getName() != imageNames[i]) {
+                    printf("image %u lookup mismatch\n", i);
+                    failed++;
+                }
+            }
+            if (npk.getImage("sprite/missing.img") || npk.findImages("sprite/") != npk.getNameIndex()->findPrefix("sprite/") ||
+                npk.listDirectory("sprite") != npk.getNameIndex()->list("sprite/")) {
+                printf("handler lookup mismatch\n");
+                failed++;
+            }
+        }
+    }
+    NPKHandler empty;
+    if (empty.findImage("root.img") != -1 || !empty.findImages("").empty() || empty.getImage("root.img")) {
+        printf("empty handler lookup\n");
+        failed++;
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(NPKSidecar::defaultPath(path));
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+//
+// Created by liu86 on 24-8-22.
+//
+// 各种输出格式的解码结果与BGRA8解码结果逐像素转换后一致，16位格式直接输出IMG中的原始像素；
+// 行转换的SIMD实现与标量实现一致
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKSimd.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+constexpr OutputFormat FORMATS[] = {OF_BGRA8, OF_RGBA8, OF_BGRA8_PREMULTIPLIED, OF_RGBA8_PREMULTIPLIED, OF_RGB565, OF_ARGB4444};
+constexpr uint8_t GUARD = 0xCD;
+
+uint8_t premultiply(const uint8_t c, const uint8_t a)
+{
+    return static_cast<uint8_t>((c * a + 127) / 255);
+}
+
+// 按定义逐像素转换，作为对照
+void referencePixel(const NPKColor& color, const OutputFormat format, uint8_t* dst)
+{
+    switch (format) {
+    case OF_BGRA8:
+        dst[0] = color.b, dst[1] = color.g, dst[2] = color.r, dst[3] = color.a;
+        break;
+    case OF_RGBA8:
+        dst[0] = color.r, dst[1] = color.g, dst[2] = color.b, dst[3] = color.a;
+        break;
+    case OF_BGRA8_PREMULTIPLIED:
+        dst[0] = premultiply(color.b, color.a), dst[1] = premultiply(color.g, color.a), dst[2] = premultiply(color.r, color.a), dst[3] = color.a;
+        break;
+    case OF_RGBA8_PREMULTIPLIED:
+        dst[0] = premultiply(color.r, color.a), dst[1] = premultiply(color.g, color.a), dst[2] = premultiply(color.b, color.a), dst[3] = color.a;
+        break;
+    case OF_RGB565: {
+        const uint16_t value = static_cast<uint16_t>((color.r >> 3) << 11 | (color.g >> 2) << 5 | color.b >> 3);
+        memcpy(dst, &value, sizeof(value));
+        break;
+    }
+    case OF_ARGB4444: {
+        const uint16_t value = static_cast<uint16_t>((color.a >> 4) << 12 | (color.r >> 4) << 8 | (color.g >> 4) << 4 | color.b >> 4);
+        memcpy(dst, &value, sizeof(value));
+        break;
+    }
+    }
+}
+
+// 缓冲区中width*height的区域与expected中(left, top)开始的区域逐像素转换后相同，区域以外都是GUARD
+bool checkBuffer(const std::vector<uint8_t>& buffer, const NPKPixelBuffer& target, const uint32_t width, const uint32_t height,
+                 const NPKMatrix& expected, const uint32_t left, const uint32_t top)
+{
+    const uint32_t pixelSize = outputPixelSize(target.format);
+    for (uint64_t i = 0; i < buffer.size(); ++i) {
+        const uint64_t y = i / target.stride;
+        const uint64_t x = i % target.stride / pixelSize;
+        const bool inside = y >= target.offsetY && y < target.offsetY + height && x >= target.offsetX && x < target.offsetX + width;
+        if (!inside) {
+            if (buffer[i] != GUARD) {
+                return false;
+            }
+            continue;
+        }
+        uint8_t pixel[4];
+        referencePixel(expected.data()[(top + y - target.offsetY) * expected.canvasWidth() + left + x - target.offsetX], target.format, pixel);
+        if (buffer[i] != pixel[i % target.stride % pixelSize]) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    int failed = 0;
+    auto check = [&failed](const bool ok, const char* message, const uint32_t format, const uint32_t image, const uint32_t frame) {
+        if (!ok) {
+            printf("%s [format:%u][image:%u][frame:%u]\n", message, format, image, frame);
+            failed++;
+        }
+    };
+
+    // 行转换：SIMD与标量结果一致，覆盖所有颜色与透明度的组合，也覆盖原地转换
+    std::vector<NPKColor> colors(65536);
+    for (uint32_t i = 0; i < colors.size(); ++i) {
+        colors[i] = NPKColor{static_cast<uint8_t>(i), static_cast<uint8_t>(i * 7), static_cast<uint8_t>(i * 13), static_cast<uint8_t>(i >> 8)};
+    }
+    const SimdLevel level = getSimdLevel();
+    for (const OutputFormat format : FORMATS) {
+        const uint32_t pixelSize = outputPixelSize(format);
+        std::vector<uint8_t> expected(colors.size() * pixelSize);
+        for (uint32_t i = 0; i < colors.size(); ++i) {
+            referencePixel(colors[i], format, expected.data() + i * pixelSize);
+        }
+        for (const SimdLevel simd : {SIMD_SCALAR, level}) {
+            setSimdLevel(simd);
+            // 从不同的起点开始，让各种长度的尾部都走到
+            for (uint32_t start = 0; start < 9; ++start) {
+                std::vector<uint8_t> dst((colors.size() + 1) * pixelSize, GUARD);
+                const auto count = static_cast<uint32_t>(colors.size() - start);
+                convertPixelRow(colors.data() + start, count, format, dst.data());
+                check(memcmp(dst.data(), expected.data() + start * pixelSize, count * pixelSize) == 0, "row mismatch", format, simd, start);
+                check(dst[count * pixelSize] == GUARD, "row overflow", format, simd, start);
+
+                std::vector<NPKColor> inplace(colors.begin() + start, colors.end());
+                convertPixelRow(inplace.data(), count, format, reinterpret_cast<uint8_t*>(inplace.data()));
+                check(memcmp(inplace.data(), expected.data() + start * pixelSize, count * pixelSize) == 0, "in place mismatch", format, simd, start);
+            }
+        }
+    }
+    setSimdLevel(level);
+    check(outputPixelSize(static_cast<OutputFormat>(0x06)) == 0, "invalid format has size", 6, 0, 0);
+
+    std::mt19937 rng(20240822);
+    NPKWriter writer;
+    NPKWriteImage v2;
+    v2.name = "sprite/test/v2.img";
+    const ColorType colorTypes[] = {CL_ARGB8888, CL_ARGB4444, CL_ARGB1555, CL_RGB565};
+    for (uint32_t i = 0; i < 8; ++i) {
+        v2.frames.push_back(npk_test::v2Frame(rng, colorTypes[i % 4], i / 4 ? CP_NONE : CP_ZLIB));
+    }
+    v2.frames.push_back(NPKWriter::linkFrame(1));
+    writer.addImage(v2);
+    writer.addImage(npk_test::indexedImage("sprite/test/v4.img", 4, 1, 200, 4, rng));
+    writer.addImage(npk_test::ddsImage("sprite/test/v5.img", 30, 30, 3, rng));
+    const auto path = npk_test::tempPath("npk_test_output_format.npk");
+    npk_test::writeFile(path, writer.serialize());
+
+    NPKHandler npk;
+    if (!npk.loadNPK(path)) {
+        printf("FAILED, load\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> buffer;
+    for (const OutputFormat format : FORMATS) {
+        const uint32_t pixelSize = outputPixelSize(format);
+        for (uint32_t i = 0; i < npk.getImageCount(); ++i) {
+            const auto image = npk.getImage(i);
+            for (uint32_t j = 0; j < image->getFrameCount(); ++j) {
+                const auto expected = image->getFrameMatrix(j);
+                if (!expected) {
+                    check(false, "reference decode failed", format, i, j);
+                    continue;
+                }
+                for (const DecodeArea area : {DA_IMAGE, DA_CANVAS}) {
+                    const bool dds = image->getFrameIsDDS(j);
+                    const uint32_t width = area == DA_IMAGE || dds ? expected->width() : expected->canvasWidth();
+                    const uint32_t height = area == DA_IMAGE || dds ? expected->height() : expected->canvasHeight();
+                    NPKPixelBuffer target;
+                    target.format = format;
+                    target.stride = (width + 1 + j % 3) * pixelSize;
+                    target.offsetX = j % 2;
+                    target.offsetY = j % 3;
+                    const uint64_t size = image->getFrameDecodeSize(j, target, area);
+                    check(size == pixelBufferSize(target, width, height), "decode size mismatch", format, i, j);
+
+                    buffer.assign(size + target.stride, GUARD);
+                    target.data = buffer.data();
+                    target.size = size;
+                    check(image->decodeFrame(j, target, 0, area), "decode failed", format, i, j);
+                    const uint32_t left = area == DA_IMAGE ? expected->offsetX() : 0;
+                    const uint32_t top = area == DA_IMAGE ? expected->offsetY() : 0;
+                    check(checkBuffer(buffer, target, width, height, *expected, left, top), "buffer mismatch", format, i, j);
+                }
+            }
+
+            for (uint32_t d = 0; d < image->getDDSCount(); ++d) {
+                const auto atlas = image->getDDSMatrix(d);
+                NPKPixelBuffer target;
+                target.format = format;
+                target.offsetX = 2;
+                target.offsetY = 1;
+                target.stride = (atlas->width() + 3) * pixelSize;
+                const uint64_t size = image->getDDSDecodeSize(d, target);
+                check(size == pixelBufferSize(target, atlas->width(), atlas->height()), "dds size mismatch", format, i, d);
+                buffer.assign(size + target.stride, GUARD);
+                target.data = buffer.data();
+                target.size = size;
+                check(image->decodeDDS(d, target), "dds decode failed", format, i, d);
+                check(checkBuffer(buffer, target, atlas->width(), atlas->height(), *atlas, 0, 0), "dds mismatch", format, i, d);
+                target.size = size - 1;
+                check(!image->decodeDDS(d, target), "dds small buffer accepted", format, i, d);
+            }
+        }
+    }
+
+    // 16位格式解码同格式的帧时输出与IMG中的原始数据相同
+    const auto image = npk.getImage(0);
+    for (uint32_t j = 0; j < v2.frames.size(); ++j) {
+        const ColorType colorType = v2.frames[j].index.colorType;
+        if ((colorType != CL_ARGB4444 && colorType != CL_RGB565) || v2.frames[j].index.compressType != CP_NONE) {
+            continue;
+        }
+        NPKPixelBuffer target;
+        target.format = colorType == CL_ARGB4444 ? OF_ARGB4444 : OF_RGB565;
+        buffer.assign(image->getFrameDecodeSize(j, target), GUARD);
+        target.data = buffer.data();
+        target.size = buffer.size();
+        check(image->decodeFrame(j, target) && buffer == v2.frames[j].data, "native passthrough mismatch", target.format, 0, j);
+    }
+
+    // 无效格式不能解码
+    NPKPixelBuffer invalid;
+    invalid.format = static_cast<OutputFormat>(0x06);
+    buffer.assign(1 << 16, GUARD);
+    invalid.data = buffer.data();
+    invalid.size = buffer.size();
+    check(!image->decodeFrame(0, invalid) && image->getFrameDecodeSize(0, invalid) == 0, "invalid format accepted", 6, 0, 0);
+
+    std::filesystem::remove(path);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
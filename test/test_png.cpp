@@ -0,0 +1,181 @@
+//
+// Created by liu86 on 24-8-11.
+//
+// 用不同的编码选项把矩阵编码为PNG，再用libpng解码，像素、尺寸、颜色类型和偏移必须与选项一致
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <png.h>
+#include <zlib.h>
+
+#include "NPKMatrix.h"
+
+using namespace neapu;
+
+namespace {
+typedef struct DecodedPng {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t channels = 0;
+    bool hasOffset = false;
+    int32_t offsetX = 0;
+    int32_t offsetY = 0;
+    std::vector<uint8_t> pixels;
+} DecodedPng;
+
+typedef struct PngReader {
+    const std::vector<uint8_t>* data;
+    size_t pos;
+} PngReader;
+
+bool decodePng(const std::vector<uint8_t>& data, DecodedPng& out)
+{
+    auto pngPtr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    auto infoPtr = png_create_info_struct(pngPtr);
+    if (setjmp(png_jmpbuf(pngPtr))) {
+        png_destroy_read_struct(&pngPtr, &infoPtr, nullptr);
+        return false;
+    }
+    PngReader reader{&data, 0};
+    png_set_read_fn(pngPtr, &reader, [](png_structp pngPtr, png_bytep dst, png_size_t length) {
+        auto reader = reinterpret_cast<PngReader*>(png_get_io_ptr(pngPtr));
+        if (reader->pos + length > reader->data->size()) {
+            png_error(pngPtr, "read past end");
+        }
+        memcpy(dst, reader->data->data() + reader->pos, length);
+        reader->pos += length;
+    });
+    png_read_info(pngPtr, infoPtr);
+    out.width = png_get_image_width(pngPtr, infoPtr);
+    out.height = png_get_image_height(pngPtr, infoPtr);
+    out.channels = png_get_channels(pngPtr, infoPtr);
+    int unit = 0;
+    png_int_32 x = 0;
+    png_int_32 y = 0;
+    out.hasOffset = png_get_oFFs(pngPtr, infoPtr, &x, &y, &unit) != 0;
+    out.offsetX = x;
+    out.offsetY = y;
+
+    const size_t rowBytes = png_get_rowbytes(pngPtr, infoPtr);
+    out.pixels.resize(rowBytes * out.height);
+    std::vector<png_bytep> rows(out.height);
+    for (uint32_t i = 0; i < out.height; ++i) {
+        rows[i] = out.pixels.data() + i * rowBytes;
+    }
+    png_read_image(pngPtr, rows.data());
+    png_read_end(pngPtr, nullptr);
+    png_destroy_read_struct(&pngPtr, &infoPtr, nullptr);
+    return true;
+}
+
+std::shared_ptr<NPKMatrix> makeMatrix(const uint32_t kind, std::mt19937& rng, uint32_t& offsetX, uint32_t& offsetY)
+{
+    const uint32_t width = 1 + rng() % 60;
+    const uint32_t height = 1 + rng() % 60;
+    offsetX = rng() % 20;
+    offsetY = rng() % 20;
+    auto matrix = NPKMatrix::createMatrix(width, height, width + offsetX + rng() % 20, height + offsetY + rng() % 20, offsetX,
+                                          offsetY);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            NPKColor color;
+            color.b = static_cast<uint8_t>(rng());
+            color.g = static_cast<uint8_t>(kind == 2 ? x : rng());
+            color.r = static_cast<uint8_t>(rng());
+            // 0: 随机透明度，1: 图像区域全部不透明，2: 渐变且全部不透明
+            color.a = kind == 0 ? static_cast<uint8_t>(rng()) : 0xFF;
+            matrix->setPixel(x, y, color);
+        }
+    }
+    return matrix;
+}
+
+int checkPng(const char* name, const NPKMatrix& matrix, const NPKPngOptions& options, const uint32_t offsetX, const uint32_t offsetY)
+{
+    const auto png = matrix.toPng(options);
+    DecodedPng decoded;
+    if (png.empty() || !decodePng(png, decoded)) {
+        printf("%s: failed to decode\n", name);
+        return 1;
+    }
+
+    const uint32_t left = options.cropToImage ? offsetX : 0;
+    const uint32_t top = options.cropToImage ? offsetY : 0;
+    const uint32_t width = options.cropToImage ? matrix.width() : matrix.canvasWidth();
+    const uint32_t height = options.cropToImage ? matrix.height() : matrix.canvasHeight();
+    if (decoded.width != width || decoded.height != height) {
+        printf("%s: size %ux%u, expected %ux%u\n", name, decoded.width, decoded.height, width, height);
+        return 1;
+    }
+    if (decoded.hasOffset != options.cropToImage ||
+        (options.cropToImage && (decoded.offsetX != static_cast<int32_t>(offsetX) || decoded.offsetY != static_cast<int32_t>(offsetY)))) {
+        printf("%s: offset mismatch\n", name);
+        return 1;
+    }
+
+    bool opaque = true;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            opaque = opaque && matrix.data()[(y + top) * matrix.canvasWidth() + x + left].a == 0xFF;
+        }
+    }
+    const uint32_t channels = options.rgbIfOpaque && opaque ? 3 : 4;
+    if (decoded.channels != channels) {
+        printf("%s: %u channels, expected %u\n", name, decoded.channels, channels);
+        return 1;
+    }
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            // PNG中为RGBA顺序
+            const NPKColor& color = matrix.data()[(y + top) * matrix.canvasWidth() + x + left];
+            const uint8_t expected[4] = {color.r, color.g, color.b, color.a};
+            if (memcmp(decoded.pixels.data() + (y * width + x) * channels, expected, channels) != 0) {
+                printf("%s: pixel (%u, %u) mismatch\n", name, x, y);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+}
+
+int main()
+{
+    std::mt19937 rng(20240811);
+    const PngFilter filters[] = {PF_DEFAULT, PF_NONE, PF_SUB, PF_UP, PF_AVERAGE, PF_PAETH};
+    int failed = 0;
+
+    for (uint32_t i = 0; i < 60; ++i) {
+        uint32_t offsetX = 0;
+        uint32_t offsetY = 0;
+        const auto matrix = makeMatrix(i % 3, rng, offsetX, offsetY);
+        for (const auto filter : filters) {
+            for (uint32_t flags = 0; flags < 4; ++flags) {
+                NPKPngOptions options;
+                options.filter = filter;
+                options.rgbIfOpaque = flags & 1;
+                options.cropToImage = flags & 2;
+                options.compressionLevel = static_cast<int>(rng() % 11) - 1;
+                options.compressionStrategy = flags == 3 ? Z_RLE : -1;
+                options.reserveSize = rng() % 2 ? 16 : 0;
+                failed += checkPng("options", *matrix, options, offsetX, offsetY);
+            }
+        }
+    }
+
+    // 默认选项输出整个画布、RGBA
+    uint32_t offsetX = 0;
+    uint32_t offsetY = 0;
+    const auto matrix = makeMatrix(1, rng, offsetX, offsetY);
+    failed += checkPng("default", *matrix, NPKPngOptions{}, offsetX, offsetY);
+    if (!NPKMatrix().toPng().empty()) {
+        printf("empty matrix: expected no output\n");
+        failed++;
+    }
+
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
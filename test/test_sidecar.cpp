@@ -0,0 +1,182 @@
+//
+// Created by liu86 on 24-8-15.
+//
+// 从索引文件加载的NPK必须与正常解析的结果完全相同，包括截断的帧；
+// NPK修改后或索引文件损坏时回退到正常解析
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKSidecar.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+std::shared_ptr<NPKMatrix> randomMatrix(std::mt19937& rng)
+{
+    const uint32_t width = 1 + rng() % 30;
+    const uint32_t height = 1 + rng() % 30;
+    auto matrix = NPKMatrix::createMatrix(width, height, width + 4, height + 4, 2, 2);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            matrix->setPixel(x, y, NPKColor{static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), 0xFF});
+        }
+    }
+    return matrix;
+}
+
+bool sameMatrix(const std::shared_ptr<NPKMatrix>& a, const std::shared_ptr<NPKMatrix>& b)
+{
+    if (!a || !b) {
+        return !a && !b;
+    }
+    return a->width() == b->width() && a->height() == b->height() && a->canvasWidth() == b->canvasWidth() &&
+           a->canvasHeight() == b->canvasHeight() &&
+           memcmp(a->data(), b->data(), static_cast<size_t>(a->canvasWidth()) * a->canvasHeight() * sizeof(NPKColor)) == 0;
+}
+
+int compare(const NPKHandler& expected, const NPKHandler& actual)
+{
+    if (expected.getImageCount() != actual.getImageCount()) {
+        printf("image count mismatch\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < expected.getImageCount(); ++i) {
+        const auto a = expected.getImage(i);
+        const auto b = actual.getImage(i);
+        if (a->getName() != b->getName() || a->getShortName() != b->getShortName() || a->version() != b->version() ||
+            a->getFrameCount() != b->getFrameCount() || a->getPalletCount() != b->getPalletCount() || a->getDDSCount() != b->getDDSCount()) {
+            printf("image %u header mismatch\n", i);
+            return 1;
+        }
+        for (int p = 0; p < std::max(1, a->getPalletCount()); ++p) {
+            for (uint32_t j = 0; j < a->getFrameCount(); ++j) {
+                if (a->getFrameIsLink(j) != b->getFrameIsLink(j) || !sameMatrix(a->getFrameMatrix(j, p), b->getFrameMatrix(j, p))) {
+                    printf("image %u frame %u palette %d mismatch\n", i, j, p);
+                    return 1;
+                }
+            }
+        }
+        for (uint32_t j = 0; j < a->getDDSCount(); ++j) {
+            if (!sameMatrix(a->getDDSMatrix(j), b->getDDSMatrix(j))) {
+                printf("image %u DDS %u mismatch\n", i, j);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    std::mt19937 rng(20240815);
+    NPKWriter writer;
+    NPKWriteImage v2;
+    v2.name = "sprite/test/v2.img";
+    for (uint32_t i = 0; i < 5; ++i) {
+        v2.frames.push_back(NPKWriter::matrixFrame(*randomMatrix(rng)));
+    }
+    v2.frames.push_back(NPKWriter::linkFrame(0));
+    writer.addImage(v2);
+    for (const uint32_t version : {4u, 6u}) {
+        auto image = npk_test::indexedImage("sprite/test/v" + std::to_string(version) + ".img", version, version == 6 ? 3 : 1, 1 + rng() % 200, 4, rng);
+        image.frames.push_back(NPKWriter::linkFrame(1));
+        writer.addImage(image);
+    }
+    writer.addImage(npk_test::ddsImage("sprite/test/v5.img", 32, 32, 3, rng));
+    // 最后一个Image的最后一帧数据不完整
+    v2.name = "sprite/test/truncated.img";
+    v2.frames.pop_back();
+    writer.addImage(v2);
+    auto data = writer.serialize();
+
+    NPKHeader header{};
+    memcpy(&header, data.data(), sizeof(header));
+    const uint64_t verifyOffset = sizeof(NPKHeader) + header.imgCount * sizeof(NPKImageIndex);
+    NPKImageIndex last{};
+    memcpy(&last, data.data() + verifyOffset - sizeof(NPKImageIndex), sizeof(last));
+    last.size -= 7;
+    memcpy(data.data() + verifyOffset - sizeof(NPKImageIndex), &last, sizeof(last));
+    NPKHandler::sha256(data.data(), verifyOffset / 17 * 17, data.data() + verifyOffset, 32);
+    data.resize(data.size() - 7);
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto path = (dir / "npk_test_sidecar.npk").string();
+    const auto sidecarPath = NPKSidecar::defaultPath(path);
+    npk_test::writeFile(path, data);
+    std::filesystem::remove(sidecarPath);
+
+    int failed = 0;
+    auto check = [&failed](const bool ok, const char* message) {
+        if (!ok) {
+            printf("%s\n", message);
+            failed++;
+        }
+    };
+
+    NPKHandler expected;
+    check(expected.loadNPK(path) && !expected.isLoadedFromSidecar(), "failed to load NPK");
+    check(expected.getImage(4)->getFrameMatrix(4) == nullptr && expected.getImage(4)->getFrameMatrix(3) != nullptr,
+          "truncated frame not reproduced");
+
+    for (const bool useMmap : {false, true}) {
+        for (const bool lazyLoad : {false, true}) {
+            NPKLoadOptions options;
+            options.useMmap = useMmap;
+            options.lazyLoad = lazyLoad;
+            options.sidecarMode = SCM_UPDATE;
+            std::filesystem::remove(sidecarPath);
+
+            NPKHandler npk;
+            check(npk.loadNPK(path, options) && !npk.isLoadedFromSidecar() && std::filesystem::exists(sidecarPath), "sidecar not written");
+            failed += compare(expected, npk);
+
+            options.sidecarMode = SCM_READ;
+            check(npk.loadNPK(path, options) && npk.isLoadedFromSidecar(), "sidecar not used");
+            failed += compare(expected, npk);
+
+            // NPK修改时间变化后索引文件失效
+            std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(5));
+            check(npk.loadNPK(path, options) && !npk.isLoadedFromSidecar(), "stale sidecar used");
+            failed += compare(expected, npk);
+            options.sidecarMode = SCM_UPDATE;
+            check(npk.loadNPK(path, options) && !npk.isLoadedFromSidecar(), "stale sidecar used");
+            check(npk.loadNPK(path, options) && npk.isLoadedFromSidecar(), "sidecar not rewritten");
+            failed += compare(expected, npk);
+        }
+    }
+
+    // 损坏的索引文件
+    const auto sidecarSize = std::filesystem::file_size(sidecarPath);
+    std::filesystem::resize_file(sidecarPath, sidecarSize - 1);
+    NPKLoadOptions options;
+    options.sidecarMode = SCM_READ;
+    NPKHandler npk;
+    check(npk.loadNPK(path, options) && !npk.isLoadedFromSidecar(), "truncated sidecar used");
+    failed += compare(expected, npk);
+
+    // 指定路径生成
+    const auto customPath = (dir / "npk_test_sidecar_custom.idx").string();
+    check(npk.saveSidecar(customPath) && std::filesystem::file_size(customPath) == sidecarSize, "saveSidecar failed");
+    options.sidecarPath = customPath;
+    check(npk.loadNPK(path, options) && npk.isLoadedFromSidecar(), "custom sidecar not used");
+    failed += compare(expected, npk);
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(sidecarPath);
+    std::filesystem::remove(customPath);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+//
+// Created by liu86 on 24-8-6.
+//
+// 用随机块与边界端点构造DDS，对比各SIMD级别与标量解码的结果必须逐字节一致
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <zlib.h>
+
+#include "NPKDDSHandler.h"
+#include "NPKPublic.h"
+#include "NPKMatrix.h"
+#include "NPKSimd.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+std::vector<uint8_t> makeBlocks(const DDSPixelDTXFormat format, const uint32_t blockCount, std::mt19937& rng)
+{
+    const uint32_t unitLength = format == DDSPixelDTXFormat::DXT1 ? 8 : 16;
+    std::vector<uint8_t> blocks(static_cast<size_t>(blockCount) * unitLength);
+    for (auto& byte : blocks) {
+        byte = static_cast<uint8_t>(rng());
+    }
+
+    // 覆盖端点相等、大小关系两种情况，以及alpha端点的各种组合
+    for (uint32_t i = 0; i < blockCount; ++i) {
+        uint8_t* block = blocks.data() + static_cast<size_t>(i) * unitLength;
+        uint8_t* color = format == DDSPixelDTXFormat::DXT1 ? block : block + 8;
+        switch (i % 4) {
+        case 0: color[2] = color[0];
+            color[3] = color[1];
+            break;
+        case 1: color[0] = 0xFF;
+            color[1] = 0xFF;
+            break;
+        default: break;
+        }
+        if (format == DDSPixelDTXFormat::DXT5) {
+            // 块数足够时覆盖全部65536种alpha端点组合
+            block[0] = static_cast<uint8_t>(i);
+            block[1] = static_cast<uint8_t>(i >> 8);
+        }
+    }
+    return blocks;
+}
+
+std::vector<uint8_t> makeDDS(const DDSPixelDTXFormat format, const uint32_t width, const uint32_t height, const std::vector<uint8_t>& blocks)
+{
+    auto raw = npk_test::ddsHeader(width, height, format, static_cast<uint32_t>(blocks.size()));
+    raw.insert(raw.end(), blocks.begin(), blocks.end());
+
+    uLongf compressLen = compressBound(static_cast<uLong>(raw.size()));
+    std::vector<uint8_t> compressed(compressLen);
+    compress(compressed.data(), &compressLen, raw.data(), static_cast<uLong>(raw.size()));
+    compressed.resize(compressLen);
+
+    NPKDDSIndex index;
+    index.compressSize = static_cast<uint32_t>(compressed.size());
+    index.uncompressSize = static_cast<uint32_t>(raw.size());
+    index.width = width;
+    index.height = height;
+
+    std::vector<uint8_t> ret(sizeof(index) + compressed.size());
+    memcpy(ret.data(), &index, sizeof(index));
+    memcpy(ret.data() + sizeof(index), compressed.data(), compressed.size());
+    return ret;
+}
+
+// 16位格式的期望结果，按格式定义独立计算
+NPKColor expectPixel(const ColorType type, const uint16_t pixel)
+{
+    NPKColor color;
+    if (type == CL_ARGB4444) {
+        color.a = (pixel >> 12) * 0x11;
+        color.r = (pixel >> 8 & 0x0F) << 4;
+        color.g = (pixel >> 4 & 0x0F) << 4;
+        color.b = (pixel & 0x0F) << 4;
+    } else if (type == CL_ARGB1555) {
+        color.a = pixel >> 15 ? 0xFF : 0;
+        color.r = (pixel >> 10 & 0x1F) << 3;
+        color.g = (pixel >> 5 & 0x1F) << 3;
+        color.b = (pixel & 0x1F) << 3;
+    } else {
+        color.a = 0xFF;
+        color.r = (pixel >> 11) << 3;
+        color.g = (pixel >> 5 & 0x3F) << 2;
+        color.b = (pixel & 0x1F) << 3;
+    }
+    return color;
+}
+
+// 所有65536种像素值都经过内核转换，与期望结果对比
+int checkPixelKernel(const ColorType type, const simd::PixelRowKernel kernel, const char* name)
+{
+    std::vector<uint8_t> src(65536 * 2);
+    for (uint32_t i = 0; i < 65536; ++i) {
+        src[i * 2] = static_cast<uint8_t>(i);
+        src[i * 2 + 1] = static_cast<uint8_t>(i >> 8);
+    }
+    std::vector<NPKColor> dst(65536);
+    const uint32_t converted = kernel(src.data(), 65536, reinterpret_cast<uint8_t*>(dst.data()));
+    int failed = 0;
+    for (uint32_t i = 0; i < converted; ++i) {
+        const NPKColor expect = expectPixel(type, static_cast<uint16_t>(i));
+        if (memcmp(&expect, &dst[i], sizeof(NPKColor)) != 0) {
+            failed++;
+        }
+    }
+    if (converted != 65536 || failed > 0) {
+        printf("pixel kernel %s mismatch, converted %u, %d failed\n", name, converted, failed);
+        return 1;
+    }
+    return 0;
+}
+
+// 调色板查表内核与逐像素查表对比，包括无效索引的计数
+int checkPaletteKernel(const simd::PaletteRowKernel kernel, std::mt19937& rng)
+{
+    NPKColor lut[256];
+    for (uint32_t i = 0; i < 256; ++i) {
+        lut[i].b = static_cast<uint8_t>(rng());
+        lut[i].g = static_cast<uint8_t>(rng());
+        lut[i].r = static_cast<uint8_t>(rng());
+        lut[i].a = static_cast<uint8_t>(rng());
+    }
+    std::vector<uint8_t> indices(1000);
+    for (auto& index : indices) {
+        index = static_cast<uint8_t>(rng());
+    }
+
+    int failed = 0;
+    for (const uint32_t colorCount : {0u, 1u, 40u, 255u, 256u}) {
+        std::vector<NPKColor> dst(indices.size());
+        uint32_t invalid = 0;
+        const uint32_t converted = kernel(indices.data(), static_cast<uint32_t>(indices.size()), lut, colorCount,
+                                          reinterpret_cast<uint8_t*>(dst.data()), invalid);
+        uint32_t expectInvalid = 0;
+        for (uint32_t i = 0; i < converted; ++i) {
+            expectInvalid += indices[i] >= colorCount;
+            if (memcmp(&lut[indices[i]], &dst[i], sizeof(NPKColor)) != 0) {
+                failed++;
+            }
+        }
+        if (converted + 16 <= indices.size() || invalid != expectInvalid) {
+            printf("palette kernel mismatch, colors %u converted %u invalid %u/%u\n", colorCount, converted, invalid, expectInvalid);
+            failed++;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+std::shared_ptr<NPKMatrix> decode(const std::vector<uint8_t>& dds, const SimdLevel level, const NPKParallelOptions& parallel = {})
+{
+    setSimdLevel(level);
+    NPKDDSHandler handler;
+    const int64_t indexLen = handler.loadIndex(dds.data(), dds.size());
+    if (indexLen < 0 || handler.loadData(dds.data() + indexLen, dds.size() - indexLen) < 0) {
+        return nullptr;
+    }
+    return handler.toMatrix(parallel);
+}
+}
+
+int main()
+{
+    std::mt19937 rng(20240806);
+    const DDSPixelDTXFormat formats[] = {DDSPixelDTXFormat::DXT1, DDSPixelDTXFormat::DXT3, DDSPixelDTXFormat::DXT5};
+    // 宽度覆盖SIMD主循环与各种尾部块数量，最后一项覆盖全部alpha端点组合
+    const uint32_t blockSizes[][2] = {{1, 3}, {2, 3}, {3, 3}, {4, 3}, {5, 3}, {7, 3}, {8, 3}, {13, 3}, {64, 3}, {256, 256}};
+    int failed = 0;
+
+    for (const auto format : formats) {
+        for (const auto& blockSize : blockSizes) {
+            const uint32_t width = blockSize[0] * 4;
+            const uint32_t height = blockSize[1] * 4;
+            const auto dds = makeDDS(format, width, height, makeBlocks(format, blockSize[0] * blockSize[1], rng));
+            const auto reference = decode(dds, SIMD_SCALAR);
+            if (!reference) {
+                printf("scalar decode failed, format %08X width %u\n", format, width);
+                failed++;
+                continue;
+            }
+            for (uint32_t level = SIMD_SSE41; level <= detectSimdLevel(); ++level) {
+                const auto matrix = decode(dds, static_cast<SimdLevel>(level));
+                if (!matrix || memcmp(matrix->data(), reference->data(), static_cast<size_t>(width) * height * sizeof(NPKColor)) != 0) {
+                    printf("mismatch, format %08X width %u level %u\n", format, width, level);
+                    failed++;
+                }
+            }
+
+            // 多线程按块行拆分的结果也必须一致
+            NPKParallelOptions parallel;
+            parallel.pool = std::make_shared<NPKThreadPool>(3);
+            parallel.minBlocks = 0;
+            const auto matrix = decode(dds, detectSimdLevel(), parallel);
+            if (!matrix || memcmp(matrix->data(), reference->data(), static_cast<size_t>(width) * height * sizeof(NPKColor)) != 0) {
+                printf("parallel mismatch, format %08X width %u\n", format, width);
+                failed++;
+            }
+
+            // 只解码裁剪区域的结果必须与完整解码后裁剪一致
+            for (uint32_t i = 0; i < 8; ++i) {
+                const uint32_t left = rng() % width;
+                const uint32_t top = rng() % height;
+                const uint32_t right = left + 1 + rng() % (width - left);
+                const uint32_t bottom = top + 1 + rng() % (height - top);
+                const auto clipped = reference->clip(left, top, right, bottom);
+                for (uint32_t level = SIMD_SCALAR; level <= detectSimdLevel(); ++level) {
+                    setSimdLevel(static_cast<SimdLevel>(level));
+                    NPKDDSHandler handler;
+                    const int64_t indexLen = handler.loadIndex(dds.data(), dds.size());
+                    handler.loadData(dds.data() + indexLen, dds.size() - indexLen);
+                    const auto region = NPKMatrix::createMatrix(right - left, bottom - top);
+                    if (!handler.decodeRegion(left, top, right, bottom, *region) ||
+                        memcmp(region->data(), clipped->data(), static_cast<size_t>(right - left) * (bottom - top) * sizeof(NPKColor)) != 0) {
+                        printf("region mismatch, format %08X rect %u.%u:%u.%u level %u\n", format, left, top, right, bottom, level);
+                        failed++;
+                    }
+                }
+            }
+        }
+    }
+
+#if NPK_SIMD_X86
+    if (detectSimdLevel() >= SIMD_SSE41) {
+        failed += checkPixelKernel(CL_ARGB4444, simd::argb4444RowSSE41, "argb4444 sse4.1");
+        failed += checkPixelKernel(CL_ARGB1555, simd::argb1555RowSSE41, "argb1555 sse4.1");
+        failed += checkPixelKernel(CL_RGB565, simd::rgb565RowSSE41, "rgb565 sse4.1");
+    }
+    if (detectSimdLevel() >= SIMD_AVX2) {
+        failed += checkPixelKernel(CL_ARGB4444, simd::argb4444RowAVX2, "argb4444 avx2");
+        failed += checkPixelKernel(CL_ARGB1555, simd::argb1555RowAVX2, "argb1555 avx2");
+        failed += checkPixelKernel(CL_RGB565, simd::rgb565RowAVX2, "rgb565 avx2");
+        failed += checkPaletteKernel(simd::paletteRowAVX2, rng);
+    }
+#endif
+
+    printf("simd level %u, %d failed\n", detectSimdLevel(), failed);
+    return failed == 0 ? 0 : 1;
+}
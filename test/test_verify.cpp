@@ -0,0 +1,144 @@
+//
+// Created by liu86 on 24-8-14.
+//
+// 检查各校验方式的结果、后台校验的回调，以及校验缓存在文件未变化时跳过计算、文件变化后失效
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKVerifyCache.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+std::atomic<uint32_t> hashCount{0};
+
+}
+
+int main()
+{
+    // 统计计算次数，没有OpenSSL时使用一个简单的替代
+    const funcSHA256 original = NPKHandler::sha256;
+    const funcSHA256 counting = [original](const uint8_t* source, const uint64_t sourceLen, uint8_t* dst, const uint64_t dstLen) {
+        ++hashCount;
+        if (original) {
+            return original(source, sourceLen, dst, dstLen);
+        }
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (uint64_t i = 0; i < sourceLen; ++i) {
+            h = (h ^ source[i]) * 0x100000001B3ULL;
+        }
+        for (uint64_t i = 0; i < dstLen; ++i) {
+            dst[i] = static_cast<uint8_t>(h >> (i % 8 * 8));
+        }
+        return true;
+    };
+    NPKHandler::sha256 = counting;
+
+    NPKWriter writer;
+    for (uint32_t i = 0; i < 3; ++i) {
+        NPKWriteImage image;
+        image.name = "sprite/test/verify" + std::to_string(i) + ".img";
+        auto matrix = NPKMatrix::createMatrix(8, 8);
+        image.frames.push_back(NPKWriter::matrixFrame(*matrix));
+        writer.addImage(image);
+    }
+    auto data = writer.serialize();
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto path = (dir / "npk_test_verify.npk").string();
+    const auto badPath = (dir / "npk_test_verify_bad.npk").string();
+    const auto cachePath = (dir / "npk_test_verify.cache").string();
+    npk_test::writeFile(path, data);
+    data[sizeof(NPKHeader) + 3 * sizeof(NPKImageIndex)] ^= 0xFF;
+    npk_test::writeFile(badPath, data);
+
+    int failed = 0;
+    auto check = [&failed](const bool ok, const char* message) {
+        if (!ok) {
+            printf("%s\n", message);
+            failed++;
+        }
+    };
+    auto& cache = NPKVerifyCache::global();
+    cache.clear();
+
+    // 同步校验，第二次命中缓存
+    NPKHandler npk;
+    hashCount = 0;
+    check(npk.loadNPK(path) && npk.getVerifyState() == VS_VERIFIED && hashCount == 1, "strict load failed");
+    check(npk.loadNPK(path) && npk.getImageCount() == 3 && hashCount == 1, "strict load not cached");
+    NPKLoadOptions options;
+    options.verifyCache = false;
+    check(npk.loadNPK(path, options) && hashCount == 2, "verify cache not bypassed");
+    NPKFileStamp stamp, badStamp;
+    NPKVerifyCache::getStamp(path, stamp);
+    NPKVerifyCache::getStamp(badPath, badStamp);
+    check(!npk.loadNPK(badPath) && !npk.loadNPK(badPath) && hashCount == 4 && !cache.contains(badPath, badStamp), "bad file accepted");
+
+    // 后台校验，加载不等待校验结果
+    for (const bool useMmap : {false, true}) {
+        for (const bool lazyLoad : {false, true}) {
+            NPKLoadOptions deferred;
+            deferred.verifyMode = VM_DEFERRED;
+            deferred.verifyCache = false;
+            deferred.useMmap = useMmap;
+            deferred.lazyLoad = lazyLoad;
+            deferred.verifyPool = std::make_shared<NPKThreadPool>(1);
+            std::atomic<int> result{-1};
+            deferred.verifyCallback = [&result](const std::string&, const bool verified) { result = verified ? 1 : 0; };
+            check(npk.loadNPK(path, deferred) && npk.waitVerify() == VS_VERIFIED && result == 1, "deferred verify failed");
+            result = -1;
+            check(npk.loadNPK(badPath, deferred) && npk.getImageCount() == 3, "deferred load failed");
+            check(npk.waitVerify() == VS_FAILED && result == 0, "deferred verify accepted bad file");
+            // 校验任务不依赖NPKHandler
+            {
+                NPKHandler temp;
+                result = -1;
+                check(temp.loadNPK(path, deferred), "deferred load failed");
+            }
+            deferred.verifyPool.reset();
+            check(result == 1, "deferred verify lost after handler release");
+        }
+    }
+
+    // 后台校验通过后加入缓存，之后直接回调
+    NPKLoadOptions deferred;
+    deferred.verifyMode = VM_DEFERRED;
+    cache.clear();
+    bool called = false;
+    check(npk.loadNPK(path, deferred) && npk.waitVerify() == VS_VERIFIED && cache.contains(path, stamp), "deferred not cached");
+    hashCount = 0;
+    deferred.verifyCallback = [&called](const std::string&, const bool verified) { called = verified; };
+    check(npk.loadNPK(path, deferred) && called && npk.getVerifyState() == VS_VERIFIED && hashCount == 0, "deferred cache miss");
+
+    // 缓存保存后重新加载
+    check(cache.save(cachePath), "failed to save cache");
+    cache.clear();
+    check(cache.load(cachePath) && cache.size() == 1, "failed to load cache");
+    check(npk.loadNPK(path) && hashCount == 0, "persisted cache miss");
+
+    // 修改时间变化后缓存失效
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(5));
+    check(npk.loadNPK(path) && hashCount == 1, "stale cache entry used");
+
+    // 不校验时不需要sha256
+    NPKHandler::sha256 = nullptr;
+    NPKLoadOptions skip;
+    skip.verifyMode = VM_SKIP;
+    check(npk.loadNPK(badPath, skip) && npk.getVerifyState() == VS_SKIPPED && npk.getImageCount() == 3, "skip load failed");
+    check(!npk.loadNPK(badPath), "strict load without sha256");
+    NPKHandler::sha256 = original;
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(badPath);
+    std::filesystem::remove(cachePath);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+//
+// Created by liu86 on 24-8-13.
+//
+// 用NPKWriter生成包含V2/V4/V5/V6的NPK，通过loadNPK读回后帧画面必须与写入的一致；
+// 读回的Image再通过fromImage写出，结果必须与第一次写出的文件完全相同
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "NPKHandler.h"
+#include "NPKImageHandler.h"
+#include "NPKMatrix.h"
+#include "NPKWriter.h"
+#include "npk_test_fixtures.h"
+
+using namespace neapu;
+
+namespace {
+// 颜色取各格式能精确表示的值，读回后应与写入的完全相同
+NPKColor randomColor(const ColorType colorType, std::mt19937& rng)
+{
+    NPKColor color;
+    color.b = static_cast<uint8_t>(rng());
+    color.g = static_cast<uint8_t>(rng());
+    color.r = static_cast<uint8_t>(rng());
+    color.a = static_cast<uint8_t>(rng());
+    switch (colorType) {
+    case CL_ARGB4444:
+        color.b &= 0xF0;
+        color.g &= 0xF0;
+        color.r &= 0xF0;
+        color.a = (color.a >> 4) * 0x11;
+        break;
+    case CL_ARGB1555:
+        color.b &= 0xF8;
+        color.g &= 0xF8;
+        color.r &= 0xF8;
+        color.a = color.a & 0x80 ? 0xFF : 0x00;
+        break;
+    case CL_RGB565:
+        color.b &= 0xF8;
+        color.g &= 0xFC;
+        color.r &= 0xF8;
+        color.a = 0xFF;
+        break;
+    default: break;
+    }
+    return color;
+}
+
+std::shared_ptr<NPKMatrix> randomMatrix(const ColorType colorType, std::mt19937& rng)
+{
+    const uint32_t width = 1 + rng() % 50;
+    const uint32_t height = 1 + rng() % 50;
+    const uint32_t offsetX = rng() % 10;
+    const uint32_t offsetY = rng() % 10;
+    auto matrix = NPKMatrix::createMatrix(width, height, width + offsetX + rng() % 10, height + offsetY + rng() % 10, offsetX, offsetY);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            matrix->setPixel(x, y, randomColor(colorType, rng));
+        }
+    }
+    return matrix;
+}
+
+bool sameMatrix(const std::shared_ptr<NPKMatrix>& a, const std::shared_ptr<NPKMatrix>& b)
+{
+    if (!a || !b) {
+        return !a && !b;
+    }
+    return a->width() == b->width() && a->height() == b->height() && a->canvasWidth() == b->canvasWidth() &&
+           a->canvasHeight() == b->canvasHeight() && a->offsetX() == b->offsetX() && a->offsetY() == b->offsetY() &&
+           memcmp(a->data(), b->data(), static_cast<size_t>(a->canvasWidth()) * a->canvasHeight() * sizeof(NPKColor)) == 0;
+}
+
+std::vector<uint8_t> readFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+}
+
+int main()
+{
+    npk_test::useStubSha256();
+
+    std::mt19937 rng(20240813);
+    int failed = 0;
+    NPKWriter writer;
+
+    // V2：各颜色格式、压缩与不压缩、链接帧和空帧
+    NPKWriteImage v2;
+    v2.name = "sprite/test/v2.img";
+    std::vector<std::shared_ptr<NPKMatrix>> v2Matrices;
+    const ColorType colorTypes[] = {CL_ARGB8888, CL_ARGB4444, CL_ARGB1555, CL_RGB565};
+    for (uint32_t i = 0; i < 12; ++i) {
+        const ColorType colorType = colorTypes[i % 4];
+        v2Matrices.push_back(randomMatrix(colorType, rng));
+        v2.frames.push_back(NPKWriter::matrixFrame(*v2Matrices.back(), colorType, i % 3 == 2 ? CP_NONE : CP_ZLIB));
+    }
+    v2.frames.push_back(NPKWriter::linkFrame(3));
+    v2.frames.push_back(NPKWriter::matrixFrame(NPKMatrix()));
+    writer.addImage(v2);
+
+    // V4与V6：1字节索引，V6有多个调色板
+    NPKWriteImage v4;
+    v4.name = "sprite/test/v4.img";
+    v4.version = 4;
+    v4.palettes.push_back(npk_test::randomPalette(37, rng));
+    for (uint32_t i = 0; i < 5; ++i) {
+        v4.frames.push_back(npk_test::indexedFrame(37, rng() % 2 ? CP_ZLIB : CP_NONE, rng, 40, 5));
+    }
+    v4.frames.push_back(NPKWriter::linkFrame(0));
+    writer.addImage(v4);
+
+    NPKWriteImage v6 = v4;
+    v6.name = "sprite/test/v6.img";
+    v6.version = 6;
+    v6.palettes.push_back(npk_test::randomPalette(64, rng));
+    writer.addImage(v6);
+
+    // V5：两个图集上的帧
+    NPKWriteImage v5;
+    v5.name = "sprite/test/v5.img";
+    v5.version = 5;
+    v5.palettes.push_back(npk_test::randomPalette(16, rng));
+    v5.dds.push_back(npk_test::randomDDS(DDS_FXT5, 128, 64, 0, rng));
+    v5.dds.push_back(npk_test::randomDDS(DDS_FXT1, 64, 32, 1, rng));
+    for (uint32_t i = 0; i < 6; ++i) {
+        v5.frames.push_back(npk_test::ddsFrame(v5.dds[i % 2], rng));
+    }
+    v5.frames.push_back(NPKWriter::linkFrame(2));
+    writer.addImage(v5);
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto path = (dir / "npk_test_writer.npk").string();
+    const auto copyPath = (dir / "npk_test_writer_copy.npk").string();
+    NPKWriteOptions options;
+    options.pool = std::make_shared<NPKThreadPool>(4);
+    if (!writer.save(path, options)) {
+        printf("failed to save %s\n", path.c_str());
+        return 1;
+    }
+    // 线程数量不影响输出
+    options.pool = std::make_shared<NPKThreadPool>(1);
+    const auto serialized = writer.serialize(options);
+    if (serialized.empty() || serialized != readFile(path)) {
+        printf("serialize() differs from save()\n");
+        failed++;
+    }
+
+    NPKHandler npk;
+    if (!npk.loadNPK(path) || npk.getImageCount() != 4) {
+        printf("failed to load written NPK\n");
+        return 1;
+    }
+
+    const auto image2 = npk.getImage(0);
+    if (image2->getName() != v2.name || image2->version() != 2 || image2->getFrameCount() != v2.frames.size()) {
+        printf("V2 image header mismatch\n");
+        failed++;
+    }
+    for (uint32_t i = 0; i < v2Matrices.size(); ++i) {
+        if (!sameMatrix(image2->getFrameMatrix(i), v2Matrices[i])) {
+            printf("V2 frame %u mismatch\n", i);
+            failed++;
+        }
+    }
+    if (!sameMatrix(image2->getFrameMatrix(12), v2Matrices[3]) || image2->getFrameMatrix(13)) {
+        printf("V2 link or empty frame mismatch\n");
+        failed++;
+    }
+
+    const NPKWriteImage* indexed[] = {&v4, &v6};
+    for (uint32_t k = 0; k < 2; ++k) {
+        const auto& source = *indexed[k];
+        const auto image = npk.getImage(1 + k);
+        if (image->getName() != source.name || image->getPalletCount() != static_cast<int>(k + 1)) {
+            printf("%s header mismatch\n", source.name.c_str());
+            failed++;
+            continue;
+        }
+        for (uint32_t p = 0; p < source.palettes.size(); ++p) {
+            for (uint32_t i = 0; i < source.frames.size(); ++i) {
+                const auto& frame = source.frames[source.frames[i].index.colorType == CL_LINK ? source.frames[i].index.linkTo : i];
+                const auto matrix = image->getFrameMatrix(i, static_cast<int>(p));
+                bool same = matrix && matrix->width() == frame.index.width && matrix->height() == frame.index.height;
+                for (uint32_t y = 0; same && y < frame.index.height; ++y) {
+                    for (uint32_t x = 0; x < frame.index.width; ++x) {
+                        const NPKColor expected = source.palettes[p][frame.data[y * frame.index.width + x]];
+                        const NPKColor& actual = matrix->data()[(y + frame.index.posY) * matrix->canvasWidth() + x + frame.index.posX];
+                        same = same && memcmp(&expected, &actual, sizeof(NPKColor)) == 0;
+                    }
+                }
+                if (!same) {
+                    printf("%s frame %u palette %u mismatch\n", source.name.c_str(), i, p);
+                    failed++;
+                }
+            }
+        }
+    }
+
+    const auto image5 = npk.getImage(3);
+    if (image5->getDDSCount() != 2 || image5->getFrameCount() != v5.frames.size()) {
+        printf("V5 image header mismatch\n");
+        failed++;
+    }
+    for (uint32_t i = 0; i < image5->getFrameCount(); ++i) {
+        if (!image5->getFrameMatrix(i)) {
+            printf("V5 frame %u failed to decode\n", i);
+            failed++;
+        }
+    }
+
+    // 读回的Image重新写出，文件应完全相同，读回的帧也相同
+    NPKWriter copy;
+    for (const auto& image : npk.getImages()) {
+        NPKWriteImage writeImage;
+        if (!NPKWriter::fromImage(*image, writeImage)) {
+            printf("fromImage failed for %s\n", image->getName().c_str());
+            failed++;
+        }
+        copy.addImage(std::move(writeImage));
+    }
+    if (!copy.save(copyPath) || readFile(copyPath) != serialized) {
+        printf("rewritten NPK differs\n");
+        failed++;
+    }
+    NPKHandler copied;
+    if (!copied.loadNPK(copyPath)) {
+        printf("failed to load rewritten NPK\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < npk.getImageCount(); ++i) {
+        const auto a = npk.getImage(i);
+        const auto b = copied.getImage(i);
+        for (int p = 0; p < std::max(1, a->getPalletCount()); ++p) {
+            for (uint32_t j = 0; j < a->getFrameCount(); ++j) {
+                if (!sameMatrix(a->getFrameMatrix(j, p), b->getFrameMatrix(j, p))) {
+                    printf("image %u frame %u palette %d differs after rewrite\n", i, j, p);
+                    failed++;
+                }
+            }
+        }
+        for (uint32_t j = 0; j < a->getDDSCount(); ++j) {
+            if (!sameMatrix(a->getDDSMatrix(j), b->getDDSMatrix(j))) {
+                printf("image %u DDS %u differs after rewrite\n", i, j);
+                failed++;
+            }
+        }
+    }
+
+    // 无效的Image
+    NPKWriter invalid;
+    NPKWriteImage bad;
+    bad.name = std::string(300, 'a');
+    invalid.addImage(bad);
+    if (!invalid.serialize().empty()) {
+        printf("long name accepted\n");
+        failed++;
+    }
+    invalid.clear();
+    bad.name = "sprite/test/v3.img";
+    bad.version = 3;
+    invalid.addImage(bad);
+    if (!invalid.serialize().empty()) {
+        printf("unsupported version accepted\n");
+        failed++;
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(copyPath);
+    printf("%s, %d failures\n", failed ? "FAILED" : "PASSED", failed);
+    return failed ? 1 : 0;
+}